@@ -0,0 +1,183 @@
+/*
+ * arena allocator module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "arena.h"
+
+/* block header, rounded up so data stays aligned */
+#define BLK_HDR ((sizeof(struct arena_blk_str) + ARENA_ALIGN - 1) \
+                 & ~(size_t)(ARENA_ALIGN - 1))
+
+/*
+ * private functions
+ */
+
+static void *blk_data(struct arena_blk_str *b)
+{
+    return (char *)b + BLK_HDR;
+}
+
+/* new block of at least len bytes at the end, NULL past the limit */
+static struct arena_blk_str *add_blk(struct arena_str *a, size_t len)
+{
+    struct arena_blk_str *b, **p;
+    size_t want = len;
+
+    /* grow geometrically, within the limit */
+    if (want < ARENA_BLOCK)
+        want = ARENA_BLOCK;
+    if (want < a->held)
+        want = a->held;
+    if (a->limit > 0 && a->held + want > a->limit)
+        want = len;
+    if (a->limit > 0 && a->held + want > a->limit)
+        return NULL;
+
+    b = malloc(BLK_HDR + want);
+    if (b == NULL)
+        return NULL;
+    b->next = NULL;
+    b->len = want;
+    b->used = 0;
+    for (p = &a->head; *p != NULL; p = &(*p)->next)
+        ;
+    *p = b;
+    a->held += want;
+    return b;
+}
+
+/*
+ * public functions
+ */
+
+void arena_init(struct arena_str *a, size_t limit)
+{
+    memset(a, 0, sizeof(*a));
+    a->limit = limit;
+}
+
+/* len bytes, aligned; NULL past the limit */
+void *arena_alloc(struct arena_str *a, size_t len)
+{
+    struct arena_blk_str *b = a->cur;
+    void *p;
+
+    len = (len + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (len == 0)
+        len = ARENA_ALIGN;
+    /* blocks kept past cur are empty */
+    while (b != NULL && b->len - b->used < len)
+        b = b->next;
+    if (b == NULL)
+        b = add_blk(a, len);
+    if (b == NULL) {
+        a->n_fail++;
+        return NULL;
+    }
+    a->cur = b;
+    p = (char *)blk_data(b) + b->used;
+    b->used += len;
+    a->used += len;
+    if (a->used > a->high)
+        a->high = a->used;
+    return p;
+}
+
+void *arena_calloc(struct arena_str *a, size_t n, size_t size)
+{
+    void *p;
+
+    if (size > 0 && n > (size_t)-1 / size)
+        return NULL;
+    p = arena_alloc(a, n * size);
+    if (p != NULL)
+        memset(p, 0, n * size);
+    return p;
+}
+
+void arena_mark(const struct arena_str *a, struct arena_mark_str *m)
+{
+    m->blk = a->cur;
+    m->blk_used = (a->cur != NULL) ? a->cur->used : 0;
+    m->used = a->used;
+}
+
+/* blocks after the mark's are emptied, not freed */
+void arena_release(struct arena_str *a, const struct arena_mark_str *m)
+{
+    struct arena_blk_str *b;
+
+    if (m->blk == NULL) {
+        arena_reset(a);
+        return;
+    }
+    for (b = m->blk->next; b != NULL; b = b->next)
+        b->used = 0;
+    m->blk->used = m->blk_used;
+    a->cur = m->blk;
+    a->used = m->used;
+}
+
+/* give everything back; more than one block becomes one */
+void arena_reset(struct arena_str *a)
+{
+    struct arena_blk_str *b, *next;
+    size_t held = a->held;
+
+    if (a->head != NULL && a->head->next != NULL) {
+        for (b = a->head; b != NULL; b = next) {
+            next = b->next;
+            free(b);
+        }
+        a->head = NULL;
+        a->held = 0;
+        add_blk(a, held);
+    }
+    for (b = a->head; b != NULL; b = b->next)
+        b->used = 0;
+    a->cur = a->head;
+    a->used = 0;
+}
+
+void arena_free(struct arena_str *a)
+{
+    struct arena_blk_str *b, *next;
+
+    for (b = a->head; b != NULL; b = next) {
+        next = b->next;
+        free(b);
+    }
+    a->head = a->cur = NULL;
+    a->held = 0;
+    a->used = 0;
+}
+
+/* resident set now, bytes (0 if unknown) */
+size_t arena_rss(void)
+{
+    FILE *in = fopen("/proc/self/statm", "r");
+    unsigned long size, rss;
+    int n;
+
+    if (in == NULL)
+        return 0;
+    n = fscanf(in, "%lu %lu", &size, &rss);
+    fclose(in);
+    return (n == 2) ? (size_t)rss * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+/* peak resident set, bytes */
+size_t arena_peak_rss(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+    return (size_t)ru.ru_maxrss * 1024;     /* kilobytes on Linux */
+}
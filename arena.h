@@ -0,0 +1,64 @@
+/*
+ * Header file for arena allocator module
+ *
+ * Memory for one epoch of work (a site, a frame) handed out from a
+ * few large blocks and given back all at once by arena_reset.  A
+ * reset keeps the memory, folded into one block, so later epochs
+ * of the same size allocate nothing.  An optional limit bounds the
+ * bytes held; an allocation past it fails.  Not thread safe: one
+ * arena per thread.
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_BLOCK (1 << 20)   /* least block, bytes */
+
+struct arena_blk_str {
+    struct arena_blk_str *next;
+    size_t len;                 /* bytes after the header */
+    size_t used;
+};
+
+struct arena_str {
+    struct arena_blk_str *head; /* blocks, filled in order */
+    struct arena_blk_str *cur;  /* block being filled */
+    size_t limit;               /* most bytes held, 0: no limit */
+    size_t held;                /* bytes in blocks */
+    size_t used;                /* handed out since the reset */
+    size_t high;                /* most used at once */
+    int n_fail;                 /* allocations refused */
+};
+
+/* point to go back to, from arena_mark */
+struct arena_mark_str {
+    struct arena_blk_str *blk;  /* cur then, NULL if none */
+    size_t blk_used;
+    size_t used;
+};
+
+/*
+ * public function prototypes
+ */
+
+/* empty arena holding at most limit bytes (0: any) */
+void arena_init(struct arena_str *a, size_t limit);
+/* len bytes, aligned to ARENA_ALIGN; NULL past the limit */
+void *arena_alloc(struct arena_str *a, size_t len);
+/* same, n elements of size, zeroed */
+void *arena_calloc(struct arena_str *a, size_t n, size_t size);
+/* give back what was handed out after mark, keeping the memory */
+void arena_mark(const struct arena_str *a, struct arena_mark_str *m);
+void arena_release(struct arena_str *a, const struct arena_mark_str *m);
+/* give back everything handed out, keeping the memory */
+void arena_reset(struct arena_str *a);
+void arena_free(struct arena_str *a);
+
+/* resident set of the process now, and at its peak, bytes */
+size_t arena_rss(void);
+size_t arena_peak_rss(void);
+
+#endif
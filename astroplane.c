@@ -1,14 +1,44 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
 #include <math.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "ephtime.h"
 #include "ephstar.h"
 #include "ephutil.h"
+#include "ephsun.h"
 
 #include "coord.h"
 #include "vector3.h"
+#include "matrix3x3.h"
+#include "catalog.h"
+#include "catdata.h"
+#include "site.h"
+#include "horizon.h"
+#include "surface.h"
+#include "occlude.h"
+#include "dotgrid.h"
+#include "plotpath.h"
+#include "stencil.h"
+#include "sha256.h"
+#include "cache.h"
+#include "quadtree.h"
+#include "fisheye.h"
+#include "tolerance.h"
+#include "viewpoint.h"
+#include "figure.h"
+#include "lru.h"
+#include "server.h"
+#include "shard.h"
+#include "verify.h"
+#include "kdtree.h"
+#include "arena.h"
+#include "series.h"
+#include "tune.h"
 
 /*
  * gnuplot notes:
@@ -19,6 +49,15 @@
  *
  *  the "/$12" only plots the completed stars
  *  the "/($2<=4) selects by magnitude
+ *
+ *  with -s (curved surfaces), columns 6, 7 are the surface (u, v)
+ *  and column 10 is the completed flag:
+ *   plot '<file>' using 6:($7/$10):($9*0.3) \
+ *         with points linetype 3 pointtype 6 pointsize variable
+ *
+ *  with -F (figures), polylines follow the stars as "fig name east
+ *  north" lines, a blank line before each:
+ *   plot '< grep ^fig <file>' using 3:4 with lines
  */
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -34,8 +73,9 @@
  * Hipparcos Main Catalog
  * heasarc.gsfc.nasa.gov/W3Browse/all/hipparcos.html
  * visual magnitude <= 6.0
+ * built in from hip_magle6.dat (catdata.h); -k: any catalog, text or
+ * binary as written by catconv
  */
-#define STARFILE "hip_magle6.dat"
 #define POSNFILE "latlon.dat"
 
 #define DFLT_LAT DMS2DEG(44, 35, 26.0)
@@ -48,8 +88,13 @@
 #define PLOTHOUR   14
 #define PLOTMINUTE  3
 #define PLOTSECOND 22
-/* minimum altitude (degrees) */
+/* minimum altitude (degrees), when no horizon profile is given */
 #define ALT_MIN 5.0
+/* sky cells for the declination band precheck, degrees */
+#define ZONE_DEC  5.0
+#define ZONE_RA  15.0
+/* most refraction can raise a star (ephAtmRef), degrees */
+#define REFRACT_MAX 1.0
 /* room dimensions, cm */
 #define OBS_TO_CEIL 152.0       /* observer to ceiling */
 #define OBS_TO_WALL  38.0       /* observer to wall */
@@ -57,13 +102,302 @@
 #define ROOM_EW     442.0       /* east-west dimension */
 /* diameter (mm) of 0 magnitude star (vega) at zenith */
 #define DIA_0         6.0
+/* result cache: default size bound (MB), result format version */
+#define CACHE_MB    256
+#define RESULT_VERSION 1        /* bump when projection results change */
+/* figure lines: default chord tolerance, mm */
+#define FIG_TOL 0.5
+/* tolerance analysis: worst stars listed */
+#define TOL_WORST 10
+/* best epoch search: night is sun under this (degrees), LST bins */
+#define NIGHT_ALT  -18.0
+#define LST_FINE     0.25       /* degrees, a minute of time */
+#define LST_COARSE   2.0        /* degrees, LST_FINE multiple */
+/* multi-process runs: results held per round (MB), least per shard */
+#define SHARD_MB   512
+#define SHARD_MIN  4096
+/* photo verification: placed within, paired within (mm) */
+#define PHOTO_TOL   3.0
+#define PHOTO_FAR  25.0
+/* lookups (-Q) on one command line */
+#define MAX_LOOKS  64
+/*
+ * tuning (--tune): profile read at startup from the working
+ * directory, star-epochs a measurement projects, runs of each (fastest
+ * kept), relative agreement of result sums, speedup a setting needs
+ * over the one before
+ */
+#define TUNEFILE   "astroplane.tune"
+#define TUNE_WORK  (1 << 20)
+#define TUNE_REPS  3
+#define TUNE_TOL   1e-9
+#define TUNE_GAIN  1.05
+#define OPT_TUNE   0x100        /* --tune, past any short option */
+
+/* why a star was not painted (reported with -r) */
+enum drop_reason {
+    DROP_NONE,
+    DROP_HORIZON,               /* below horizon mask */
+    DROP_OCCLUDED,              /* ray hits an occluder */
+    DROP_OFF_SURFACE,           /* ray misses ceiling / surfaces */
+    DROP_MERGED,                /* merged into an overlapping dot */
+    DROP_AGGREGATED             /* below level of detail resolution */
+};
+
+static const char *drop_names[] = {"-", "horizon", "occluded", "off-surface",
+                                   "merged", "aggregated"};
+
+/* result of projecting one catalog star */
+struct dot_str {
+    enum drop_reason drop;
+    int occ;                    /* occluder hit, if any */
+    int into;                   /* dot merged into, if any */
+    int have_pos;               /* pos computed (not culled by zone) */
+    struct starData pos;        /* altitude, azimuth */
+    /* ceiling */
+    double east, north;
+    /* dn is anchored in ne corner, ds in se corner */
+    /*
+     * dn is wall measurement using NE anchor point
+     * ds is wall measurement using SE anchor point
+     * N, S walls measured from east side
+     * W wall measured from S side _from_both_anchors_
+     */
+    double dn, ds;
+    char wn, ws;                /* wall on which line terminates */
+    /* surfaces (-s) */
+    struct srf_hit_str hit;
+    double vmag;                /* magnitude (combined, if merged) */
+    double dia;                 /* diameter of dot */
+};
+
+/* what to project onto, and what is in the way */
+struct scene_str {
+    struct srf_str *surfs;      /* curved/mesh surfaces replacing ceiling */
+    int n_surfs;
+    struct occ_scene_str occ;   /* fixtures, beams, skylights */
+    struct hzn_str hzn;         /* horizon mask */
+    struct vp_set_str views;    /* viewpoints to compromise between */
+    struct fig_set_str figs;    /* constellation figures, outlines */
+};
+
+/* the sky as seen from one site */
+struct sky_str {
+    const struct site_str *site;
+    double lst;                 /* local sidereal time, degrees */
+    struct m3x3_str rot;        /* equatorial to (east, north, up) */
+};
+
+/* what a lookup (-Q) asks */
+enum look_kind {
+    LOOK_NEAR,                  /* dots nearest a surface point */
+    LOOK_WITHIN,                /* dots within a radius of one */
+    LOOK_BOX,                   /* dots within a rectangle */
+    LOOK_SKY,                   /* stars nearest a sky point */
+    LOOK_CONE                   /* stars within an angle of one */
+};
+
+/* one lookup */
+struct look_str {
+    const char *arg;            /* as given */
+    int kind;                   /* enum look_kind */
+    double a[4];                /* point (mm, or ra dec degrees), extent */
+    int count;                  /* LOOK_NEAR, LOOK_SKY: how many */
+};
+
+/* lookup result, nearest first */
+struct hit_str {
+    int i;
+    double d;
+};
+
+/* what a best epoch search (-E) maximizes */
+enum goal_kind {
+    GOAL_FLUX,                  /* total flux on the ceiling */
+    GOAL_MAG,                   /* stars down to a magnitude */
+    GOAL_HIP                    /* required stars all on the ceiling */
+};
+
+/* best epoch search: date range and objective */
+struct goal_str {
+    double jd0, jd1;            /* range, JD (0h UTC) */
+    int kind;                   /* enum goal_kind */
+    double mag;                 /* GOAL_MAG: faintest counted */
+    int *hip;                   /* GOAL_HIP: required stars */
+    int n_hip;
+    unsigned char *req;         /* same, flagged by catalog index */
+};
+
+/* what to write, same for every site */
+struct opts_str {
+    int report;                 /* report dropped stars */
+    int collide;                /* 1: report, 2: merge overlapping dots */
+    double gap;                 /* minimum dot spacing, mm */
+    int plot;                   /* 1: G-code, 2: HPGL */
+    int stencil;                /* 1: PostScript, 2: SVG */
+    double lod;                 /* level of detail, mm (0: none) */
+    double lod_ang;             /* same, degrees */
+    int fisheye;                /* fisheye frame size, pixels (0: none) */
+    int frames;                 /* fisheye or series frames */
+    double frame_step;          /* time between frames, seconds */
+    int series;                 /* write a time series (-Z) */
+    const struct tol_str *tol;  /* tolerance analysis, if any */
+    const struct goal_str *goal;        /* best epoch search, if any */
+    int threads;                /* threads for one site's frames/trials */
+    double fig_tol;             /* figure chord tolerance, mm */
+    const struct pv_blobs_str *photo;   /* photo verification, if any */
+    double photo_tol;           /* dot placed within, mm */
+    double photo_far;           /* blob paired with a dot within, mm */
+    const struct look_str *looks;       /* lookups, if any */
+    int n_looks;
+};
+
+/*
+ * cached result: header, then one dot_str per catalog star.  Dots
+ * hold no pointers, so a mapped result is used as it is.
+ */
+struct result_hdr_str {
+    char magic[8];
+    int version;
+    int dot_size;
+    int n;
+    int pad;                    /* keeps dots 8 byte aligned */
+};
+
+/* result cache, with the digest of inputs common to all sites */
+struct res_cache_str {
+    struct cache_str cache;
+    struct sha256_str base;
+    struct sha256_str figs;     /* same, for figure lines */
+};
+
+/* what figure lines are projected with */
+struct fig_ctx_str {
+    const struct scene_str *sc;
+    const struct room_str *room;
+    const struct sky_str *sky;
+};
+
+/* one thread's share of a tolerance analysis: dots first .. */
+struct tol_part_str {
+    const struct dot_str *dots;
+    const struct room_str *room;
+    const struct tol_str *tol;
+    const int *map;             /* catalog index of each painted dot */
+    int first, count;
+    struct tol_acc_str *acc;    /* errors of each painted dot, mm */
+};
+
+/* one thread's share of the multi-viewpoint placement */
+struct view_part_str {
+    const struct vp_set_str *views;
+    const struct room_str *room;
+    struct dot_str *dots;
+    int first, count;
+};
+
+/*
+ * best epoch search of one site, shared by the search threads.  The
+ * sky repeats with sidereal time, so dark epochs are binned by LST
+ * (LST_FINE) and bins grouped into cells (LST_COARSE) for bounding
+ */
+struct search_str {
+    const struct cat_str *cat;
+    const struct cat_zones_str *zones;
+    const struct scene_str *sc;
+    const struct site_str *site;
+    const struct goal_str *goal;
+    const double *flux;         /* flux of each catalog star */
+    struct v3_str corner[4];    /* ceiling corners, unit, in order */
+    struct v3_str edge[4];      /* normals of the edges, inward */
+    double alt_lo;              /* lowest altitude on the ceiling */
+    const double *bin_jd;       /* first dark epoch in each bin, 0: none */
+    int n_bins;
+    double *bound;              /* score bound of each cell */
+    int *order;                 /* cells, highest bound first */
+    int n_cells;
+    int n_order;                /* cells with dark epochs */
+    int refine;                 /* 0: bounding cells, 1: refining */
+    pthread_mutex_t lock;       /* guards the rest */
+    int next;                   /* next cell (or order entry) */
+    double best;                /* best score, and its epoch */
+    double best_jd;
+    int n_refined;              /* cells refined, bins evaluated */
+    int n_eval;
+    int failed;
+};
+
+/* site list shared by the batch worker threads */
+struct batch_str {
+    const struct cat_str *cat;
+    const struct cat_zones_str *zones;
+    const struct scene_str *sc;
+    const struct opts_str *opts;
+    struct res_cache_str *rc;
+    const struct site_str *sites;
+    int n_sites;
+    const struct dot_str **done;        /* projected by shards, else NULL */
+    size_t mem_avail;           /* memory budget left to sites, 0: none */
+    size_t arena_limit;         /* of each worker's arena, 0: none */
+    int shard_min;              /* least catalog entries in a shard */
+    pthread_mutex_t lock;       /* guards the rest */
+    int next;                   /* next site to run */
+    int failed;
+    size_t arena_high;          /* most any worker's arena held */
+};
+
+/*
+ * multi-process run (-P): one round of sites, the projection of each
+ * cut into shards of range catalog entries
+ */
+struct shard_job_str {
+    const struct cat_str *cat;
+    const struct cat_zones_str *zones;
+    const struct scene_str *sc;
+    const struct site_str **sites;      /* sites to project */
+    struct dot_str *dots;       /* cat->n for each, shared */
+    int range;                  /* catalog entries per shard */
+    int n_ranges;               /* shards per site */
+};
+
+/* query server (-D): what queries are answered from */
+struct serve_str {
+    const struct cat_str *cat;
+    const struct cat_zones_str *zones;
+    const struct scene_str *sc;
+    const struct opts_str *opts;
+    struct lru_str lru;         /* listings of recent queries */
+    struct arena_str ar;        /* one sky's culls and projections */
+    long n_culls;               /* horizon culls, one per sky */
+    long n_projs;               /* projections, one per room and sky */
+};
+
+/* one parsed query */
+struct query_str {
+    struct site_str site;
+    double maglim;              /* faintest star listed */
+    char sky_key[LRU_KEY_LEN];  /* site and epoch */
+    char key[LRU_KEY_LEN];      /* same, and room */
+    int done;                   /* answered */
+    char *reply;                /* "ok length" and listing, or "err" */
+    size_t n_reply;
+};
+
+/* one epoch's projection in brief, to compare tuning settings by */
+struct tune_sum_str {
+    int n;                      /* dots painted */
+    unsigned hash;              /* of their catalog indices */
+    double east, north, dia;    /* sums */
+};
 
-/* data parsed from input file */
-struct star_rec_str {
-    int hip;                     /* Hipparcus catalog number */
-    double ra;                   /* right ascension, degrees */
-    double dec;                  /* declination, degrees */
-    float vmag;                  /* visual magnitude */
+/* tuning benchmark: epochs of a site */
+struct tune_job_str {
+    const struct cat_str *cat;
+    const struct cat_zones_str *zones;
+    const struct scene_str *sc;
+    const struct site_str *sites;       /* one for each epoch */
+    int n_sites;
+    struct tune_sum_str *sum;   /* of each */
 };
 
 /*
@@ -73,59 +407,53 @@ struct star_rec_str {
 /* constants */
 
 static const struct v3_str origin = {0, 0, 0};
-/* ceiling origin (south west corner) */
-static const struct v3_str p0 = {OBS_TO_WALL - ROOM_EW,
-                                 -ROOM_NS / 2.0,
-                                 OBS_TO_CEIL};
-/* extent of x-axis (north west corner) */
-static const struct v3_str px = {OBS_TO_WALL - ROOM_EW,
-                                 ROOM_NS / 2.0,
-                                 OBS_TO_CEIL};
-/* extent of y-axis (south east corner) */
-static const struct v3_str py = {OBS_TO_WALL,
-                                 -ROOM_NS / 2.0,
-                                 OBS_TO_CEIL};
+static const struct room_str dflt_room = {OBS_TO_CEIL, OBS_TO_WALL,
+                                          ROOM_NS, ROOM_EW};
+static const char result_magic[8] = "APDOTS";
+static const char figs_magic[8] = "APFIGS";
+static const struct option long_opts[] = {
+    {"tune", no_argument, NULL, OPT_TUNE},
+    {NULL, 0, NULL, 0}
+};
+/* server reply when a request can't be answered */
+static const char no_mem[] = "err out of memory\n";
+/* tuning candidates: cull sky cells (dec, ra), least shard sizes */
+static const double tune_cells[][2] = {{2.5, 7.5}, {5.0, 15.0}, {10.0, 30.0},
+                                       {20.0, 60.0}, {45.0, 90.0},
+                                       {180.0, 360.0}};
+static const int tune_shards[] = {1024, 4096, 16384, 65536, 262144};
 
 /*
  * private functions
  */
 
-static double ms2deg(int m, float s)
+static void usage(const char *prog)
 {
-    return (m + (s / 60.0)) / 60.0;
+    fprintf(stderr, "usage: %s [-r] [-s surfacefile] [-o occluderfile]"
+            " [-H horizonfile] [-c gap | -m gap] [-p gcode|hpgl]"
+            " [-t ps|svg] [-S sitefile [-j threads]] [-P processes]"
+            " [-M megabytes]"
+            " [-C cachedir [-L megabytes]] [-l mm | -l degreesd]"
+            " [-f pixels | -Z] [-a frames,seconds] [-T tolerancefile]"
+            " [-V viewfile] [-E yyyy-mm-dd,yyyy-mm-dd"
+            " [-O flux|mag:N|hip:N+N...]] [-F figurefile [-G mm]]"
+            " [-k catalog] [-D socketpath] [-X blobfile [-x mm[,mm]]]"
+            " [--tune]"
+            " [-Q near:x,y[,n]|within:x,y,mm|box:x0,y0,x1,y1"
+            "|sky:ra,dec[,n]|cone:ra,dec,degrees ...]\n", prog);
+    exit(1);
 }
 
-static double hms2d(int h, int m, float s)
+/* open file named on command line, exit if it can't be */
+static FILE *open_arg(const char *path)
 {
-    return 15.0 * (h + ms2deg(m, s));
-}
-
-/* tricky: degrees could be "-00", so leave as str */
-static double dms2d(const char *d, int m, float s)
-{
-    double sign;
-    double ret;
-
-    /* leading sign */
-    if (*d == '-') {
-        sign = -1;
-        d++;
-    } else {
-        sign = 1;
-        if (*d == '+')
-            d++;
-    }
+    FILE *in = fopen(path, "r");
 
-    /* 0..180 */
-    ret = 0;
-    while (isdigit(*d)) {
-        ret *= 10.0;
-        ret += *d++ - '0';
+    if (in == NULL) {
+        perror(path);
+        exit(1);
     }
-
-    ret += ms2deg(m, s);
-
-    return ret * sign;
+    return in;
 }
 
 static int read_latlon(FILE *in, double *lat, double *lon)
@@ -136,67 +464,344 @@ static int read_latlon(FILE *in, double *lat, double *lon)
 
     if (fscanf(in, "%s %d %f\n", d, &m, &s) == EOF)
         return -1;
-    *lat = dms2d(d, m, s);
+    *lat = cat_dms2d(d, m, s);
     if (fscanf(in, "%s %d %f", d, &m, &s) == EOF)
         return -1;
-    *lon = dms2d(d, m, s);
+    *lon = cat_dms2d(d, m, s);
     return 0;
 }
 
-/* read next star's data from input file, return -1 on EOF */
-static int read_star(FILE *in, struct star_rec_str *p)
+/* date range of a search (-E), returns -1 if malformed */
+static int read_range(const char *arg, struct goal_str *g)
 {
-    int ra_hours, ra_minutes;
-    float ra_seconds;
-    char dec_degrees[4];        /* must be char (-00 case) */
-    int dec_minutes;
-    float dec_seconds;
+    struct ymdhms t0 = {0, 0, 0, 0, 0, 0.0};
+    struct ymdhms t1 = {0, 0, 0, 0, 0, 0.0};
 
-    if (fscanf(in, "|HIP %d |%d %d %f|%s %d %f|%f|\n",
-               &p->hip,
-               &ra_hours, &ra_minutes, &ra_seconds,
-               dec_degrees, &dec_minutes, &dec_seconds,
-               &p->vmag) == EOF)
+    memset(g, 0, sizeof(*g));
+    if (sscanf(arg, "%d-%d-%d,%d-%d-%d", &t0.year, &t0.month, &t0.day,
+               &t1.year, &t1.month, &t1.day) != 6)
         return -1;
+    g->jd0 = ephCalcJD(&t0);
+    g->jd1 = ephCalcJD(&t1);
+    return (g->jd1 > g->jd0) ? 0 : -1;
+}
 
-#if 0
-    printf("|HIP %-6d |%02d %02d %07.4f|%s %02d %06.3f|%5.2f|\n",
-           p->hip,
-           ra_hours, ra_minutes, ra_seconds,
-           dec_degrees, dec_minutes, dec_seconds,
-           p->vmag);
-#endif
+/* search objective (-O), returns -1 if malformed */
+static int read_objective(const char *arg, struct goal_str *g)
+{
+    const char *p;
+    char *end;
+
+    if (strcmp(arg, "flux") == 0) {
+        g->kind = GOAL_FLUX;
+        return 0;
+    }
+    if (strncmp(arg, "mag:", 4) == 0) {
+        g->kind = GOAL_MAG;
+        g->mag = strtod(arg + 4, &end);
+        return (end == arg + 4 || *end != '\0') ? -1 : 0;
+    }
+    if (strncmp(arg, "hip:", 4) != 0)
+        return -1;
+    g->kind = GOAL_HIP;
+    g->hip = malloc(strlen(arg) * sizeof(*g->hip));
+    if (g->hip == NULL)
+        return -1;
+    for (p = arg + 4; ; p = end + 1) {
+        long h = strtol(p, &end, 10);
 
-    /* convert to decimal degrees */
-    p->ra = hms2d(ra_hours, ra_minutes, ra_seconds);
-    p->dec = dms2d(dec_degrees, dec_minutes, dec_seconds);
+        if (end == p || h <= 0)
+            return -1;
+        g->hip[g->n_hip++] = (int)h;
+        if (*end == '\0')
+            return 0;
+        if (*end != '+')
+            return -1;
+    }
+}
 
-#if 0
-    printf(" %012.8f,%012.8f\n", p->ra, p->dec);
-#endif
+/*
+ * lookup: near:x,y[,n], within:x,y,mm, box:x0,y0,x1,y1 on the
+ * surface (mm), sky:ra,dec[,n] or cone:ra,dec,degrees.
+ * returns -1 on error
+ */
+static int read_look(const char *arg, struct look_str *lk)
+{
+    static const struct {
+        const char *name;
+        int kind;
+        int n_min, n_max;       /* numbers given */
+    } kinds[] = {{"near:", LOOK_NEAR, 2, 3}, {"within:", LOOK_WITHIN, 3, 3},
+                 {"box:", LOOK_BOX, 4, 4}, {"sky:", LOOK_SKY, 2, 3},
+                 {"cone:", LOOK_CONE, 3, 3}};
+    const char *p;
+    char *end;
+    int k, n;
 
+    memset(lk, 0, sizeof(*lk));
+    lk->arg = arg;
+    for (k = 0; k < (int)(sizeof(kinds) / sizeof(kinds[0])); k++)
+        if (strncmp(arg, kinds[k].name, strlen(kinds[k].name)) == 0)
+            break;
+    if (k == (int)(sizeof(kinds) / sizeof(kinds[0])))
+        return -1;
+    lk->kind = kinds[k].kind;
+    p = arg + strlen(kinds[k].name);
+    for (n = 0; n < 4; p = end + 1) {
+        lk->a[n++] = strtod(p, &end);
+        if (end == p)
+            return -1;
+        if (*end != ',')
+            break;
+    }
+    if (*end != '\0' || n < kinds[k].n_min || n > kinds[k].n_max)
+        return -1;
+    if (lk->kind == LOOK_NEAR || lk->kind == LOOK_SKY) {
+        lk->count = (n == 3) ? (int)lk->a[2] : 1;
+        if (lk->count < 1)
+            return -1;
+    }
+    if ((lk->kind == LOOK_WITHIN || lk->kind == LOOK_CONE) && lk->a[2] < 0.0)
+        return -1;
     return 0;
 }
 
+/* flag the search's required stars in the catalog, -1 if missing */
+static int goal_stars(const struct cat_str *cat, struct goal_str *g)
+{
+    int n = 0;
+    int i, k;
 
-/* M A I N */
-int main(int argc, char *argv[])
+    if (g->kind != GOAL_HIP)
+        return 0;
+    g->req = calloc(cat->n + 1, 1);
+    if (g->req == NULL)
+        return -1;
+    for (k = 0; k < g->n_hip; k++) {
+        for (i = 0; i < cat->n; i++)
+            if (cat->star[i].hip == g->hip[k])
+                break;
+        if (i == cat->n) {
+            fprintf(stderr, "HIP %d: not in catalog\n", g->hip[k]);
+            return -1;
+        }
+        /* a star listed twice is required once */
+        n += !g->req[i];
+        g->req[i] = 1;
+    }
+    g->n_hip = n;
+    return 0;
+}
+
+/*
+ * ceiling corners: origin (south west), extent of x-axis (north
+ * west) and of y-axis (south east)
+ */
+static void ceiling_corners(const struct room_str *room, struct v3_str *p0,
+                            struct v3_str *px, struct v3_str *py)
 {
-    FILE *starfile;
-    FILE *posnfile;
-    double lat, lon;
-    struct star_rec_str star_rec;
-    /* time, UTC */
-    struct ymdhms tstar  = {PLOTYEAR, PLOTMONTH, PLOTDAY,
-                            PLOTHOUR, PLOTMINUTE, PLOTSECOND};
-    struct starData stardat;
-    double east, north;
+    p0->x = room->wall - room->ew;
+    p0->y = -room->ns / 2.0;
+    p0->z = room->ceil;
+    *px = *p0;
+    px->y = room->ns / 2.0;
+    *py = *p0;
+    py->x = room->wall;
+}
+
+/* equatorial to horizon rotation for a site at sidereal time lst */
+static void sky_at(struct sky_str *sky, const struct site_str *site,
+                   double lst)
+{
+    double sl, cl, sp, cp;
+
+    sky->site = site;
+    sky->lst = lst;
+    sl = ephSin(sky->lst);
+    cl = ephCos(sky->lst);
+    sp = ephSin(site->lat);
+    cp = ephCos(site->lat);
+    /* columns are the east, north and up axes in equatorial coords */
+    sky->rot.a1 = -sl;
+    sky->rot.b1 = cl;
+    sky->rot.c1 = 0.0;
+    sky->rot.a2 = -sp * cl;
+    sky->rot.b2 = -sp * sl;
+    sky->rot.c2 = cp;
+    sky->rot.a3 = cp * cl;
+    sky->rot.b3 = cp * sl;
+    sky->rot.c3 = sp;
+}
+
+/* sidereal time and equatorial to horizon rotation for a site */
+static void sky_init(struct sky_str *sky, const struct site_str *site)
+{
+    struct ymdhms t = site->t;
+
+    /* local sidereal time (lon is east positive) */
+    sky_at(sky, site, ephMSTG(ephCalcJD(&t)) + site->lon);
+}
+
+/*
+ * epoch of n sites' mean time, Julian years: star vectors are made
+ * once, for all sites, moved by proper motion to it
+ */
+static double sites_epoch(const struct site_str *sites, int n)
+{
+    double jd = 0.0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        struct ymdhms t = sites[i].t;
+
+        jd += ephCalcJD(&t) / n;
+    }
+    return CAT_EPOCH + (jd - 2451545.0) / 365.25;
+}
+
+/* apparent altitude, azimuth of star with equatorial unit vector u */
+static void star_pos(const struct sky_str *sky, const struct v3_str *u,
+                     struct starData *pos)
+{
+    struct v3_str h = *u;
+
+    m3x3_vmul(&h, &sky->rot);
+    pos->az = ephAngleRed(ephRadToDeg(atan2(h.x, h.y)));
+    pos->alt = ephRadToDeg(asin(MAX(-1.0, MIN(1.0, h.z))));
+    /* correct for atmospheric refraction */
+    pos->alt = ephAtmRef(pos->alt);
+}
+
+/* brightness ratio, relative to mag 0: m = -2.5log_10(F/F0) */
+static double mag_flux(double vmag)
+{
+    /* this could be more accurate: 5th root of 100 */
+    /* see Wikipedia: apparent magnitude */
+    return pow(10.0, vmag / -2.5);
+}
+
+/* magnitude of flux (relative to mag 0) */
+static double flux_mag(double flux)
+{
+    return -2.5 * log10(flux);
+}
+
+/*
+ * diameter of dot for star of magnitude vmag, painted dist from the
+ * observer on a surface viewed at cos_view (sine of altitude for
+ * the ceiling), in a room with ceiling height ceil
+ */
+static double dot_diameter(float vmag, double dist, double cos_view,
+                           double ceil)
+{
+    double bri;     /* brightness of dot (relative to mag 0) */
+
+    bri = mag_flux(vmag);
+    /* compensate for distance from observer to dot */
+    bri *= dist * dist / (ceil * ceil);
+    /* compensate for view angle */
+    bri /= cos_view;
+    /* brightness proportional to square of diameter */
+    return DIA_0 * sqrt(bri);
+}
+
+/* wall measurements (dn, ds) locating a ceiling dot */
+static void wall_anchors(struct dot_str *dot, const struct room_str *room)
+{
+    double ns = room->ns;
+    double ew = room->ew;
+
+    if (-dot->east / (ns / 2.0 - dot->north) <= ew / ns) {
+        dot->dn = -dot->east * ns / (ns / 2.0 - dot->north);
+        dot->wn = 's';
+    } else {
+        dot->dn = ns - ew * (ns / 2.0 - dot->north) / -dot->east;
+        dot->wn = 'W';
+    }
+
+    if (-dot->east / (ns / 2.0 + dot->north) <= ew / ns) {
+        dot->ds = -dot->east * ns / (ns / 2.0 + dot->north);
+        dot->ws = 'n';
+    } else {
+        dot->ds = ew * (ns / 2.0 + dot->north) / -dot->east;
+        dot->ws = 'W';
+    }
+}
+
+/*
+ * first cull: drop stars under the horizon mask, of catalog entries
+ * first .. first + count - 1.  Whole sky cells whose altitude bound
+ * (from declination band and hour angle range) is under the lowest
+ * point of the mask are dropped without any per-star trig.
+ */
+static void cull_horizon(const struct cat_str *cat,
+                         const struct cat_zones_str *zones,
+                         const struct hzn_str *hzn,
+                         const struct sky_str *sky,
+                         struct dot_str *dots, int first, int count)
+{
+    double lst = sky->lst;
+    int last = first + count;
+    int all = (first == 0 && count == cat->n);
+    int z, i;
+
+    for (z = 0; z < zones->n_zones; z++) {
+        const struct cat_zone_str *zn = &zones->zone[z];
+        const int *idx = &zones->idx[zn->first];
+
+        if (zn->count == 0)
+            continue;
+        if (hzn_max_alt(sky->site->lat, zn->dec0, zn->dec1,
+                        lst - zn->ra1, lst - zn->ra0) + REFRACT_MAX
+            < hzn->alt_min) {
+            for (i = 0; i < zn->count; i++)
+                if (all || (idx[i] >= first && idx[i] < last))
+                    dots[idx[i]].drop = DROP_HORIZON;
+            continue;
+        }
+
+        for (i = 0; i < zn->count; i++) {
+            struct dot_str *dot = &dots[idx[i]];
 
+            if (!all && (idx[i] < first || idx[i] >= last))
+                continue;
+
+            /* calculate altitude, azimuth */
+            /*
+             * note: these calculations don't quite agree with stellarium's.
+             * I suspect it's due to "RA/DE (of date)" calculation
+             * (proper motion)
+             */
+            star_pos(sky, &cat->u[idx[i]], &dot->pos);
+            dot->have_pos = 1;
+#if 0
+            printf("%lld,%10.6f,%10.6f\n", cat->star[idx[i]].id,
+                   dot->pos.az, dot->pos.alt);
+#endif
+            /* skip stars too low (or below horizon) */
+            if (!hzn_visible(hzn, dot->pos.az, dot->pos.alt))
+                dot->drop = DROP_HORIZON;
+        }
+    }
+}
+
+/*
+ * project stars that survived the horizon cull, of catalog entries
+ * first .. first + count - 1
+ */
+static void project_stars(const struct cat_str *cat,
+                          const struct scene_str *sc,
+                          const struct room_str *room,
+                          struct dot_str *dots, int first, int count)
+{
+    struct v3_str p0, px, py;
     struct v3_str p0x, p0y;
     /* vector normal to ceiling */
     struct v3_str n;
+    int i;
 
     /* compute normal to ceiling */
+    ceiling_corners(room, &p0, &px, &py);
     p0x = px;
     v3_sub(&p0x, &p0);
     p0y = py;
@@ -204,118 +809,3246 @@ int main(int argc, char *argv[])
     n = p0x;
     v3_cross(&n, &p0y);
 
-    /* read in latitude, longitude */
-    posnfile = fopen(POSNFILE, "r");
-    if (posnfile != NULL) {
-        if (read_latlon(posnfile, &lat, &lon) != 0) {
-            lat = DFLT_LAT;
-            lon = DFLT_LON;
-        }
-        fclose(posnfile);
-    } else {
-        lat = DFLT_LAT;
-        lon = DFLT_LON;
-    }
-#if 1
-    printf("lat: %f, lon: %f\n", lat, lon);
-#endif
-
-    starfile = fopen(STARFILE, "r");
-    while (read_star(starfile, &star_rec) != -1) {
-        /* dn is anchored in ne corner, ds in se corner */
-        /*
-         * dn is wall measurement using NE anchor point
-         * ds is wall measurement using SE anchor point
-         * N, S walls measured from east side
-         * W wall measured from S side _from_both_anchors_
-         */
-        double dn, ds;
-        char wn, ws;    /* wall on which line terminates */
-        double bri;     /* brightness of dot (relative to mag 0) */
-        double dia;     /* diameter of dot */
+    for (i = first; i < first + count; i++) {
+        const struct cat_star_str *star = &cat->star[i];
+        struct dot_str *dot = &dots[i];
+        const struct starData *pos = &dot->pos;
         double dist;    /* observer to dot distance */
+        int i_occ;      /* occluder hit, if any */
         /* unit vector in direction of star, spherical coords */
         struct crd_sph_str u_sph;
         struct v3_str u_crt;    /* same in cartesian coords */
 
-        /* calculate altitude, azimuth */
-        /*
-         * note: these calculations don't quite agree with stellarium's.
-         * I suspect it's due to "RA/DE (of date)" calculation
-         * (proper motion)
-         */
-        ephStarPos(&tstar, lat, lon, star_rec.ra, star_rec.dec,
-                   &stardat);
-#if 0
-        //printf("\nStar %d:\n", star_rec.hip);
-        //ephStarDump(&stardat);
-        printf("%d,%10.6f,%10.6f\n", star_rec.hip, stardat.az, stardat.alt);
-#endif
+        if (dot->drop != DROP_NONE)
+            continue;
+        dot->vmag = star->vmag;
 
         /* create unit vector in direction of star */
         u_sph.r = 1.0;
-        u_sph.phi = ephDegToRad(ephAltToPhi(stardat.alt));
-        u_sph.theta = ephDegToRad(ephAzToTheta(stardat.az));
+        u_sph.phi = ephDegToRad(ephAltToPhi(pos->alt));
+        u_sph.theta = ephDegToRad(ephAzToTheta(pos->az));
         crd_sph2cart(&u_sph, &u_crt);
-        /* distance from origin to dot */
-        dist = v3_dist_line_plane(&origin, &u_crt, &p0, &n);
 
-        /* CLEANED UP TO HERE */
+        /* occluders hide only what is behind them */
+        if (sc->n_surfs > 0) {
+            int miss = srf_trace(sc->surfs, sc->n_surfs,
+                                 &origin, &u_crt, &dot->hit);
+
+            i_occ = occ_test(&sc->occ, &origin, &u_crt,
+                             miss ? HUGE_VAL : dot->hit.t);
+            if (i_occ >= 0) {
+                dot->drop = DROP_OCCLUDED;
+                dot->occ = i_occ;
+                continue;
+            }
+            if (miss) {
+                dot->drop = DROP_OFF_SURFACE;
+                continue;
+            }
+            dot->dia = dot_diameter(star->vmag, dot->hit.t,
+                                    -v3_dot(&u_crt, &dot->hit.n),
+                                    room->ceil);
+            continue;
+        }
 
-        /* skip stars too low (or below horizon) */
-        if (stardat.alt < ALT_MIN)
+        /* distance from origin to dot */
+        dist = v3_dist_line_plane(&origin, &u_crt, &p0, &n);
+        i_occ = occ_test(&sc->occ, &origin, &u_crt, dist);
+        if (i_occ >= 0) {
+            dot->drop = DROP_OCCLUDED;
+            dot->occ = i_occ;
             continue;
+        }
 
         /*
          * convert to cartesian coords:
-         *    observer is OBS_TO_CEIL below ceiling
-         *    OBS_TO_WALL from middle of east wall
+         *    observer is room->ceil below ceiling
+         *    room->wall from middle of east wall
          */
-        east = OBS_TO_CEIL * ephSin(stardat.az) / ephTan(stardat.alt);
-        north = OBS_TO_CEIL * ephCos(stardat.az) / ephTan(stardat.alt);
-        east -= OBS_TO_WALL;
+        dot->east = room->ceil * ephSin(pos->az) / ephTan(pos->alt);
+        dot->north = room->ceil * ephCos(pos->az) / ephTan(pos->alt);
+        dot->east -= room->wall;
         /* skip those not on ceiling */
-        if ((north > ROOM_NS / 2.0) || (north < -ROOM_NS / 2.0)
-            || (east > 0) || (east < -ROOM_EW))
+        if ((dot->north > room->ns / 2.0) || (dot->north < -room->ns / 2.0)
+            || (dot->east > 0) || (dot->east < -room->ew)) {
+            dot->drop = DROP_OFF_SURFACE;
             continue;
+        }
 #if 0
-        printf("%d %6.1f %6.1f %5.2f\n", star_rec.hip,
-               east, north, star_rec.vmag);
+        printf("%lld %6.1f %6.1f %5.2f\n", star->id,
+               dot->east, dot->north, star->vmag);
 #endif
-        if (-east / (ROOM_NS / 2.0 - north) <= ROOM_EW / ROOM_NS) {
-            dn = -east * ROOM_NS / (ROOM_NS / 2.0 - north);
-            wn = 's';
-        } else {
-            dn = ROOM_NS - ROOM_EW * (ROOM_NS / 2.0 - north) / -east;
-            wn = 'W';
+        wall_anchors(dot, room);
+
+        dot->dia = dot_diameter(star->vmag, dist, ephSin(pos->alt),
+                                room->ceil);
+    }
+}
+
+/* unit vector toward a star (east, north, up) */
+static void star_dir(const struct starData *pos, struct v3_str *h)
+{
+    h->x = ephCos(pos->alt) * ephSin(pos->az);
+    h->y = ephCos(pos->alt) * ephCos(pos->az);
+    h->z = ephSin(pos->alt);
+}
+
+/*
+ * figure line projection: where equatorial unit vector u lands, in
+ * mm as dots_mm() has it.  returns 0 under the horizon mask, behind
+ * an occluder or off the ceiling / surfaces
+ */
+static int fig_proj(void *ctx, const struct v3_str *u, double *x, double *y,
+                    int *surf)
+{
+    const struct fig_ctx_str *fc = ctx;
+    const struct room_str *room = fc->room;
+    struct starData pos;
+    struct srf_hit_str hit;
+    struct v3_str h;
+    double east, north;
+
+    star_pos(fc->sky, u, &pos);
+    if (!hzn_visible(&fc->sc->hzn, pos.az, pos.alt))
+        return 0;
+    star_dir(&pos, &h);
+
+    /* occluders hide only what is behind them, as for dots */
+    if (fc->sc->n_surfs > 0) {
+        if (srf_trace(fc->sc->surfs, fc->sc->n_surfs, &origin, &h,
+                      &hit) != 0
+            || occ_test(&fc->sc->occ, &origin, &h, hit.t) >= 0)
+            return 0;
+        *x = 10.0 * hit.u;
+        *y = 10.0 * hit.v;
+        *surf = hit.surf;
+        return 1;
+    }
+
+    if (h.z <= 0.0
+        || occ_test(&fc->sc->occ, &origin, &h, room->ceil / h.z) >= 0)
+        return 0;
+    east = room->ceil * h.x / h.z - room->wall;
+    north = room->ceil * h.y / h.z;
+    if ((north > room->ns / 2.0) || (north < -room->ns / 2.0)
+        || (east > 0) || (east < -room->ew))
+        return 0;
+    *x = 10.0 * (east + room->ew);
+    *y = 10.0 * (north + room->ns / 2.0);
+    *surf = 0;
+    return 1;
+}
+
+/* viewpoint thread: place its share of the ceiling dots */
+static void *view_worker(void *arg)
+{
+    struct view_part_str *p = arg;
+    const struct room_str *room = p->room;
+    int i;
+
+    for (i = p->first; i < p->first + p->count; i++) {
+        struct dot_str *dot = &p->dots[i];
+        struct v3_str h;
+        double x, y;
+
+        if (dot->drop != DROP_NONE)
+            continue;
+        star_dir(&dot->pos, &h);
+        vp_solve(p->views, &h, room->ceil, &x, &y);
+        dot->east = x - room->wall;
+        dot->north = y;
+        if ((dot->north > room->ns / 2.0) || (dot->north < -room->ns / 2.0)
+            || (dot->east > 0) || (dot->east < -room->ew)) {
+            dot->drop = DROP_OFF_SURFACE;
+            continue;
+        }
+        wall_anchors(dot, room);
+    }
+    return NULL;
+}
+
+/*
+ * move ceiling dots of catalog entries first .. first + count - 1 to
+ * the compromise between several viewpoints, each star solved on its
+ * own, spread over n_threads
+ */
+static void view_dots(const struct vp_set_str *vs,
+                      const struct room_str *room, struct dot_str *dots,
+                      int first, int count, int n_threads)
+{
+    struct view_part_str *part;
+    pthread_t *tid;
+    int *started;
+    int k;
+
+    n_threads = (n_threads < 1) ? 1 : n_threads;
+    part = calloc(n_threads, sizeof(*part));
+    tid = malloc(n_threads * sizeof(*tid));
+    started = calloc(n_threads, sizeof(*started));
+    if (part == NULL || tid == NULL || started == NULL) {
+        /* do it all here */
+        struct view_part_str all = {vs, room, dots, first, count};
+
+        view_worker(&all);
+        goto done;
+    }
+    for (k = 0; k < n_threads; k++) {
+        part[k].views = vs;
+        part[k].room = room;
+        part[k].dots = dots;
+        part[k].first = first + (int)((long long)count * k / n_threads);
+        part[k].count = first + (int)((long long)count * (k + 1) / n_threads)
+            - part[k].first;
+    }
+    for (k = 1; k < n_threads; k++)
+        started[k] = (pthread_create(&tid[k], NULL, view_worker,
+                                     &part[k]) == 0);
+    view_worker(&part[0]);
+    for (k = 1; k < n_threads; k++) {
+        if (started[k])
+            pthread_join(tid[k], NULL);
+        else
+            view_worker(&part[k]);
+    }
+
+done:
+    free(part);
+    free(tid);
+    free(started);
+}
+
+/*
+ * angular distortion of the painted dots seen from each viewpoint,
+ * and of dots placed for the nominal eye alone
+ */
+static void view_report(const struct cat_str *cat,
+                        const struct vp_set_str *vs,
+                        const struct site_str *site,
+                        const struct dot_str *dots, FILE *out)
+{
+    const struct room_str *room = &site->room;
+    int i, k;
+
+    for (k = 0; k < vs->n; k++) {
+        double sum = 0.0, max = 0.0, sum1 = 0.0, max1 = 0.0;
+        int n = 0;
+
+        for (i = 0; i < cat->n; i++) {
+            const struct dot_str *dot = &dots[i];
+            struct v3_str p = {dot->east + room->wall, dot->north,
+                               room->ceil};
+            struct v3_str h, p1;
+            double e;
+
+            if (dot->drop != DROP_NONE)
+                continue;
+            star_dir(&dot->pos, &h);
+            e = ephRadToDeg(vp_error(&vs->view[k].eye, &p, &h));
+            sum += e;
+            max = MAX(max, e);
+            p1 = h;
+            v3_mul(&p1, room->ceil / h.z);
+            e = ephRadToDeg(vp_error(&vs->view[k].eye, &p1, &h));
+            sum1 += e;
+            max1 = MAX(max1, e);
+            n++;
+        }
+        n = MAX(n, 1);
+        fprintf(out, "%s%sview %s: mean %.3f max %.3f degrees"
+                " (one eye: mean %.3f max %.3f)\n",
+                site->name, (site->name[0] != '\0') ? ": " : "",
+                vs->view[k].name, sum / n, max, sum1 / n, max1);
+    }
+}
+
+/*
+ * find dots whose edges are closer than gap (mm) on the surface.
+ * merge != 0: each group of such dots becomes one dot at the
+ * flux-weighted center, with combined flux, kept on the brightest
+ * star of the group.  Otherwise conflicting pairs are listed.
+ */
+static int collide_dots(const struct cat_str *cat,
+                        const struct scene_str *sc,
+                        const struct room_str *room, FILE *out,
+                        struct dot_str *dots, double gap, int merge,
+                        struct arena_str *ar)
+{
+    double *x, *y, *r, *w;
+    int *map;                   /* catalog index of each painted dot */
+    int *root;
+    struct dg_pair_str *pairs;
+    int n_pairs;
+    int n = 0;
+    int i;
+
+    x = arena_alloc(ar, (cat->n + 1) * sizeof(*x));
+    y = arena_alloc(ar, (cat->n + 1) * sizeof(*y));
+    r = arena_alloc(ar, (cat->n + 1) * sizeof(*r));
+    w = arena_alloc(ar, (cat->n + 1) * sizeof(*w));
+    map = arena_alloc(ar, (cat->n + 1) * sizeof(*map));
+    root = arena_alloc(ar, (cat->n + 1) * sizeof(*root));
+    if (x == NULL || y == NULL || r == NULL || w == NULL
+        || map == NULL || root == NULL)
+        goto fail;
+
+    for (i = 0; i < cat->n; i++) {
+        const struct dot_str *dot = &dots[i];
+
+        if (dot->drop != DROP_NONE)
+            continue;
+        x[n] = (sc->n_surfs > 0) ? dot->hit.u : dot->east;
+        y[n] = (sc->n_surfs > 0) ? dot->hit.v : dot->north;
+        /* diameter is mm, surface is cm */
+        r[n] = dot->dia / 20.0;
+        map[n++] = i;
+    }
+
+    if (dg_overlaps(x, y, r, n, gap / 10.0, &pairs, &n_pairs) != 0)
+        goto fail;
+
+    if (!merge) {
+        for (i = 0; i < n_pairs; i++) {
+            const struct dg_pair_str *p = &pairs[i];
+
+            fprintf(out, "# conflict %6lld %6lld %6.1f %5.1f\n",
+                    cat->star[map[p->i]].id, cat->star[map[p->j]].id,
+                    p->d, 10.0 * (r[p->i] + r[p->j] - p->d));
         }
+        goto done;
+    }
+
+    /* sums over each group, kept at its root (brightest member) */
+    for (i = 0; i < n; i++)
+        r[i] = mag_flux(dots[map[i]].vmag);
+    dg_clusters(n, pairs, n_pairs, r, root);
+    for (i = 0; i < n; i++) {
+        /* painted flux is proportional to area */
+        w[i] = dots[map[i]].dia * dots[map[i]].dia;
+        x[i] *= w[i];
+        y[i] *= w[i];
+    }
+    for (i = 0; i < n; i++) {
+        if (root[i] == i)
+            continue;
+        x[root[i]] += x[i];
+        y[root[i]] += y[i];
+        w[root[i]] += w[i];
+        r[root[i]] += r[i];
+        dots[map[i]].drop = DROP_MERGED;
+        dots[map[i]].into = map[root[i]];
+    }
+    for (i = 0; i < n; i++) {
+        struct dot_str *dot = &dots[map[i]];
 
-        if (-east / (ROOM_NS / 2.0 + north) <= ROOM_EW / ROOM_NS) {
-            ds = -east * ROOM_NS / (ROOM_NS / 2.0 + north);
-            ws = 'n';
+        if (root[i] != i || dot->dia * dot->dia == w[i])
+            continue;
+        dot->dia = sqrt(w[i]);
+        dot->vmag = flux_mag(r[i]);
+        if (sc->n_surfs > 0) {
+            dot->hit.u = x[i] / w[i];
+            dot->hit.v = y[i] / w[i];
         } else {
-            ds = ROOM_EW * (ROOM_NS / 2.0 + north) / -east;
-            ws = 'W';
-        }
-
-        /* brightness ratio, relative to mag 0: m = -2.5log_10(F/F0) */
-        /* this could be more accurate: 5th root of 100 */
-        /* see Wikipedia: apparent magnitude */
-        bri = pow(10.0, star_rec.vmag / -2.5);
-        /* compensate for distance from observer to dot */
-        bri *= dist * dist / (OBS_TO_CEIL * OBS_TO_CEIL);
-        /* compensate for view angle */
-        bri /= ephSin(stardat.alt);
-        /* brightness proportional to square of diameter */
-        dia = DIA_0 * sqrt(bri);
-#if 1
-        printf("%6d %5.2f %010.6f %09.6f %6.1f %6.1f %05.1f %c %05.1f %c %4.1f 0\n",
-               star_rec.hip, star_rec.vmag,
-               stardat.az, stardat.alt,
-               east, north,
-               dn, wn, ds, ws, dia);
-#endif
+            dot->east = x[i] / w[i];
+            dot->north = y[i] / w[i];
+            wall_anchors(dot, room);
+        }
+    }
+
+done:
+    free(pairs);
+    return n_pairs;
+
+fail:
+    return -1;
+}
+
+/*
+ * level of detail: painted dots within res mm of each other, or
+ * res_ang degrees as seen by the observer, become one dot at the
+ * flux-weighted center with the combined flux, kept on the brightest.
+ * returns number of dots left, -1 on error
+ */
+static int lod_dots(const struct cat_str *cat, const struct scene_str *sc,
+                    const struct room_str *room, struct dot_str *dots,
+                    double res, double res_ang,
+                    struct arena_str *ar)
+{
+    struct qt_str qt;
+    double *x, *y, *w, *f, *d;
+    int *map, *cut;
+    int n = 0;
+    int n_cut = -1;
+    int i, j;
+
+    x = arena_alloc(ar, (cat->n + 1) * sizeof(*x));
+    y = arena_alloc(ar, (cat->n + 1) * sizeof(*y));
+    w = arena_alloc(ar, (cat->n + 1) * sizeof(*w));
+    f = arena_alloc(ar, (cat->n + 1) * sizeof(*f));
+    d = arena_alloc(ar, (cat->n + 1) * sizeof(*d));
+    map = arena_alloc(ar, (cat->n + 1) * sizeof(*map));
+    cut = arena_alloc(ar, (cat->n + 1) * sizeof(*cut));
+    if (x == NULL || y == NULL || w == NULL || f == NULL || d == NULL
+        || map == NULL || cut == NULL)
+        goto done;
+
+    for (i = 0; i < cat->n; i++) {
+        const struct dot_str *dot = &dots[i];
+
+        if (dot->drop != DROP_NONE)
+            continue;
+        if (sc->n_surfs > 0) {
+            x[n] = dot->hit.u;
+            y[n] = dot->hit.v;
+            d[n] = dot->hit.t;
+        } else {
+            x[n] = dot->east;
+            y[n] = dot->north;
+            d[n] = room->ceil / ephSin(dot->pos.alt);
+        }
+        /* painted flux is proportional to area */
+        w[n] = dot->dia * dot->dia;
+        f[n] = mag_flux(dot->vmag);
+        map[n++] = i;
+    }
+
+    /* tree is in surface units (cm) */
+    if (qt_build(&qt, x, y, w, f, d, n) != 0)
+        goto done;
+    n_cut = qt_lod(&qt, res / 10.0, ephDegToRad(res_ang), cut);
+    for (i = 0; i < n_cut; i++) {
+        const struct qt_node_str *nd = &qt.node[cut[i]];
+        struct dot_str *dot = &dots[map[nd->bright]];
+
+        if (nd->count == 1)
+            continue;
+        for (j = nd->first; j < nd->first + nd->count; j++) {
+            if (qt.idx[j] == nd->bright)
+                continue;
+            dots[map[qt.idx[j]]].drop = DROP_AGGREGATED;
+            dots[map[qt.idx[j]]].into = map[nd->bright];
+        }
+        dot->dia = sqrt(nd->w);
+        dot->vmag = flux_mag(nd->flux);
+        if (sc->n_surfs > 0) {
+            dot->hit.u = nd->x;
+            dot->hit.v = nd->y;
+        } else {
+            dot->east = nd->x;
+            dot->north = nd->y;
+            wall_anchors(dot, room);
+        }
+    }
+    qt_free(&qt);
+
+done:
+    return n_cut;
+}
+
+/*
+ * painted dots in mm from the south west corner of the ceiling, or
+ * surface (u, v) in mm; map[] gets the catalog index of each.
+ * returns number of dots
+ */
+static int dots_mm(const struct cat_str *cat, const struct scene_str *sc,
+                   const struct room_str *room, const struct dot_str *dots,
+                   double *x, double *y, double *dia, int *map)
+{
+    int n = 0;
+    int i;
+
+    for (i = 0; i < cat->n; i++) {
+        const struct dot_str *dot = &dots[i];
+
+        if (dot->drop != DROP_NONE)
+            continue;
+        if (sc->n_surfs > 0) {
+            x[n] = 10.0 * dot->hit.u;
+            y[n] = 10.0 * dot->hit.v;
+        } else {
+            x[n] = 10.0 * (dot->east + room->ew);
+            y[n] = 10.0 * (dot->north + room->ns / 2.0);
+        }
+        dia[n] = dot->dia;
+        map[n] = i;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * write plotter program for the painted dots instead of the listing.
+ * Travel saved over catalog order goes to stderr.
+ */
+static int plot_dots(const struct cat_str *cat,
+                     const struct scene_str *sc,
+                     const struct site_str *site, FILE *out,
+                     const struct dot_str *dots, int hpgl,
+                     const struct fig_pt_str *pts, int n_pts,
+                     struct arena_str *ar)
+{
+    double *x, *y, *dia;
+    double *lx, *ly;
+    long long *label;
+    int *order;
+    int *pen;
+    double len0, len1;
+    int n;
+    int i;
+    int ret = -1;
+
+    x = arena_alloc(ar, (cat->n + 1) * sizeof(*x));
+    y = arena_alloc(ar, (cat->n + 1) * sizeof(*y));
+    dia = arena_alloc(ar, (cat->n + 1) * sizeof(*dia));
+    label = arena_alloc(ar, (cat->n + 1) * sizeof(*label));
+    order = arena_alloc(ar, (cat->n + 1) * sizeof(*order));
+    lx = arena_alloc(ar, (n_pts + 1) * sizeof(*lx));
+    ly = arena_alloc(ar, (n_pts + 1) * sizeof(*ly));
+    pen = arena_alloc(ar, (n_pts + 1) * sizeof(*pen));
+    if (x == NULL || y == NULL || dia == NULL || label == NULL
+        || order == NULL || lx == NULL || ly == NULL || pen == NULL)
+        goto done;
+    for (i = 0; i < n_pts; i++) {
+        lx[i] = pts[i].x;
+        ly[i] = pts[i].y;
+        pen[i] = pts[i].pen;
+    }
+
+    n = dots_mm(cat, sc, &site->room, dots, x, y, dia, order);
+    for (i = 0; i < n; i++) {
+        label[i] = cat->star[order[i]].id;
+        order[i] = i;
+    }
+
+    len0 = pp_length(x, y, order, n, 0.0, 0.0);
+    if (pp_tour(x, y, n, 0.0, 0.0, order) != 0)
+        goto done;
+    len1 = pp_length(x, y, order, n, 0.0, 0.0);
+
+    if (hpgl)
+        pp_write_hpgl(out, x, y, dia, label, order, n, lx, ly, pen, n_pts);
+    else
+        pp_write_gcode(out, x, y, dia, label, order, n, lx, ly, pen, n_pts);
+    fprintf(stderr, "%s%s%d dots: travel %.1f m in catalog order, %.1f m"
+            " optimized, %.1f m (%.0f%%) saved\n",
+            site->name, (site->name[0] != '\0') ? ": " : "", n,
+            len0 / 1000.0, len1 / 1000.0, (len0 - len1) / 1000.0,
+            (len0 > 0) ? 100.0 * (len0 - len1) / len0 : 0.0);
+    ret = 0;
+
+done:
+    return ret;
+}
+
+/* stencil annotation context */
+struct note_ctx_str {
+    const struct cat_str *cat;
+    const struct scene_str *sc;
+    const struct dot_str *dots;
+    const int *map;
+};
+
+/* catalog number and wall measurements (or surface coords) of dot i */
+static void stencil_note(void *ctx, int i, char *buf, size_t len)
+{
+    const struct note_ctx_str *nc = ctx;
+    const struct dot_str *dot = &nc->dots[nc->map[i]];
+    long long id = nc->cat->star[nc->map[i]].id;
+
+    if (nc->sc->n_surfs > 0)
+        snprintf(buf, len, "%lld %.1f,%.1f", id, dot->hit.u, dot->hit.v);
+    else
+        snprintf(buf, len, "%lld %.1f%c %.1f%c", id,
+                 dot->dn, dot->wn, dot->ds, dot->ws);
+}
+
+/*
+ * write 1:1 stencil sheets for the painted dots: PostScript to out,
+ * or SVG pages to <prefix>-rRR-cCC.svg
+ */
+static int stencil_dots(const struct cat_str *cat,
+                        const struct scene_str *sc,
+                        const struct site_str *site, FILE *out,
+                        const char *prefix,
+                        const struct dot_str *dots, int svg,
+                        struct arena_str *ar)
+{
+    struct stn_str st;
+    struct note_ctx_str nc;
+    double *x, *y, *dia;
+    int *map;
+    int n;
+    int i;
+    int ret = -1;
+
+    x = arena_alloc(ar, (cat->n + 1) * sizeof(*x));
+    y = arena_alloc(ar, (cat->n + 1) * sizeof(*y));
+    dia = arena_alloc(ar, (cat->n + 1) * sizeof(*dia));
+    map = arena_alloc(ar, (cat->n + 1) * sizeof(*map));
+    if (x == NULL || y == NULL || dia == NULL || map == NULL)
+        goto done;
+    n = dots_mm(cat, sc, &site->room, dots, x, y, dia, map);
+
+    st.page_w = STN_LETTER_W;
+    st.page_h = STN_LETTER_H;
+    st.margin = 10.0;
+    if (sc->n_surfs > 0) {
+        st.x0 = st.y0 = HUGE_VAL;
+        st.x1 = st.y1 = -HUGE_VAL;
+        for (i = 0; i < n; i++) {
+            st.x0 = MIN(st.x0, x[i]);
+            st.x1 = MAX(st.x1, x[i]);
+            st.y0 = MIN(st.y0, y[i]);
+            st.y1 = MAX(st.y1, y[i]);
+        }
+    } else {
+        st.x0 = st.y0 = 0.0;
+        st.x1 = 10.0 * site->room.ew;
+        st.y1 = 10.0 * site->room.ns;
+    }
+    st.svg = svg;
+    st.out = out;
+    st.prefix = prefix;
+    nc.cat = cat;
+    nc.sc = sc;
+    nc.dots = dots;
+    nc.map = map;
+    st.note = stencil_note;
+    st.ctx = &nc;
+
+    i = stn_write(&st, x, y, dia, n);
+    if (i >= 0) {
+        fprintf(stderr, "%s%s%d dots on %d pages\n", site->name,
+                (site->name[0] != '\0') ? ": " : "", n, i);
+        ret = 0;
+    }
+
+done:
+    return ret;
+}
+
+/* one painted dot as a listing line */
+static void print_dot(const struct cat_str *cat, const struct scene_str *sc,
+                      FILE *out, int i, const struct dot_str *dot)
+{
+    const struct cat_star_str *star = &cat->star[i];
+
+    if (sc->n_surfs > 0) {
+        fprintf(out,
+                "%6lld %5.2f %010.6f %09.6f %-*s %7.1f %7.1f %6.1f %4.1f 0\n",
+                star->id, dot->vmag,
+                dot->pos.az, dot->pos.alt,
+                SRF_NAME_LEN - 1, sc->surfs[dot->hit.surf].name,
+                dot->hit.u, dot->hit.v, dot->hit.t, dot->dia);
+        return;
+    }
+#if 1
+    fprintf(out,
+            "%6lld %5.2f %010.6f %09.6f %6.1f %6.1f %05.1f %c %05.1f %c %4.1f 0\n",
+            star->id, dot->vmag,
+            dot->pos.az, dot->pos.alt,
+            dot->east, dot->north,
+            dot->dn, dot->wn, dot->ds, dot->ws, dot->dia);
+#endif
+}
+
+/* print results in catalog order */
+static void print_dots(const struct cat_str *cat,
+                       const struct scene_str *sc,
+                       const struct sky_str *sky, FILE *out,
+                       struct dot_str *dots, int report)
+{
+    int i;
+
+    for (i = 0; i < cat->n; i++) {
+        const struct cat_star_str *star = &cat->star[i];
+        struct dot_str *dot = &dots[i];
+
+        if (dot->drop != DROP_NONE) {
+            if (!report)
+                continue;
+            /* culled by sky cell: position is only needed for the report */
+            if (!dot->have_pos)
+                star_pos(sky, &cat->u[i], &dot->pos);
+            /* dropped star as a comment line (ignored by gnuplot) */
+            fprintf(out, "# %6lld %5.2f %010.6f %09.6f %s ",
+                    star->id, star->vmag, dot->pos.az, dot->pos.alt,
+                    drop_names[dot->drop]);
+            if (dot->drop == DROP_MERGED || dot->drop == DROP_AGGREGATED)
+                fprintf(out, "%lld\n", cat->star[dot->into].id);
+            else
+                fprintf(out, "%s\n", (dot->drop == DROP_OCCLUDED)
+                        ? sc->occ.occ[dot->occ].name : "-");
+            continue;
+        }
+        print_dot(cat, sc, out, i, dot);
+    }
+}
+
+/*
+ * figure polylines, after the stars: "fig name east north" (cm, as
+ * the dots) on the ceiling, "fig name surface u v" on surfaces.  A
+ * blank line starts each polyline
+ */
+static void print_figures(const struct scene_str *sc,
+                          const struct room_str *room, FILE *out,
+                          const struct fig_pt_str *pts, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        const struct fig_pt_str *pt = &pts[i];
+
+        if (!pt->pen)
+            fprintf(out, "\n");
+        if (sc->n_surfs > 0)
+            fprintf(out, "fig %s %s %7.1f %7.1f\n", sc->figs.fig[pt->fig].name,
+                    sc->surfs[pt->surf].name, pt->x / 10.0, pt->y / 10.0);
+        else
+            fprintf(out, "fig %s %7.1f %7.1f\n", sc->figs.fig[pt->fig].name,
+                    pt->x / 10.0 - room->ew, pt->y / 10.0 - room->ns / 2.0);
+    }
+}
+
+/* add file contents to digest, returns -1 on read error */
+static int hash_file(struct sha256_str *s, FILE *in)
+{
+    char buf[8192];
+    size_t n;
+
+    rewind(in);
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        sha256_update(s, buf, n);
+    return ferror(in) ? -1 : 0;
+}
+
+/* add the parsed scene (not its files: meshes live elsewhere) */
+static void hash_scene(struct sha256_str *s, const struct scene_str *sc)
+{
+    int i;
+
+    sha256_update(s, &sc->n_surfs, sizeof(sc->n_surfs));
+    for (i = 0; i < sc->n_surfs; i++) {
+        const struct srf_str *sf = &sc->surfs[i];
+        const struct srf_mesh_str *m = sf->mesh;
+
+        sha256_update(s, &sf->type, sizeof(sf->type));
+        sha256_update(s, sf->name, sizeof(sf->name));
+        sha256_update(s, &sf->c, sizeof(sf->c));
+        sha256_update(s, &sf->a, sizeof(sf->a));
+        sha256_update(s, &sf->b, sizeof(sf->b));
+        sha256_update(s, &sf->r, sizeof(sf->r));
+        sha256_update(s, sf->q, sizeof(sf->q));
+        sha256_update(s, &sf->clipped, sizeof(sf->clipped));
+        if (sf->clipped)
+            sha256_update(s, &sf->clip, sizeof(sf->clip));
+        if (m == NULL)
+            continue;
+        sha256_update(s, &m->n_vtx, sizeof(m->n_vtx));
+        sha256_update(s, m->vtx, m->n_vtx * sizeof(*m->vtx));
+        sha256_update(s, &m->n_tex, sizeof(m->n_tex));
+        if (m->n_tex > 0)
+            sha256_update(s, m->tex, m->n_tex * sizeof(*m->tex));
+        sha256_update(s, &m->n_tri, sizeof(m->n_tri));
+        sha256_update(s, m->tri, m->n_tri * sizeof(*m->tri));
+        if (m->n_tex > 0)
+            sha256_update(s, m->tri_tex, m->n_tri * sizeof(*m->tri_tex));
+    }
+
+    sha256_update(s, &sc->occ.n, sizeof(sc->occ.n));
+    for (i = 0; i < sc->occ.n; i++) {
+        const struct occ_str *o = &sc->occ.occ[i];
+
+        sha256_update(s, o->name, sizeof(o->name));
+        sha256_update(s, &o->c, sizeof(o->c));
+        sha256_update(s, &o->h, sizeof(o->h));
+        sha256_update(s, o->ax, sizeof(o->ax));
+    }
+
+    sha256_update(s, sc->hzn.alt, sizeof(sc->hzn.alt));
+
+    sha256_update(s, &sc->views.n, sizeof(sc->views.n));
+    for (i = 0; i < sc->views.n; i++) {
+        sha256_update(s, &sc->views.view[i].eye,
+                      sizeof(sc->views.view[i].eye));
+        sha256_update(s, &sc->views.view[i].w, sizeof(sc->views.view[i].w));
+    }
+}
+
+/*
+ * digest of what goes into every site's result: catalog file (or
+ * the built in catalog's records, starfile NULL) and the epoch its
+ * stars were moved to, scene, merge setting and the code that
+ * computes them
+ */
+static int result_base(struct sha256_str *s, FILE *starfile,
+                       const struct cat_str *cat, double epoch,
+                       const struct scene_str *sc,
+                       const struct opts_str *opts)
+{
+    const int version[2] = {RESULT_VERSION, (int)sizeof(struct dot_str)};
+    const double consts[2] = {DIA_0, REFRACT_MAX};
+    int merge = (opts->collide == 2);
+
+    sha256_init(s);
+    sha256_update(s, version, sizeof(version));
+    sha256_update(s, consts, sizeof(consts));
+    if (starfile == NULL)
+        sha256_update(s, cat->star, cat->n * sizeof(*cat->star));
+    else if (hash_file(s, starfile) != 0)
+        return -1;
+    /* stars that move are where the run's epoch put them */
+    if (cat_has_pm(cat))
+        sha256_update(s, &epoch, sizeof(epoch));
+    hash_scene(s, sc);
+    /* overlap reports (-c) are made from the result, merges change it */
+    sha256_update(s, &merge, sizeof(merge));
+    if (merge)
+        sha256_update(s, &opts->gap, sizeof(opts->gap));
+    return 0;
+}
+
+/*
+ * digest of what goes into every site's figure lines: the result
+ * digest (catalog, scene), figures and tolerance
+ */
+static void figs_base(struct sha256_str *s, const struct sha256_str *base,
+                      const struct fig_set_str *fs, double tol)
+{
+    const int version[2] = {RESULT_VERSION, (int)sizeof(struct fig_pt_str)};
+
+    *s = *base;
+    sha256_update(s, figs_magic, sizeof(figs_magic));
+    sha256_update(s, version, sizeof(version));
+    sha256_update(s, &fs->n_figs, sizeof(fs->n_figs));
+    sha256_update(s, fs->fig, fs->n_figs * sizeof(*fs->fig));
+    sha256_update(s, &fs->n_vtx, sizeof(fs->n_vtx));
+    sha256_update(s, fs->vtx, fs->n_vtx * sizeof(*fs->vtx));
+    sha256_update(s, &tol, sizeof(tol));
+}
+
+/* cache key of one site's result, from the digest of common inputs */
+static void result_key(const struct sha256_str *base,
+                       const struct site_str *site, char key[SHA256_HEX])
+{
+    struct sha256_str s = *base;
+    unsigned char d[SHA256_LEN];
+    const double v[12] = {site->lat, site->lon,
+                          site->t.year, site->t.month, site->t.day,
+                          site->t.hour, site->t.minute, site->t.second,
+                          site->room.ceil, site->room.wall,
+                          site->room.ns, site->room.ew};
+
+    sha256_update(&s, v, sizeof(v));
+    sha256_final(&s, d);
+    sha256_hex(d, key);
+}
+
+/* nonzero if mapped result is complete and for this build, catalog */
+static int result_ok(const struct cache_map_str *m, int n)
+{
+    const struct result_hdr_str *hdr = m->data;
+
+    return m->len == sizeof(*hdr) + n * sizeof(struct dot_str)
+        && memcmp(hdr->magic, result_magic, sizeof(hdr->magic)) == 0
+        && hdr->version == RESULT_VERSION
+        && hdr->dot_size == (int)sizeof(struct dot_str)
+        && hdr->n == n;
+}
+
+/* nonzero if mapped figure lines are complete and for this build */
+static int figs_ok(const struct cache_map_str *m)
+{
+    const struct result_hdr_str *hdr = m->data;
+
+    return m->len >= sizeof(*hdr)
+        && memcmp(hdr->magic, figs_magic, sizeof(hdr->magic)) == 0
+        && hdr->version == RESULT_VERSION
+        && hdr->dot_size == (int)sizeof(struct fig_pt_str)
+        && m->len == sizeof(*hdr) + hdr->n * sizeof(struct fig_pt_str);
+}
+
+/*
+ * where a dot lands when its wall measurements (dn, ds, taken in
+ * the room as drawn) are laid out in a room ns by ew: the crossing
+ * of the strings from the NE and SE corners.  returns -1 if they
+ * don't cross
+ */
+static int anchor_place(const struct dot_str *dot, double ns, double ew,
+                        double *east, double *north)
+{
+    double ax = 0.0, ay = ns / 2.0;     /* NE corner */
+    double bx = 0.0, by = -ns / 2.0;    /* SE corner */
+    double px, py, qx, qy, den, s;
+
+    if (dot->wn == 's') {
+        px = -dot->dn;
+        py = -ns / 2.0;
+    } else {
+        px = -ew;
+        py = -ns / 2.0 + dot->dn;
+    }
+    if (dot->ws == 'n') {
+        qx = -dot->ds;
+        qy = ns / 2.0;
+    } else {
+        qx = -ew;
+        qy = -ns / 2.0 + dot->ds;
+    }
+    px -= ax;
+    py -= ay;
+    qx -= bx;
+    qy -= by;
+    den = px * qy - py * qx;
+    if (fabs(den) < 1e-12)
+        return -1;
+    s = ((bx - ax) * qy - (by - ay) * qx) / den;
+    *east = ax + s * px;
+    *north = ay + s * py;
+    return 0;
+}
+
+/*
+ * placement error (cm) of a ceiling dot in one trial: where its wall
+ * measurements put it in the true room, less where the star is seen
+ * from the true eye position.  d holds the trial's errors
+ */
+static void trial_error(const struct dot_str *dot,
+                        const struct room_str *room, const double *d,
+                        double *ex, double *ey)
+{
+    double ceil = room->ceil + d[TOL_CEIL] - d[TOL_EYE_Z];
+    double wall = room->wall + d[TOL_WALL] - d[TOL_EYE_X];
+    double east, north;
+
+    if (anchor_place(dot, room->ns + d[TOL_NS], room->ew + d[TOL_EW],
+                     &east, &north) != 0) {
+        east = dot->east;
+        north = dot->north;
+    }
+    /* the star's direction is fixed by the drawn dot and eye */
+    *ex = east - (-wall + ceil * (dot->east + room->wall) / room->ceil);
+    *ey = north - (d[TOL_EYE_Y] + ceil * dot->north / room->ceil);
+}
+
+/*
+ * tolerance thread: every trial for its dots.  Any thread draws
+ * any trial alike, so results don't depend on the thread count
+ */
+static void *tol_worker(void *arg)
+{
+    struct tol_part_str *p = arg;
+    double d[TOL_N_PARAMS];
+    double ex, ey;
+    int t, k;
+
+    for (t = 0; t < p->tol->trials; t++) {
+        tol_draw(p->tol, t, d);
+        for (k = p->first; k < p->first + p->count; k++) {
+            trial_error(&p->dots[p->map[k]], p->room, d, &ex, &ey);
+            tol_acc_add(&p->acc[k], 10.0 * ex, 10.0 * ey);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Monte Carlo placement tolerance of the ceiling dots: the room
+ * measurements and eye position are perturbed in each trial and only
+ * the dot geometry is redone.  Writes each dot's error ellipse (mm)
+ * and the worst dots to out.  returns -1 on error
+ */
+static int tolerance_dots(const struct cat_str *cat,
+                          const struct room_str *room, FILE *out,
+                          const struct dot_str *dots,
+                          const struct tol_str *tol, int n_threads,
+                          struct arena_str *ar)
+{
+    struct tol_part_str *part;
+    struct tol_acc_str *acc;
+    pthread_t *tid;
+    int *map;
+    int *worst;
+    int *started;
+    int n = 0;
+    int n_worst = 0;
+    int ret = -1;
+    int i, k;
+
+    n_threads = (n_threads < 1) ? 1 : n_threads;
+    map = arena_alloc(ar, (cat->n + 1) * sizeof(*map));
+    acc = arena_alloc(ar, (cat->n + 1) * sizeof(*acc));
+    part = arena_calloc(ar, n_threads, sizeof(*part));
+    tid = arena_alloc(ar, n_threads * sizeof(*tid));
+    started = arena_calloc(ar, n_threads, sizeof(*started));
+    worst = arena_alloc(ar, TOL_WORST * sizeof(*worst));
+    if (map == NULL || acc == NULL || part == NULL || tid == NULL
+        || started == NULL || worst == NULL)
+        goto done;
+
+    for (i = 0; i < cat->n; i++)
+        if (dots[i].drop == DROP_NONE) {
+            tol_acc_init(&acc[n]);
+            map[n++] = i;
+        }
+    for (k = 0; k < n_threads; k++) {
+        part[k].dots = dots;
+        part[k].room = room;
+        part[k].tol = tol;
+        part[k].map = map;
+        part[k].first = (int)((long long)n * k / n_threads);
+        part[k].count = (int)((long long)n * (k + 1) / n_threads)
+            - part[k].first;
+        part[k].acc = acc;
+    }
+    for (k = 1; k < n_threads; k++)
+        started[k] = (pthread_create(&tid[k], NULL, tol_worker,
+                                     &part[k]) == 0);
+    tol_worker(&part[0]);
+    for (k = 1; k < n_threads; k++) {
+        if (started[k])
+            pthread_join(tid[k], NULL);
+        else
+            tol_worker(&part[k]);
+    }
+
+    fprintf(out, "# tolerance: %d trials, seed %llu, %d dots, mm\n",
+            tol->trials, tol->seed, n);
+    fprintf(out, "#     id  vmag    east   north  bias_e  bias_n"
+            "   major   minor   angle     max\n");
+    for (k = 0; k < n; k++) {
+        const struct dot_str *dot = &dots[map[k]];
+        double major, minor, angle;
+
+        tol_ellipse(&acc[k], &major, &minor, &angle);
+        fprintf(out, "%8lld %5.2f %7.1f %7.1f %7.2f %7.2f %7.2f %7.2f"
+                " %7.1f %7.2f\n", cat->star[map[k]].id, dot->vmag,
+                10.0 * dot->east, 10.0 * dot->north, acc[k].mx, acc[k].my,
+                major, minor, angle, acc[k].max);
+    }
+
+    /* worst dots by largest error, kept in order */
+    for (k = 0; k < n; k++) {
+        int j;
+
+        if (n_worst == TOL_WORST && acc[worst[n_worst - 1]].max >= acc[k].max)
+            continue;
+        j = (n_worst < TOL_WORST) ? n_worst++ : TOL_WORST - 1;
+        for (; j > 0 && acc[worst[j - 1]].max < acc[k].max; j--)
+            worst[j] = worst[j - 1];
+        worst[j] = k;
+    }
+    fprintf(out, "# worst:\n");
+    for (k = 0; k < n_worst; k++) {
+        double major, minor, angle;
+
+        tol_ellipse(&acc[worst[k]], &major, &minor, &angle);
+        fprintf(out, "# %6lld max %7.2f major %7.2f\n",
+                cat->star[map[worst[k]]].id, acc[worst[k]].max, major);
+    }
+    ret = 0;
+
+done:
+    return ret;
+}
+
+/*
+ * register a photograph's blobs with the painted dots and list the
+ * dots misplaced or missing and the blobs extra, in mm as dots_mm()
+ * has them.  returns -1 on error
+ */
+static int verify_dots(const struct cat_str *cat,
+                       const struct scene_str *sc,
+                       const struct site_str *site, FILE *out,
+                       const struct dot_str *dots,
+                       const struct opts_str *opts,
+                       struct arena_str *ar)
+{
+    const struct pv_blobs_str *b = opts->photo;
+    struct pv_str pv;
+    struct timespec t0, t1;
+    double *x, *y, *dia, *xy;
+    int *map;
+    int n;
+    int i;
+    int ret = -1;
+
+    x = arena_alloc(ar, (cat->n + 1) * sizeof(*x));
+    y = arena_alloc(ar, (cat->n + 1) * sizeof(*y));
+    dia = arena_alloc(ar, (cat->n + 1) * sizeof(*dia));
+    map = arena_alloc(ar, (cat->n + 1) * sizeof(*map));
+    xy = arena_alloc(ar, (2 * cat->n + 1) * sizeof(*xy));
+    if (x == NULL || y == NULL || dia == NULL || map == NULL || xy == NULL)
+        goto done;
+    n = dots_mm(cat, sc, &site->room, dots, x, y, dia, map);
+    for (i = 0; i < n; i++) {
+        xy[2 * i] = x[i];
+        xy[2 * i + 1] = y[i];
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (pv_register(xy, n, b, opts->photo_tol, opts->photo_far, &pv) != 0)
+        goto done;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fprintf(stderr, "%s%s%d blobs on %d dots registered in %.3f s,"
+            " %d of %d votes agreeing\n", site->name,
+            (site->name[0] != '\0') ? ": " : "", b->n, n,
+            (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9,
+            pv.n_consensus, pv.n_votes);
+
+    fprintf(out, "# verify: %d dots, %d blobs, tolerance %.1f mm,"
+            " pairing %.1f mm\n", n, b->n, opts->photo_tol, opts->photo_far);
+    if (pv.n_pairs == 0)
+        fprintf(out, "# registration: none found\n");
+    else
+        fprintf(out, "# registration: scale %.5f mm/px, rotation %.2f,"
+                " %smirrored, offset %.1f %.1f, rms %.2f mm\n",
+                hypot(pv.xf.re, pv.xf.im),
+                atan2(pv.xf.im, pv.xf.re) * 180.0 / M_PI,
+                pv.xf.mirror ? "" : "not ", pv.xf.tx, pv.xf.ty, pv.rms);
+    fprintf(out, "# kind        id  vmag       x       y   off_x   off_y\n");
+    for (i = 0; i < n; i++) {
+        const struct dot_str *dot = &dots[map[i]];
+        double ox = pv.off[2 * i], oy = pv.off[2 * i + 1];
+
+        if (pv.blob[i] >= 0 && hypot(ox, oy) <= opts->photo_tol)
+            continue;
+        if (pv.blob[i] >= 0)
+            fprintf(out, "misplaced %6lld %5.2f %7.1f %7.1f %7.1f %7.1f\n",
+                    cat->star[map[i]].id, dot->vmag, x[i], y[i], ox, oy);
+        else
+            fprintf(out, "missing   %6lld %5.2f %7.1f %7.1f\n",
+                    cat->star[map[i]].id, dot->vmag, x[i], y[i]);
+    }
+    for (i = 0; i < b->n; i++) {
+        double u, v;
+
+        if (pv.dot[i] >= 0)
+            continue;
+        /* photo pixels when there is no registration */
+        u = b->xy[2 * i];
+        v = b->xy[2 * i + 1];
+        if (pv.n_pairs > 0)
+            pv_apply(&pv.xf, u, v, &u, &v);
+        fprintf(out, "extra     %6d       %7.1f %7.1f\n", i + 1, u, v);
+    }
+    fprintf(out, "# placed %d, misplaced %d, missing %d, extra %d\n",
+            pv.n_placed, pv.n_misplaced, pv.n_missing, pv.n_extra);
+    pv_free(&pv);
+    ret = 0;
+
+done:
+    return ret;
+}
+
+static int cmp_hit(const void *pa, const void *pb)
+{
+    const struct hit_str *a = pa, *b = pb;
+
+    return (a->d > b->d) - (a->d < b->d);
+}
+
+/*
+ * answer the -Q queries: dots near a point of the surface (mm as
+ * dots_mm() has them), within a radius or a box, or catalog stars
+ * near a point of the sky, painted or not.  returns -1 on error
+ */
+static int lookup_dots(const struct cat_str *cat,
+                       const struct scene_str *sc,
+                       const struct site_str *site, FILE *out,
+                       const struct dot_str *dots,
+                       const struct opts_str *opts,
+                       struct arena_str *ar)
+{
+    const double rad = M_PI / 180.0;
+    struct kd_str dot_kd, sky_kd;
+    struct hit_str *hit;
+    double *x, *y, *dia, *xy, *d2;
+    int *map, *idx, *at;
+    int n, m;
+    int i, j, k;
+    int ret = -1;
+
+    memset(&dot_kd, 0, sizeof(dot_kd));
+    memset(&sky_kd, 0, sizeof(sky_kd));
+    x = arena_alloc(ar, (cat->n + 1) * sizeof(*x));
+    y = arena_alloc(ar, (cat->n + 1) * sizeof(*y));
+    dia = arena_alloc(ar, (cat->n + 1) * sizeof(*dia));
+    map = arena_alloc(ar, (cat->n + 1) * sizeof(*map));
+    xy = arena_alloc(ar, (2 * cat->n + 1) * sizeof(*xy));
+    idx = arena_alloc(ar, (cat->n + 1) * sizeof(*idx));
+    d2 = arena_alloc(ar, (cat->n + 1) * sizeof(*d2));
+    at = arena_alloc(ar, (cat->n + 1) * sizeof(*at));
+    hit = arena_alloc(ar, (cat->n + 1) * sizeof(*hit));
+    if (x == NULL || y == NULL || dia == NULL || map == NULL || xy == NULL
+        || idx == NULL || d2 == NULL || at == NULL || hit == NULL)
+        goto done;
+    n = dots_mm(cat, sc, &site->room, dots, x, y, dia, map);
+    for (i = 0; i < cat->n; i++)
+        at[i] = -1;
+    for (i = 0; i < n; i++) {
+        xy[2 * i] = x[i];
+        xy[2 * i + 1] = y[i];
+        at[map[i]] = i;
+    }
+    /* v3_str is three doubles, so the unit vectors are points as is */
+    if (kd_build(&dot_kd, xy, n, 2) != 0
+        || kd_build(&sky_kd, &cat->u[0].x, cat->n, 3) != 0)
+        goto done;
+
+    fprintf(out, "# surface: id vmag x y distance (mm)\n"
+            "# sky: id vmag ra dec separation (degrees), then x y (mm)"
+            " or why not painted\n");
+    for (k = 0; k < opts->n_looks; k++) {
+        const struct look_str *lk = &opts->looks[k];
+        int sky = (lk->kind == LOOK_SKY || lk->kind == LOOK_CONE);
+        double q[3], lo[2], hi[2], r;
+
+        if (sky) {
+            q[0] = cos(lk->a[1] * rad) * cos(lk->a[0] * rad);
+            q[1] = cos(lk->a[1] * rad) * sin(lk->a[0] * rad);
+            q[2] = sin(lk->a[1] * rad);
+        } else {
+            q[0] = lk->a[0];
+            q[1] = lk->a[1];
+        }
+        switch (lk->kind) {
+        case LOOK_NEAR:
+            m = kd_knearest(&dot_kd, q, lk->count, HUGE_VAL, idx, d2);
+            break;
+        case LOOK_WITHIN:
+            m = kd_radius(&dot_kd, q, lk->a[2] * lk->a[2], idx, cat->n);
+            break;
+        case LOOK_BOX:
+            lo[0] = MIN(lk->a[0], lk->a[2]);
+            lo[1] = MIN(lk->a[1], lk->a[3]);
+            hi[0] = MAX(lk->a[0], lk->a[2]);
+            hi[1] = MAX(lk->a[1], lk->a[3]);
+            q[0] = (lo[0] + hi[0]) / 2.0;
+            q[1] = (lo[1] + hi[1]) / 2.0;
+            m = kd_box(&dot_kd, lo, hi, idx, cat->n);
+            break;
+        case LOOK_SKY:
+            m = kd_knearest(&sky_kd, q, lk->count, HUGE_VAL, idx, d2);
+            break;
+        default:
+            /* cone, by the chord of its radius */
+            r = 2.0 * sin(MIN(lk->a[2], 180.0) * rad / 2.0);
+            m = kd_radius(&sky_kd, q, r * r, idx, cat->n);
+            break;
+        }
+
+        /* nearest first: surface distance, or angle on the sky */
+        for (i = 0; i < m; i++) {
+            const double *p = sky ? &cat->u[idx[i]].x : &xy[2 * idx[i]];
+            double s = 0.0;
+
+            for (j = 0; j < (sky ? 3 : 2); j++)
+                s += (p[j] - q[j]) * (p[j] - q[j]);
+            hit[i].i = idx[i];
+            hit[i].d = sky ? 2.0 * asin(MIN(sqrt(s) / 2.0, 1.0)) / rad
+                : sqrt(s);
+        }
+        qsort(hit, m, sizeof(*hit), cmp_hit);
+
+        fprintf(out, "# %s: %d\n", lk->arg, m);
+        for (i = 0; i < m; i++) {
+            int c = sky ? hit[i].i : map[hit[i].i];
+            const struct cat_star_str *star = &cat->star[c];
+
+            if (!sky) {
+                fprintf(out, "%6lld %5.2f %7.1f %7.1f %6.1f\n", star->id,
+                        star->vmag, x[hit[i].i], y[hit[i].i], hit[i].d);
+                continue;
+            }
+            fprintf(out, "%6lld %5.2f %10.6f %+010.6f %7.4f", star->id,
+                    star->vmag, star->ra, star->dec, hit[i].d);
+            if (at[c] >= 0)
+                fprintf(out, " %7.1f %7.1f\n", x[at[c]], y[at[c]]);
+            else
+                fprintf(out, " %s\n", drop_names[dots[c].drop]);
+        }
+    }
+    ret = 0;
+
+done:
+    kd_free(&dot_kd);
+    kd_free(&sky_kd);
+    return ret;
+}
+
+/*
+ * render the sky of a site as fisheye frames (PPM, one after the
+ * other) to out.  returns -1 on error
+ */
+static int fisheye_site(const struct cat_str *cat,
+                        const struct cat_zones_str *zones,
+                        const struct scene_str *sc,
+                        const struct opts_str *opts,
+                        const struct site_str *site, FILE *out,
+                        struct arena_str *ar)
+{
+    struct site_str at = *site;
+    struct sky_str sky;
+    struct fe_str fe;
+    struct fe_star_str *fs;
+    struct dot_str *dots;
+    int ret = -1;
+    int i, k, n;
+
+    if (fe_init(&fe, opts->fisheye, opts->threads) != 0)
+        return -1;
+    dots = arena_alloc(ar, (cat->n + 1) * sizeof(*dots));
+    fs = arena_alloc(ar, (cat->n + 1) * sizeof(*fs));
+    if (dots == NULL || fs == NULL)
+        goto done;
+
+    for (k = 0; k < opts->frames; k++) {
+        at.t.second = site->t.second + k * opts->frame_step;
+        sky_init(&sky, &at);
+        memset(dots, 0, cat->n * sizeof(*dots));
+        cull_horizon(cat, zones, &sc->hzn, &sky, dots, 0, cat->n);
+        for (i = 0, n = 0; i < cat->n; i++) {
+            const struct cat_star_str *star = &cat->star[i];
+
+            if (dots[i].drop == DROP_NONE
+                && fe_star(&fe, dots[i].pos.alt, dots[i].pos.az, star->vmag,
+                           star->flags & CAT_HAVE_BV, star->bv, &fs[n]))
+                n++;
+        }
+        if (fe_render(&fe, fs, n) != 0 || fe_write_ppm(&fe, out) != 0)
+            goto done;
+    }
+    ret = 0;
+
+done:
+    fe_free(&fe);
+    return ret;
+}
+
+/*
+ * score of the search objective when the stars flagged in on are on
+ * the ceiling; n_on (if not NULL) gets their number.  Sums run in
+ * catalog order, so flagging more stars never scores lower.  Short
+ * of a required star, GOAL_HIP scores minus the number missing
+ */
+static double goal_score(const struct search_str *s,
+                         const unsigned char *on, int *n_on)
+{
+    const struct goal_str *g = s->goal;
+    double sum = 0.0;
+    int n = 0, n_mag = 0, n_req = 0;
+    int i;
+
+    for (i = 0; i < s->cat->n; i++) {
+        if (!on[i])
+            continue;
+        sum += s->flux[i];
+        n_mag += (s->cat->star[i].vmag <= g->mag);
+        n_req += (g->req != NULL && g->req[i]);
+        n++;
+    }
+    if (n_on != NULL)
+        *n_on = n;
+    switch (g->kind) {
+    case GOAL_MAG:
+        return n_mag;
+    case GOAL_HIP:
+        return (n_req == g->n_hip) ? sum : n_req - g->n_hip;
+    default:
+        return sum;
+    }
+}
+
+/* angle between unit vectors, radians */
+static double unit_angle(const struct v3_str *a, const struct v3_str *b)
+{
+    struct v3_str c = *a;
+
+    v3_cross(&c, b);
+    return atan2(v3_mag(&c), v3_dot(a, b));
+}
+
+/* angular distance (radians) from unit direction p to the ceiling */
+static double ceiling_dist(const struct search_str *s, const struct v3_str *p)
+{
+    double d = HUGE_VAL;
+    int inside = 1;
+    int k;
+
+    for (k = 0; k < 4; k++) {
+        const struct v3_str *a = &s->corner[k];
+        const struct v3_str *b = &s->corner[(k + 1) % 4];
+        const struct v3_str *e = &s->edge[k];
+        double pe = v3_dot(p, e);
+        struct v3_str q = *e, t;
+
+        if (pe >= 0.0)
+            continue;
+        inside = 0;
+        /* nearest point of the edge's great circle, if on the edge */
+        v3_mul(&q, -pe);
+        v3_add(&q, p);
+        t = *a;
+        v3_cross(&t, &q);
+        if (v3_dot(&t, e) >= 0.0) {
+            t = q;
+            v3_cross(&t, b);
+            if (v3_dot(&t, e) >= 0.0) {
+                d = MIN(d, atan2(-pe, v3_mag(&q)));
+                continue;
+            }
+        }
+        d = MIN(d, MIN(unit_angle(p, a), unit_angle(p, b)));
+    }
+    return inside ? 0.0 : d;
+}
+
+/*
+ * upper bound on the score of any epoch in LST cell c: stars are
+ * taken at the middle of the cell and flagged if they come within
+ * the sweep (plus the change in refraction) of the ceiling.  The
+ * horizon mask and occluders only remove stars, so are left out
+ */
+static double cell_bound(const struct search_str *s, int c,
+                         unsigned char *on)
+{
+    const struct cat_str *cat = s->cat;
+    const struct cat_zones_str *zones = s->zones;
+    int per = s->n_bins / s->n_cells;
+    double lst = (c + 0.5) * LST_COARSE;
+    double sweep = LST_COARSE / 2.0;
+    struct sky_str sky;
+    int z, i, b;
+
+    for (b = c * per; b < (c + 1) * per; b++)
+        if (s->bin_jd[b] != 0.0)
+            break;
+    if (b == (c + 1) * per)
+        return -HUGE_VAL;
+
+    sky_at(&sky, s->site, lst);
+    memset(on, 0, cat->n);
+    for (z = 0; z < zones->n_zones; z++) {
+        const struct cat_zone_str *zn = &zones->zone[z];
+        const int *idx = &zones->idx[zn->first];
+
+        if (zn->count == 0
+            || hzn_max_alt(s->site->lat, zn->dec0, zn->dec1,
+                           lst - sweep - zn->ra1, lst + sweep - zn->ra0)
+            + REFRACT_MAX < s->alt_lo)
+            continue;
+        for (i = 0; i < zn->count; i++) {
+            struct v3_str h = cat->u[idx[i]];
+            double alt, app, slack, r;
+
+            m3x3_vmul(&h, &sky.rot);
+            alt = ephRadToDeg(asin(MAX(-1.0, MIN(1.0, h.z))));
+            /* refraction falls with altitude above the horizon */
+            if (alt - sweep > 0.0)
+                slack = (ephAtmRef(alt - sweep) - (alt - sweep))
+                    - (ephAtmRef(alt + sweep) - (alt + sweep));
+            else
+                slack = REFRACT_MAX;
+            /* raise to the apparent altitude */
+            app = ephAtmRef(alt);
+            r = hypot(h.x, h.y);
+            if (r > 0.0) {
+                h.x *= ephCos(app) / r;
+                h.y *= ephCos(app) / r;
+            }
+            h.z = ephSin(app);
+            on[idx[i]] = (ceiling_dist(s, &h)
+                          <= ephDegToRad(sweep + slack));
+        }
+    }
+    return goal_score(s, on, NULL);
+}
+
+/* score of the epoch jd, stars on the ceiling flagged in on */
+static double epoch_score(const struct search_str *s, double jd,
+                          struct dot_str *dots, unsigned char *on,
+                          int *n_on)
+{
+    struct sky_str sky;
+    int i;
+
+    sky_at(&sky, s->site, ephMSTG(jd) + s->site->lon);
+    memset(dots, 0, s->cat->n * sizeof(*dots));
+    cull_horizon(s->cat, s->zones, &s->sc->hzn, &sky, dots, 0, s->cat->n);
+    project_stars(s->cat, s->sc, &s->site->room, dots, 0, s->cat->n);
+    for (i = 0; i < s->cat->n; i++)
+        on[i] = (dots[i].drop == DROP_NONE);
+    return goal_score(s, on, n_on);
+}
+
+/*
+ * search thread: bound cells, or refine them highest bound first
+ * until the rest can't beat the best.  Ties go to the earlier epoch,
+ * so the result doesn't depend on the thread count
+ */
+static void *search_worker(void *arg)
+{
+    struct search_str *s = arg;
+    int per = s->n_bins / s->n_cells;
+    struct dot_str *dots;
+    unsigned char *on;
+    int k, b;
+
+    dots = malloc((s->cat->n + 1) * sizeof(*dots));
+    on = malloc(s->cat->n + 1);
+    if (dots == NULL || on == NULL) {
+        pthread_mutex_lock(&s->lock);
+        s->failed = 1;
+        pthread_mutex_unlock(&s->lock);
+        goto done;
+    }
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        k = s->next++;
+        if (s->refine && k < s->n_order && s->bound[s->order[k]] < s->best)
+            k = s->next = s->n_order;
+        pthread_mutex_unlock(&s->lock);
+        if (!s->refine) {
+            if (k >= s->n_cells)
+                break;
+            s->bound[k] = cell_bound(s, k, on);
+            continue;
+        }
+        if (k >= s->n_order)
+            break;
+        k = s->order[k];
+        for (b = k * per; b < (k + 1) * per; b++) {
+            double jd = s->bin_jd[b];
+            double score;
+
+            if (jd == 0.0)
+                continue;
+            score = epoch_score(s, jd, dots, on, NULL);
+            pthread_mutex_lock(&s->lock);
+            s->n_eval++;
+            if (score > s->best || (score == s->best && jd < s->best_jd)) {
+                s->best = score;
+                s->best_jd = jd;
+            }
+            pthread_mutex_unlock(&s->lock);
+        }
+        pthread_mutex_lock(&s->lock);
+        s->n_refined++;
+        pthread_mutex_unlock(&s->lock);
+    }
+
+done:
+    free(dots);
+    free(on);
+    return NULL;
+}
+
+/* one pass of the search on n_threads threads, returns -1 on error */
+static int search_pass(struct search_str *s, int n_threads)
+{
+    pthread_t *tid;
+    int n = 0;
+    int k;
+
+    tid = malloc(n_threads * sizeof(*tid));
+    s->next = 0;
+    for (k = 1; tid != NULL && k < n_threads; k++)
+        if (pthread_create(&tid[n], NULL, search_worker, s) == 0)
+            n++;
+    search_worker(s);
+    for (k = 0; k < n; k++)
+        pthread_join(tid[k], NULL);
+    free(tid);
+    return s->failed ? -1 : 0;
+}
+
+/*
+ * search a site's date range for the dark epoch (to the minute)
+ * scoring best, and write it to out.  returns -1 on error
+ */
+static int search_site(const struct cat_str *cat,
+                       const struct cat_zones_str *zones,
+                       const struct scene_str *sc,
+                       const struct opts_str *opts,
+                       const struct site_str *site, FILE *out,
+                       struct arena_str *ar)
+{
+    const struct goal_str *g = opts->goal;
+    struct search_str s;
+    struct v3_str p0, px, py, mid = {0, 0, 0};
+    struct ymdhms t;
+    double *flux = NULL;
+    double *bin_jd = NULL;
+    int *nights = NULL;
+    struct dot_str *dots = NULL;
+    unsigned char *on = NULL;
+    double sun_ra = 0.0, sin_dec = 0.0, cos_dec = 0.0;
+    double sin_night = ephSin(NIGHT_ALT);
+    double sp = ephSin(site->lat), cp = ephCos(site->lat);
+    long n_min, n_dark = 0, m;
+    int n_seen = 0, n_on;
+    int ret = -1;
+    int b, i, j, k;
+
+    memset(&s, 0, sizeof(s));
+    s.cat = cat;
+    s.zones = zones;
+    s.sc = sc;
+    s.site = site;
+    s.goal = g;
+    s.n_bins = (int)(360.0 / LST_FINE + 0.5);
+    s.n_cells = (int)(360.0 / LST_COARSE + 0.5);
+    s.best = -HUGE_VAL;
+
+    /* the ceiling seen from the observer, corners in order around */
+    ceiling_corners(&site->room, &p0, &px, &py);
+    s.corner[0] = p0;
+    s.corner[1] = py;
+    s.corner[2] = px;
+    v3_add(&s.corner[2], &py);
+    v3_sub(&s.corner[2], &p0);
+    s.corner[3] = px;
+    s.alt_lo = 90.0;
+    for (k = 0; k < 4; k++) {
+        v3_unit(&s.corner[k]);
+        v3_add(&mid, &s.corner[k]);
+        s.alt_lo = MIN(s.alt_lo, ephRadToDeg(asin(s.corner[k].z)));
+    }
+    for (k = 0; k < 4; k++) {
+        s.edge[k] = s.corner[k];
+        v3_cross(&s.edge[k], &s.corner[(k + 1) % 4]);
+        v3_unit(&s.edge[k]);
+        if (v3_dot(&s.edge[k], &mid) < 0.0)
+            v3_mul(&s.edge[k], -1.0);
+    }
+
+    flux = arena_alloc(ar, (cat->n + 1) * sizeof(*flux));
+    bin_jd = arena_calloc(ar, s.n_bins, sizeof(*bin_jd));
+    nights = arena_calloc(ar, s.n_bins, sizeof(*nights));
+    s.bound = arena_alloc(ar, s.n_cells * sizeof(*s.bound));
+    s.order = arena_alloc(ar, s.n_cells * sizeof(*s.order));
+    dots = arena_alloc(ar, (cat->n + 1) * sizeof(*dots));
+    on = arena_alloc(ar, cat->n + 1);
+    if (flux == NULL || bin_jd == NULL || nights == NULL || s.bound == NULL
+        || s.order == NULL || dots == NULL || on == NULL)
+        goto done;
+    for (i = 0; i < cat->n; i++)
+        flux[i] = mag_flux(cat->star[i].vmag);
+    s.flux = flux;
+    s.bin_jd = bin_jd;
+
+    /* every minute of the range: the first dark one in each LST bin */
+    n_min = (long)((g->jd1 - g->jd0) * 1440.0 + 0.5);
+    for (m = 0; m < n_min; m++) {
+        double jd = g->jd0 + m / 1440.0;
+        double lst = ephAngleRed(ephMSTG(jd) + site->lon);
+
+        /* the sun moves a degree a day: hourly is close enough */
+        if (m % 60 == 0) {
+            double dec;
+
+            ephSunPos(jd, &sun_ra, &dec);
+            sin_dec = ephSin(dec);
+            cos_dec = ephCos(dec);
+        }
+        if (sp * sin_dec + cp * cos_dec * ephCos(lst - sun_ra) >= sin_night)
+            continue;
+        b = MIN((int)(lst / LST_FINE), s.n_bins - 1);
+        if (nights[b]++ == 0) {
+            bin_jd[b] = jd;
+            n_seen++;
+        }
+        n_dark++;
+    }
+
+    fprintf(out, "search: lat %f, lon %f, %ld minutes from JD %.1f\n",
+            site->lat, site->lon, n_min, g->jd0);
+    if (g->kind == GOAL_MAG)
+        fprintf(out, "objective: stars to magnitude %.2f\n", g->mag);
+    else if (g->kind == GOAL_HIP)
+        fprintf(out, "objective: flux, %d required stars\n", g->n_hip);
+    else
+        fprintf(out, "objective: flux\n");
+    fprintf(out, "dark minutes: %ld (sun under %.0f degrees),"
+            " LST bins %d of %d\n", n_dark, NIGHT_ALT, n_seen, s.n_bins);
+    if (n_dark == 0) {
+        fprintf(out, "no dark sky in range\n");
+        ret = 0;
+        goto done;
+    }
+
+    /* coarse pass: bound every cell, then refine the best first */
+    pthread_mutex_init(&s.lock, NULL);
+    if (search_pass(&s, opts->threads) != 0)
+        goto unlock;
+    for (k = 0; k < s.n_cells; k++) {
+        if (s.bound[k] == -HUGE_VAL)
+            continue;
+        for (j = s.n_order; j > 0 && s.bound[s.order[j - 1]] < s.bound[k];
+             j--)
+            s.order[j] = s.order[j - 1];
+        s.order[j] = k;
+        s.n_order++;
+    }
+    s.refine = 1;
+    if (search_pass(&s, opts->threads) != 0)
+        goto unlock;
+
+    fprintf(out, "cells: %d of %d refined, %d pruned, %d epochs scored\n",
+            s.n_refined, s.n_order, s.n_order - s.n_refined, s.n_eval);
+    epoch_score(&s, s.best_jd, dots, on, &n_on);
+    ephCalcDate(s.best_jd, &t);
+    fprintf(out, "best: %04d-%02d-%02d %02d:%02d UTC, LST %.2f,"
+            " score %.3f, %d stars on ceiling\n", t.year, t.month, t.day,
+            t.hour, t.minute, ephAngleRed(ephMSTG(s.best_jd) + site->lon),
+            s.best, n_on);
+    if (g->kind == GOAL_HIP && s.best < 0.0)
+        fprintf(out, "best misses %.0f required stars\n", -s.best);
+    b = MIN((int)(ephAngleRed(ephMSTG(s.best_jd) + site->lon) / LST_FINE),
+            s.n_bins - 1);
+    fprintf(out, "same sky (to %.2f degrees) on %d nights\n", LST_FINE,
+            nights[b]);
+    ret = 0;
+
+unlock:
+    pthread_mutex_destroy(&s.lock);
+done:
+    return ret;
+}
+
+/*
+ * figure lines of one site, batched: *pts gets them from the result
+ * cache (rc not NULL) or as projected (then stored).  Afterwards
+ * *map is to be unmapped and *block freed.  returns number of
+ * points, -1 on error
+ */
+static int site_figures(const struct scene_str *sc,
+                        const struct opts_str *opts,
+                        struct res_cache_str *rc,
+                        const struct site_str *site,
+                        const struct sky_str *sky,
+                        const struct fig_pt_str **pts,
+                        struct cache_map_str *map,
+                        struct result_hdr_str **block,
+                        struct arena_str *ar)
+{
+    struct fig_ctx_str fc;
+    struct fig_pt_str *p;
+    char key[SHA256_HEX];
+    size_t len;
+    int n;
+
+    *block = NULL;
+    if (rc != NULL) {
+        result_key(&rc->figs, site, key);
+        if (cache_get(&rc->cache, key, map) == 0) {
+            if (figs_ok(map)) {
+                *pts = (const struct fig_pt_str *)
+                    ((char *)map->data + sizeof(**block));
+                return ((const struct result_hdr_str *)map->data)->n;
+            }
+            cache_unmap(map);
+            cache_reject(&rc->cache, key);
+        }
+    }
+
+    fc.sc = sc;
+    fc.room = &site->room;
+    fc.sky = sky;
+    n = fig_project(&sc->figs, fig_proj, &fc, opts->fig_tol, &p);
+    if (n < 0)
+        return -1;
+    /* header and points in one block, stored as is */
+    len = sizeof(**block) + n * sizeof(*p);
+    *block = arena_calloc(ar, 1, len + sizeof(*p));
+    if (*block == NULL) {
+        free(p);
+        return -1;
+    }
+    memcpy((*block)->magic, figs_magic, sizeof((*block)->magic));
+    (*block)->version = RESULT_VERSION;
+    (*block)->dot_size = sizeof(*p);
+    (*block)->n = n;
+    if (n > 0)
+        memcpy(*block + 1, p, n * sizeof(*p));
+    free(p);
+    if (rc != NULL)
+        cache_put(&rc->cache, key, *block, len);
+    *pts = (const struct fig_pt_str *)(*block + 1);
+    return n;
+}
+
+/*
+ * projection stage: cull and project catalog entries first .. first
+ * + count - 1 for one site, and place them between the viewpoints
+ */
+static void project_site(const struct cat_str *cat,
+                         const struct cat_zones_str *zones,
+                         const struct scene_str *sc,
+                         const struct site_str *site,
+                         const struct sky_str *sky, struct dot_str *dots,
+                         int first, int count, int n_threads)
+{
+    cull_horizon(cat, zones, &sc->hzn, sky, dots, first, count);
+    project_stars(cat, sc, &site->room, dots, first, count);
+    if (sc->views.n > 0)
+        view_dots(&sc->views, &site->room, dots, first, count, n_threads);
+}
+
+/*
+ * write the listing of a site over its frames as a time series (-Z)
+ * to out, one epoch per frame.  Merging and level of detail apply
+ * to each.  returns -1 on error
+ */
+static int series_site(const struct cat_str *cat,
+                       const struct cat_zones_str *zones,
+                       const struct scene_str *sc,
+                       const struct opts_str *opts,
+                       const struct site_str *site, FILE *out,
+                       struct arena_str *ar)
+{
+    struct site_str at = *site;
+    struct sky_str sky;
+    struct ts_writer_str w;
+    struct ts_rec_str *recs;
+    struct dot_str *dots;
+    int ret = -1;
+    int i, k, n;
+
+    dots = arena_alloc(ar, (cat->n + 1) * sizeof(*dots));
+    recs = arena_alloc(ar, (cat->n + 1) * sizeof(*recs));
+    if (dots == NULL || recs == NULL
+        || ts_create(&w, out, cat->n, TS_KEY_EVERY) != 0)
+        return -1;
+
+    for (k = 0; k < opts->frames; k++) {
+        at.t.second = site->t.second + k * opts->frame_step;
+        sky_init(&sky, &at);
+        memset(dots, 0, cat->n * sizeof(*dots));
+        project_site(cat, zones, sc, &at, &sky, dots, 0, cat->n,
+                     opts->threads);
+        if (opts->collide == 2
+            && collide_dots(cat, sc, &site->room, out, dots, opts->gap,
+                            1, ar) < 0)
+            goto done;
+        if ((opts->lod > 0.0 || opts->lod_ang > 0.0)
+            && lod_dots(cat, sc, &site->room, dots, opts->lod,
+                        opts->lod_ang, ar) < 0)
+            goto done;
+        for (i = 0, n = 0; i < cat->n; i++) {
+            const struct dot_str *dot = &dots[i];
+            struct ts_rec_str *rec = &recs[n];
+
+            if (dot->drop != DROP_NONE)
+                continue;
+            rec->i = i;
+            rec->id = cat->star[i].id;
+            rec->v[TS_AZ] = dot->pos.az;
+            rec->v[TS_ALT] = dot->pos.alt;
+            rec->v[TS_EAST] = dot->east;
+            rec->v[TS_NORTH] = dot->north;
+            rec->v[TS_DN] = dot->dn;
+            rec->v[TS_DS] = dot->ds;
+            rec->v[TS_VMAG] = dot->vmag;
+            rec->v[TS_DIA] = dot->dia;
+            rec->v[TS_WN] = dot->wn;
+            rec->v[TS_WS] = dot->ws;
+            n++;
+        }
+        if (ts_put_epoch(&w, ephCalcJD(&at.t), recs, n) != 0)
+            goto done;
+    }
+    n = w.n_epochs;
+    if (ts_finish(&w) != 0)
+        return -1;
+    fprintf(stderr, "%s%s%d epochs, %lld dots in %lld bytes"
+            " (%.1f a dot)\n", site->name, (site->name[0] != '\0') ? ": "
+            : "", n, w.n_recs, w.pos,
+            (w.n_recs > 0) ? (double)w.pos / w.n_recs : 0.0);
+    return 0;
+
+done:
+    ts_finish(&w);
+    return ret;
+}
+
+/*
+ * project the catalog for one site and write the chosen output to
+ * out (SVG stencil pages go to files named after prefix).  With a
+ * result cache (rc not NULL) the projection is looked up first and
+ * stored after.  done, if not NULL, is the projection stage already
+ * run (by shard workers).  Working memory comes from ar, for the
+ * caller to reset between sites.  returns -1 on error
+ */
+static int run_site(const struct cat_str *cat,
+                    const struct cat_zones_str *zones,
+                    const struct scene_str *sc,
+                    const struct opts_str *opts,
+                    struct res_cache_str *rc,
+                    const struct site_str *site,
+                    const struct dot_str *done, FILE *out,
+                    const char *prefix,
+                    struct arena_str *ar)
+{
+    struct sky_str sky;
+    struct result_hdr_str *hdr = NULL;
+    struct result_hdr_str *fig_hdr = NULL;
+    struct dot_str *dots = NULL;
+    const struct fig_pt_str *pts = NULL;
+    struct cache_map_str map = {NULL, 0};
+    struct cache_map_str fig_map = {NULL, 0};
+    char key[SHA256_HEX];
+    size_t len = sizeof(*hdr) + cat->n * sizeof(*dots);
+    int n_pts = 0;
+    int ret = 0;
+
+    if (opts->goal != NULL)
+        return search_site(cat, zones, sc, opts, site, out, ar);
+    if (opts->fisheye)
+        return fisheye_site(cat, zones, sc, opts, site, out, ar);
+    if (opts->series)
+        return series_site(cat, zones, sc, opts, site, out, ar);
+
+#if 1
+    if (!opts->plot && !opts->stencil && opts->tol == NULL
+        && opts->photo == NULL && opts->n_looks == 0)
+        fprintf(out, "lat: %f, lon: %f\n", site->lat, site->lon);
+#endif
+
+    sky_init(&sky, site);
+    if (rc != NULL) {
+        result_key(&rc->base, site, key);
+        if (cache_get(&rc->cache, key, &map) == 0) {
+            if (result_ok(&map, cat->n)) {
+                dots = (struct dot_str *)((char *)map.data + sizeof(*hdr));
+            } else {
+                cache_unmap(&map);
+                cache_reject(&rc->cache, key);
+            }
+        }
+    }
+
+    if (dots == NULL) {
+        /* header and dots in one block, stored as is */
+        hdr = arena_calloc(ar, 1, len + sizeof(*dots));
+        if (hdr == NULL)
+            return -1;
+        memcpy(hdr->magic, result_magic, sizeof(hdr->magic));
+        hdr->version = RESULT_VERSION;
+        hdr->dot_size = sizeof(*dots);
+        hdr->n = cat->n;
+        dots = (struct dot_str *)(hdr + 1);
+
+        if (done != NULL)
+            memcpy(dots, done, cat->n * sizeof(*dots));
+        else
+            project_site(cat, zones, sc, site, &sky, dots, 0, cat->n,
+                         opts->threads);
+        /* merging looks across the whole catalog */
+        if (opts->collide == 2
+            && collide_dots(cat, sc, &site->room, out, dots, opts->gap,
+                            1, ar) < 0) {
+            ret = -1;
+            goto done;
+        }
+        if (rc != NULL)
+            cache_put(&rc->cache, key, hdr, len);
+    }
+
+    if (sc->views.n > 0)
+        view_report(cat, &sc->views, site, dots, stderr);
+
+    /* figures go to the listing and the plotter */
+    if (sc->figs.n_figs > 0 && !opts->stencil && opts->tol == NULL
+        && opts->photo == NULL && opts->n_looks == 0) {
+        n_pts = site_figures(sc, opts, rc, site, &sky, &pts, &fig_map,
+                             &fig_hdr, ar);
+        if (n_pts < 0) {
+            ret = -1;
+            goto done;
+        }
+    }
+
+    /* level of detail is cut from the full (cached) result */
+    if ((opts->lod > 0.0 || opts->lod_ang > 0.0)
+        && lod_dots(cat, sc, &site->room, dots, opts->lod,
+                    opts->lod_ang, ar) < 0)
+        ret = -1;
+    else if (opts->collide == 1
+             && collide_dots(cat, sc, &site->room, out, dots, opts->gap,
+                             0, ar) < 0)
+        ret = -1;
+    else if (opts->plot)
+        ret = plot_dots(cat, sc, site, out, dots, opts->plot == 2, pts,
+                        n_pts, ar);
+    else if (opts->stencil)
+        ret = stencil_dots(cat, sc, site, out, prefix, dots,
+                           opts->stencil == 2, ar);
+    else if (opts->tol != NULL)
+        ret = tolerance_dots(cat, &site->room, out, dots, opts->tol,
+                             opts->threads, ar);
+    else if (opts->photo != NULL)
+        ret = verify_dots(cat, sc, site, out, dots, opts, ar);
+    else if (opts->n_looks > 0)
+        ret = lookup_dots(cat, sc, site, out, dots, opts, ar);
+    else {
+        print_dots(cat, sc, &sky, out, dots, opts->report);
+        print_figures(sc, &site->room, out, pts, n_pts);
+    }
+
+done:
+    if (map.data != NULL)
+        cache_unmap(&map);
+    if (fig_map.data != NULL)
+        cache_unmap(&fig_map);
+    return ret;
+}
+
+/* run one site of a batch, output to a file named after the site */
+static int batch_site(const struct batch_str *b, const struct site_str *site,
+                      struct arena_str *ar)
+{
+    char path[SITE_NAME_LEN + 8];
+    const char *ext;
+    FILE *out = NULL;
+    int ret;
+
+    if (b->opts->fisheye)
+        ext = ".ppm";
+    else if (b->opts->series)
+        ext = ".apts";
+    else if (b->opts->plot)
+        ext = (b->opts->plot == 2) ? ".plt" : ".ngc";
+    else if (b->opts->stencil)
+        ext = ".ps";
+    else
+        ext = ".txt";
+
+    /* SVG stencil pages are files of their own */
+    if (b->opts->stencil != 2) {
+        snprintf(path, sizeof(path), "%s%s", site->name, ext);
+        out = fopen(path, "w");
+        if (out == NULL) {
+            perror(path);
+            return -1;
+        }
+    }
+    ret = run_site(b->cat, b->zones, b->sc, b->opts, b->rc, site,
+                   (b->done != NULL) ? b->done[site - b->sites] : NULL, out,
+                   site->name, ar);
+    if (out != NULL && fclose(out) != 0)
+        ret = -1;
+    if (ret != 0)
+        fprintf(stderr, "%s: can't write output\n", site->name);
+    return ret;
+}
+
+/* batch thread: take sites off the list until there are none left */
+static void *batch_worker(void *arg)
+{
+    struct batch_str *b = arg;
+    struct arena_str ar;
+    int i;
+
+    /* one arena per worker, reset between sites */
+    arena_init(&ar, b->arena_limit);
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        i = b->next++;
+        pthread_mutex_unlock(&b->lock);
+        if (i >= b->n_sites)
+            break;
+        if (batch_site(b, &b->sites[i], &ar) != 0) {
+            pthread_mutex_lock(&b->lock);
+            b->failed++;
+            pthread_mutex_unlock(&b->lock);
+        }
+        arena_reset(&ar);
+    }
+    pthread_mutex_lock(&b->lock);
+    b->arena_high = MAX(b->arena_high, ar.held);
+    pthread_mutex_unlock(&b->lock);
+    arena_free(&ar);
+    return NULL;
+}
+
+/*
+ * run every site of the batch on up to n_threads threads; the
+ * catalog and scene are shared, read only.  Under a memory budget
+ * the first site is run alone, and as many threads as the budget
+ * holds of what it took run the rest.
+ * returns number of sites that failed
+ */
+static int run_batch(struct batch_str *b, int n_threads)
+{
+    pthread_t *tid;
+    int n = 0;
+    int i;
+
+    n_threads = MAX(1, MIN(n_threads, b->n_sites));
+    pthread_mutex_init(&b->lock, NULL);
+    b->next = 0;
+    b->failed = 0;
+    b->arena_limit = b->mem_avail;
+    if (b->mem_avail > 0 && n_threads > 1) {
+        struct arena_str ar;
+        size_t need;
+
+        arena_init(&ar, b->mem_avail);
+        if (batch_site(b, &b->sites[0], &ar) != 0)
+            b->failed++;
+        b->next = 1;
+        /* libraries allocate outside the arena: leave them a quarter */
+        need = ar.held + ar.held / 4 + 1;
+        b->arena_high = MAX(b->arena_high, ar.held);
+        arena_free(&ar);
+        n_threads = (int)MAX(1, MIN((size_t)n_threads, b->mem_avail / need));
+        b->arena_limit = b->mem_avail / n_threads;
+        fprintf(stderr, "%d threads of %.1f MB each\n", n_threads,
+                b->arena_limit / 1048576.0);
+    }
+    tid = malloc(n_threads * sizeof(*tid));
+    for (i = 0; tid != NULL && i < n_threads; i++)
+        if (pthread_create(&tid[n], NULL, batch_worker, b) == 0)
+            n++;
+    /* no threads to be had: do the work here */
+    if (n == 0)
+        batch_worker(b);
+    for (i = 0; i < n; i++)
+        pthread_join(tid[i], NULL);
+    pthread_mutex_destroy(&b->lock);
+    free(tid);
+    return b->failed;
+}
+
+/* shard worker: project one catalog range of one site */
+static int shard_site(void *ctx, int i)
+{
+    const struct shard_job_str *job = ctx;
+    const struct cat_str *cat = job->cat;
+    const struct site_str *site = job->sites[i / job->n_ranges];
+    int first = (i % job->n_ranges) * job->range;
+    struct sky_str sky;
+
+    sky_init(&sky, site);
+    project_site(cat, job->zones, job->sc, site, &sky,
+                 job->dots + (size_t)(i / job->n_ranges) * cat->n, first,
+                 MIN(job->range, cat->n - first), 1);
+    return 0;
+}
+
+/*
+ * run the sites of b with the projection stage on n_procs worker
+ * processes.  Sites are taken in rounds whose results fit in
+ * SHARD_MB; each site of a round not in the result cache is cut
+ * into catalog ranges, projected by the workers into shared memory.
+ * The outputs are then written here from the merged results: to out
+ * for a single site, else on n_threads threads as a batch.
+ * returns number of sites that failed
+ */
+static int run_sharded(struct batch_str *b, int n_procs, int n_threads,
+                       FILE *out)
+{
+    const struct cat_str *cat = b->cat;
+    struct shard_job_str job;
+    size_t site_len = (cat->n + 1) * sizeof(struct dot_str);
+    /* under a budget, half of it holds a round's results */
+    size_t fit = ((b->mem_avail > 0) ? b->mem_avail / 2
+                  : (size_t)SHARD_MB * 1048576) / site_len;
+    int per_round = (int)MIN((size_t)b->n_sites, MAX(fit, (size_t)1));
+    size_t mem_avail = b->mem_avail;
+    struct arena_str ar;
+    const struct site_str *sites = b->sites;
+    int n_sites = b->n_sites;
+    int failed = 0;
+    int r0, n, k;
+
+    job.cat = cat;
+    job.zones = b->zones;
+    job.sc = b->sc;
+    job.range = MAX(b->shard_min, (cat->n + n_procs - 1) / n_procs);
+    job.n_ranges = MAX(1, (cat->n + job.range - 1) / job.range);
+    job.sites = malloc(per_round * sizeof(*job.sites));
+    b->done = malloc(per_round * sizeof(*b->done));
+    b->mem_avail = (mem_avail > 0) ? mem_avail / 2 : 0;
+    arena_init(&ar, b->mem_avail);
+    if (job.sites == NULL || b->done == NULL) {
+        failed = n_sites;
+        goto done;
+    }
+
+    for (r0 = 0; r0 < n_sites; r0 += per_round) {
+        int n_proj = 0;
+        int j;
+
+        n = MIN(per_round, n_sites - r0);
+        for (k = 0; k < n; k++) {
+            const struct site_str *site = &sites[r0 + k];
+            char key[SHA256_HEX];
+
+            b->done[k] = NULL;
+            if (b->rc != NULL) {
+                result_key(&b->rc->base, site, key);
+                if (cache_has(&b->rc->cache, key))
+                    continue;
+            }
+            job.sites[n_proj++] = site;
+        }
+
+        /* fresh pages each round, first touched by the workers */
+        job.dots = shard_alloc(n_proj * site_len);
+        if (job.dots == NULL
+            || shard_run(n_procs, n_proj * job.n_ranges, shard_site,
+                         &job) != 0) {
+            fprintf(stderr, "shard workers failed\n");
+            shard_free(job.dots, n_proj * site_len);
+            failed += n;
+            continue;
+        }
+        for (k = 0, j = 0; k < n && j < n_proj; k++)
+            if (job.sites[j] == &sites[r0 + k])
+                b->done[k] = job.dots + (size_t)(j++) * cat->n;
+
+        if (out != NULL) {
+            if (run_site(cat, b->zones, b->sc, b->opts, b->rc, &sites[r0],
+                         b->done[0], out, "stencil", &ar) != 0)
+                failed++;
+            b->arena_high = MAX(b->arena_high, ar.held);
+            arena_reset(&ar);
+        } else {
+            b->sites = &sites[r0];
+            b->n_sites = n;
+            failed += run_batch(b, n_threads);
+        }
+        shard_free(job.dots, n_proj * site_len);
+    }
+
+done:
+    b->sites = sites;
+    b->n_sites = n_sites;
+    b->mem_avail = mem_avail;
+    arena_free(&ar);
+    free(b->done);
+    b->done = NULL;
+    free(job.sites);
+    return failed;
+}
+
+/* monotonic clock, seconds */
+static double tune_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* what was painted, and where */
+static void tune_summary(const struct cat_str *cat,
+                         const struct dot_str *dots, struct tune_sum_str *s)
+{
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    for (i = 0; i < cat->n; i++) {
+        if (dots[i].drop != DROP_NONE)
+            continue;
+        s->n++;
+        s->hash = s->hash * 31u + (unsigned)i;
+        s->east += dots[i].east;
+        s->north += dots[i].north;
+        s->dia += dots[i].dia;
+    }
+}
+
+/* n epochs painted alike: same dots, sums within TUNE_TOL */
+static int tune_agree(const struct tune_sum_str *a,
+                      const struct tune_sum_str *b, int n)
+{
+    int k;
+
+    for (k = 0; k < n; k++)
+        if (a[k].n != b[k].n || a[k].hash != b[k].hash
+            || fabs(a[k].east - b[k].east) > TUNE_TOL * (1.0 + fabs(a[k].east))
+            || fabs(a[k].north - b[k].north)
+            > TUNE_TOL * (1.0 + fabs(a[k].north))
+            || fabs(a[k].dia - b[k].dia) > TUNE_TOL * (1.0 + a[k].dia))
+            return 0;
+    return 1;
+}
+
+/*
+ * fastest of TUNE_REPS runs projecting the epochs of job one after
+ * another, each site's catalog split over n_threads threads as a
+ * single site's frame is (opts.threads), seconds.  returns -1 on error
+ */
+static double tune_threads(struct tune_job_str *job, int n_threads)
+{
+    const struct cat_str *cat = job->cat;
+    struct dot_str *dots = malloc((cat->n + 1) * sizeof(*dots));
+    struct sky_str sky;
+    double best = HUGE_VAL;
+    double t0;
+    int r, i;
+
+    if (dots == NULL)
+        return -1.0;
+    for (r = 0; r < TUNE_REPS; r++) {
+        t0 = tune_now();
+        for (i = 0; i < job->n_sites; i++) {
+            sky_init(&sky, &job->sites[i]);
+            memset(dots, 0, cat->n * sizeof(*dots));
+            project_site(cat, job->zones, job->sc, &job->sites[i], &sky,
+                         dots, 0, cat->n, n_threads);
+            tune_summary(cat, dots, &job->sum[i]);
+        }
+        best = MIN(best, tune_now() - t0);
+    }
+    free(dots);
+    return best;
+}
+
+/*
+ * same, the epochs cut into shards of at least shard_min catalog
+ * entries run on n_procs worker processes as -P runs them
+ */
+static double tune_procs(struct tune_job_str *job, int n_procs,
+                         int shard_min)
+{
+    const struct cat_str *cat = job->cat;
+    struct shard_job_str sj;
+    size_t len = (size_t)job->n_sites * cat->n * sizeof(struct dot_str);
+    double best = HUGE_VAL;
+    double t0;
+    int r, k;
+
+    sj.cat = cat;
+    sj.zones = job->zones;
+    sj.sc = job->sc;
+    sj.range = MAX(shard_min, (cat->n + n_procs - 1) / n_procs);
+    sj.n_ranges = MAX(1, (cat->n + sj.range - 1) / sj.range);
+    sj.sites = malloc(job->n_sites * sizeof(*sj.sites));
+    if (sj.sites == NULL)
+        return -1.0;
+    for (k = 0; k < job->n_sites; k++)
+        sj.sites[k] = &job->sites[k];
+
+    for (r = 0; r < TUNE_REPS; r++) {
+        t0 = tune_now();
+        sj.dots = shard_alloc(len);
+        if (sj.dots == NULL
+            || shard_run(n_procs, job->n_sites * sj.n_ranges, shard_site,
+                         &sj) != 0) {
+            shard_free(sj.dots, len);
+            best = -1.0;
+            break;
+        }
+        best = MIN(best, tune_now() - t0);
+        for (k = 0; k < job->n_sites; k++)
+            tune_summary(cat, sj.dots + (size_t)k * cat->n, &job->sum[k]);
+        shard_free(sj.dots, len);
+    }
+    free(sj.sites);
+    return best;
+}
+
+/*
+ * measure the projection stage on epochs of site through a sidereal
+ * day: sky cells of the horizon cull on one thread, then thread
+ * counts splitting each epoch's catalog, as viewpoints do, then shard
+ * sizes for -P on a process a processor.  Settings whose results
+ * disagree with the default's are passed over, and one must be
+ * TUNE_GAIN faster than the best so far, starting from the default,
+ * to be chosen.  The choice goes to TUNEFILE in the working
+ * directory, the measurements to out.  returns -1 on error
+ */
+static int tune(const struct cat_str *cat, const struct scene_str *sc,
+                const struct site_str *site, int n_cpus, FILE *out)
+{
+    const int n_cells = sizeof(tune_cells) / sizeof(tune_cells[0]);
+    const int n_shards = sizeof(tune_shards) / sizeof(tune_shards[0]);
+    struct tune_job_str job;
+    struct cat_zones_str zones;
+    struct tune_sum_str *ref;
+    struct site_str *sites;
+    struct tune_str prof;
+    char note[128];
+    double t_cell[sizeof(tune_cells) / sizeof(tune_cells[0])];
+    int agree[sizeof(tune_cells) / sizeof(tune_cells[0])];
+    int n = MAX(8, MIN(96, TUNE_WORK / MAX(cat->n, 1)));
+    double t, t_cells, t_threads, t_dflt, t_proc, t_proc_dflt;
+    int ret = -1;
+    int i, k, ok, last;
+    FILE *f;
+
+    memset(&zones, 0, sizeof(zones));
+    sites = malloc(n * sizeof(*sites));
+    ref = malloc(n * sizeof(*ref));
+    job.sum = malloc(n * sizeof(*job.sum));
+    if (sites == NULL || ref == NULL || job.sum == NULL)
+        goto done;
+    for (k = 0; k < n; k++) {
+        sites[k] = *site;
+        sites[k].t.second += k * 86164.0905 / n;
+    }
+    job.cat = cat;
+    job.zones = &zones;
+    job.sc = sc;
+    job.sites = sites;
+    job.n_sites = n;
+    fprintf(out, "tune: %d stars, %d epochs from lat %.4f, lon %.4f,"
+            " %d processors\n", cat->n, n, site->lat, site->lon, n_cpus);
+
+    /* the default's results, also warming caches up */
+    prof.cpus = n_cpus;
+    prof.cell_dec = ZONE_DEC;
+    prof.cell_ra = ZONE_RA;
+    if (cat_zones_build(cat, ZONE_DEC, ZONE_RA, &zones) != 0
+        || tune_threads(&job, 1) < 0.0)
+        goto done;
+    memcpy(ref, job.sum, n * sizeof(*ref));
+
+    /* cull cells on one thread */
+    t_cells = HUGE_VAL;
+    for (i = 0; i < n_cells; i++) {
+        const double *c = tune_cells[i];
+
+        cat_zones_free(&zones);
+        if (cat_zones_build(cat, c[0], c[1], &zones) != 0
+            || (t_cell[i] = tune_threads(&job, 1)) < 0.0)
+            goto done;
+        agree[i] = tune_agree(ref, job.sum, n);
+        fprintf(out, "cull cells %5.1f x %5.1f: %8.2f ms%s\n", c[0], c[1],
+                t_cell[i] * 1e3, !agree[i] ? " (disagrees, not used)"
+                : (c[0] == ZONE_DEC && c[1] == ZONE_RA) ? " (default)" : "");
+        if (c[0] == ZONE_DEC && c[1] == ZONE_RA)
+            t_cells = t_cell[i];
+    }
+    for (i = 0; i < n_cells; i++)
+        if (agree[i] && t_cell[i] * TUNE_GAIN < t_cells) {
+            t_cells = t_cell[i];
+            prof.cell_dec = tune_cells[i][0];
+            prof.cell_ra = tune_cells[i][1];
+        }
+    cat_zones_free(&zones);
+    if (cat_zones_build(cat, prof.cell_dec, prof.cell_ra, &zones) != 0)
+        goto done;
+
+    /*
+     * threads: 1, 2, 4 .. and all the processors.  Only viewpoints
+     * split a site, so without them the default stands
+     */
+    prof.threads = (sc->views.n > 0) ? 1 : n_cpus;
+    t_threads = t_cells;
+    if (sc->views.n == 0)
+        fprintf(out, "threads: no viewpoints to split a site over, %d\n",
+                n_cpus);
+    for (k = 2, last = (n_cpus == 1 || sc->views.n == 0); !last;
+         k = MIN(2 * k, n_cpus)) {
+        last = (k == n_cpus);
+        if ((t = tune_threads(&job, k)) < 0.0)
+            goto done;
+        ok = tune_agree(ref, job.sum, n);
+        fprintf(out, "threads %3d: %8.2f ms%s\n", k, t * 1e3,
+                ok ? "" : " (disagrees, not used)");
+        if (ok && t * TUNE_GAIN < t_threads) {
+            t_threads = t;
+            prof.threads = k;
+        }
+    }
+
+    /* shards for -P: the default size, then larger up to whole sites */
+    prof.shard = SHARD_MIN;
+    t_proc = t_proc_dflt = 0.0;
+    for (i = -1, last = 0; ; i++) {
+        int shard = (i < 0) ? SHARD_MIN
+            : (i < n_shards) ? tune_shards[i] : cat->n;
+        int range = MAX(shard, (cat->n + n_cpus - 1) / n_cpus);
+
+        if (i < 0 || (shard > SHARD_MIN && range > last)) {
+            if ((t = tune_procs(&job, n_cpus, shard)) < 0.0)
+                goto done;
+            ok = tune_agree(ref, job.sum, n);
+            fprintf(out, "shards of %7d, %d a site, on %d processes:"
+                    " %8.2f ms%s\n", MIN(range, cat->n),
+                    (cat->n + range - 1) / range, n_cpus, t * 1e3,
+                    ok ? "" : " (disagrees, not used)");
+            if (i < 0)
+                t_proc = t_proc_dflt = t;
+            else if (ok && t * TUNE_GAIN < t_proc) {
+                t_proc = t;
+                prof.shard = shard;
+            }
+            last = range;
+        }
+        if (range >= cat->n || i >= n_shards)
+            break;
+    }
+
+    /* the choice against a run with no profile, back to back */
+    if ((t_threads = tune_threads(&job, prof.threads)) < 0.0)
+        goto done;
+    cat_zones_free(&zones);
+    if (cat_zones_build(cat, ZONE_DEC, ZONE_RA, &zones) != 0
+        || (t_dflt = tune_threads(&job, n_cpus)) < 0.0)
+        goto done;
+
+    fprintf(out, "chosen: cells %g x %g, %d threads a site, shards of at"
+            " least %d (-P)\n", prof.cell_dec, prof.cell_ra, prof.threads,
+            prof.shard);
+    fprintf(out, "speedup: %.2fx over cells %g x %g on %d threads,"
+            " -P %.2fx\n", t_dflt / t_threads, ZONE_DEC, ZONE_RA, n_cpus,
+            t_proc_dflt / t_proc);
+    snprintf(note, sizeof(note), "astroplane --tune: %d stars, %d epochs",
+             cat->n, n);
+    f = fopen(TUNEFILE, "w");
+    if (f == NULL) {
+        perror(TUNEFILE);
+        goto done;
+    }
+    if ((tune_write(f, &prof, note) != 0) | (fclose(f) != 0)) {
+        perror(TUNEFILE);
+        goto done;
+    }
+    fprintf(out, "profile: %s in the working directory\n", TUNEFILE);
+    ret = 0;
+
+done:
+    cat_zones_free(&zones);
+    free(sites);
+    free(ref);
+    free(job.sum);
+    return ret;
+}
+
+/*
+ * parse "query lat lon yyyy-mm-dd hh:mm:ss ceil wall ns ew maglim",
+ * returns -1 on error
+ */
+static int read_query(const char *line, struct query_str *q)
+{
+    struct site_str *site = &q->site;
+    struct ymdhms *t = &site->t;
+    struct room_str *room = &site->room;
+    int end = -1;
+
+    memset(q, 0, sizeof(*q));
+    if (sscanf(line, "query %lf %lf %d-%d-%d %d:%d:%lf %lf %lf %lf %lf %lf %n",
+               &site->lat, &site->lon, &t->year, &t->month, &t->day,
+               &t->hour, &t->minute, &t->second, &room->ceil, &room->wall,
+               &room->ns, &room->ew, &q->maglim, &end) != 13
+        || line[end] != '\0')
+        return -1;
+    if (fabs(site->lat) > 90.0 || fabs(site->lon) > 360.0
+        || t->month < 1 || t->month > 12 || t->day < 1 || t->day > 31
+        || room->ceil <= 0.0 || room->ns <= 0.0 || room->ew <= 0.0)
+        return -1;
+    snprintf(q->sky_key, sizeof(q->sky_key),
+             "%.6f %.6f %04d-%02d-%02d %02d:%02d:%06.3f", site->lat,
+             site->lon, t->year, t->month, t->day, t->hour, t->minute,
+             t->second);
+    snprintf(q->key, sizeof(q->key), "%s %.3f %.3f %.3f %.3f", q->sky_key,
+             room->ceil, room->wall, room->ns, room->ew);
+    return 0;
+}
+
+/*
+ * listing of the painted dots for a query, from the horizon cull of
+ * its sky (base).  returns -1 on error
+ */
+static int query_dots(struct serve_str *sv, const struct query_str *q,
+                      const struct dot_str *base, char **buf, size_t *len)
+{
+    const struct cat_str *cat = sv->cat;
+    const struct room_str *room = &q->site.room;
+    struct arena_mark_str mark;
+    struct dot_str *dots;
+    FILE *out = NULL;
+    int ret = -1;
+    int i;
+
+    /* the sky's base stays, the room's projection goes */
+    arena_mark(&sv->ar, &mark);
+    dots = arena_alloc(&sv->ar, cat->n * sizeof(*dots));
+    if (dots == NULL)
+        goto done;
+    memcpy(dots, base, cat->n * sizeof(*dots));
+    project_stars(cat, sv->sc, room, dots, 0, cat->n);
+    if (sv->sc->views.n > 0)
+        view_dots(&sv->sc->views, room, dots, 0, cat->n, sv->opts->threads);
+    if (sv->opts->collide == 2
+        && collide_dots(cat, sv->sc, room, stderr, dots, sv->opts->gap,
+                        1, &sv->ar) < 0)
+        goto done;
+
+    out = open_memstream(buf, len);
+    if (out == NULL)
+        goto done;
+    for (i = 0; i < cat->n; i++)
+        if (dots[i].drop == DROP_NONE)
+            print_dot(cat, sv->sc, out, i, &dots[i]);
+    ret = (fclose(out) == 0) ? 0 : -1;
+
+done:
+    arena_release(&sv->ar, &mark);
+    return ret;
+}
+
+/* reply "ok length" and the text, or "err reason" if it is NULL */
+static void set_reply(struct query_str *q, const char *text, size_t len,
+                      const char *err)
+{
+    char *buf;
+    int n;
+
+    free(q->reply);
+    q->reply = NULL;
+    q->n_reply = 0;
+    if (text == NULL) {
+        buf = malloc(strlen(err) + 6);
+        if (buf == NULL)
+            return;
+        q->n_reply = sprintf(buf, "err %s\n", err);
+        q->reply = buf;
+        return;
+    }
+    buf = malloc(len + 32);
+    if (buf == NULL)
+        return;
+    n = sprintf(buf, "ok %zu\n", len);
+    memcpy(buf + n, text, len);
+    q->reply = buf;
+    q->n_reply = n + len;
+}
+
+/* answer query from the full listing: the lines down to its magnitude */
+static void reply_query(struct query_str *q, const char *list, size_t len)
+{
+    const char *p = list, *end = list + len;
+    char *buf = malloc(len + 1);
+    size_t n = 0;
+
+    if (buf == NULL)
+        return;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        size_t k = (eol != NULL) ? (size_t)(eol - p) + 1 : (size_t)(end - p);
+        double vmag;
+
+        /* second column is the magnitude */
+        if (sscanf(p, "%*d %lf", &vmag) == 1 && vmag <= q->maglim) {
+            memcpy(buf + n, p, k);
+            n += k;
+        }
+        p += k;
+    }
+    set_reply(q, buf, n, NULL);
+    free(buf);
+}
+
+/* server, cache and sharing statistics */
+static void reply_stats(struct serve_str *sv, const struct srv_str *srv,
+                        struct query_str *q)
+{
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&buf, &len);
+
+    if (out == NULL)
+        return;
+    srv_stats(srv, out);
+    lru_report(&sv->lru, out);
+    fprintf(out, "skies culled: %ld, rooms projected: %ld\n", sv->n_culls,
+            sv->n_projs);
+    if (fclose(out) == 0)
+        set_reply(q, buf, len, NULL);
+    free(buf);
+}
+
+/*
+ * answer n query lines, in order.  Queries of the same sky (site and
+ * epoch) share one horizon cull, and those of the same room as well
+ * share one projection, looked up in and kept in the LRU
+ */
+static void serve_queries(struct serve_str *sv, struct srv_str *srv,
+                          const struct srv_req_str *req, int n)
+{
+    const struct cat_str *cat = sv->cat;
+    struct query_str *q = malloc((n + 1) * sizeof(*q));
+    int i, j, k;
+
+    if (q == NULL) {
+        for (i = 0; i < n; i++)
+            srv_reply(srv, &req[i], no_mem, sizeof(no_mem) - 1);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        if (read_query(req[i].line, &q[i]) != 0) {
+            set_reply(&q[i], NULL, 0, "bad query");
+            q[i].done = 1;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        struct dot_str *base = NULL;
+
+        if (q[i].done)
+            continue;
+        for (j = i; j < n; j++) {
+            const char *list;
+            char *buf = NULL;
+            size_t len;
+
+            if (q[j].done || strcmp(q[j].sky_key, q[i].sky_key) != 0)
+                continue;
+            list = lru_get(&sv->lru, q[j].key, &len);
+            if (list == NULL && base == NULL) {
+                struct sky_str sky;
+
+                base = arena_calloc(&sv->ar, cat->n, sizeof(*base));
+                if (base != NULL) {
+                    sky_init(&sky, &q[j].site);
+                    cull_horizon(cat, sv->zones, &sv->sc->hzn, &sky, base,
+                                 0, cat->n);
+                    sv->n_culls++;
+                }
+            }
+            if (list == NULL && base != NULL
+                && query_dots(sv, &q[j], base, &buf, &len) == 0) {
+                sv->n_projs++;
+                lru_put(&sv->lru, q[j].key, buf, len);
+                list = buf;
+            }
+
+            /* everyone asking for this room and sky */
+            for (k = j; k < n; k++) {
+                if (q[k].done || strcmp(q[k].key, q[j].key) != 0)
+                    continue;
+                if (list != NULL)
+                    reply_query(&q[k], list, len);
+                q[k].done = 1;
+            }
+            free(buf);
+        }
+        arena_reset(&sv->ar);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (q[i].reply != NULL)
+            srv_reply(srv, &req[i], q[i].reply, q[i].n_reply);
+        else
+            srv_reply(srv, &req[i], no_mem, sizeof(no_mem) - 1);
+        free(q[i].reply);
+    }
+    free(q);
+}
+
+/*
+ * answer a batch of request lines, in order: the queries between
+ * one "stats" and the next together, then the stats, which so count
+ * everything asked before them
+ */
+static void serve_batch(void *ctx, struct srv_str *srv,
+                        const struct srv_req_str *req, int n)
+{
+    struct serve_str *sv = ctx;
+    struct query_str q;
+    int i, first;
+
+    for (i = first = 0; i <= n; i++) {
+        if (i < n && strcmp(req[i].line, "stats") != 0)
+            continue;
+        if (i > first)
+            serve_queries(sv, srv, req + first, i - first);
+        first = i + 1;
+        if (i == n)
+            break;
+        memset(&q, 0, sizeof(q));
+        reply_stats(sv, srv, &q);
+        if (q.reply != NULL)
+            srv_reply(srv, &req[i], q.reply, q.n_reply);
+        else
+            srv_reply(srv, &req[i], no_mem, sizeof(no_mem) - 1);
+        free(q.reply);
+    }
+}
+
+/*
+ * keep the catalog and scene loaded and answer queries on socket
+ * path until SIGINT or SIGTERM, with up to max_bytes of recent
+ * listings kept.  returns -1 on error
+ */
+static int serve(const struct cat_str *cat, const struct cat_zones_str *zones,
+                 const struct scene_str *sc, const struct opts_str *opts,
+                 const char *path, size_t max_bytes)
+{
+    static struct serve_str sv;
+    static struct srv_str srv;
+    int ret;
+
+    sv.cat = cat;
+    sv.zones = zones;
+    sv.sc = sc;
+    sv.opts = opts;
+    arena_init(&sv.ar, 0);
+    if (lru_init(&sv.lru, max_bytes) != 0)
+        return -1;
+    if (srv_open(&srv, path) != 0) {
+        perror(path);
+        lru_free(&sv.lru);
+        return -1;
+    }
+    fprintf(stderr, "listening on %s\n", path);
+    ret = srv_run(&srv, serve_batch, &sv);
+    srv_stats(&srv, stderr);
+    lru_report(&sv.lru, stderr);
+    fprintf(stderr, "skies culled: %ld, rooms projected: %ld, arena"
+            " %.1f MB\n", sv.n_culls, sv.n_projs, sv.ar.held / 1048576.0);
+    srv_close(&srv);
+    lru_free(&sv.lru);
+    arena_free(&sv.ar);
+    return ret;
+}
+
+
+/* M A I N */
+int main(int argc, char *argv[])
+{
+    FILE *starfile;
+    FILE *posnfile;
+    FILE *in;
+    /* single site: latlon.dat (or default) at the fixed time, UTC */
+    struct site_str here = {"", DFLT_LAT, DFLT_LON,
+                            {PLOTYEAR, PLOTMONTH, PLOTDAY,
+                             PLOTHOUR, PLOTMINUTE, PLOTSECOND},
+                            {OBS_TO_CEIL, OBS_TO_WALL, ROOM_NS, ROOM_EW}};
+    struct site_str *sites = NULL;
+    int n_sites = 0;
+    struct cat_str cat;
+    struct cat_zones_str zones;
+    static struct scene_str scene;
+    struct opts_str opts = {0, 0, 0.0, 0, 0, 0.0, 0.0, 0, 1, 0.0, 0, NULL,
+                            NULL, 1, FIG_TOL, NULL, PHOTO_TOL, PHOTO_FAR,
+                            NULL, 0};
+    struct pv_blobs_str photo;
+    struct look_str looks[MAX_LOOKS];
+    struct tol_str tol;
+    struct goal_str goal;
+    const char *objective = "flux";
+    struct batch_str batch;
+    static struct res_cache_str rcache;
+    struct res_cache_str *rc = NULL;
+    const char *cachedir = NULL;
+    double cache_mb = CACHE_MB;
+    const char *surffile = NULL;
+    const char *occfile = NULL;
+    const char *hznfile = NULL;
+    const char *sitefile = NULL;
+    const char *viewfile = NULL;
+    const char *figfile = NULL;
+    const char *catfile = NULL;
+    const char *sockpath = NULL;
+    double mem_mb = 0.0;
+    size_t mem_base = 0;
+    struct arena_str ar;
+    int n_procs = 0;
+    double epoch;
+    int n_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int n_threads = 0;
+    int split;
+    struct tune_str prof;
+    int tune_run = 0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "a:C:c:D:E:F:f:G:H:j:k:L:l:M:m:O:o:P:p:Q:rS:s:T:t:V:X:x:Z", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'C':
+            cachedir = optarg;
+            break;
+        case 'L':
+            cache_mb = atof(optarg);
+            if (cache_mb <= 0.0)
+                usage(argv[0]);
+            break;
+        case 'k':
+            catfile = optarg;
+            break;
+        case 'M':
+            mem_mb = atof(optarg);
+            if (mem_mb <= 0.0)
+                usage(argv[0]);
+            break;
+        case 'D':
+            sockpath = optarg;
+            break;
+        case 'f':
+            opts.fisheye = atoi(optarg);
+            if (opts.fisheye < 1)
+                usage(argv[0]);
+            break;
+        case 'Z':
+            opts.series = 1;
+            break;
+        case 'a':
+            if (sscanf(optarg, "%d,%lf", &opts.frames,
+                       &opts.frame_step) != 2 || opts.frames < 1)
+                usage(argv[0]);
+            break;
+        case 'l':
+            /* trailing 'd': degrees, else mm */
+            if (optarg[0] != '\0' && optarg[strlen(optarg) - 1] == 'd')
+                opts.lod_ang = atof(optarg);
+            else
+                opts.lod = atof(optarg);
+            if (opts.lod <= 0.0 && opts.lod_ang <= 0.0)
+                usage(argv[0]);
+            break;
+        case 'S':
+            sitefile = optarg;
+            break;
+        case 'V':
+            viewfile = optarg;
+            break;
+        case 'E':
+            if (read_range(optarg, &goal) != 0)
+                usage(argv[0]);
+            opts.goal = &goal;
+            break;
+        case 'O':
+            objective = optarg;
+            break;
+        case 'F':
+            figfile = optarg;
+            break;
+        case 'G':
+            opts.fig_tol = atof(optarg);
+            if (opts.fig_tol <= 0.0)
+                usage(argv[0]);
+            break;
+        case 'T':
+            in = open_arg(optarg);
+            if (tol_read(in, &tol) != 0) {
+                fprintf(stderr, "%s: bad tolerance description\n", optarg);
+                exit(1);
+            }
+            fclose(in);
+            opts.tol = &tol;
+            break;
+        case 'X':
+            in = open_arg(optarg);
+            if (pv_read_blobs(in, &photo) != 0) {
+                fprintf(stderr, "%s: bad blob list\n", optarg);
+                exit(1);
+            }
+            fclose(in);
+            opts.photo = &photo;
+            break;
+        case 'x':
+            if (sscanf(optarg, "%lf,%lf", &opts.photo_tol,
+                       &opts.photo_far) < 1 || opts.photo_tol <= 0.0
+                || opts.photo_far < opts.photo_tol)
+                usage(argv[0]);
+            break;
+        case 'Q':
+            if (opts.n_looks == MAX_LOOKS
+                || read_look(optarg, &looks[opts.n_looks]) != 0)
+                usage(argv[0]);
+            opts.looks = looks;
+            opts.n_looks++;
+            break;
+        case 'j':
+            n_threads = atoi(optarg);
+            if (n_threads < 1)
+                usage(argv[0]);
+            break;
+        case 'P':
+            n_procs = atoi(optarg);
+            if (n_procs < 1)
+                usage(argv[0]);
+            break;
+        case 't':
+            if (strcmp(optarg, "ps") == 0)
+                opts.stencil = 1;
+            else if (strcmp(optarg, "svg") == 0)
+                opts.stencil = 2;
+            else
+                usage(argv[0]);
+            break;
+        case 'p':
+            if (strcmp(optarg, "gcode") == 0)
+                opts.plot = 1;
+            else if (strcmp(optarg, "hpgl") == 0)
+                opts.plot = 2;
+            else
+                usage(argv[0]);
+            break;
+        case 'c':
+        case 'm':
+            opts.collide = (opt == 'c') ? 1 : 2;
+            opts.gap = atof(optarg);
+            break;
+        case 'H':
+            hznfile = optarg;
+            break;
+        case 'o':
+            occfile = optarg;
+            break;
+        case 'r':
+            opts.report = 1;
+            break;
+        case 's':
+            surffile = optarg;
+            break;
+        case OPT_TUNE:
+            tune_run = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    /* tolerances, viewpoints and searches are of the ceiling layout */
+    if ((opts.tol != NULL || viewfile != NULL || opts.goal != NULL)
+        && surffile != NULL)
+        usage(argv[0]);
+    if (opts.goal != NULL && read_objective(objective, &goal) != 0)
+        usage(argv[0]);
+    /* a series holds ceiling listings, nothing else */
+    if (opts.series
+        && (surffile != NULL || opts.goal != NULL || opts.fisheye
+            || opts.collide == 1 || opts.plot || opts.stencil
+            || opts.tol != NULL || opts.photo != NULL || opts.n_looks > 0))
+        usage(argv[0]);
+    /* worker processes run the projection stage of listings, plots */
+    if (n_procs > 0
+        && (sockpath != NULL || opts.goal != NULL || opts.fisheye
+            || opts.series))
+        usage(argv[0]);
+    /* the server answers with listings of one site at a time */
+    if (sockpath != NULL
+        && (sitefile != NULL || opts.goal != NULL || opts.fisheye
+            || opts.series || opts.plot || opts.stencil || opts.tol != NULL
+            || opts.photo != NULL || opts.n_looks > 0))
+        usage(argv[0]);
+    /* tuning measures the projection stage, and does nothing else */
+    if (tune_run
+        && (sockpath != NULL || opts.goal != NULL || opts.series
+            || n_procs > 0 || n_threads > 0 || cachedir != NULL))
+        usage(argv[0]);
+
+    /* what --tune found fastest here, unless tuning again */
+    n_cpus = MAX(n_cpus, 1);
+    prof.cpus = n_cpus;
+    prof.cell_dec = ZONE_DEC;
+    prof.cell_ra = ZONE_RA;
+    prof.threads = n_cpus;
+    prof.shard = SHARD_MIN;
+    if (!tune_run && (in = fopen(TUNEFILE, "r")) != NULL) {
+        struct tune_str t = prof;
+
+        if (tune_read(in, &t) != 0)
+            fprintf(stderr, "%s: bad profile, not used\n", TUNEFILE);
+        else if (t.cpus != n_cpus)
+            fprintf(stderr, "%s: tuned for %d processors, not used\n",
+                    TUNEFILE, t.cpus);
+        else
+            prof = t;
+        fclose(in);
+    }
+    /* the profile splits a site; -S batches run a site a processor */
+    split = (n_threads > 0) ? n_threads : prof.threads;
+    if (n_threads == 0)
+        n_threads = n_cpus;
+
+    if (viewfile != NULL) {
+        in = open_arg(viewfile);
+        if (vp_read(in, &scene.views) != 0) {
+            fprintf(stderr, "%s: bad viewpoint list\n", viewfile);
+            exit(1);
+        }
+        fclose(in);
+    }
+
+    if (surffile != NULL) {
+        in = open_arg(surffile);
+        scene.n_surfs = srf_read(in, &scene.surfs);
+        fclose(in);
+        if (scene.n_surfs < 0) {
+            fprintf(stderr, "%s: bad surface description\n", surffile);
+            exit(1);
+        }
+    }
+
+    if (occfile != NULL) {
+        in = open_arg(occfile);
+        if (occ_read(in, &scene.occ) != 0) {
+            fprintf(stderr, "%s: bad occluder description\n", occfile);
+            exit(1);
+        }
+        fclose(in);
+    }
+
+    /* a fisheye frame goes down to the horizon, unless told otherwise */
+    hzn_const(&scene.hzn, opts.fisheye ? 0.0 : ALT_MIN);
+    if (hznfile != NULL) {
+        in = open_arg(hznfile);
+        if (hzn_read(in, &scene.hzn) != 0) {
+            fprintf(stderr, "%s: bad horizon profile\n", hznfile);
+            exit(1);
+        }
+        fclose(in);
+    }
+
+    if (sitefile != NULL) {
+        in = open_arg(sitefile);
+        n_sites = site_read(in, &dflt_room, &sites);
+        fclose(in);
+        if (n_sites <= 0) {
+            fprintf(stderr, "%s: bad site list\n", sitefile);
+            exit(1);
+        }
+    } else {
+        /* read in latitude, longitude */
+        posnfile = fopen(POSNFILE, "r");
+        if (posnfile != NULL) {
+            if (read_latlon(posnfile, &here.lat, &here.lon) != 0) {
+                here.lat = DFLT_LAT;
+                here.lon = DFLT_LON;
+            }
+            fclose(posnfile);
+        }
+    }
+
+    /* catalog is read and vectorized once, for all sites */
+    /* worker processes share one copy of it */
+    epoch = (sitefile != NULL) ? sites_epoch(sites, n_sites)
+        : sites_epoch(&here, 1);
+    if (catfile != NULL) {
+        starfile = open_arg(catfile);
+        if ((n_procs > 0 ? cat_load_shared(starfile, &cat)
+             : cat_load(starfile, &cat)) != 0
+            || cat_vectors(&cat, epoch) != 0) {
+            fprintf(stderr, "%s: bad catalog or out of memory\n", catfile);
+            exit(1);
+        }
+    } else {
+        /* built in: nothing to read */
+        starfile = NULL;
+        cat_fixed(&cat, cat_builtin_star, cat_builtin_u, cat_builtin_n);
+    }
+    if (cat_zones_build(&cat, prof.cell_dec, prof.cell_ra, &zones) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    /* figures name catalog stars */
+    if (figfile != NULL) {
+        in = open_arg(figfile);
+        if (fig_read(in, &cat, &scene.figs) != 0) {
+            fprintf(stderr, "%s: bad figure list\n", figfile);
+            exit(1);
+        }
+        fclose(in);
+        if (scene.figs.n_missing > 0)
+            fprintf(stderr, "%s: %d figure stars not in catalog\n", figfile,
+                    scene.figs.n_missing);
+    }
+
+    /* results are keyed by the digest of all their inputs */
+    if (cachedir != NULL) {
+        if (cache_open(&rcache.cache, cachedir,
+                       (long long)(cache_mb * 1048576.0)) != 0) {
+            perror(cachedir);
+            exit(1);
+        }
+        if (result_base(&rcache.base, starfile, &cat, epoch, &scene,
+                        &opts) != 0) {
+            perror(catfile);
+            exit(1);
+        }
+        figs_base(&rcache.figs, &rcache.base, &scene.figs, opts.fig_tol);
+        rc = &rcache;
+    }
+    if (starfile != NULL)
+        fclose(starfile);
+
+    if (opts.goal != NULL && goal_stars(&cat, &goal) != 0)
+        exit(1);
+
+    if (tune_run)
+        exit(tune(&cat, &scene, (sitefile != NULL) ? &sites[0] : &here,
+                  n_cpus, stdout) != 0);
+
+    /* what the catalog, scene and cache took is not the sites' */
+    if (mem_mb > 0.0) {
+        size_t budget = (size_t)(mem_mb * 1048576.0);
+
+        mem_base = arena_rss();
+        if (mem_base >= budget) {
+            fprintf(stderr, "memory budget of %.0f MB is below the"
+                    " %.1f MB the catalog takes\n", mem_mb,
+                    mem_base / 1048576.0);
+            exit(1);
+        }
+        batch.mem_avail = budget - mem_base;
+    } else
+        batch.mem_avail = 0;
+    batch.arena_high = 0;
+    arena_init(&ar, batch.mem_avail);
+
+    /* threads render one frame, or each run a site of the batch */
+    opts.threads = (sitefile != NULL) ? 1 : split;
+    if (sockpath != NULL) {
+        if (serve(&cat, &zones, &scene, &opts, sockpath,
+                  (size_t)(cache_mb * 1048576.0)) != 0)
+            exit(1);
+    } else if (sitefile != NULL || n_procs > 0) {
+        batch.cat = &cat;
+        batch.zones = &zones;
+        batch.sc = &scene;
+        batch.opts = &opts;
+        batch.rc = rc;
+        batch.sites = (sitefile != NULL) ? sites : &here;
+        batch.n_sites = (sitefile != NULL) ? n_sites : 1;
+        batch.done = NULL;
+        batch.shard_min = prof.shard;
+        if (n_procs > 0) {
+            if (run_sharded(&batch, n_procs, n_threads,
+                            (sitefile != NULL) ? NULL : stdout) != 0) {
+                fprintf(stderr, "can't write output\n");
+                exit(1);
+            }
+        } else if (run_batch(&batch, n_threads) != 0)
+            exit(1);
+    } else if (run_site(&cat, &zones, &scene, &opts, rc, &here, NULL, stdout,
+                        "stencil", &ar) != 0) {
+        if (ar.n_fail > 0)
+            fprintf(stderr, "memory budget of %.0f MB is too small\n",
+                    mem_mb);
+        fprintf(stderr, "can't write output\n");
+        exit(1);
+    }
+    if (mem_mb > 0.0)
+        fprintf(stderr, "memory: peak %.1f MB of %.0f MB budget, catalog"
+                " and scene %.1f MB, arena high-water %.1f MB\n",
+                arena_peak_rss() / 1048576.0, mem_mb, mem_base / 1048576.0,
+                MAX(batch.arena_high, ar.held) / 1048576.0);
+    arena_free(&ar);
+    if (rc != NULL) {
+        cache_report(&rc->cache, stderr);
+        cache_close(&rc->cache);
+    }
+
+    free(sites);
+    cat_zones_free(&zones);
+    cat_free(&cat);
+    srf_free(scene.surfs, scene.n_surfs);
+    occ_free(&scene.occ);
+    vp_free(&scene.views);
+    fig_free(&scene.figs);
+    if (opts.goal != NULL) {
+        free(goal.hip);
+        free(goal.req);
     }
-    fclose(starfile);
     exit(0);
 }
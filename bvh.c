@@ -0,0 +1,301 @@
+/*
+ * bounding volume hierarchy module
+ *
+ * Binary tree of axis-aligned boxes over an array of primitives.
+ * Nodes are stored depth first: the left child of an interior node
+ * directly follows it, the right child index is kept in "first".
+ */
+
+#include <stdlib.h>
+#include <float.h>
+
+#include "bvh.h"
+
+#define LEAF_MAX  4             /* max primitives per leaf */
+#define STACK_MAX 64            /* traversal stack depth */
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/* build state */
+struct build_str {
+    struct bvh_str *bvh;
+    const struct bvh_box_str *boxes;
+    struct v3_str *cent;        /* primitive centroids */
+};
+
+/*
+ * private functions
+ */
+
+static double v3_comp(const struct v3_str *v, int axis)
+{
+    return (axis == 0) ? v->x : ((axis == 1) ? v->y : v->z);
+}
+
+/* partially order prims[lo..hi) on centroid axis so that k is in place */
+static void select_kth(int *prims, const struct v3_str *cent,
+                       int lo, int hi, int k, int axis)
+{
+    while (hi - lo > 1) {
+        double pivot = v3_comp(&cent[prims[(lo + hi) / 2]], axis);
+        int i = lo;
+        int j = hi - 1;
+        int t;
+
+        while (i <= j) {
+            while (v3_comp(&cent[prims[i]], axis) < pivot)
+                i++;
+            while (v3_comp(&cent[prims[j]], axis) > pivot)
+                j--;
+            if (i <= j) {
+                t = prims[i];
+                prims[i] = prims[j];
+                prims[j] = t;
+                i++;
+                j--;
+            }
+        }
+        if (k <= j)
+            hi = j + 1;
+        else if (k >= i)
+            lo = i;
+        else
+            return;
+    }
+}
+
+/* build subtree over prims[lo..hi), returns node index */
+static int build_node(struct build_str *b, int lo, int hi)
+{
+    struct bvh_str *bvh = b->bvh;
+    int node = bvh->n_nodes++;
+    struct bvh_node_str *nd = &bvh->nodes[node];
+    struct bvh_box_str cbox;
+    struct v3_str ext;
+    int axis;
+    int mid;
+    int i;
+
+    bvh_box_empty(&nd->box);
+    bvh_box_empty(&cbox);
+    for (i = lo; i < hi; i++) {
+        bvh_box_union(&nd->box, &b->boxes[bvh->prims[i]]);
+        bvh_box_add(&cbox, &b->cent[bvh->prims[i]]);
+    }
+
+    if (hi - lo <= LEAF_MAX) {
+        nd->first = lo;
+        nd->count = hi - lo;
+        return node;
+    }
+
+    /* split at the median of the widest centroid axis */
+    ext = cbox.hi;
+    v3_sub(&ext, &cbox.lo);
+    axis = (ext.x >= ext.y && ext.x >= ext.z) ? 0 : ((ext.y >= ext.z) ? 1 : 2);
+    mid = (lo + hi) / 2;
+    select_kth(bvh->prims, b->cent, lo, hi, mid, axis);
+
+    nd->count = 0;
+    build_node(b, lo, mid);
+    /* nodes array is not reallocated, so nd is still valid */
+    nd->first = build_node(b, mid, hi);
+
+    return node;
+}
+
+static void inv_dir(const struct v3_str *u, struct v3_str *inv_u)
+{
+    inv_u->x = (u->x != 0.0) ? 1.0 / u->x : DBL_MAX;
+    inv_u->y = (u->y != 0.0) ? 1.0 / u->y : DBL_MAX;
+    inv_u->z = (u->z != 0.0) ? 1.0 / u->z : DBL_MAX;
+}
+
+/* distance of box center along ray direction */
+static double box_depth(const struct bvh_box_str *b,
+                        const struct v3_str *p, const struct v3_str *u)
+{
+    struct v3_str c = b->lo;
+
+    v3_add(&c, &b->hi);
+    v3_mul(&c, 0.5);
+    v3_sub(&c, p);
+    return v3_dot(&c, u);
+}
+
+/* shared traversal: any != 0 returns on the first hit */
+static int traverse(const struct bvh_str *bvh,
+                    const struct v3_str *p, const struct v3_str *u,
+                    double *t_max, bvh_hit_fn hit, void *ctx, int any)
+{
+    int stack[STACK_MAX];
+    int sp = 0;
+    int found = -1;
+    struct v3_str inv_u;
+
+    if (bvh->n_nodes == 0)
+        return -1;
+
+    inv_dir(u, &inv_u);
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const struct bvh_node_str *nd = &bvh->nodes[stack[--sp]];
+        int left, right;
+        int i;
+
+        if (!bvh_box_hit(&nd->box, p, &inv_u, *t_max))
+            continue;
+
+        if (nd->count > 0) {
+            for (i = nd->first; i < nd->first + nd->count; i++)
+                if (hit(ctx, bvh->prims[i], p, u, t_max)) {
+                    found = bvh->prims[i];
+                    if (any)
+                        return found;
+                }
+            continue;
+        }
+
+        /* push the far child first so the near one is visited next */
+        if (sp + 2 > STACK_MAX)
+            continue;
+        left = (int)(nd - bvh->nodes) + 1;
+        right = nd->first;
+        if (box_depth(&bvh->nodes[left].box, p, u) <
+            box_depth(&bvh->nodes[right].box, p, u)) {
+            stack[sp++] = right;
+            stack[sp++] = left;
+        } else {
+            stack[sp++] = left;
+            stack[sp++] = right;
+        }
+    }
+
+    return found;
+}
+
+/*
+ * public functions
+ */
+
+/* box functions */
+
+/* empty (inverted) box */
+void bvh_box_empty(struct bvh_box_str *b)
+{
+    b->lo.x = b->lo.y = b->lo.z = DBL_MAX;
+    b->hi.x = b->hi.y = b->hi.z = -DBL_MAX;
+}
+
+/* grow box b to include point p */
+void bvh_box_add(struct bvh_box_str *b, const struct v3_str *p)
+{
+    b->lo.x = MIN(b->lo.x, p->x);
+    b->lo.y = MIN(b->lo.y, p->y);
+    b->lo.z = MIN(b->lo.z, p->z);
+    b->hi.x = MAX(b->hi.x, p->x);
+    b->hi.y = MAX(b->hi.y, p->y);
+    b->hi.z = MAX(b->hi.z, p->z);
+}
+
+/* grow box b to include box c */
+void bvh_box_union(struct bvh_box_str *b, const struct bvh_box_str *c)
+{
+    bvh_box_add(b, &c->lo);
+    bvh_box_add(b, &c->hi);
+}
+
+/* ray/box slab test, returns nonzero if hit in [0, t_max] */
+int bvh_box_hit(const struct bvh_box_str *b, const struct v3_str *p,
+                const struct v3_str *inv_u, double t_max)
+{
+    double t0, t1;
+    double tmin = 0.0;
+    double tmax = t_max;
+
+    t0 = (b->lo.x - p->x) * inv_u->x;
+    t1 = (b->hi.x - p->x) * inv_u->x;
+    tmin = MAX(tmin, MIN(t0, t1));
+    tmax = MIN(tmax, MAX(t0, t1));
+
+    t0 = (b->lo.y - p->y) * inv_u->y;
+    t1 = (b->hi.y - p->y) * inv_u->y;
+    tmin = MAX(tmin, MIN(t0, t1));
+    tmax = MIN(tmax, MAX(t0, t1));
+
+    t0 = (b->lo.z - p->z) * inv_u->z;
+    t1 = (b->hi.z - p->z) * inv_u->z;
+    tmin = MAX(tmin, MIN(t0, t1));
+    tmax = MIN(tmax, MAX(t0, t1));
+
+    return tmin <= tmax;
+}
+
+/* hierarchy functions */
+
+/* build hierarchy over n primitive boxes, returns -1 on failure */
+int bvh_build(struct bvh_str *bvh, const struct bvh_box_str *boxes, int n)
+{
+    struct build_str b;
+    int i;
+
+    bvh->nodes = NULL;
+    bvh->prims = NULL;
+    bvh->n_nodes = 0;
+    bvh->n_prims = n;
+    if (n <= 0)
+        return 0;
+
+    bvh->nodes = malloc((2 * n - 1) * sizeof(*bvh->nodes));
+    bvh->prims = malloc(n * sizeof(*bvh->prims));
+    b.cent = malloc(n * sizeof(*b.cent));
+    if (bvh->nodes == NULL || bvh->prims == NULL || b.cent == NULL) {
+        free(b.cent);
+        bvh_free(bvh);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        bvh->prims[i] = i;
+        b.cent[i] = boxes[i].lo;
+        v3_add(&b.cent[i], &boxes[i].hi);
+        v3_mul(&b.cent[i], 0.5);
+    }
+    b.bvh = bvh;
+    b.boxes = boxes;
+    build_node(&b, 0, n);
+
+    free(b.cent);
+    return 0;
+}
+
+/* release memory held by hierarchy */
+void bvh_free(struct bvh_str *bvh)
+{
+    free(bvh->nodes);
+    free(bvh->prims);
+    bvh->nodes = NULL;
+    bvh->prims = NULL;
+    bvh->n_nodes = 0;
+    bvh->n_prims = 0;
+}
+
+/*
+ * nearest hit along ray within (0, *t_max], returns primitive index
+ * or -1 if none; *t_max is updated to distance of nearest hit
+ */
+int bvh_trace(const struct bvh_str *bvh,
+              const struct v3_str *p, const struct v3_str *u,
+              double *t_max, bvh_hit_fn hit, void *ctx)
+{
+    return traverse(bvh, p, u, t_max, hit, ctx, 0);
+}
+
+/* any hit along ray within (0, t_max], returns primitive index or -1 */
+int bvh_any(const struct bvh_str *bvh,
+            const struct v3_str *p, const struct v3_str *u,
+            double t_max, bvh_hit_fn hit, void *ctx)
+{
+    return traverse(bvh, p, u, &t_max, hit, ctx, 1);
+}
@@ -0,0 +1,75 @@
+/*
+ * Header file for bounding volume hierarchy module
+ */
+
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include "vector3.h"
+
+/* axis-aligned bounding box */
+struct bvh_box_str {
+    struct v3_str lo;
+    struct v3_str hi;
+};
+
+struct bvh_node_str {
+    struct bvh_box_str box;
+    int first;                  /* leaf: first prim index; else right child */
+    int count;                  /* leaf: number of prims; 0 for interior */
+};
+
+struct bvh_str {
+    struct bvh_node_str *nodes;
+    int n_nodes;
+    int *prims;                 /* primitive indices, leaf order */
+    int n_prims;
+};
+
+/*
+ * primitive test called during traversal:
+ *  - ctx: caller's context
+ *  - prim: index of primitive (as passed to bvh_build)
+ *  - p, u: ray start and direction
+ *  - t_max: on entry, nearest hit so far; lower it on a closer hit
+ * returns nonzero if the primitive was hit closer than *t_max
+ */
+typedef int (*bvh_hit_fn)(void *ctx, int prim,
+                          const struct v3_str *p, const struct v3_str *u,
+                          double *t_max);
+
+/*
+ * public function prototypes
+ */
+
+/* box functions */
+
+/* empty (inverted) box */
+void bvh_box_empty(struct bvh_box_str *b);
+/* grow box b to include point p */
+void bvh_box_add(struct bvh_box_str *b, const struct v3_str *p);
+/* grow box b to include box c */
+void bvh_box_union(struct bvh_box_str *b, const struct bvh_box_str *c);
+/* ray/box slab test, returns nonzero if hit in [0, t_max] */
+int bvh_box_hit(const struct bvh_box_str *b, const struct v3_str *p,
+                const struct v3_str *inv_u, double t_max);
+
+/* hierarchy functions */
+
+/* build hierarchy over n primitive boxes, returns -1 on failure */
+int bvh_build(struct bvh_str *bvh, const struct bvh_box_str *boxes, int n);
+/* release memory held by hierarchy */
+void bvh_free(struct bvh_str *bvh);
+/*
+ * nearest hit along ray within (0, *t_max], returns primitive index
+ * or -1 if none; *t_max is updated to distance of nearest hit
+ */
+int bvh_trace(const struct bvh_str *bvh,
+              const struct v3_str *p, const struct v3_str *u,
+              double *t_max, bvh_hit_fn hit, void *ctx);
+/* any hit along ray within (0, t_max], returns primitive index or -1 */
+int bvh_any(const struct bvh_str *bvh,
+            const struct v3_str *p, const struct v3_str *u,
+            double t_max, bvh_hit_fn hit, void *ctx);
+
+#endif
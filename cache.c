@@ -0,0 +1,309 @@
+/*
+ * result cache module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cache.h"
+
+#define SUFFIX ".res"
+
+/* one cache file, for eviction */
+struct entry_str {
+    char name[256];
+    long long size;
+    struct timespec used;       /* last use (file mtime) */
+};
+
+/*
+ * private functions
+ */
+
+static void entry_path(const struct cache_str *c, const char *name,
+                       char *path, size_t len)
+{
+    snprintf(path, len, "%s/%s", c->dir, name);
+}
+
+/* cache file name of key */
+static void key_name(const char *key, char *name, size_t len)
+{
+    snprintf(name, len, "%s" SUFFIX, key);
+}
+
+/* oldest first */
+static int cmp_used(const void *a, const void *b)
+{
+    const struct entry_str *ea = a;
+    const struct entry_str *eb = b;
+
+    if (ea->used.tv_sec != eb->used.tv_sec)
+        return (ea->used.tv_sec < eb->used.tv_sec) ? -1 : 1;
+    if (ea->used.tv_nsec != eb->used.tv_nsec)
+        return (ea->used.tv_nsec < eb->used.tv_nsec) ? -1 : 1;
+    return 0;
+}
+
+/*
+ * list cache entries with their sizes and last use, returns number
+ * of entries (or -1 on error); total size to *total
+ */
+static int scan(const struct cache_str *c, struct entry_str **list,
+                long long *total)
+{
+    char path[CACHE_PATH_LEN + 256];
+    struct entry_str *arr = NULL;
+    struct dirent *de;
+    struct stat sb;
+    size_t sl = strlen(SUFFIX);
+    int cap = 0;
+    int n = 0;
+    DIR *d;
+
+    *total = 0;
+    d = opendir(c->dir);
+    if (d == NULL)
+        return -1;
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+
+        if (len <= sl || len >= sizeof(arr->name)
+            || strcmp(de->d_name + len - sl, SUFFIX) != 0)
+            continue;
+        entry_path(c, de->d_name, path, sizeof(path));
+        if (stat(path, &sb) != 0 || !S_ISREG(sb.st_mode))
+            continue;
+        if (n >= cap) {
+            struct entry_str *t;
+
+            cap = (cap > 0) ? 2 * cap : 64;
+            t = realloc(arr, cap * sizeof(*t));
+            if (t == NULL) {
+                free(arr);
+                closedir(d);
+                return -1;
+            }
+            arr = t;
+        }
+        strcpy(arr[n].name, de->d_name);
+        arr[n].size = sb.st_size;
+        arr[n].used = sb.st_mtim;
+        *total += sb.st_size;
+        n++;
+    }
+    closedir(d);
+    *list = arr;
+    return n;
+}
+
+/*
+ * rescan, then remove least recently used entries until under the
+ * bound; the scan also picks up what other processes stored
+ */
+static void evict(struct cache_str *c)
+{
+    char path[CACHE_PATH_LEN + 256];
+    struct entry_str *list;
+    long long total;
+    int n, i;
+
+    n = scan(c, &list, &total);
+    if (n < 0)
+        return;
+    if (total > c->max_bytes) {
+        qsort(list, n, sizeof(*list), cmp_used);
+        for (i = 0; i < n && total > c->max_bytes; i++) {
+            entry_path(c, list[i].name, path, sizeof(path));
+            if (unlink(path) == 0) {
+                total -= list[i].size;
+                c->evictions++;
+            }
+        }
+    }
+    c->bytes = total;
+    free(list);
+}
+
+/*
+ * public functions
+ */
+
+/* use (creating if needed) cache directory dir, returns -1 on error */
+int cache_open(struct cache_str *c, const char *dir, long long max_bytes)
+{
+    struct entry_str *list;
+    struct stat sb;
+    int n;
+
+    memset(c, 0, sizeof(*c));
+    if (strlen(dir) >= sizeof(c->dir))
+        return -1;
+    strcpy(c->dir, dir);
+    c->max_bytes = max_bytes;
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+        return -1;
+    if (stat(dir, &sb) != 0 || !S_ISDIR(sb.st_mode))
+        return -1;
+    n = scan(c, &list, &c->bytes);
+    if (n < 0)
+        return -1;
+    free(list);
+    pthread_mutex_init(&c->lock, NULL);
+    return 0;
+}
+
+void cache_close(struct cache_str *c)
+{
+    pthread_mutex_destroy(&c->lock);
+}
+
+/* map entry for key, returns 0 on a hit, -1 on a miss */
+int cache_get(struct cache_str *c, const char *key, struct cache_map_str *m)
+{
+    char name[256];
+    char path[CACHE_PATH_LEN + 256];
+    struct stat sb;
+    void *p = MAP_FAILED;
+    int fd;
+
+    key_name(key, name, sizeof(name));
+    entry_path(c, name, path, sizeof(path));
+    fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        if (fstat(fd, &sb) == 0 && sb.st_size > 0)
+            /* private: callers may scribble on their copy */
+            p = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE, fd, 0);
+        close(fd);
+    }
+
+    pthread_mutex_lock(&c->lock);
+    if (p == MAP_FAILED) {
+        c->misses++;
+        pthread_mutex_unlock(&c->lock);
+        return -1;
+    }
+    c->hits++;
+    pthread_mutex_unlock(&c->lock);
+
+    /* mark as recently used */
+    utime(path, NULL);
+    m->data = p;
+    m->len = sb.st_size;
+    return 0;
+}
+
+/* whether key has an entry, without counting or touching it */
+int cache_has(const struct cache_str *c, const char *key)
+{
+    char name[256];
+    char path[CACHE_PATH_LEN + 256];
+    struct stat sb;
+
+    key_name(key, name, sizeof(name));
+    entry_path(c, name, path, sizeof(path));
+    return stat(path, &sb) == 0 && sb.st_size > 0;
+}
+
+/* unmap entry returned by cache_get */
+void cache_unmap(struct cache_map_str *m)
+{
+    munmap(m->data, m->len);
+    m->data = NULL;
+    m->len = 0;
+}
+
+/* count a hit that turned out to be unusable as a miss instead */
+void cache_reject(struct cache_str *c, const char *key)
+{
+    char name[256];
+    char path[CACHE_PATH_LEN + 256];
+    struct stat sb;
+    long long gone = 0;
+
+    key_name(key, name, sizeof(name));
+    entry_path(c, name, path, sizeof(path));
+    if (stat(path, &sb) == 0 && unlink(path) == 0)
+        gone = sb.st_size;
+    pthread_mutex_lock(&c->lock);
+    c->bytes -= gone;
+    c->hits--;
+    c->misses++;
+    pthread_mutex_unlock(&c->lock);
+}
+
+/* store entry for key, evict over the bound, returns -1 on error */
+int cache_put(struct cache_str *c, const char *key,
+              const void *data, size_t len)
+{
+    char name[256];
+    char path[CACHE_PATH_LEN + 256];
+    char tmp[CACHE_PATH_LEN + 256];
+    const char *p = data;
+    long long added = (long long)len;
+    struct stat sb;
+    ssize_t w;
+    int fd;
+
+    key_name(key, name, sizeof(name));
+    entry_path(c, name, path, sizeof(path));
+    /* written aside and renamed, so readers never see part of it */
+    snprintf(tmp, sizeof(tmp), "%s/%s.XXXXXX", c->dir, key);
+    fd = mkstemp(tmp);
+    if (fd < 0)
+        return -1;
+    while (len > 0) {
+        w = write(fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            unlink(tmp);
+            return -1;
+        }
+        p += w;
+        len -= w;
+    }
+    /* an entry replaced no longer counts */
+    if (stat(path, &sb) == 0)
+        added -= sb.st_size;
+    if (close(fd) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    pthread_mutex_lock(&c->lock);
+    c->stores++;
+    c->bytes += added;
+    if (c->bytes > c->max_bytes)
+        evict(c);
+    pthread_mutex_unlock(&c->lock);
+    return 0;
+}
+
+/* hit/miss statistics and cache size */
+void cache_report(struct cache_str *c, FILE *out)
+{
+    struct entry_str *list;
+    long long total;
+    int n;
+
+    pthread_mutex_lock(&c->lock);
+    n = scan(c, &list, &total);
+    if (n >= 0)
+        free(list);
+    fprintf(out, "cache %s: %ld hits, %ld misses, %ld stored,"
+            " %ld evicted; %d entries, %.1f of %.1f MB\n",
+            c->dir, c->hits, c->misses, c->stores, c->evictions,
+            (n > 0) ? n : 0, total / 1048576.0, c->max_bytes / 1048576.0);
+    pthread_mutex_unlock(&c->lock);
+}
@@ -0,0 +1,63 @@
+/*
+ * Header file for result cache module
+ *
+ * Results are files in a cache directory named by the (hex) digest
+ * of everything that went into them, so a key never goes stale.
+ * Hits are mapped read/copy-on-write rather than read.  Each hit
+ * touches its file, and when the directory grows past its size
+ * bound the least recently used entries are removed.  The size is
+ * scanned once and then kept as entries are stored and removed,
+ * rescanning only when it goes over the bound.
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define CACHE_PATH_LEN 512
+
+struct cache_str {
+    char dir[CACHE_PATH_LEN];
+    long long max_bytes;        /* size bound of all entries */
+    pthread_mutex_t lock;       /* guards counters, eviction */
+    long long bytes;            /* of all entries, as stored here */
+    long hits;
+    long misses;
+    long stores;
+    long evictions;
+};
+
+/* a mapped entry */
+struct cache_map_str {
+    void *data;
+    size_t len;
+};
+
+/*
+ * public function prototypes
+ */
+
+/* use (creating if needed) cache directory dir, returns -1 on error */
+int cache_open(struct cache_str *c, const char *dir, long long max_bytes);
+void cache_close(struct cache_str *c);
+/* map entry for key, returns 0 on a hit, -1 on a miss */
+int cache_get(struct cache_str *c, const char *key, struct cache_map_str *m);
+/* whether key has an entry, without counting or touching it */
+int cache_has(const struct cache_str *c, const char *key);
+/* unmap entry returned by cache_get */
+void cache_unmap(struct cache_map_str *m);
+/* count a hit that turned out to be unusable as a miss instead */
+void cache_reject(struct cache_str *c, const char *key);
+/*
+ * store entry for key (atomically, by rename), then evict least
+ * recently used entries over the size bound. returns -1 on error
+ */
+int cache_put(struct cache_str *c, const char *key,
+              const void *data, size_t len);
+/* hit/miss statistics and cache size */
+void cache_report(struct cache_str *c, FILE *out);
+
+#endif
@@ -0,0 +1,431 @@
+/*
+ * star catalog module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "catalog.h"
+
+/*
+ * private functions
+ */
+
+/*
+ * zeroed POSIX shared memory of len bytes, MAP_FAILED on error.  The
+ * name is unlinked at once: the mapping lives on in this process
+ * and its children
+ */
+static void *shm_segment(size_t len)
+{
+    char name[32];
+    void *p;
+    int fd;
+
+    snprintf(name, sizeof(name), "/astroplane-cat.%ld", (long)getpid());
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return MAP_FAILED;
+    shm_unlink(name);
+    if (ftruncate(fd, len) != 0) {
+        close(fd);
+        return MAP_FAILED;
+    }
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p;
+}
+
+/* map segment for n stars and their vectors, returns -1 on error */
+static int cat_share(struct cat_str *cat, int n)
+{
+    size_t stars = ((n + 1) * sizeof(*cat->star) + 63) & ~(size_t)63;
+    size_t len = stars + (n + 1) * sizeof(*cat->u);
+    void *p = shm_segment(len);
+
+    if (p == MAP_FAILED)
+        return -1;
+    cat->shm = p;
+    cat->shm_len = len;
+    cat->fixed = 0;
+    cat->star = p;
+    cat->u = (struct v3_str *)((char *)p + stars);
+    return 0;
+}
+
+/*
+ * public functions
+ */
+
+double cat_ms2deg(int m, float s)
+{
+    return (m + (s / 60.0)) / 60.0;
+}
+
+double cat_hms2d(int h, int m, float s)
+{
+    return 15.0 * (h + cat_ms2deg(m, s));
+}
+
+/* tricky: degrees could be "-00", so leave as str */
+double cat_dms2d(const char *d, int m, float s)
+{
+    double sign;
+    double ret;
+
+    /* leading sign */
+    if (*d == '-') {
+        sign = -1;
+        d++;
+    } else {
+        sign = 1;
+        if (*d == '+')
+            d++;
+    }
+
+    /* 0..180 */
+    ret = 0;
+    while (isdigit(*d)) {
+        ret *= 10.0;
+        ret += *d++ - '0';
+    }
+
+    ret += cat_ms2deg(m, s);
+
+    return ret * sign;
+}
+
+/* read next star's data from input file, return -1 on EOF (or junk) */
+int cat_read_star(FILE *in, struct cat_star_str *p)
+{
+    int ra_hours, ra_minutes;
+    float ra_seconds;
+    char dec_degrees[4];        /* must be char (-00 case) */
+    int dec_minutes;
+    float dec_seconds;
+
+    memset(p, 0, sizeof(*p));
+    if (fscanf(in, "|HIP %d |%d %d %f|%3s %d %f|%f|\n",
+               &p->hip,
+               &ra_hours, &ra_minutes, &ra_seconds,
+               dec_degrees, &dec_minutes, &dec_seconds,
+               &p->vmag) != 8)
+        return -1;
+
+#if 0
+    printf("|HIP %-6d |%02d %02d %07.4f|%s %02d %06.3f|%5.2f|\n",
+           p->hip,
+           ra_hours, ra_minutes, ra_seconds,
+           dec_degrees, dec_minutes, dec_seconds,
+           p->vmag);
+#endif
+
+    /* convert to decimal degrees */
+    p->ra = cat_hms2d(ra_hours, ra_minutes, ra_seconds);
+    p->dec = cat_dms2d(dec_degrees, dec_minutes, dec_seconds);
+    p->id = p->hip;
+    p->src = CAT_SRC_HIP;
+
+#if 0
+    printf(" %012.8f,%012.8f\n", p->ra, p->dec);
+#endif
+
+    return 0;
+}
+
+/* read whole catalog, returns -1 on error */
+int cat_read(FILE *in, struct cat_str *cat)
+{
+    struct cat_star_str *t;
+    int cap = 0;
+    int c;
+
+    cat->star = NULL;
+    cat->n = 0;
+    cat->u = NULL;
+    cat->shm = NULL;
+    cat->fixed = 0;
+    for (;;) {
+        if (cat->n >= cap) {
+            cap = (cap > 0) ? 2 * cap : 1024;
+            t = realloc(cat->star, cap * sizeof(*t));
+            if (t == NULL) {
+                cat_free(cat);
+                return -1;
+            }
+            cat->star = t;
+        }
+        /* only the end of the file ends it, a bad line is an error */
+        while ((c = getc(in)) != EOF && isspace(c))
+            ;
+        if (c == EOF)
+            break;
+        ungetc(c, in);
+        if (cat_read_star(in, &cat->star[cat->n]) == -1) {
+            cat_free(cat);
+            return -1;
+        }
+        cat->n++;
+    }
+    if (ferror(in)) {
+        cat_free(cat);
+        return -1;
+    }
+    return 0;
+}
+
+/* read whole binary catalog, returns -1 on error */
+int cat_read_bin(FILE *in, struct cat_str *cat)
+{
+    struct cat_bin_str hdr;
+
+    cat->star = NULL;
+    cat->n = 0;
+    cat->u = NULL;
+    cat->shm = NULL;
+    cat->fixed = 0;
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1
+        || memcmp(hdr.magic, CAT_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.rec_size != (int)sizeof(*cat->star)
+        || hdr.order != CAT_ORDER
+        || hdr.n < 0 || hdr.n >= 0x7fffffff)
+        return -1;
+    cat->star = malloc((hdr.n + 1) * sizeof(*cat->star));
+    if (cat->star == NULL)
+        return -1;
+    if (fread(cat->star, sizeof(*cat->star), hdr.n, in) != (size_t)hdr.n) {
+        cat_free(cat);
+        return -1;
+    }
+    cat->n = (int)hdr.n;
+    return 0;
+}
+
+/* read text or binary catalog, returns -1 on error */
+int cat_load(FILE *in, struct cat_str *cat)
+{
+    char magic[8];
+    size_t got;
+
+    got = fread(magic, 1, sizeof(magic), in);
+    rewind(in);
+    if (got == sizeof(magic) && memcmp(magic, CAT_MAGIC, sizeof(magic)) == 0)
+        return cat_read_bin(in, cat);
+    return cat_read(in, cat);
+}
+
+/* read catalog into a shared segment, returns -1 on error */
+int cat_load_shared(FILE *in, struct cat_str *cat)
+{
+    struct cat_bin_str hdr;
+    struct cat_str tmp;
+    size_t got;
+
+    got = fread(&hdr, 1, sizeof(hdr), in);
+    if (got == sizeof(hdr)
+        && memcmp(hdr.magic, CAT_MAGIC, sizeof(hdr.magic)) == 0) {
+        /* binary: records go straight into the segment */
+        cat->n = 0;
+        cat->shm = NULL;
+        cat->fixed = 0;
+        if (hdr.rec_size != (int)sizeof(*cat->star)
+            || hdr.order != CAT_ORDER
+            || hdr.n < 0 || hdr.n >= 0x7fffffff
+            || cat_share(cat, (int)hdr.n) != 0)
+            return -1;
+        if (fread(cat->star, sizeof(*cat->star), hdr.n, in)
+            != (size_t)hdr.n) {
+            cat_free(cat);
+            return -1;
+        }
+        cat->n = (int)hdr.n;
+        return 0;
+    }
+
+    /* text: count is known once read */
+    rewind(in);
+    if (cat_read(in, &tmp) != 0)
+        return -1;
+    cat->n = 0;
+    cat->shm = NULL;
+    cat->fixed = 0;
+    if (cat_share(cat, tmp.n) != 0) {
+        cat_free(&tmp);
+        return -1;
+    }
+    memcpy(cat->star, tmp.star, tmp.n * sizeof(*cat->star));
+    cat->n = tmp.n;
+    cat_free(&tmp);
+    return 0;
+}
+
+/* catalog from constant tables */
+void cat_fixed(struct cat_str *cat, const struct cat_star_str *star,
+               const struct v3_str *u, int n)
+{
+    /* never written through: every user takes the catalog as const */
+    cat->star = (struct cat_star_str *)star;
+    cat->u = (struct v3_str *)u;
+    cat->n = n;
+    cat->shm = NULL;
+    cat->shm_len = 0;
+    cat->fixed = 1;
+}
+
+/* write binary catalog header for n records, returns -1 on error */
+int cat_write_bin_header(FILE *out, long long n)
+{
+    struct cat_bin_str hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CAT_MAGIC, sizeof(hdr.magic));
+    hdr.rec_size = sizeof(struct cat_star_str);
+    hdr.order = CAT_ORDER;
+    hdr.n = n;
+    return (fwrite(&hdr, sizeof(hdr), 1, out) == 1) ? 0 : -1;
+}
+
+/* release catalog */
+void cat_free(struct cat_str *cat)
+{
+    if (cat->shm != NULL) {
+        munmap(cat->shm, cat->shm_len);
+    } else if (!cat->fixed) {
+        free(cat->star);
+        free(cat->u);
+    }
+    cat->shm = NULL;
+    cat->star = NULL;
+    cat->u = NULL;
+    cat->n = 0;
+    cat->fixed = 0;
+}
+
+/* equatorial unit vectors, returns -1 on error */
+int cat_vectors(struct cat_str *cat, double epoch)
+{
+    const double rad = M_PI / 180.0;
+    /* mas/yr to radians over the years from CAT_EPOCH */
+    const double pm = (epoch - CAT_EPOCH) * rad / 3600000.0;
+    int i;
+
+    /* made by catgen */
+    if (cat->fixed)
+        return 0;
+    if (cat->shm == NULL) {
+        free(cat->u);
+        cat->u = malloc((cat->n + 1) * sizeof(*cat->u));
+        if (cat->u == NULL)
+            return -1;
+    }
+    for (i = 0; i < cat->n; i++) {
+        const struct cat_star_str *s = &cat->star[i];
+        double ra = s->ra * rad;
+        double dec = s->dec * rad;
+        struct v3_str *u = &cat->u[i];
+
+        u->x = cos(dec) * cos(ra);
+        u->y = cos(dec) * sin(ra);
+        u->z = sin(dec);
+        if ((s->flags & CAT_HAVE_PM) && pm != 0.0) {
+            /* along the tangent plane: east (pmra is cos dec), north */
+            double e = s->pmra * pm;
+            double n = s->pmdec * pm;
+
+            u->x += -e * sin(ra) - n * sin(dec) * cos(ra);
+            u->y += e * cos(ra) - n * sin(dec) * sin(ra);
+            u->z += n * cos(dec);
+            n = sqrt(u->x * u->x + u->y * u->y + u->z * u->z);
+            u->x /= n;
+            u->y /= n;
+            u->z /= n;
+        }
+    }
+    return 0;
+}
+
+/* a star has proper motion, returns 1 if so */
+int cat_has_pm(const struct cat_str *cat)
+{
+    int i;
+
+    for (i = 0; i < cat->n; i++)
+        if (cat->star[i].flags & CAT_HAVE_PM)
+            return 1;
+    return 0;
+}
+
+/* group catalog into sky cells, returns -1 on error */
+int cat_zones_build(const struct cat_str *cat,
+                    double dec_step, double ra_step,
+                    struct cat_zones_str *z)
+{
+    int n_dec = (int)(180.0 / dec_step) + 1;
+    int n_ra = (int)(360.0 / ra_step) + 1;
+    int *cell;                  /* cell of each star */
+    int *fill;
+    struct cat_zone_str *zn;
+    int i, c;
+
+    memset(z, 0, sizeof(*z));
+    z->n_zones = n_dec * n_ra;
+    z->zone = calloc(z->n_zones, sizeof(*z->zone));
+    z->idx = malloc((cat->n + 1) * sizeof(*z->idx));
+    cell = malloc((cat->n + 1) * sizeof(*cell));
+    fill = calloc(z->n_zones, sizeof(*fill));
+    if (z->zone == NULL || z->idx == NULL || cell == NULL || fill == NULL) {
+        free(cell);
+        free(fill);
+        cat_zones_free(z);
+        return -1;
+    }
+
+    /* counting sort by cell */
+    for (i = 0; i < cat->n; i++) {
+        const struct cat_star_str *s = &cat->star[i];
+        int d = (int)((s->dec + 90.0) / dec_step);
+        int r = (int)(s->ra / ra_step);
+
+        d = (d < 0) ? 0 : ((d >= n_dec) ? n_dec - 1 : d);
+        r = (r < 0) ? 0 : ((r >= n_ra) ? n_ra - 1 : r);
+        cell[i] = d * n_ra + r;
+        z->zone[cell[i]].count++;
+    }
+    for (c = 0, i = 0; c < z->n_zones; c++) {
+        z->zone[c].first = i;
+        i += z->zone[c].count;
+    }
+    for (i = 0; i < cat->n; i++) {
+        const struct cat_star_str *s = &cat->star[i];
+
+        zn = &z->zone[cell[i]];
+        if (fill[cell[i]] == 0) {
+            zn->dec0 = zn->dec1 = s->dec;
+            zn->ra0 = zn->ra1 = s->ra;
+        } else {
+            zn->dec0 = (s->dec < zn->dec0) ? s->dec : zn->dec0;
+            zn->dec1 = (s->dec > zn->dec1) ? s->dec : zn->dec1;
+            zn->ra0 = (s->ra < zn->ra0) ? s->ra : zn->ra0;
+            zn->ra1 = (s->ra > zn->ra1) ? s->ra : zn->ra1;
+        }
+        z->idx[zn->first + fill[cell[i]]++] = i;
+    }
+
+    free(cell);
+    free(fill);
+    return 0;
+}
+
+/* release cell index */
+void cat_zones_free(struct cat_zones_str *z)
+{
+    free(z->zone);
+    free(z->idx);
+    memset(z, 0, sizeof(*z));
+}
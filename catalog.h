@@ -0,0 +1,139 @@
+/*
+ * Header file for star catalog module
+ */
+
+#ifndef _CATALOG_H_
+#define _CATALOG_H_
+
+#include <stdio.h>
+
+#include "vector3.h"
+
+/* source catalog of an entry, and so the meaning of its id */
+enum cat_src {
+    CAT_SRC_HIP,                /* Hipparcos number */
+    CAT_SRC_TYCHO,              /* Tycho-2 TYC1 * 1000000 + TYC2 * 10 + TYC3 */
+    CAT_SRC_GAIA                /* Gaia source_id */
+};
+
+/* cat_star_str.flags: which optional quantities are known */
+#define CAT_EPOCH 2000.0        /* of positions, Julian years */
+
+#define CAT_HAVE_PM  0x01
+#define CAT_HAVE_PLX 0x02
+#define CAT_HAVE_BV  0x04
+
+/*
+ * one catalog entry.  Also the record of the binary catalog, so
+ * it is laid out without padding.
+ */
+struct cat_star_str {
+    long long id;               /* catalog number */
+    double ra;                  /* right ascension (J2000), degrees */
+    double dec;                 /* declination (J2000), degrees */
+    float vmag;                 /* visual magnitude */
+    float pmra;                 /* proper motion, mu_ra cos(dec), mas/yr */
+    float pmdec;                /* proper motion, mas/yr */
+    float plx;                  /* parallax, mas */
+    float bv;                   /* B-V colour index */
+    int hip;                    /* Hipparcos number, 0 if none */
+    int src;                    /* enum cat_src */
+    int flags;                  /* CAT_HAVE_... */
+};
+
+/*
+ * binary catalog: this header, then n cat_star_str records in host
+ * byte order (order tells a foreign one)
+ */
+#define CAT_MAGIC "APCAT02"
+#define CAT_ORDER 0x01020304
+
+struct cat_bin_str {
+    char magic[8];
+    int rec_size;               /* sizeof(struct cat_star_str) */
+    int order;                  /* CAT_ORDER */
+    long long n;
+};
+
+/* whole catalog, in file (brightness) order */
+struct cat_str {
+    struct cat_star_str *star;
+    int n;
+    struct v3_str *u;           /* equatorial unit vectors (cat_vectors) */
+    void *shm;                  /* shared segment holding both, if any */
+    size_t shm_len;
+    int fixed;                  /* both constant tables (cat_fixed) */
+};
+
+/* sky cell: stars within a declination band and right ascension range */
+struct cat_zone_str {
+    double dec0, dec1;          /* declination extent of members */
+    double ra0, ra1;            /* right ascension extent of members */
+    int first;                  /* offset into cat_zones_str.idx */
+    int count;
+};
+
+/* catalog index grouped by sky cell */
+struct cat_zones_str {
+    struct cat_zone_str *zone;
+    int n_zones;
+    int *idx;                   /* catalog indices, cell by cell */
+};
+
+/*
+ * public function prototypes
+ */
+
+/* minutes, seconds to degrees */
+double cat_ms2deg(int m, float s);
+/* hours, minutes, seconds to degrees */
+double cat_hms2d(int h, int m, float s);
+/* degrees (as string, may be "-00"), minutes, seconds to degrees */
+double cat_dms2d(const char *d, int m, float s);
+
+/* read next star in |HIP n |hh mm ss|+dd mm ss|mag| format, -1 on EOF/junk */
+int cat_read_star(FILE *in, struct cat_star_str *p);
+/* read whole catalog to end of file, returns -1 on error or a bad line */
+int cat_read(FILE *in, struct cat_str *cat);
+/* read whole binary catalog, returns -1 on error */
+int cat_read_bin(FILE *in, struct cat_str *cat);
+/* read text or binary catalog (by its first bytes), -1 on error */
+int cat_load(FILE *in, struct cat_str *cat);
+/*
+ * read text or binary catalog into a shared memory segment with room
+ * for its unit vectors, so processes forked after share one copy.
+ * returns -1 on error
+ */
+int cat_load_shared(FILE *in, struct cat_str *cat);
+/*
+ * catalog of n stars and their unit vectors from constant tables
+ * (catdata.h), used in place: nothing to read, vectorize or free
+ */
+void cat_fixed(struct cat_str *cat, const struct cat_star_str *star,
+               const struct v3_str *u, int n);
+/* write binary catalog header for n records, returns -1 on error */
+int cat_write_bin_header(FILE *out, long long n);
+/* release catalog */
+void cat_free(struct cat_str *cat);
+/*
+ * unit vector toward each star (x toward RA 0, z toward north
+ * celestial pole) at epoch (Julian years), stars with proper motion
+ * moved to it from CAT_EPOCH, so that per-site positions are one
+ * rotation each.  A shared catalog keeps them in its segment.
+ * returns -1 on error
+ */
+int cat_vectors(struct cat_str *cat, double epoch);
+/* a star has proper motion, returns 1 if so */
+int cat_has_pm(const struct cat_str *cat);
+
+/*
+ * group catalog into cells dec_step degrees high and ra_step degrees
+ * wide, returns -1 on error
+ */
+int cat_zones_build(const struct cat_str *cat,
+                    double dec_step, double ra_step,
+                    struct cat_zones_str *z);
+/* release cell index */
+void cat_zones_free(struct cat_zones_str *z);
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * catconv: convert an external star catalog to the binary catalog
+ * read by astroplane -k
+ *
+ *   catconv [-j threads] [-m maglimit] tycho2|gaia infile outfile
+ *
+ * infile "-" is standard input (e.g. zcat catalog.dat.gz | ...);
+ * outfile must be a regular file.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "catalog.h"
+#include "xcat.h"
+
+#define MAG_MAX 6.0             /* default limit, as hip_magle6.dat */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-m maglimit]"
+            " tycho2|gaia infile outfile\n", prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const struct xcat_fmt_str *fmt;
+    struct xcat_stats_str st;
+    double mag_max = MAG_MAX;
+    int n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    FILE *in, *out;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:m:")) != -1) {
+        switch (opt) {
+        case 'j':
+            n_threads = atoi(optarg);
+            if (n_threads < 1)
+                usage(argv[0]);
+            break;
+        case 'm':
+            mag_max = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3)
+        usage(argv[0]);
+
+    fmt = xcat_format(argv[optind]);
+    if (fmt == NULL)
+        usage(argv[0]);
+    if (strcmp(argv[optind + 1], "-") == 0) {
+        in = stdin;
+    } else {
+        in = fopen(argv[optind + 1], "r");
+        if (in == NULL) {
+            perror(argv[optind + 1]);
+            exit(1);
+        }
+    }
+    out = fopen(argv[optind + 2], "w");
+    if (out == NULL) {
+        perror(argv[optind + 2]);
+        exit(1);
+    }
+
+    if (xcat_convert(in, out, fmt, mag_max, n_threads, &st) != 0
+        || fclose(out) != 0) {
+        fprintf(stderr, "%s: conversion failed\n", argv[optind + 1]);
+        remove(argv[optind + 2]);
+        exit(1);
+    }
+    if (in != stdin)
+        fclose(in);
+    fprintf(stderr, "%lld rows, %lld stars to magnitude %.1f kept,"
+            " %lld unreadable\n", st.rows, st.kept, mag_max, st.bad);
+    exit(0);
+}
@@ -0,0 +1,21 @@
+/*
+ * Header file for built in catalog
+ *
+ * The default catalog (hip_magle6.dat) as constant tables, in
+ * catdata.c, which the build generates with catgen: stars in order
+ * of magnitude, and their unit vectors as cat_vectors makes them
+ * (no star has proper motion, so at any epoch).
+ * Taken up by cat_fixed, it needs no reading or parsing at startup.
+ */
+
+#ifndef _CATDATA_H_
+#define _CATDATA_H_
+
+#include "catalog.h"
+#include "vector3.h"
+
+extern const struct cat_star_str cat_builtin_star[];
+extern const struct v3_str cat_builtin_u[];
+extern const int cat_builtin_n;
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * catgen: write a catalog as C source for the built in catalog of
+ * astroplane (catdata.h), run by the build on hip_magle6.dat
+ *
+ *   catgen catalogfile > catdata.c
+ *
+ * Stars are sorted by magnitude (stably, so a catalog already in
+ * that order keeps it) and written with their unit vectors, every
+ * number exactly as it is in memory.  A catalog with proper motions
+ * is refused, as its vectors depend on the epoch.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "catalog.h"
+
+static const struct cat_star_str *sort_star;
+
+/* by magnitude, then catalog order */
+static int cmp_mag(const void *pa, const void *pb)
+{
+    int a = *(const int *)pa;
+    int b = *(const int *)pb;
+
+    if (sort_star[a].vmag != sort_star[b].vmag)
+        return (sort_star[a].vmag < sort_star[b].vmag) ? -1 : 1;
+    return (a > b) - (a < b);
+}
+
+int main(int argc, char *argv[])
+{
+    struct cat_str cat;
+    FILE *in;
+    int *order;
+    int i;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s catalogfile\n", argv[0]);
+        exit(1);
+    }
+    in = fopen(argv[1], "r");
+    if (in == NULL) {
+        perror(argv[1]);
+        exit(1);
+    }
+    if (cat_load(in, &cat) != 0 || cat_vectors(&cat, CAT_EPOCH) != 0) {
+        fprintf(stderr, "%s: bad catalog or out of memory\n", argv[1]);
+        exit(1);
+    }
+    fclose(in);
+    /* fixed vectors can't follow the sites' epoch */
+    if (cat_has_pm(&cat)) {
+        fprintf(stderr, "%s: has proper motions, read it with -k\n",
+                argv[1]);
+        exit(1);
+    }
+
+    order = malloc((cat.n + 1) * sizeof(*order));
+    if (order == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < cat.n; i++)
+        order[i] = i;
+    sort_star = cat.star;
+    qsort(order, cat.n, sizeof(*order), cmp_mag);
+
+    /* %.17g gives back the same double, and so the same float */
+    printf("/*\n * built in catalog: generated by catgen from %s,"
+           " do not edit\n */\n\n#include \"catdata.h\"\n\n", argv[1]);
+    printf("const int cat_builtin_n = %d;\n\n", cat.n);
+    printf("const struct cat_star_str cat_builtin_star[] = {\n");
+    for (i = 0; i < cat.n; i++) {
+        const struct cat_star_str *s = &cat.star[order[i]];
+
+        printf("    {%lldLL, %.17g, %.17g, %.17g, %.17g, %.17g, %.17g,"
+               " %.17g, %d, %d, %d},\n", s->id, s->ra, s->dec,
+               (double)s->vmag, (double)s->pmra, (double)s->pmdec,
+               (double)s->plx, (double)s->bv, s->hip, s->src, s->flags);
+    }
+    printf("    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}\n};\n\n");
+    printf("const struct v3_str cat_builtin_u[] = {\n");
+    for (i = 0; i < cat.n; i++) {
+        const struct v3_str *u = &cat.u[order[i]];
+
+        printf("    {%.17g, %.17g, %.17g},\n", u->x, u->y, u->z);
+    }
+    printf("    {0, 0, 0}\n};\n");
+
+    free(order);
+    cat_free(&cat);
+    if (fflush(stdout) != 0 || ferror(stdout)) {
+        perror("catgen");
+        exit(1);
+    }
+    exit(0);
+}
@@ -0,0 +1,129 @@
+/*
+ * catmatch: cross-match a catalog with an auxiliary one and write
+ * it, with the colour, proper motion and parallax it gains, as a
+ * binary catalog for astroplane -k
+ *
+ *   catmatch [-j threads] [-m id|pos|both] [-r arcsec]
+ *            basefile auxfile outfile
+ *
+ * basefile is text (hip_magle6.dat) or binary, auxfile binary (from
+ * catconv).  Stars are matched on Hipparcos number, then those left
+ * on position within the radius.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "catalog.h"
+#include "xmatch.h"
+
+#define RADIUS 2.0              /* default match radius, arcsec */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-j threads] [-m id|pos|both] [-r arcsec]"
+            " basefile auxfile outfile\n", prog);
+    exit(1);
+}
+
+static void load(const char *name, struct cat_str *cat)
+{
+    FILE *in = fopen(name, "r");
+
+    if (in == NULL) {
+        perror(name);
+        exit(1);
+    }
+    if (cat_load(in, cat) != 0) {
+        fprintf(stderr, "%s: unreadable catalog\n", name);
+        exit(1);
+    }
+    fclose(in);
+}
+
+int main(int argc, char *argv[])
+{
+    struct cat_str base, aux;
+    struct xm_stats_str st;
+    struct timespec t0, t1;
+    double radius = RADIUS;
+    double secs;
+    int n_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int mode = XM_ID | XM_POS;
+    int *match;
+    FILE *out;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:m:r:")) != -1) {
+        switch (opt) {
+        case 'j':
+            n_threads = atoi(optarg);
+            if (n_threads < 1)
+                usage(argv[0]);
+            break;
+        case 'm':
+            if (strcmp(optarg, "id") == 0)
+                mode = XM_ID;
+            else if (strcmp(optarg, "pos") == 0)
+                mode = XM_POS;
+            else if (strcmp(optarg, "both") == 0)
+                mode = XM_ID | XM_POS;
+            else
+                usage(argv[0]);
+            break;
+        case 'r':
+            radius = atof(optarg);
+            if (radius <= 0.0)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3)
+        usage(argv[0]);
+
+    load(argv[optind], &base);
+    load(argv[optind + 1], &aux);
+    match = malloc((base.n + 1) * sizeof(*match));
+    if (match == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (xm_match(&base, &aux, mode, radius / 3600.0, n_threads, match,
+                 &st) != 0) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    xm_enrich(&base, &aux, match);
+
+    out = fopen(argv[optind + 2], "w");
+    if (out == NULL) {
+        perror(argv[optind + 2]);
+        exit(1);
+    }
+    if (cat_write_bin_header(out, base.n) != 0
+        || fwrite(base.star, sizeof(*base.star), base.n, out)
+        != (size_t)base.n
+        || fclose(out) != 0) {
+        fprintf(stderr, "%s: write failed\n", argv[optind + 2]);
+        remove(argv[optind + 2]);
+        exit(1);
+    }
+
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%d stars: %d matched on number, %d on position,"
+            " %d unmatched (%.3f s, %.2f M stars/s)\n",
+            base.n, st.by_id, st.by_pos, st.none, secs,
+            (secs > 0.0) ? base.n / secs / 1e6 : 0.0);
+    free(match);
+    cat_free(&base);
+    cat_free(&aux);
+    exit(0);
+}
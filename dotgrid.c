@@ -0,0 +1,221 @@
+/*
+ * dot grid module
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "dotgrid.h"
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/* pairs found so far */
+struct dg_pair_list_str {
+    struct dg_pair_str *p;
+    int n;
+    int cap;
+};
+
+/*
+ * private functions
+ */
+
+/* union-find root with path halving */
+static int find(int *root, int i)
+{
+    while (root[i] != i) {
+        root[i] = root[root[i]];
+        i = root[i];
+    }
+    return i;
+}
+
+/* dot i ahead of dot j as a group's root */
+static int ahead(const double *key, int i, int j)
+{
+    if (key != NULL && key[i] != key[j])
+        return key[i] > key[j];
+    return i < j;
+}
+
+/* pairs in order of first, then second dot */
+static int cmp_pair(const void *pa, const void *pb)
+{
+    const struct dg_pair_str *a = pa;
+    const struct dg_pair_str *b = pb;
+
+    if (a->i != b->i)
+        return (a->i > b->i) - (a->i < b->i);
+    return (a->j > b->j) - (a->j < b->j);
+}
+
+/*
+ * list dots i, j if too close, when i is the larger (so each pair is
+ * listed once).  returns -1 on error
+ */
+static int add_pair(struct dg_pair_list_str *pl, const double *x,
+                    const double *y, const double *r, double gap,
+                    int i, int j)
+{
+    double dx = x[j] - x[i];
+    double dy = y[j] - y[i];
+    double lim = r[i] + r[j] + gap;
+    double d2 = dx * dx + dy * dy;
+    struct dg_pair_str *t;
+
+    if (j == i || r[j] > r[i] || (r[j] == r[i] && j < i) || d2 >= lim * lim)
+        return 0;
+    if (pl->n >= pl->cap) {
+        pl->cap = (pl->cap > 0) ? 2 * pl->cap : 256;
+        t = realloc(pl->p, pl->cap * sizeof(*t));
+        if (t == NULL)
+            return -1;
+        pl->p = t;
+    }
+    pl->p[pl->n].i = MIN(i, j);
+    pl->p[pl->n].j = MAX(i, j);
+    pl->p[pl->n].d = sqrt(d2);
+    pl->n++;
+    return 0;
+}
+
+/*
+ * public functions
+ */
+
+/* cell index of coordinate */
+long dg_cell(const struct dg_grid_str *g, double v)
+{
+    return (long)floor(v / g->cell);
+}
+
+/* hash bucket of cell (ix, iy) */
+unsigned int dg_bucket(const struct dg_grid_str *g, long ix, long iy)
+{
+    unsigned long h;
+
+    h = (unsigned long)ix * 73856093UL ^ (unsigned long)iy * 19349663UL;
+    return (unsigned int)(h ^ (h >> 17)) & g->mask;
+}
+
+/* hash all n dots into cells of size cell, returns -1 on error */
+int dg_build(struct dg_grid_str *g, const double *x, const double *y,
+             int n, double cell)
+{
+    unsigned int size = 16;
+    unsigned int b;
+    int i;
+
+    /* about two buckets per dot */
+    while (size < 2U * (unsigned int)n)
+        size <<= 1;
+    g->cell = cell;
+    g->mask = size - 1;
+    g->x = x;
+    g->y = y;
+    g->n = n;
+    g->head = malloc(size * sizeof(*g->head));
+    g->next = malloc((n + 1) * sizeof(*g->next));
+    if (g->head == NULL || g->next == NULL) {
+        dg_free(g);
+        return -1;
+    }
+    for (b = 0; b < size; b++)
+        g->head[b] = -1;
+    for (i = 0; i < n; i++) {
+        b = dg_bucket(g, dg_cell(g, x[i]), dg_cell(g, y[i]));
+        g->next[i] = g->head[b];
+        g->head[b] = i;
+    }
+    return 0;
+}
+
+/* release grid */
+void dg_free(struct dg_grid_str *g)
+{
+    free(g->head);
+    free(g->next);
+    g->head = NULL;
+    g->next = NULL;
+}
+
+/* find all pairs of discs closer than gap, returns -1 on error */
+int dg_overlaps(const double *x, const double *y, const double *r, int n,
+                double gap, struct dg_pair_str **pairs, int *n_pairs)
+{
+    struct dg_grid_str g;
+    struct dg_pair_list_str pl = {NULL, 0, 0};
+    double r_sum = 0.0;
+    int i, j;
+
+    for (i = 0; i < n; i++)
+        r_sum += r[i];
+
+    /*
+     * cells fit a dot of mean size, so a few large ones leave them
+     * fine.  Each pair is found from its larger dot, looking as many
+     * cells out as its reach takes, or at every dot if that is less
+     */
+    if (dg_build(&g, x, y, n,
+                 fmax(2.0 * r_sum / MAX(n, 1) + gap, 1e-6)) != 0)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        long cx = dg_cell(&g, x[i]);
+        long cy = dg_cell(&g, y[i]);
+        double k = ceil((2.0 * r[i] + gap) / g.cell);
+        long ix, iy;
+
+        if ((2.0 * k + 1.0) * (2.0 * k + 1.0) > n) {
+            for (j = 0; j < n; j++)
+                if (add_pair(&pl, x, y, r, gap, i, j) != 0)
+                    goto fail;
+            continue;
+        }
+        for (ix = cx - (long)k; ix <= cx + (long)k; ix++)
+            for (iy = cy - (long)k; iy <= cy + (long)k; iy++)
+                for (j = g.head[dg_bucket(&g, ix, iy)]; j >= 0;
+                     j = g.next[j]) {
+                    /* skip hash collisions from far cells */
+                    if (dg_cell(&g, x[j]) != ix || dg_cell(&g, y[j]) != iy)
+                        continue;
+                    if (add_pair(&pl, x, y, r, gap, i, j) != 0)
+                        goto fail;
+                }
+    }
+
+    dg_free(&g);
+    if (pl.n > 0)
+        qsort(pl.p, pl.n, sizeof(*pl.p), cmp_pair);
+    *pairs = pl.p;
+    *n_pairs = pl.n;
+    return 0;
+
+fail:
+    free(pl.p);
+    dg_free(&g);
+    return -1;
+}
+
+/* group dots connected by pairs, each under its largest key */
+void dg_clusters(int n, const struct dg_pair_str *pairs, int n_pairs,
+                 const double *key, int *root)
+{
+    int i, a, b;
+
+    for (i = 0; i < n; i++)
+        root[i] = i;
+    for (i = 0; i < n_pairs; i++) {
+        a = find(root, pairs[i].i);
+        b = find(root, pairs[i].j);
+        if (a == b)
+            continue;
+        if (ahead(key, a, b))
+            root[b] = a;
+        else
+            root[a] = b;
+    }
+    for (i = 0; i < n; i++)
+        root[i] = find(root, i);
+}
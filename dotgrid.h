@@ -0,0 +1,57 @@
+/*
+ * Header file for dot grid module
+ *
+ * Uniform grid over surface coordinates, stored as a hash table
+ * of cells so memory is proportional to the number of dots rather
+ * than the surface area.
+ */
+
+#ifndef _DOTGRID_H_
+#define _DOTGRID_H_
+
+struct dg_grid_str {
+    double cell;                /* cell size (surface units) */
+    unsigned int mask;          /* hash table size - 1 */
+    int *head;                  /* first dot in each bucket, -1 if none */
+    int *next;                  /* next dot in same bucket */
+    const double *x;            /* dot coordinates (not copied) */
+    const double *y;
+    int n;
+};
+
+/* pair of dots closer than allowed */
+struct dg_pair_str {
+    int i;
+    int j;
+    double d;                   /* center to center distance */
+};
+
+/*
+ * public function prototypes
+ */
+
+/* hash all n dots into cells of size cell, returns -1 on error */
+int dg_build(struct dg_grid_str *g, const double *x, const double *y,
+             int n, double cell);
+/* release grid */
+void dg_free(struct dg_grid_str *g);
+/* hash bucket of cell (ix, iy) */
+unsigned int dg_bucket(const struct dg_grid_str *g, long ix, long iy);
+/* cell index of coordinate */
+long dg_cell(const struct dg_grid_str *g, double v);
+/*
+ * find all pairs of discs (center x, y, radius r) whose edges are
+ * closer than gap (gap 0: overlapping), returns -1 on error.
+ * *pairs is allocated, caller frees; i < j in each, in order of i, j
+ */
+int dg_overlaps(const double *x, const double *y, const double *r, int n,
+                double gap, struct dg_pair_str **pairs, int *n_pairs);
+/*
+ * group dots connected by pairs: root[i] is the dot of i's group with
+ * the largest key, the smallest index of those (key NULL: smallest
+ * index)
+ */
+void dg_clusters(int n, const struct dg_pair_str *pairs, int n_pairs,
+                 const double *key, int *root);
+
+#endif
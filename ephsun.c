@@ -0,0 +1,48 @@
+#include "ephtime.h"
+#include "ephutil.h"
+#include "ephsun.h"
+
+/*
+ * All code derived from:
+ *   Astronomical Algorithms, 2nd Edition
+ *   Jean Meeus
+ *   Willmann-Bell, Inc.
+ */
+
+/*
+ * ephSunPos: apparent position of the Sun, low accuracy
+ *   Derived from equations (25.2) - (25.8)
+ *     (obliquity from equation (22.2))
+ */
+void
+ephSunPos(double jd, double *pAlpha, double *pDelta)
+{
+    double t;
+    double l0;      /* geometric mean longitude */
+    double m;       /* mean anomaly */
+    double c;       /* equation of center */
+    double omega;   /* longitude of ascending node of moon's orbit */
+    double lambda;  /* apparent longitude */
+    double eps;     /* obliquity of the ecliptic, corrected */
+
+    t = ephCalcT(jd);
+
+    l0 = 280.46646 + t*(36000.76983 + t*0.0003032);
+    m = 357.52911 + t*(35999.05029 - t*0.0001537);
+    c = (1.914602 - t*(0.004817 + t*0.000014))*ephSin(m)
+        + (0.019993 - t*0.000101)*ephSin(2*m)
+        + 0.000289*ephSin(3*m);
+
+    omega = 125.04 - 1934.136*t;
+    lambda = l0 + c - 0.00569 - 0.00478*ephSin(omega);
+
+    eps = 23.0 + (26.0 + (21.448 - t*(46.8150 + t*(0.00059
+            - t*0.001813)))/60.0)/60.0;
+    eps += 0.00256*ephCos(omega);
+
+    *pAlpha = ephAngleRed(ephATan2(ephCos(eps)*ephSin(lambda),
+            ephCos(lambda)));
+    *pDelta = ephASin(ephSin(eps)*ephSin(lambda));
+
+    return;
+}
@@ -0,0 +1,18 @@
+/*
+ * calculate position of the Sun
+ */
+#ifndef EPHSUN_H
+#define EPHSUN_H
+
+/*
+ * ephSunPos: apparent right ascension, declination of the Sun,
+ *   low accuracy (0.01 degree)
+ *   input:
+ *     jd: JD (or JDE)
+ *   output:
+ *     right ascension, declination, degrees
+ *     (see chapter 25)
+ */
+void ephSunPos(double jd, double *pAlpha, double *pDelta);
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <math.h>
 
 #include "ephtime.h"
 #include "ephutil.h"
@@ -45,6 +46,49 @@ ephCalcJD(struct ymdhms *pTime)
             + fDay + b - 1524.5;
 }
 
+/*
+ * ephCalcDate: Calculate calendar date of Julian Day.
+ *   Derived from the method of chapter 7 (page 63)
+ */
+void
+ephCalcDate(double jd, struct ymdhms *pTime)
+{
+    long z;
+    long a;
+    long alpha;
+    long b;
+    long c;
+    long d;
+    long e;
+    long ms;    /* milliseconds into the day */
+
+    jd += 0.5;
+    z = (long)jd;
+    ms = (long)floor((jd - z) * 86400000.0 + 0.5);
+    if (ms >= 86400000) {
+        z++;
+        ms -= 86400000;
+    }
+
+    if (z < 2299161) {
+        a = z;
+    } else {
+        alpha = (long)((z - 1867216.25)/36524.25);
+        a = z + 1 + alpha - alpha/4;
+    }
+    b = a + 1524;
+    c = (long)((b - 122.1)/365.25);
+    d = (long)(365.25 * c);
+    e = (long)((b - d)/30.6001);
+
+    pTime->day = b - d - (long)(30.6001 * e);
+    pTime->month = (e < 14) ? e - 1 : e - 13;
+    pTime->year = (pTime->month > 2) ? c - 4716 : c - 4715;
+    pTime->hour = ms / 3600000;
+    pTime->minute = (ms / 60000) % 60;
+    pTime->second = (ms % 60000) / 1000.0;
+}
+
 /*
  * ephCalcT: Calculate T, centuries from Epoch J2000.0 (JDE 2451545.0)
  *   derived from equation (22.1)
@@ -28,6 +28,16 @@ struct ymdhms {
  */
 double ephCalcJD(struct ymdhms *pTime);
 
+/*
+ * ephCalcDate: convert JD to ymdhms (to the millisecond)
+ *   input:
+ *     JD
+ *   output:
+ *     ymdhms struct is populated
+ *     (see chapter 7)
+ */
+void ephCalcDate(double jd, struct ymdhms *pTime);
+
 /*
  * ephCalcT: convert JDE to T
  *   input:
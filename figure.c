@@ -0,0 +1,463 @@
+/*
+ * sky figure module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "figure.h"
+
+#define LINE_LEN  4096
+#define FIG_STEP  (2.0 * M_PI / 180.0)  /* longest arc piece, radians */
+#define CLIP_ANG  1e-5          /* cuts found to, radians */
+#define MAX_DEPTH 30
+#define RUN_LEN   64            /* most points merged into one chord */
+
+/* Hipparcos number to catalog index, sorted by number */
+struct hip_idx_str {
+    int hip;
+    int i;
+};
+
+/* a projected point */
+struct proj_str {
+    int vis;                    /* nonzero if drawn */
+    double x, y;
+    int surf;
+};
+
+/*
+ * figures being projected.  Half the tolerance goes to each chord
+ * against its arc, half to merging chords in a line: the points a
+ * merged chord replaces (run[1 .. n_run - 1], from run[0]) are kept
+ * to check it against
+ */
+struct walk_str {
+    fig_proj_fn proj;
+    void *ctx;
+    double tol;                 /* half the tolerance */
+    struct fig_pt_str *pt;
+    int n, cap;
+    int fig;                    /* figure being drawn */
+    int drawing;                /* pen is down at the last point */
+    struct proj_str run[RUN_LEN];
+    int n_run;
+    int failed;
+};
+
+/*
+ * private functions
+ */
+
+static int cmp_hip(const void *a, const void *b)
+{
+    const struct hip_idx_str *p = a, *q = b;
+
+    return (p->hip > q->hip) - (p->hip < q->hip);
+}
+
+/* new figure, returns NULL on error */
+static struct fig_str *add_fig(struct fig_set_str *fs, int *cap,
+                               const char *name, int closed)
+{
+    struct fig_str *f;
+
+    if (fs->n_figs >= *cap) {
+        *cap = (*cap > 0) ? 2 * *cap : 64;
+        f = realloc(fs->fig, *cap * sizeof(*f));
+        if (f == NULL)
+            return NULL;
+        fs->fig = f;
+    }
+    f = &fs->fig[fs->n_figs++];
+    memset(f, 0, sizeof(*f));
+    strncpy(f->name, name, FIG_NAME_LEN - 1);
+    f->closed = closed;
+    f->first = fs->n_vtx;
+    return f;
+}
+
+/* new vertex, returns -1 on error */
+static int add_vtx(struct fig_set_str *fs, int *cap, const struct v3_str *u)
+{
+    struct v3_str *v;
+
+    if (fs->n_vtx >= *cap) {
+        *cap = (*cap > 0) ? 2 * *cap : 256;
+        v = realloc(fs->vtx, *cap * sizeof(*v));
+        if (v == NULL)
+            return -1;
+        fs->vtx = v;
+    }
+    fs->vtx[fs->n_vtx++] = *u;
+    return 0;
+}
+
+/* point at fraction t along the arc a to b of angle theta */
+static void slerp(const struct v3_str *a, const struct v3_str *b,
+                  double theta, double t, struct v3_str *u)
+{
+    double sa = sin((1.0 - t) * theta);
+    double sb = sin(t * theta);
+
+    u->x = sa * a->x + sb * b->x;
+    u->y = sa * a->y + sb * b->y;
+    u->z = sa * a->z + sb * b->z;
+    v3_unit(u);
+}
+
+static void project(struct walk_str *w, const struct v3_str *u,
+                    struct proj_str *p)
+{
+    p->vis = w->proj(w->ctx, u, &p->x, &p->y, &p->surf);
+}
+
+static void emit(struct walk_str *w, const struct proj_str *p, int pen)
+{
+    struct fig_pt_str *pt;
+
+    if (w->n >= w->cap) {
+        int cap = (w->cap > 0) ? 2 * w->cap : 1024;
+
+        pt = realloc(w->pt, cap * sizeof(*pt));
+        if (pt == NULL) {
+            w->failed = 1;
+            return;
+        }
+        w->pt = pt;
+        w->cap = cap;
+    }
+    pt = &w->pt[w->n++];
+    pt->x = p->x;
+    pt->y = p->y;
+    pt->surf = p->surf;
+    pt->fig = w->fig;
+    pt->pen = pen;
+    pt->pad = 0;
+}
+
+/* distance from m to the chord p0 p1 */
+static double chord_dev(const struct proj_str *p0, const struct proj_str *m,
+                        const struct proj_str *p1)
+{
+    double dx = p1->x - p0->x, dy = p1->y - p0->y;
+    double mx = m->x - p0->x, my = m->y - p0->y;
+    double len2 = dx * dx + dy * dy;
+    double s;
+
+    if (len2 <= 0.0)
+        return hypot(mx, my);
+    s = (mx * dx + my * dy) / len2;
+    s = (s < 0.0) ? 0.0 : ((s > 1.0) ? 1.0 : s);
+    return hypot(mx - s * dx, my - s * dy);
+}
+
+/* draw a chord to p, merged with the last if they're in line */
+static void line_to(struct walk_str *w, const struct proj_str *p)
+{
+    int k;
+
+    if (w->n_run >= 2 && w->n_run < RUN_LEN) {
+        for (k = 1; k < w->n_run; k++)
+            if (chord_dev(&w->run[0], &w->run[k], p) > w->tol)
+                break;
+        if (k == w->n_run) {
+            w->n--;
+            emit(w, p, 1);
+            w->run[w->n_run++] = *p;
+            return;
+        }
+    }
+    emit(w, p, 1);
+    if (w->n_run >= 1)
+        w->run[0] = w->run[w->n_run - 1];
+    w->run[1] = *p;
+    w->n_run = 2;
+}
+
+/*
+ * nonzero if the eighth points of the arc from t0 to t1 are drawn
+ * within tolerance of the chord too: the middle alone misses where
+ * the projection bunches up toward one end
+ */
+static int flat(struct walk_str *w, const struct v3_str *a,
+                const struct v3_str *b, double theta,
+                double t0, const struct proj_str *p0,
+                double t1, const struct proj_str *p1)
+{
+    struct proj_str q;
+    struct v3_str u;
+    int k;
+
+    for (k = 1; k < 8; k++) {
+        if (k == 4)
+            continue;
+        slerp(a, b, theta, t0 + k * (t1 - t0) / 8.0, &u);
+        project(w, &u, &q);
+        if (!q.vis || q.surf != p0->surf || chord_dev(p0, &q, p1) > w->tol)
+            return 0;
+    }
+    return 1;
+}
+
+/* nonzero if both points are drawn on one surface, or both not drawn */
+static int same_kind(const struct proj_str *p, const struct proj_str *q)
+{
+    return p->vis == q->vis && (!p->vis || p->surf == q->surf);
+}
+
+/*
+ * draw the arc from t0 to t1 (projected p0, p1).  Where the ends
+ * differ in being drawn (or in surface) the cut is closed in on to
+ * CLIP_ANG by bisection and the pen lifted there; otherwise a chord
+ * is drawn once the middle is within tolerance of it, else halved
+ */
+static void piece(struct walk_str *w, const struct v3_str *a,
+                  const struct v3_str *b, double theta,
+                  double t0, const struct proj_str *p0,
+                  double t1, const struct proj_str *p1, int depth)
+{
+    struct proj_str m, pl, pr;
+    struct v3_str u;
+    double tm, tl, tr;
+
+    if (same_kind(p0, p1)) {
+        tm = (t0 + t1) / 2.0;
+        slerp(a, b, theta, tm, &u);
+        project(w, &u, &m);
+        if (same_kind(p0, &m)) {
+            if (!p0->vis) {
+                w->drawing = 0;
+                return;
+            }
+            if (depth >= MAX_DEPTH || (chord_dev(p0, &m, p1) <= w->tol
+                                       && flat(w, a, b, theta, t0, p0,
+                                               t1, p1))) {
+                if (!w->drawing) {
+                    emit(w, p0, 0);
+                    w->run[0] = *p0;
+                    w->n_run = 1;
+                }
+                line_to(w, p1);
+                w->drawing = 1;
+                return;
+            }
+        }
+        piece(w, a, b, theta, t0, p0, tm, &m, depth + 1);
+        piece(w, a, b, theta, tm, &m, t1, p1, depth + 1);
+        return;
+    }
+
+    /* a cut: close in on where p0's kind ends */
+    tl = t0;
+    pl = *p0;
+    tr = t1;
+    pr = *p1;
+    while ((tr - tl) * theta > CLIP_ANG) {
+        tm = (tl + tr) / 2.0;
+        slerp(a, b, theta, tm, &u);
+        project(w, &u, &m);
+        if (same_kind(p0, &m)) {
+            tl = tm;
+            pl = m;
+        } else {
+            tr = tm;
+            pr = m;
+        }
+    }
+    if (tl > t0)
+        piece(w, a, b, theta, t0, p0, tl, &pl, depth + 1);
+    w->drawing = 0;
+    if (tr < t1)
+        piece(w, a, b, theta, tr, &pr, t1, p1, depth + 1);
+}
+
+/* draw the arc between vertices i, j (projected pi, pj) */
+static void arc(struct walk_str *w, const struct fig_set_str *fs,
+                int i, int j, const struct proj_str *pi,
+                const struct proj_str *pj)
+{
+    const struct v3_str *a = &fs->vtx[i];
+    const struct v3_str *b = &fs->vtx[j];
+    struct v3_str c = *a;
+    struct proj_str p0 = *pi, p1;
+    double theta;
+    int n, k;
+
+    v3_cross(&c, b);
+    theta = atan2(v3_mag(&c), v3_dot(a, b));
+    if (theta <= 0.0)
+        return;
+    /* pieces short enough for a midpoint to catch what they do */
+    n = (int)ceil(theta / FIG_STEP);
+    for (k = 1; k <= n; k++) {
+        double t0 = (k - 1.0) / n, t1 = (double)k / n;
+        struct v3_str u;
+
+        if (k == n) {
+            p1 = *pj;
+        } else {
+            slerp(a, b, theta, t1, &u);
+            project(w, &u, &p1);
+        }
+        piece(w, a, b, theta, t0, &p0, t1, &p1, 0);
+        p0 = p1;
+    }
+}
+
+/*
+ * public functions
+ */
+
+/* read figures, returns -1 on error */
+int fig_read(FILE *in, const struct cat_str *cat, struct fig_set_str *fs)
+{
+    const double rad = M_PI / 180.0;
+    char line[LINE_LEN];
+    char kw[16], name[FIG_NAME_LEN];
+    struct hip_idx_str *hi;
+    struct fig_str *f = NULL;
+    int n_hi = 0;
+    int fig_cap = 0, vtx_cap = 0;
+    int i, k;
+
+    memset(fs, 0, sizeof(*fs));
+    hi = malloc((cat->n + 1) * sizeof(*hi));
+    if (hi == NULL)
+        return -1;
+    for (i = 0; i < cat->n; i++)
+        if (cat->star[i].hip > 0) {
+            hi[n_hi].hip = cat->star[i].hip;
+            hi[n_hi++].i = i;
+        }
+    qsort(hi, n_hi, sizeof(*hi), cmp_hip);
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, "%15s", kw) != 1 || kw[0] == '#')
+            continue;
+
+        if (strcmp(kw, "fig") == 0) {
+            char *p, *end;
+            char c;
+            int pos;
+
+            if (sscanf(line, "%*s %31s%n", name, &pos) != 1)
+                goto fail;
+            f = NULL;
+            for (p = line + pos; ; p = end) {
+                struct hip_idx_str key, *h;
+                long hip = strtol(p, &end, 10);
+
+                if (end == p)
+                    break;
+                key.hip = (int)hip;
+                h = bsearch(&key, hi, n_hi, sizeof(*hi), cmp_hip);
+                if (h == NULL) {
+                    /* the figure goes on after the missing star */
+                    fs->n_missing++;
+                    f = NULL;
+                    continue;
+                }
+                if (f == NULL && (f = add_fig(fs, &fig_cap, name, 0)) == NULL)
+                    goto fail;
+                if (add_vtx(fs, &vtx_cap, &cat->u[h->i]) != 0)
+                    goto fail;
+                f->n++;
+            }
+            if (sscanf(end, " %c", &c) == 1 && c != '#')
+                goto fail;
+            f = NULL;
+            continue;
+        }
+
+        if (strcmp(kw, "outline") == 0) {
+            if (sscanf(line, "%*s %31s", name) != 1
+                || (f = add_fig(fs, &fig_cap, name, 1)) == NULL)
+                goto fail;
+            continue;
+        }
+
+        /* vertex of the outline being read */
+        {
+            double ra, dec;
+            struct v3_str u;
+
+            if (f == NULL || !f->closed
+                || sscanf(line, "%lf %lf", &ra, &dec) != 2)
+                goto fail;
+            u.x = cos(dec * rad) * cos(ra * rad);
+            u.y = cos(dec * rad) * sin(ra * rad);
+            u.z = sin(dec * rad);
+            if (add_vtx(fs, &vtx_cap, &u) != 0)
+                goto fail;
+            f->n++;
+        }
+    }
+
+    /* a stick figure needs a segment, an outline an area */
+    for (k = 0, i = 0; i < fs->n_figs; i++) {
+        if (fs->fig[i].closed && fs->fig[i].n < 3)
+            goto fail;
+        if (fs->fig[i].n >= 2)
+            fs->fig[k++] = fs->fig[i];
+    }
+    fs->n_figs = k;
+    free(hi);
+    return 0;
+
+fail:
+    free(hi);
+    fig_free(fs);
+    return -1;
+}
+
+void fig_free(struct fig_set_str *fs)
+{
+    free(fs->fig);
+    free(fs->vtx);
+    memset(fs, 0, sizeof(*fs));
+}
+
+/* project figures, returns number of points, -1 on error */
+int fig_project(const struct fig_set_str *fs, fig_proj_fn proj, void *ctx,
+                double tol, struct fig_pt_str **pts)
+{
+    struct walk_str w;
+    struct proj_str *pv;
+    int f, i, k;
+
+    memset(&w, 0, sizeof(w));
+    w.proj = proj;
+    w.ctx = ctx;
+    w.tol = tol / 2.0;
+    *pts = NULL;
+
+    /* every vertex once, then the arcs between them */
+    pv = malloc((fs->n_vtx + 1) * sizeof(*pv));
+    if (pv == NULL)
+        return -1;
+    for (i = 0; i < fs->n_vtx; i++)
+        project(&w, &fs->vtx[i], &pv[i]);
+
+    for (f = 0; f < fs->n_figs && !w.failed; f++) {
+        const struct fig_str *fg = &fs->fig[f];
+        int n = fg->closed ? fg->n : fg->n - 1;
+
+        w.fig = f;
+        w.drawing = 0;
+        for (k = 0; k < n; k++) {
+            i = fg->first + k;
+            arc(&w, fs, i, fg->first + (k + 1) % fg->n, &pv[i],
+                &pv[fg->first + (k + 1) % fg->n]);
+        }
+    }
+    free(pv);
+    if (w.failed) {
+        free(w.pt);
+        return -1;
+    }
+    *pts = w.pt;
+    return w.n;
+}
@@ -0,0 +1,77 @@
+/*
+ * Header file for sky figure module
+ *
+ * Line features on the sky: constellation stick figures (polylines
+ * through catalog stars, by Hipparcos number) and outlines such as
+ * the Milky Way boundary (closed polygons in J2000 coordinates).
+ * Every segment is a great-circle arc.  An arc is projected by
+ * bisection until the chord between projected points stays within a
+ * tolerance of the projected curve, and is cut where the projection
+ * stops (under the horizon, off the surface, behind an occluder).
+ * The ends of all arcs are projected first, in one batch, so stars
+ * shared by several segments are projected once.
+ */
+
+#ifndef _FIGURE_H_
+#define _FIGURE_H_
+
+#include <stdio.h>
+
+#include "catalog.h"
+#include "vector3.h"
+
+#define FIG_NAME_LEN 32
+
+struct fig_str {
+    char name[FIG_NAME_LEN];
+    int closed;                 /* outline: last vertex joins the first */
+    int first, n;               /* vertices vtx[first .. first + n) */
+};
+
+struct fig_set_str {
+    struct fig_str *fig;
+    int n_figs;
+    struct v3_str *vtx;         /* equatorial unit vectors */
+    int n_vtx;
+    int n_missing;              /* figure stars not in the catalog */
+};
+
+/* one point of a projected figure */
+struct fig_pt_str {
+    double x, y;                /* projection units */
+    int surf;                   /* surface the point is on */
+    int fig;                    /* figure it belongs to */
+    int pen;                    /* 0: move here, 1: line to here */
+    int pad;
+};
+
+/*
+ * project equatorial unit vector u to (*x, *y) on surface *surf.
+ * returns 0 where nothing is drawn
+ */
+typedef int (*fig_proj_fn)(void *ctx, const struct v3_str *u,
+                           double *x, double *y, int *surf);
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * read figures, one per line ('#' comments):
+ *   fig name hip hip ...       stick figure through catalog stars
+ *   outline name               closed polygon, its vertices follow:
+ *   ra dec                     J2000, degrees
+ * a star missing from the catalog (cat_vectors done) breaks its
+ * stick figure in two.  returns -1 on error
+ */
+int fig_read(FILE *in, const struct cat_str *cat, struct fig_set_str *fs);
+void fig_free(struct fig_set_str *fs);
+/*
+ * project every figure through proj, chords within tol of the curve
+ * (projection units).  *pts gets the polylines (malloc'd), returns
+ * their number of points, -1 on error
+ */
+int fig_project(const struct fig_set_str *fs, fig_proj_fn proj, void *ctx,
+                double tol, struct fig_pt_str **pts);
+
+#endif
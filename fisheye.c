@@ -0,0 +1,302 @@
+/*
+ * fisheye image module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "fisheye.h"
+
+/* spot of a star at 4096 pixels: width SIGMA_MIN + SIGMA_K sqrt(flux) */
+#define REF_SIZE  4096.0
+#define SIGMA_MIN 0.8
+#define SIGMA_K   1.6
+#define GAIN      150.0         /* energy of a magnitude 0 star */
+#define SPOT_R    3.0           /* spot drawn out to this many sigma */
+#define MAX_R     32            /* and no further, pixels */
+#define GAMMA     2.2
+#define LUT_LEN   4096
+
+/* star colour for B-V from -0.4 in steps of 0.2 */
+#define BV_MIN  -0.4
+#define BV_STEP  0.2
+static const float bv_rgb[][3] = {
+    {0.61f, 0.69f, 1.00f}, {0.67f, 0.75f, 1.00f}, {0.79f, 0.84f, 1.00f},
+    {0.91f, 0.92f, 1.00f}, {1.00f, 0.98f, 0.97f}, {1.00f, 0.94f, 0.88f},
+    {1.00f, 0.89f, 0.78f}, {1.00f, 0.85f, 0.69f}, {1.00f, 0.81f, 0.60f},
+    {1.00f, 0.77f, 0.52f}, {1.00f, 0.73f, 0.44f}, {1.00f, 0.69f, 0.37f},
+    {1.00f, 0.65f, 0.30f}
+};
+
+/* stars binned by tile, shared by the render threads */
+struct tiles_str {
+    struct fe_str *fe;
+    const struct fe_star_str *s;
+    int n_tiles;                /* per side */
+    int *first;                 /* tile t: list[first[t] .. first[t+1]) */
+    int *list;
+    const unsigned char *lut;
+    pthread_mutex_t lock;       /* guards next */
+    int next;                   /* next tile to render */
+};
+
+/*
+ * private functions
+ */
+
+/* pixel range [*p0, *p1) of a star's spot along one axis */
+static void spot_span(float c, float sigma, int *p0, int *p1)
+{
+    int r = (int)ceil(SPOT_R * sigma);
+
+    r = (r > MAX_R) ? MAX_R : r;
+    *p0 = (int)floor(c) - r;
+    *p1 = (int)floor(c) + r + 1;
+}
+
+/* gaussian samples at pixel centers p0 .. p1, returns their sum */
+static float spot_samples(float c, float sigma, int p0, int p1, float *g)
+{
+    float k = -0.5f / (sigma * sigma);
+    float sum = 0.0f;
+    int i;
+
+    for (i = p0; i < p1; i++) {
+        float d = (float)i + 0.5f - c;
+
+        g[i - p0] = expf(k * d * d);
+        sum += g[i - p0];
+    }
+    return sum;
+}
+
+/* add star s to tile buffer buf (planes of FE_TILE^2) at (tx, ty) */
+static void splat(float *buf, int tx, int ty, const struct fe_star_str *s)
+{
+    float gx[2 * MAX_R + 1], gy[2 * MAX_R + 1];
+    float norm;
+    int x0, x1, y0, y1;
+    int c0, c1, r0, r1;         /* span within the tile */
+    int c, i, j;
+
+    spot_span(s->x, s->sigma, &x0, &x1);
+    spot_span(s->y, s->sigma, &y0, &y1);
+    /* whole spot normalized, so energy is kept across tiles */
+    norm = spot_samples(s->x, s->sigma, x0, x1, gx)
+        * spot_samples(s->y, s->sigma, y0, y1, gy);
+    if (norm <= 0.0f)
+        return;
+    c0 = (x0 > tx) ? x0 : tx;
+    c1 = (x1 < tx + FE_TILE) ? x1 : tx + FE_TILE;
+    r0 = (y0 > ty) ? y0 : ty;
+    r1 = (y1 < ty + FE_TILE) ? y1 : ty + FE_TILE;
+
+    for (c = 0; c < 3; c++) {
+        float e = s->rgb[c] / norm;
+
+        for (j = r0; j < r1; j++) {
+            float *row = buf + (c * FE_TILE + j - ty) * FE_TILE - tx;
+            const float *g = gx - x0;
+            float a = e * gy[j - y0];
+
+            for (i = c0; i < c1; i++)
+                row[i] += a * g[i];
+        }
+    }
+}
+
+/* tone map tile buffer into the frame */
+static void tone(struct fe_str *fe, const unsigned char *lut,
+                 const float *buf, int tx, int ty)
+{
+    int w = (fe->size - tx < FE_TILE) ? fe->size - tx : FE_TILE;
+    int h = (fe->size - ty < FE_TILE) ? fe->size - ty : FE_TILE;
+    int c, i, j;
+
+    for (j = 0; j < h; j++) {
+        unsigned char *px = fe->rgb + ((size_t)(ty + j) * fe->size + tx) * 3;
+
+        for (i = 0; i < w; i++)
+            for (c = 0; c < 3; c++) {
+                float v = buf[(c * FE_TILE + j) * FE_TILE + i];
+
+                v = (v < 1.0f) ? v : 1.0f;
+                px[3 * i + c] = lut[(int)(v * (LUT_LEN - 1) + 0.5f)];
+            }
+    }
+}
+
+/* render thread: take tiles until there are none left */
+static void *render_worker(void *arg)
+{
+    struct tiles_str *t = arg;
+    float *buf = malloc(3 * FE_TILE * FE_TILE * sizeof(*buf));
+    int k, i;
+
+    if (buf == NULL)
+        return t;
+    for (;;) {
+        pthread_mutex_lock(&t->lock);
+        k = t->next++;
+        pthread_mutex_unlock(&t->lock);
+        if (k >= t->n_tiles * t->n_tiles)
+            break;
+        memset(buf, 0, 3 * FE_TILE * FE_TILE * sizeof(*buf));
+        for (i = t->first[k]; i < t->first[k + 1]; i++)
+            splat(buf, (k % t->n_tiles) * FE_TILE, (k / t->n_tiles) * FE_TILE,
+                  &t->s[t->list[i]]);
+        tone(t->fe, t->lut, buf, (k % t->n_tiles) * FE_TILE,
+             (k / t->n_tiles) * FE_TILE);
+    }
+    free(buf);
+    return NULL;
+}
+
+/* tiles [*t0, *t1] touched by a star's spot along one axis */
+static void tile_span(const struct tiles_str *t, float c, float sigma,
+                      int *t0, int *t1)
+{
+    int p0, p1;
+
+    spot_span(c, sigma, &p0, &p1);
+    *t0 = (p0 < 0) ? 0 : p0 / FE_TILE;
+    *t0 = (*t0 >= t->n_tiles) ? t->n_tiles - 1 : *t0;
+    *t1 = (p1 < 1) ? 0 : (p1 - 1) / FE_TILE;
+    *t1 = (*t1 >= t->n_tiles) ? t->n_tiles - 1 : *t1;
+}
+
+/*
+ * public functions
+ */
+
+/* frame of size pixels, returns -1 on error */
+int fe_init(struct fe_str *fe, int size, int n_threads)
+{
+    fe->size = size;
+    fe->n_threads = (n_threads < 1) ? 1 : n_threads;
+    fe->rgb = malloc((size_t)size * size * 3);
+    return (fe->rgb == NULL) ? -1 : 0;
+}
+
+void fe_free(struct fe_str *fe)
+{
+    free(fe->rgb);
+    fe->rgb = NULL;
+}
+
+/* star at alt, az ready to render, returns 0 if under the horizon */
+int fe_star(const struct fe_str *fe, double alt, double az, double vmag,
+            int have_bv, double bv, struct fe_star_str *s)
+{
+    double scale = fe->size / REF_SIZE;
+    double flux = pow(10.0, vmag / -2.5);
+    /* equidistant: radius proportional to zenith distance */
+    double r = (90.0 - alt) / 90.0 * fe->size / 2.0;
+    double a = az * M_PI / 180.0;
+    float e = GAIN * flux * scale * scale;
+    int c;
+
+    if (alt < 0.0)
+        return 0;
+    s->x = fe->size / 2.0 - r * sin(a);
+    s->y = fe->size / 2.0 - r * cos(a);
+    s->sigma = (SIGMA_MIN + SIGMA_K * sqrt(flux)) * scale;
+    s->sigma = (s->sigma < 0.5f) ? 0.5f : s->sigma;
+    for (c = 0; c < 3; c++)
+        s->rgb[c] = e;
+    if (have_bv) {
+        double f = (bv - BV_MIN) / BV_STEP;
+        int n = sizeof(bv_rgb) / sizeof(*bv_rgb);
+        int k;
+
+        f = (f < 0.0) ? 0.0 : ((f > n - 1) ? n - 1 : f);
+        k = (f >= n - 1) ? n - 2 : (int)f;
+        f -= k;
+        for (c = 0; c < 3; c++)
+            s->rgb[c] = e * ((1.0 - f) * bv_rgb[k][c] + f * bv_rgb[k + 1][c]);
+    }
+    return 1;
+}
+
+/* render n stars into the frame, returns -1 on error */
+int fe_render(struct fe_str *fe, const struct fe_star_str *s, int n)
+{
+    struct tiles_str t;
+    unsigned char lut[LUT_LEN];
+    pthread_t *tid = NULL;
+    int *fill = NULL;
+    int n_started = 0;
+    int ret = -1;
+    int i, k, x0, x1, y0, y1, x, y;
+
+    memset(&t, 0, sizeof(t));
+    t.fe = fe;
+    t.s = s;
+    t.n_tiles = (fe->size + FE_TILE - 1) / FE_TILE;
+    t.lut = lut;
+    t.next = 0;
+    for (i = 0; i < LUT_LEN; i++)
+        lut[i] = (unsigned char)(255.0 * pow(i / (LUT_LEN - 1.0), 1.0 / GAMMA)
+                                 + 0.5);
+
+    /* counting sort of stars by the tiles they touch */
+    t.first = calloc(t.n_tiles * t.n_tiles + 1, sizeof(*t.first));
+    fill = calloc(t.n_tiles * t.n_tiles, sizeof(*fill));
+    tid = malloc(fe->n_threads * sizeof(*tid));
+    if (t.first == NULL || fill == NULL || tid == NULL)
+        goto done;
+    for (i = 0; i < n; i++) {
+        tile_span(&t, s[i].x, s[i].sigma, &x0, &x1);
+        tile_span(&t, s[i].y, s[i].sigma, &y0, &y1);
+        for (y = y0; y <= y1; y++)
+            for (x = x0; x <= x1; x++)
+                t.first[y * t.n_tiles + x + 1]++;
+    }
+    for (k = 0; k < t.n_tiles * t.n_tiles; k++)
+        t.first[k + 1] += t.first[k];
+    t.list = malloc((t.first[t.n_tiles * t.n_tiles] + 1) * sizeof(*t.list));
+    if (t.list == NULL)
+        goto done;
+    for (i = 0; i < n; i++) {
+        tile_span(&t, s[i].x, s[i].sigma, &x0, &x1);
+        tile_span(&t, s[i].y, s[i].sigma, &y0, &y1);
+        for (y = y0; y <= y1; y++)
+            for (x = x0; x <= x1; x++) {
+                k = y * t.n_tiles + x;
+                t.list[t.first[k] + fill[k]++] = i;
+            }
+    }
+
+    pthread_mutex_init(&t.lock, NULL);
+    for (k = 1; k < fe->n_threads; k++)
+        if (pthread_create(&tid[n_started], NULL, render_worker, &t) == 0)
+            n_started++;
+    ret = (render_worker(&t) == NULL) ? 0 : -1;
+    for (k = 0; k < n_started; k++) {
+        void *r;
+
+        pthread_join(tid[k], &r);
+        if (r != NULL)
+            ret = -1;
+    }
+    pthread_mutex_destroy(&t.lock);
+
+done:
+    free(t.first);
+    free(t.list);
+    free(fill);
+    free(tid);
+    return ret;
+}
+
+/* write frame as binary PPM, returns -1 on error */
+int fe_write_ppm(const struct fe_str *fe, FILE *out)
+{
+    size_t len = (size_t)fe->size * fe->size * 3;
+
+    fprintf(out, "P6\n%d %d\n255\n", fe->size, fe->size);
+    return (fwrite(fe->rgb, 1, len, out) == len) ? 0 : -1;
+}
@@ -0,0 +1,54 @@
+/*
+ * Header file for fisheye image module
+ *
+ * Renders stars into a square equidistant fisheye frame (zenith at
+ * the center, horizon on the inscribed circle, north up and east
+ * left, as seen looking up) for a planetarium projector.  Each star
+ * is a gaussian spot whose width and energy follow its magnitude.
+ *
+ * The frame is cut into tiles that threads render independently:
+ * stars are binned to the tiles their spot touches, each tile is
+ * accumulated in a small float buffer that stays in cache, then
+ * tone mapped into the 8 bit RGB frame.  Spots are separable, so
+ * the inner loop is a scaled row add that the compiler vectorizes.
+ */
+
+#ifndef _FISHEYE_H_
+#define _FISHEYE_H_
+
+#include <stdio.h>
+
+#define FE_TILE 64              /* tile side, pixels */
+
+/* one star, ready to splat */
+struct fe_star_str {
+    float x, y;                 /* center, pixels */
+    float sigma;                /* spot width, pixels */
+    float rgb[3];               /* energy in each channel */
+};
+
+struct fe_str {
+    int size;                   /* frame is size x size pixels */
+    int n_threads;
+    unsigned char *rgb;         /* frame, rows top down */
+};
+
+/*
+ * public function prototypes
+ */
+
+/* frame of size pixels rendered on n_threads, returns -1 on error */
+int fe_init(struct fe_str *fe, int size, int n_threads);
+void fe_free(struct fe_str *fe);
+/*
+ * star of magnitude vmag at altitude alt, azimuth az (degrees),
+ * colour index bv (when have_bv).  returns 0 if under the horizon
+ */
+int fe_star(const struct fe_str *fe, double alt, double az, double vmag,
+            int have_bv, double bv, struct fe_star_str *s);
+/* render n stars into the frame, returns -1 on error */
+int fe_render(struct fe_str *fe, const struct fe_star_str *s, int n);
+/* write frame as binary PPM, returns -1 on error */
+int fe_write_ppm(const struct fe_str *fe, FILE *out);
+
+#endif
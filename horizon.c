@@ -0,0 +1,177 @@
+/*
+ * horizon mask module
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "horizon.h"
+#include "ephutil.h"
+
+#define LINE_LEN 128
+#define MAX_PTS  2048            /* profile points */
+
+/*
+ * private functions
+ */
+
+static void set_limits(struct hzn_str *h)
+{
+    int i;
+
+    h->alt_min = h->alt_max = h->alt[0];
+    for (i = 1; i < HZN_N; i++) {
+        if (h->alt[i] < h->alt_min)
+            h->alt_min = h->alt[i];
+        if (h->alt[i] > h->alt_max)
+            h->alt_max = h->alt[i];
+    }
+}
+
+/* a sin(x) + b cos(x) */
+static double sincos_comb(double a, double b, double x)
+{
+    return a * ephSin(x) + b * ephCos(x);
+}
+
+/*
+ * public functions
+ */
+
+/* flat horizon at altitude alt (degrees) */
+void hzn_const(struct hzn_str *h, double alt)
+{
+    int i;
+
+    for (i = 0; i < HZN_N; i++)
+        h->alt[i] = alt;
+    h->alt_min = h->alt_max = alt;
+}
+
+/* read horizon profile, returns -1 on error */
+int hzn_read(FILE *in, struct hzn_str *h)
+{
+    double az[MAX_PTS], alt[MAX_PTS];
+    char line[LINE_LEN];
+    char *end;
+    int n = 0;
+    int used, skip = 0;
+    int i, j, k;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        /* the rest of a comment longer than the buffer */
+        if (skip) {
+            skip = (strchr(line, '\n') == NULL);
+            continue;
+        }
+        end = line + strspn(line, " \t\r\n");
+        if (*end == '#')
+            skip = (strchr(line, '\n') == NULL);
+        if (*end == '#' || *end == '\0')
+            continue;
+        if (n >= MAX_PTS
+            || sscanf(line, "%lf %lf %n", &az[n], &alt[n], &used) != 2
+            || line[used] != '\0' || fabs(alt[n]) > 90.0)
+            return -1;
+        az[n] = ephAngleRed(az[n]);
+        /* keep sorted by azimuth (insertion) */
+        for (k = n; k > 0 && az[k - 1] > az[k]; k--) {
+            double t;
+
+            t = az[k];
+            az[k] = az[k - 1];
+            az[k - 1] = t;
+            t = alt[k];
+            alt[k] = alt[k - 1];
+            alt[k - 1] = t;
+        }
+        n++;
+    }
+    if (n == 0)
+        return -1;
+    if (n == 1) {
+        hzn_const(h, alt[0]);
+        return 0;
+    }
+
+    /* linear interpolation between neighbors, wrapping at north */
+    for (i = 0, j = 0; i < HZN_N; i++) {
+        double a = i * HZN_STEP;
+        double a0, a1, f;
+        int lo, hi;
+
+        while (j < n && az[j] <= a)
+            j++;
+        if (j == 0) {
+            lo = n - 1;
+            a0 = az[lo] - 360.0;
+        } else {
+            lo = j - 1;
+            a0 = az[lo];
+        }
+        if (j == n) {
+            hi = 0;
+            a1 = az[hi] + 360.0;
+        } else {
+            hi = j;
+            a1 = az[hi];
+        }
+        f = (a1 > a0) ? (a - a0) / (a1 - a0) : 0.0;
+        h->alt[i] = alt[lo] + f * (alt[hi] - alt[lo]);
+    }
+    set_limits(h);
+    return 0;
+}
+
+/* horizon altitude at azimuth az (degrees east of north) */
+double hzn_alt(const struct hzn_str *h, double az)
+{
+    int i = (int)(az * HZN_PER_DEG + 0.5);
+
+    if (i < 0 || i >= HZN_N)
+        i = (int)(ephAngleRed(az) * HZN_PER_DEG + 0.5) % HZN_N;
+    return h->alt[i];
+}
+
+/* nonzero if object at az, alt is above the mask */
+int hzn_visible(const struct hzn_str *h, double az, double alt)
+{
+    /* cheap tests against the extremes first */
+    if (alt < h->alt_min)
+        return 0;
+    if (alt >= h->alt_max)
+        return 1;
+    return alt >= hzn_alt(h, az);
+}
+
+/*
+ * upper bound on true altitude of any star with declination in
+ * [dec0, dec1] and hour angle in [ha0, ha1]:
+ *   sin(alt) = sin(lat) sin(dec) + cos(lat) cos(dec) cos(ha)
+ * cos(dec) >= 0, so the largest cos(ha) gives the bound, leaving
+ * a sin(dec) + b cos(dec) to maximize over the declination band
+ */
+double hzn_max_alt(double lat, double dec0, double dec1,
+                   double ha0, double ha1)
+{
+    double a, b, c, s, d;
+
+    /* largest cos(ha) on the interval */
+    d = ha1 - ha0;
+    ha0 = ephAngleRed(ha0);
+    if (d >= 360.0 || ha0 + d >= 360.0 || ha0 == 0.0)
+        c = 1.0;
+    else
+        c = fmax(ephCos(ha0), ephCos(ha0 + d));
+
+    a = ephSin(lat);
+    b = ephCos(lat) * c;
+    s = fmax(sincos_comb(a, b, dec0), sincos_comb(a, b, dec1));
+    /* interior stationary point */
+    d = (b != 0.0) ? ephRadToDeg(atan(a / b)) : ((a >= 0) ? 90.0 : -90.0);
+    if (d > dec0 && d < dec1)
+        s = fmax(s, sincos_comb(a, b, d));
+    s = fmin(1.0, fmax(-1.0, s));
+    return ephASin(s);
+}
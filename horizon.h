@@ -0,0 +1,47 @@
+/*
+ * Header file for horizon mask module
+ *
+ * The local horizon (buildings, hills, trees) is held as a table of
+ * minimum apparent altitude against azimuth.
+ */
+
+#ifndef _HORIZON_H_
+#define _HORIZON_H_
+
+#include <stdio.h>
+
+#define HZN_PER_DEG 10                  /* table steps per degree */
+#define HZN_STEP    (1.0 / HZN_PER_DEG)  /* table resolution, degrees */
+#define HZN_N       (360 * HZN_PER_DEG)
+
+struct hzn_str {
+    float alt[HZN_N];           /* minimum altitude at each azimuth step */
+    double alt_min;             /* lowest point of the mask */
+    double alt_max;             /* highest point of the mask */
+};
+
+/*
+ * public function prototypes
+ */
+
+/* flat horizon at altitude alt (degrees) */
+void hzn_const(struct hzn_str *h, double alt);
+/*
+ * read horizon profile: "az alt" pairs in degrees, one per line,
+ * '#' comments; altitude is interpolated linearly between points
+ * (wrapping through north).  returns -1 on error, a line that is not
+ * such a pair or an altitude outside +-90 included
+ */
+int hzn_read(FILE *in, struct hzn_str *h);
+/* horizon altitude at azimuth az (degrees east of north) */
+double hzn_alt(const struct hzn_str *h, double az);
+/* nonzero if object at az, alt is above the mask */
+int hzn_visible(const struct hzn_str *h, double az, double alt);
+/*
+ * upper bound on true altitude (degrees) of any star with declination
+ * in [dec0, dec1] and hour angle in [ha0, ha1], seen from latitude lat
+ */
+double hzn_max_alt(double lat, double dec0, double dec1,
+                   double ha0, double ha1);
+
+#endif
@@ -0,0 +1,363 @@
+/*
+ * k-d tree module
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "kdtree.h"
+
+/* nearest neighbour search state */
+struct kd_near_str {
+    const struct kd_str *t;
+    const double *q;
+    double d2;                  /* best so far (or the bound) */
+    int best;                   /* tree position of best, -1 if none */
+};
+
+/* k nearest search state: the best so far, nearest first */
+struct kd_knear_str {
+    const struct kd_str *t;
+    const double *q;
+    int want;
+    int n;
+    double bound;               /* d2 of the last, once there are want */
+    int *pos;                   /* tree positions */
+    double *d2;
+};
+
+/* radius and box search state */
+struct kd_range_str {
+    const struct kd_str *t;
+    const double *q;            /* radius: centre */
+    double r2;
+    const double *lo, *hi;      /* box: corners, NULL for radius */
+    int *idx;
+    int max;
+    int n;                      /* found, may exceed max */
+};
+
+/*
+ * private functions
+ */
+
+static void swap_pts(struct kd_str *t, int a, int b)
+{
+    double tmp[KD_MAX_DIM];
+    int k = t->k;
+    int i;
+
+    memcpy(tmp, &t->pt[a * k], k * sizeof(*tmp));
+    memcpy(&t->pt[a * k], &t->pt[b * k], k * sizeof(*tmp));
+    memcpy(&t->pt[b * k], tmp, k * sizeof(*tmp));
+    i = t->idx[a];
+    t->idx[a] = t->idx[b];
+    t->idx[b] = i;
+}
+
+/* partial sort of lo .. hi - 1 on axis so that position m is in place */
+static void select_nth(struct kd_str *t, int lo, int hi, int m, int axis)
+{
+    int k = t->k;
+
+    hi--;
+    while (hi > lo) {
+        double pivot = t->pt[((lo + hi) / 2) * k + axis];
+        int i = lo, j = hi;
+
+        while (i <= j) {
+            while (t->pt[i * k + axis] < pivot)
+                i++;
+            while (t->pt[j * k + axis] > pivot)
+                j--;
+            if (i <= j)
+                swap_pts(t, i++, j--);
+        }
+        if (m <= j)
+            hi = j;
+        else if (m >= i)
+            lo = i;
+        else
+            return;
+    }
+}
+
+static void build(struct kd_str *t, int lo, int hi)
+{
+    double min[KD_MAX_DIM], max[KD_MAX_DIM];
+    int k = t->k;
+    int m, axis = 0;
+    int i, d;
+
+    if (hi - lo <= 1)
+        return;
+    for (d = 0; d < k; d++)
+        min[d] = max[d] = t->pt[lo * k + d];
+    for (i = lo + 1; i < hi; i++)
+        for (d = 0; d < k; d++) {
+            double v = t->pt[i * k + d];
+
+            if (v < min[d])
+                min[d] = v;
+            if (v > max[d])
+                max[d] = v;
+        }
+    for (d = 1; d < k; d++)
+        if (max[d] - min[d] > max[axis] - min[axis])
+            axis = d;
+
+    m = (lo + hi) / 2;
+    select_nth(t, lo, hi, m, axis);
+    t->axis[m] = axis;
+    build(t, lo, m);
+    build(t, m + 1, hi);
+}
+
+static double dist2(const double *a, const double *b, int k)
+{
+    double s = 0.0;
+    int d;
+
+    for (d = 0; d < k; d++)
+        s += (a[d] - b[d]) * (a[d] - b[d]);
+    return s;
+}
+
+static void nearest(struct kd_near_str *s, int lo, int hi)
+{
+    const struct kd_str *t = s->t;
+    int k = t->k;
+    int m, axis;
+    double d, d2;
+
+    if (hi <= lo)
+        return;
+    m = (lo + hi) / 2;
+    d2 = dist2(&t->pt[m * k], s->q, k);
+    if (d2 <= s->d2) {
+        s->d2 = d2;
+        s->best = m;
+    }
+    if (hi - lo == 1)
+        return;
+
+    /* near side first, far side only if the split is within reach */
+    axis = t->axis[m];
+    d = s->q[axis] - t->pt[m * k + axis];
+    if (d < 0.0) {
+        nearest(s, lo, m);
+        if (d * d <= s->d2)
+            nearest(s, m + 1, hi);
+    } else {
+        nearest(s, m + 1, hi);
+        if (d * d <= s->d2)
+            nearest(s, lo, m);
+    }
+}
+
+static void knearest(struct kd_knear_str *s, int lo, int hi)
+{
+    const struct kd_str *t = s->t;
+    int k = t->k;
+    int m, axis, j;
+    double d, d2;
+
+    if (hi <= lo)
+        return;
+    m = (lo + hi) / 2;
+    d2 = dist2(&t->pt[m * k], s->q, k);
+    if (d2 <= s->bound) {
+        j = (s->n < s->want) ? s->n++ : s->want - 1;
+        for (; j > 0 && s->d2[j - 1] > d2; j--) {
+            s->d2[j] = s->d2[j - 1];
+            s->pos[j] = s->pos[j - 1];
+        }
+        s->d2[j] = d2;
+        s->pos[j] = m;
+        if (s->n == s->want)
+            s->bound = s->d2[s->n - 1];
+    }
+    if (hi - lo == 1)
+        return;
+
+    axis = t->axis[m];
+    d = s->q[axis] - t->pt[m * k + axis];
+    if (d < 0.0) {
+        knearest(s, lo, m);
+        if (d * d <= s->bound)
+            knearest(s, m + 1, hi);
+    } else {
+        knearest(s, m + 1, hi);
+        if (d * d <= s->bound)
+            knearest(s, lo, m);
+    }
+}
+
+static int in_box(const double *p, const double *lo, const double *hi,
+                  int k)
+{
+    int d;
+
+    for (d = 0; d < k; d++)
+        if (p[d] < lo[d] || p[d] > hi[d])
+            return 0;
+    return 1;
+}
+
+static void range(struct kd_range_str *s, int lo, int hi)
+{
+    const struct kd_str *t = s->t;
+    int k = t->k;
+    int m, axis;
+    double v, split;
+    int near;
+
+    if (hi <= lo)
+        return;
+    m = (lo + hi) / 2;
+    if (s->lo != NULL)
+        near = in_box(&t->pt[m * k], s->lo, s->hi, k);
+    else
+        near = (dist2(&t->pt[m * k], s->q, k) <= s->r2);
+    if (near) {
+        if (s->n < s->max)
+            s->idx[s->n] = t->idx[m];
+        s->n++;
+    }
+    if (hi - lo == 1)
+        return;
+
+    /* a side is searched if the region reaches across the split */
+    axis = t->axis[m];
+    split = t->pt[m * k + axis];
+    if (s->lo != NULL) {
+        if (s->lo[axis] <= split)
+            range(s, lo, m);
+        if (s->hi[axis] >= split)
+            range(s, m + 1, hi);
+    } else {
+        v = s->q[axis] - split;
+        if (v <= 0.0 || v * v <= s->r2)
+            range(s, lo, m);
+        if (v >= 0.0 || v * v <= s->r2)
+            range(s, m + 1, hi);
+    }
+}
+
+/*
+ * public functions
+ */
+
+/* build tree over n points of k coordinates, returns -1 on error */
+int kd_build(struct kd_str *t, const double *pts, int n, int k)
+{
+    int i;
+
+    memset(t, 0, sizeof(*t));
+    if (k < 1 || k > KD_MAX_DIM || n < 0)
+        return -1;
+    t->k = k;
+    t->n = n;
+    t->pt = malloc(((size_t)n * k + 1) * sizeof(*t->pt));
+    t->idx = malloc((n + 1) * sizeof(*t->idx));
+    t->axis = malloc(n + 1);
+    if (t->pt == NULL || t->idx == NULL || t->axis == NULL) {
+        kd_free(t);
+        return -1;
+    }
+    memcpy(t->pt, pts, (size_t)n * k * sizeof(*t->pt));
+    for (i = 0; i < n; i++) {
+        t->idx[i] = i;
+        t->axis[i] = 0;
+    }
+    build(t, 0, n);
+    return 0;
+}
+
+void kd_free(struct kd_str *t)
+{
+    free(t->pt);
+    free(t->idx);
+    free(t->axis);
+    memset(t, 0, sizeof(*t));
+}
+
+/* index of the point nearest q within max_d2, -1 if none */
+int kd_nearest(const struct kd_str *t, const double *q, double max_d2,
+               double *d2)
+{
+    struct kd_near_str s;
+
+    s.t = t;
+    s.q = q;
+    s.d2 = max_d2;
+    s.best = -1;
+    nearest(&s, 0, t->n);
+    if (s.best < 0)
+        return -1;
+    if (d2 != NULL)
+        *d2 = s.d2;
+    return t->idx[s.best];
+}
+
+/* up to n points nearest q within max_d2, returns their number */
+int kd_knearest(const struct kd_str *t, const double *q, int n,
+                double max_d2, int *idx, double *d2)
+{
+    struct kd_knear_str s;
+    double buf[64];
+    int i;
+
+    if (n <= 0)
+        return 0;
+    s.t = t;
+    s.q = q;
+    s.want = n;
+    s.n = 0;
+    s.bound = max_d2;
+    s.pos = idx;
+    s.d2 = (d2 != NULL) ? d2 : (n <= 64) ? buf : malloc(n * sizeof(*s.d2));
+    if (s.d2 == NULL)
+        return 0;
+    knearest(&s, 0, t->n);
+    for (i = 0; i < s.n; i++)
+        idx[i] = t->idx[s.pos[i]];
+    if (s.d2 != d2 && s.d2 != buf)
+        free(s.d2);
+    return s.n;
+}
+
+/* points within squared distance r2 of q, returns their number */
+int kd_radius(const struct kd_str *t, const double *q, double r2, int *idx,
+              int max)
+{
+    struct kd_range_str s;
+
+    s.t = t;
+    s.q = q;
+    s.r2 = r2;
+    s.lo = s.hi = NULL;
+    s.idx = idx;
+    s.max = max;
+    s.n = 0;
+    range(&s, 0, t->n);
+    return s.n;
+}
+
+/* points within the box lo .. hi, returns their number */
+int kd_box(const struct kd_str *t, const double *lo, const double *hi,
+           int *idx, int max)
+{
+    struct kd_range_str s;
+
+    s.t = t;
+    s.q = NULL;
+    s.r2 = 0.0;
+    s.lo = lo;
+    s.hi = hi;
+    s.idx = idx;
+    s.max = max;
+    s.n = 0;
+    range(&s, 0, t->n);
+    return s.n;
+}
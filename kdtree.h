@@ -0,0 +1,59 @@
+/*
+ * Header file for k-d tree module
+ *
+ * Points in 2 or 3 dimensions in a balanced k-d tree kept implicitly
+ * in one array: the node of points lo .. hi - 1 is the median, at
+ * (lo + hi) / 2, with the points below it on one side of its split
+ * and those above it on the other.  Each node splits along the
+ * widest extent of its points.  Points are copied in tree order, so
+ * a query walks memory in a few runs.  Nearest, radius and box
+ * queries take O(log n) plus the points found.
+ */
+
+#ifndef _KDTREE_H_
+#define _KDTREE_H_
+
+#define KD_MAX_DIM 3
+
+struct kd_str {
+    int k;                      /* dimensions */
+    int n;
+    double *pt;                 /* k coordinates per point, tree order */
+    int *idx;                   /* index given to kd_build, tree order */
+    unsigned char *axis;        /* split axis of each node */
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * build tree over n points of k (1 .. KD_MAX_DIM) coordinates each,
+ * pts[i * k ..].  returns -1 on error
+ */
+int kd_build(struct kd_str *t, const double *pts, int n, int k);
+void kd_free(struct kd_str *t);
+/*
+ * index of the point nearest q within squared distance max_d2, -1 if
+ * none; *d2 (may be NULL) gets its squared distance
+ */
+int kd_nearest(const struct kd_str *t, const double *q, double max_d2,
+               double *d2);
+/*
+ * up to n points nearest q within squared distance max_d2, nearest
+ * first: indices to idx, squared distances to d2 (may be NULL).
+ * returns their number
+ */
+int kd_knearest(const struct kd_str *t, const double *q, int n,
+                double max_d2, int *idx, double *d2);
+/*
+ * points within squared distance r2 of q, in no order: up to max
+ * indices to idx.  returns their number, which may exceed max
+ */
+int kd_radius(const struct kd_str *t, const double *q, double r2, int *idx,
+              int max);
+/* same, for the points within the box lo .. hi (inclusive) */
+int kd_box(const struct kd_str *t, const double *lo, const double *hi,
+           int *idx, int max);
+
+#endif
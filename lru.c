@@ -0,0 +1,166 @@
+/*
+ * in-memory LRU module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lru.h"
+
+#define N_BUCKETS 1024          /* a power of two */
+
+/*
+ * private functions
+ */
+
+/* FNV-1a */
+static unsigned key_hash(const char *key)
+{
+    unsigned h = 2166136261u;
+
+    for (; *key != '\0'; key++) {
+        h ^= (unsigned char)*key;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void unlink_used(struct lru_str *l, struct lru_ent_str *e)
+{
+    if (e->prev != NULL)
+        e->prev->next = e->next;
+    else
+        l->head = e->next;
+    if (e->next != NULL)
+        e->next->prev = e->prev;
+    else
+        l->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void push_used(struct lru_str *l, struct lru_ent_str *e)
+{
+    e->prev = NULL;
+    e->next = l->head;
+    if (l->head != NULL)
+        l->head->prev = e;
+    l->head = e;
+    if (l->tail == NULL)
+        l->tail = e;
+}
+
+static struct lru_ent_str *find(const struct lru_str *l, const char *key,
+                                unsigned h)
+{
+    struct lru_ent_str *e;
+
+    for (e = l->bucket[h & l->mask]; e != NULL; e = e->chain)
+        if (e->hash == h && strcmp(e->key, key) == 0)
+            return e;
+    return NULL;
+}
+
+/* take entry out of the table and list, and free it */
+static void drop(struct lru_str *l, struct lru_ent_str *e)
+{
+    struct lru_ent_str **p = &l->bucket[e->hash & l->mask];
+
+    while (*p != e)
+        p = &(*p)->chain;
+    *p = e->chain;
+    unlink_used(l, e);
+    l->bytes -= e->len;
+    l->n--;
+    free(e->data);
+    free(e);
+}
+
+/*
+ * public functions
+ */
+
+/* empty LRU, returns -1 on error */
+int lru_init(struct lru_str *l, size_t max_bytes)
+{
+    memset(l, 0, sizeof(*l));
+    l->bucket = calloc(N_BUCKETS, sizeof(*l->bucket));
+    if (l->bucket == NULL)
+        return -1;
+    l->mask = N_BUCKETS - 1;
+    l->max_bytes = max_bytes;
+    return 0;
+}
+
+void lru_free(struct lru_str *l)
+{
+    while (l->head != NULL)
+        drop(l, l->head);
+    free(l->bucket);
+    l->bucket = NULL;
+}
+
+/* entry for key, NULL on a miss */
+const void *lru_get(struct lru_str *l, const char *key, size_t *len)
+{
+    struct lru_ent_str *e = find(l, key, key_hash(key));
+
+    if (e == NULL) {
+        l->misses++;
+        return NULL;
+    }
+    l->hits++;
+    unlink_used(l, e);
+    push_used(l, e);
+    *len = e->len;
+    return e->data;
+}
+
+/* store a copy of data under key, returns -1 on error */
+int lru_put(struct lru_str *l, const char *key, const void *data,
+            size_t len)
+{
+    unsigned h = key_hash(key);
+    struct lru_ent_str *e;
+
+    if (strlen(key) >= LRU_KEY_LEN)
+        return -1;
+    e = find(l, key, h);
+    if (e != NULL)
+        drop(l, e);
+    /* an entry over the bound on its own isn't kept */
+    if (len > l->max_bytes)
+        return 0;
+
+    e = calloc(1, sizeof(*e));
+    if (e == NULL)
+        return -1;
+    e->data = malloc(len + 1);
+    if (e->data == NULL) {
+        free(e);
+        return -1;
+    }
+    memcpy(e->data, data, len);
+    strcpy(e->key, key);
+    e->hash = h;
+    e->len = len;
+    e->chain = l->bucket[h & l->mask];
+    l->bucket[h & l->mask] = e;
+    push_used(l, e);
+    l->bytes += len;
+    l->n++;
+
+    while (l->bytes > l->max_bytes && l->tail != e) {
+        drop(l, l->tail);
+        l->evictions++;
+    }
+    return 0;
+}
+
+/* hit/miss statistics and size */
+void lru_report(const struct lru_str *l, FILE *out)
+{
+    fprintf(out, "lru: %ld hits, %ld misses, %ld evicted; %d entries,"
+            " %.1f of %.1f MB\n", l->hits, l->misses, l->evictions, l->n,
+            l->bytes / 1048576.0, l->max_bytes / 1048576.0);
+}
@@ -0,0 +1,63 @@
+/*
+ * Header file for in-memory LRU module
+ *
+ * Recent results kept in memory, keyed by string, up to a size
+ * bound.  Entries are chained in a hash table for lookup and in a
+ * list from most to least recently used; storing past the bound
+ * drops entries from the tail.  Not thread safe: meant for the
+ * single threaded server loop.
+ */
+
+#ifndef _LRU_H_
+#define _LRU_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define LRU_KEY_LEN 128
+
+struct lru_ent_str {
+    char key[LRU_KEY_LEN];
+    unsigned hash;
+    void *data;
+    size_t len;
+    struct lru_ent_str *chain;  /* next in hash bucket */
+    struct lru_ent_str *prev;   /* more recently used */
+    struct lru_ent_str *next;   /* less recently used */
+};
+
+struct lru_str {
+    struct lru_ent_str **bucket;
+    unsigned mask;              /* buckets - 1, a power of two */
+    struct lru_ent_str *head;   /* most recently used */
+    struct lru_ent_str *tail;
+    size_t bytes;               /* held by entries */
+    size_t max_bytes;
+    int n;
+    long hits;
+    long misses;
+    long evictions;
+};
+
+/*
+ * public function prototypes
+ */
+
+/* empty LRU holding up to max_bytes, returns -1 on error */
+int lru_init(struct lru_str *l, size_t max_bytes);
+void lru_free(struct lru_str *l);
+/*
+ * entry for key (made most recently used), NULL on a miss.  *len
+ * gets its length.  Valid until the next lru_put
+ */
+const void *lru_get(struct lru_str *l, const char *key, size_t *len);
+/*
+ * store a copy of data under key (replacing any entry), then drop
+ * least recently used entries over the bound.  returns -1 on error
+ */
+int lru_put(struct lru_str *l, const char *key, const void *data,
+            size_t len);
+/* hit/miss statistics and size */
+void lru_report(const struct lru_str *l, FILE *out);
+
+#endif
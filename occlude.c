@@ -0,0 +1,214 @@
+/*
+ * occluder module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "occlude.h"
+#include "ephutil.h"
+
+#define LINE_LEN 256
+
+/*
+ * private functions
+ */
+
+/* axes of box rotated by yaw (about z), pitch (about x'), roll (about y'') */
+static void set_axes(struct occ_str *o, double yaw, double pitch, double roll)
+{
+    double cy = ephCos(yaw), sy = ephSin(yaw);
+    double cp = ephCos(pitch), sp = ephSin(pitch);
+    double cr = ephCos(roll), sr = ephSin(roll);
+    struct v3_str x = {cy, sy, 0};
+    struct v3_str y = {-sy * cp, cy * cp, sp};
+    struct v3_str z = {sy * sp, -cy * sp, cp};
+    struct v3_str t;
+
+    /* roll rotates x, z about y */
+    o->ax[1] = y;
+    o->ax[0] = x;
+    v3_mul(&o->ax[0], cr);
+    t = z;
+    v3_mul(&t, -sr);
+    v3_add(&o->ax[0], &t);
+    o->ax[2] = z;
+    v3_mul(&o->ax[2], cr);
+    t = x;
+    v3_mul(&t, sr);
+    v3_add(&o->ax[2], &t);
+}
+
+/* axis-aligned bounds of (possibly rotated) box */
+static void bounds(const struct occ_str *o, struct bvh_box_str *b)
+{
+    struct v3_str e;
+    int i;
+
+    e.x = e.y = e.z = 0.0;
+    for (i = 0; i < 3; i++) {
+        double h = (i == 0) ? o->h.x : ((i == 1) ? o->h.y : o->h.z);
+
+        e.x += fabs(o->ax[i].x) * h;
+        e.y += fabs(o->ax[i].y) * h;
+        e.z += fabs(o->ax[i].z) * h;
+    }
+    b->lo = o->c;
+    v3_sub(&b->lo, &e);
+    b->hi = o->c;
+    v3_add(&b->hi, &e);
+}
+
+/* BVH callback */
+static int occ_hit(void *ctx, int prim,
+                   const struct v3_str *p, const struct v3_str *u,
+                   double *t_max)
+{
+    const struct occ_scene_str *sc = ctx;
+    double t = occ_box_hit(&sc->occ[prim], p, u);
+
+    if (t >= *t_max)
+        return 0;
+    *t_max = t;
+    return 1;
+}
+
+/*
+ * public functions
+ */
+
+/* read scene description, returns -1 on error */
+int occ_read(FILE *in, struct occ_scene_str *sc)
+{
+    char line[LINE_LEN];
+    char kw[16];
+    struct bvh_box_str *boxes;
+    struct occ_str *o;
+    int cap = 0;
+    int len;
+    int i;
+
+    memset(sc, 0, sizeof(*sc));
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, "%15s", kw) != 1 || kw[0] == '#')
+            continue;
+
+        if (sc->n >= cap) {
+            cap = (cap > 0) ? 2 * cap : 64;
+            o = realloc(sc->occ, cap * sizeof(*o));
+            if (o == NULL)
+                goto fail;
+            sc->occ = o;
+        }
+        o = &sc->occ[sc->n];
+        memset(o, 0, sizeof(*o));
+        if (sscanf(line, "%*s %15s%n", o->name, &len) != 1)
+            goto fail;
+
+        if (strcmp(kw, "box") == 0) {
+            struct v3_str lo, hi;
+
+            if (sscanf(line + len, "%lf %lf %lf %lf %lf %lf",
+                       &lo.x, &lo.y, &lo.z, &hi.x, &hi.y, &hi.z) != 6
+                || hi.x < lo.x || hi.y < lo.y || hi.z < lo.z)
+                goto fail;
+            o->c = lo;
+            v3_add(&o->c, &hi);
+            v3_mul(&o->c, 0.5);
+            o->h = hi;
+            v3_sub(&o->h, &o->c);
+            set_axes(o, 0.0, 0.0, 0.0);
+        } else if (strcmp(kw, "obox") == 0) {
+            double yaw, pitch, roll;
+
+            if (sscanf(line + len, "%lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                       &o->c.x, &o->c.y, &o->c.z,
+                       &o->h.x, &o->h.y, &o->h.z,
+                       &yaw, &pitch, &roll) != 9
+                || o->h.x < 0.0 || o->h.y < 0.0 || o->h.z < 0.0)
+                goto fail;
+            set_axes(o, yaw, pitch, roll);
+        } else {
+            goto fail;
+        }
+        sc->n++;
+    }
+
+    boxes = malloc(sc->n * sizeof(*boxes) + 1);
+    if (boxes == NULL)
+        goto fail;
+    for (i = 0; i < sc->n; i++)
+        bounds(&sc->occ[i], &boxes[i]);
+    i = bvh_build(&sc->bvh, boxes, sc->n);
+    free(boxes);
+    if (i != 0)
+        goto fail;
+    return 0;
+
+fail:
+    free(sc->occ);
+    memset(sc, 0, sizeof(*sc));
+    return -1;
+}
+
+/* release scene */
+void occ_free(struct occ_scene_str *sc)
+{
+    bvh_free(&sc->bvh);
+    free(sc->occ);
+    memset(sc, 0, sizeof(*sc));
+}
+
+/* distance along unit ray to box, HUGE_VAL if missed */
+double occ_box_hit(const struct occ_str *o,
+                   const struct v3_str *p, const struct v3_str *u)
+{
+    struct v3_str d = *p;
+    double tmin = 0.0;
+    double tmax = HUGE_VAL;
+    double pd, ud, h, t0, t1;
+    int inside = 1;
+    int i;
+
+    v3_sub(&d, &o->c);
+    /* slab test in the box's own frame */
+    for (i = 0; i < 3; i++) {
+        h = (i == 0) ? o->h.x : ((i == 1) ? o->h.y : o->h.z);
+        pd = v3_dot(&d, &o->ax[i]);
+        ud = v3_dot(u, &o->ax[i]);
+        if (fabs(pd) > h)
+            inside = 0;
+        if (fabs(ud) < 1e-12) {
+            if (fabs(pd) > h)
+                return HUGE_VAL;
+            continue;
+        }
+        t0 = (-h - pd) / ud;
+        t1 = (h - pd) / ud;
+        if (t0 > t1) {
+            double t = t0;
+
+            t0 = t1;
+            t1 = t;
+        }
+        if (t0 > tmin)
+            tmin = t0;
+        if (t1 < tmax)
+            tmax = t1;
+        if (tmin > tmax)
+            return HUGE_VAL;
+    }
+    /* a box around the ray's start, the observer's, hides nothing */
+    return inside ? HUGE_VAL : tmin;
+}
+
+/* first occluder hit along ray within t_max, returns index or -1 */
+int occ_test(const struct occ_scene_str *sc,
+             const struct v3_str *p, const struct v3_str *u, double t_max)
+{
+    if (sc->n == 0)
+        return -1;
+    return bvh_any(&sc->bvh, p, u, t_max, occ_hit, (void *)sc);
+}
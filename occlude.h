@@ -0,0 +1,56 @@
+/*
+ * Header file for occluder module
+ *
+ * Light fixtures, beams, fans and skylights are described as boxes
+ * in observer coordinates (x east, y north, z up, cm).  Star rays
+ * that hit one before the ceiling or surface are dropped.  A box the
+ * observer stands in hides nothing.
+ */
+
+#ifndef _OCCLUDE_H_
+#define _OCCLUDE_H_
+
+#include <stdio.h>
+
+#include "vector3.h"
+#include "bvh.h"
+
+#define OCC_NAME_LEN 16
+
+struct occ_str {
+    char name[OCC_NAME_LEN];
+    struct v3_str c;            /* center */
+    struct v3_str h;            /* half extents along axes */
+    struct v3_str ax[3];        /* unit axes (x, y, z for plain boxes) */
+};
+
+struct occ_scene_str {
+    struct occ_str *occ;
+    int n;
+    struct bvh_str bvh;         /* hierarchy over occluder bounds */
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * read scene description, one occluder per line ('#' comments):
+ *   box  name xmin ymin zmin xmax ymax zmax
+ *   obox name cx cy cz hx hy hz yaw pitch roll
+ * obox: center, half extents, then rotations (degrees) about z,
+ * the rotated x and the rotated y axes
+ * returns -1 on error, a box with a max below its min or a negative
+ * half extent included
+ */
+int occ_read(FILE *in, struct occ_scene_str *sc);
+/* release scene */
+void occ_free(struct occ_scene_str *sc);
+/* distance along unit ray to box, HUGE_VAL if missed or p is in it */
+double occ_box_hit(const struct occ_str *o,
+                   const struct v3_str *p, const struct v3_str *u);
+/* first occluder hit along ray within t_max, returns index or -1 */
+int occ_test(const struct occ_scene_str *sc,
+             const struct v3_str *p, const struct v3_str *u, double t_max);
+
+#endif
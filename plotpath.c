@@ -0,0 +1,476 @@
+/*
+ * plotter path module
+ *
+ * The tour is a cycle over the dots plus the home position (node 0).
+ * It is held as an array (tour) with its inverse (pos); 2-opt and
+ * Or-opt moves are made of path reversals, reversing whichever side
+ * of the cycle is shorter.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "plotpath.h"
+#include "dotgrid.h"
+
+#define N_NEIGH  8              /* candidate neighbours per dot */
+#define OR_MAX   3              /* longest segment moved by Or-opt */
+#define EPS      1e-9
+
+#define GC_SAFE_Z  5.0          /* marker up height, mm */
+#define GC_LINE_F  1000         /* feed drawing lines, mm/min */
+#define HPGL_UNITS 40.0         /* plotter units per mm */
+
+struct tour_str {
+    int n;                      /* nodes, including home */
+    double *x, *y;
+    int *tour;
+    int *pos;
+    int *neigh;                 /* N_NEIGH candidates per node */
+    struct dg_grid_str g;
+    long gx0, gx1, gy0, gy1;    /* occupied cell range */
+};
+
+/*
+ * private functions
+ */
+
+static double dist(const struct tour_str *t, int a, int b)
+{
+    return hypot(t->x[a] - t->x[b], t->y[a] - t->y[b]);
+}
+
+static int succ(const struct tour_str *t, int a)
+{
+    int i = t->pos[a] + 1;
+
+    return t->tour[(i == t->n) ? 0 : i];
+}
+
+static int pred(const struct tour_str *t, int a)
+{
+    int i = t->pos[a] - 1;
+
+    return t->tour[(i < 0) ? t->n - 1 : i];
+}
+
+/* reverse path a..b (following succ), or the rest of the cycle */
+static void reverse(struct tour_str *t, int a, int b)
+{
+    int i = t->pos[a];
+    int j = t->pos[b];
+    int len = j - i;
+    int k, s;
+
+    if (len < 0)
+        len += t->n;
+    len++;
+    if (2 * len > t->n) {
+        i = t->pos[succ(t, b)];
+        j = t->pos[pred(t, a)];
+        len = t->n - len;
+    }
+    for (k = 0; k < len / 2; k++) {
+        s = t->tour[i];
+        t->tour[i] = t->tour[j];
+        t->tour[j] = s;
+        t->pos[t->tour[i]] = i;
+        t->pos[t->tour[j]] = j;
+        if (++i == t->n)
+            i = 0;
+        if (--j < 0)
+            j = t->n - 1;
+    }
+}
+
+/* replace tour edges (a, b), (c, d) by (a, c), (b, d) */
+static void exchange(struct tour_str *t, int a, int b, int c, int d)
+{
+    if (succ(t, a) == b)
+        reverse(t, b, c);
+    else
+        reverse(t, a, d);
+}
+
+/*
+ * merge points of the cells at ring r around (cx, cy) into the k
+ * best found so far, skipping those with keep[] zero (if given)
+ */
+static void scan_ring(const struct tour_str *t, long cx, long cy, long r,
+                      const char *keep, int a,
+                      int *best, double *best_d2, int k)
+{
+    long ix, iy, step;
+    int j, m;
+
+    for (ix = cx - r; ix <= cx + r; ix++) {
+        if (ix < t->gx0 || ix > t->gx1)
+            continue;
+        step = (ix == cx - r || ix == cx + r) ? 1 : 2 * r;
+        for (iy = cy - r; iy <= cy + r; iy += (step > 0) ? step : 1) {
+            if (iy < t->gy0 || iy > t->gy1)
+                continue;
+            for (j = t->g.head[dg_bucket(&t->g, ix, iy)]; j >= 0;
+                 j = t->g.next[j]) {
+                double d2;
+
+                if (j == a || (keep != NULL && !keep[j]))
+                    continue;
+                if (dg_cell(&t->g, t->x[j]) != ix ||
+                    dg_cell(&t->g, t->y[j]) != iy)
+                    continue;
+                d2 = ((t->x[j] - t->x[a]) * (t->x[j] - t->x[a]) +
+                      (t->y[j] - t->y[a]) * (t->y[j] - t->y[a]));
+                if (d2 >= best_d2[k - 1])
+                    continue;
+                /* insert into sorted k best */
+                for (m = k - 1; m > 0 && best_d2[m - 1] > d2; m--) {
+                    best[m] = best[m - 1];
+                    best_d2[m] = best_d2[m - 1];
+                }
+                best[m] = j;
+                best_d2[m] = d2;
+            }
+        }
+    }
+}
+
+/* k nearest (among keep[], if given) to node a, returns number found */
+static int nearest(const struct tour_str *t, int a, const char *keep,
+                   int *best, int k)
+{
+    double best_d2[N_NEIGH];
+    long cx = dg_cell(&t->g, t->x[a]);
+    long cy = dg_cell(&t->g, t->y[a]);
+    long rmax;
+    long r;
+    int m;
+
+    for (m = 0; m < k; m++) {
+        best[m] = -1;
+        best_d2[m] = HUGE_VAL;
+    }
+    rmax = t->gx1 - t->gx0;
+    if (t->gy1 - t->gy0 > rmax)
+        rmax = t->gy1 - t->gy0;
+    for (r = 0; r <= rmax; r++) {
+        double reach = (r - 1) * t->g.cell;
+
+        /* nothing in this ring can beat the k-th best */
+        if (r > 0 && reach > 0 && reach * reach >= best_d2[k - 1])
+            break;
+        scan_ring(t, cx, cy, r, keep, a, best, best_d2, k);
+    }
+    for (m = 0; m < k && best[m] >= 0; m++)
+        ;
+    return m;
+}
+
+/* greedy tour from home */
+static void nn_tour(struct tour_str *t, char *live)
+{
+    int a = 0;
+    int i, b;
+
+    for (i = 0; i < t->n; i++)
+        live[i] = 1;
+    for (i = 0; i < t->n; i++) {
+        t->tour[i] = a;
+        t->pos[a] = i;
+        live[a] = 0;
+        if (i + 1 < t->n && nearest(t, a, live, &b, 1) == 1)
+            a = b;
+    }
+}
+
+/* try 2-opt moves around a, returns nonzero if tour was improved */
+static int try_2opt(struct tour_str *t, int a, int *touched)
+{
+    int dir, m;
+
+    for (dir = 0; dir < 2; dir++) {
+        int b = (dir == 0) ? succ(t, a) : pred(t, a);
+        double dab = dist(t, a, b);
+
+        for (m = 0; m < N_NEIGH; m++) {
+            int c = t->neigh[a * N_NEIGH + m];
+            int d;
+            double dac;
+
+            if (c < 0)
+                break;
+            dac = dist(t, a, c);
+            if (dac >= dab)
+                break;
+            d = (dir == 0) ? succ(t, c) : pred(t, c);
+            if (c == b || d == a)
+                continue;
+            if (dac + dist(t, b, d) - dab - dist(t, c, d) < -EPS) {
+                exchange(t, a, b, c, d);
+                touched[0] = a;
+                touched[1] = b;
+                touched[2] = c;
+                touched[3] = d;
+                return 4;
+            }
+        }
+    }
+    return 0;
+}
+
+/* try moving segments starting at s1 elsewhere, returns nodes touched */
+static int try_oropt(struct tour_str *t, int s1, int *touched)
+{
+    int len, side, m;
+
+    if (t->n < OR_MAX + 4)
+        return 0;
+    for (len = 1; len <= OR_MAX; len++) {
+        int seg[OR_MAX];
+        int p = pred(t, s1);
+        int s2, nx;
+        double gain;
+
+        seg[0] = s1;
+        for (m = 1; m < len; m++)
+            seg[m] = succ(t, seg[m - 1]);
+        s2 = seg[len - 1];
+        nx = succ(t, s2);
+        /* never move home */
+        for (m = 0; m < len; m++)
+            if (seg[m] == 0)
+                return 0;
+        gain = dist(t, p, s1) + dist(t, s2, nx) - dist(t, p, nx);
+        if (gain <= EPS)
+            continue;
+
+        for (side = 0; side < 2; side++)
+            for (m = 0; m < N_NEIGH; m++) {
+                int c = t->neigh[((side == 0) ? s1 : s2) * N_NEIGH + m];
+                int e, k, in_seg = 0;
+                double fwd, rev;
+
+                if (c < 0)
+                    break;
+                for (k = 0; k < len; k++)
+                    in_seg |= (c == seg[k]);
+                if (in_seg || c == p)
+                    continue;
+                e = succ(t, c);
+                /* same as moving p, left to that move */
+                if (e == p)
+                    continue;
+                fwd = dist(t, c, s1) + dist(t, s2, e) - dist(t, c, e);
+                rev = dist(t, c, s2) + dist(t, s1, e) - dist(t, c, e);
+                if (gain - fmin(fwd, rev) <= EPS)
+                    continue;
+
+                /* p [s1..s2] nx ... c e  ->  p nx ... c [s2..s1] e */
+                exchange(t, p, s1, c, e);
+                if (c != nx)
+                    exchange(t, p, c, nx, s2);
+                /* then flip segment if forward insertion is better */
+                if (fwd < rev && len > 1)
+                    exchange(t, c, s2, s1, e);
+                touched[0] = p;
+                touched[1] = nx;
+                touched[2] = c;
+                touched[3] = e;
+                touched[4] = s1;
+                touched[5] = s2;
+                return 6;
+            }
+    }
+    return 0;
+}
+
+/* local search from every node until no move improves */
+static void improve(struct tour_str *t, char *inq)
+{
+    int *queue = t->neigh + t->n * N_NEIGH;     /* spare room */
+    int head = 0, tail = 0, count = 0;
+    int touched[6];
+    int i, k;
+
+    for (i = 0; i < t->n; i++) {
+        queue[tail++] = i;
+        inq[i] = 1;
+    }
+    count = t->n;
+    tail %= t->n;
+    while (count > 0) {
+        int a = queue[head];
+
+        head = (head + 1) % t->n;
+        count--;
+        inq[a] = 0;
+        k = try_2opt(t, a, touched);
+        if (k == 0)
+            k = try_oropt(t, a, touched);
+        for (i = 0; i < k; i++) {
+            if (inq[touched[i]])
+                continue;
+            inq[touched[i]] = 1;
+            queue[tail] = touched[i];
+            tail = (tail + 1) % t->n;
+            count++;
+        }
+    }
+}
+
+/*
+ * public functions
+ */
+
+/* length of closed path from home through dots and back home */
+double pp_length(const double *x, const double *y, const int *order, int n,
+                 double hx, double hy)
+{
+    double len = 0.0;
+    double px = hx, py = hy;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        len += hypot(x[order[i]] - px, y[order[i]] - py);
+        px = x[order[i]];
+        py = y[order[i]];
+    }
+    return len + hypot(hx - px, hy - py);
+}
+
+/* visit order for n dots starting and ending at home */
+int pp_tour(const double *x, const double *y, int n, double hx, double hy,
+            int *order)
+{
+    struct tour_str t;
+    char *flags;
+    double x0, x1, y0, y1, cell;
+    int i, k;
+
+    if (n <= 0)
+        return 0;
+    t.n = n + 1;
+    t.x = malloc(t.n * sizeof(*t.x));
+    t.y = malloc(t.n * sizeof(*t.y));
+    t.tour = malloc(t.n * sizeof(*t.tour));
+    t.pos = malloc(t.n * sizeof(*t.pos));
+    /* room for queue after neighbour lists */
+    t.neigh = malloc(t.n * (N_NEIGH + 1) * sizeof(*t.neigh));
+    flags = malloc(t.n);
+    t.g.head = NULL;
+    t.g.next = NULL;
+    if (t.x == NULL || t.y == NULL || t.tour == NULL || t.pos == NULL
+        || t.neigh == NULL || flags == NULL)
+        goto fail;
+
+    t.x[0] = x0 = x1 = hx;
+    t.y[0] = y0 = y1 = hy;
+    for (i = 0; i < n; i++) {
+        t.x[i + 1] = x[i];
+        t.y[i + 1] = y[i];
+        x0 = fmin(x0, x[i]);
+        x1 = fmax(x1, x[i]);
+        y0 = fmin(y0, y[i]);
+        y1 = fmax(y1, y[i]);
+    }
+    /* about two dots per cell */
+    cell = sqrt(2.0 * fmax((x1 - x0) * (y1 - y0), 1e-6) / t.n);
+    if (dg_build(&t.g, t.x, t.y, t.n, cell) != 0)
+        goto fail;
+    t.gx0 = dg_cell(&t.g, x0);
+    t.gx1 = dg_cell(&t.g, x1);
+    t.gy0 = dg_cell(&t.g, y0);
+    t.gy1 = dg_cell(&t.g, y1);
+
+    for (i = 0; i < t.n; i++) {
+        k = nearest(&t, i, NULL, &t.neigh[i * N_NEIGH], N_NEIGH);
+        for (; k < N_NEIGH; k++)
+            t.neigh[i * N_NEIGH + k] = -1;
+    }
+
+    nn_tour(&t, flags);
+    improve(&t, flags);
+
+    /* start at home, in either direction */
+    k = t.pos[0];
+    for (i = 0; i < n; i++)
+        order[i] = t.tour[(k + 1 + i) % t.n] - 1;
+
+    dg_free(&t.g);
+    free(t.x);
+    free(t.y);
+    free(t.tour);
+    free(t.pos);
+    free(t.neigh);
+    free(flags);
+    return 0;
+
+fail:
+    dg_free(&t.g);
+    free(t.x);
+    free(t.y);
+    free(t.tour);
+    free(t.pos);
+    free(t.neigh);
+    free(flags);
+    return -1;
+}
+
+/*
+ * write G-code, each dot a rapid move, marker down, dwell, marker
+ * up, then the lines
+ */
+void pp_write_gcode(FILE *out, const double *x, const double *y,
+                    const double *dia, const long long *label,
+                    const int *order, int n,
+                    const double *lx, const double *ly, const int *pen,
+                    int n_line)
+{
+    int i, k;
+
+    fprintf(out, "(astroplane dots: %d)\n", n);
+    fprintf(out, "G21 (mm)\nG90 (absolute)\nG0 Z%.1f\n", GC_SAFE_Z);
+    for (i = 0; i < n; i++) {
+        k = order[i];
+        fprintf(out, "(star %lld dia %.1f)\n", label[k], dia[k]);
+        fprintf(out, "G0 X%.1f Y%.1f\n", x[k], y[k]);
+        fprintf(out, "G1 Z0 F300\nG4 P%.2f\nG0 Z%.1f\n",
+                0.1 + 0.05 * dia[k], GC_SAFE_Z);
+    }
+    if (n_line > 0)
+        fprintf(out, "(lines: %d points)\n", n_line);
+    for (i = 0; i < n_line; i++) {
+        if (pen[i])
+            fprintf(out, "G1 X%.2f Y%.2f F%d\n", lx[i], ly[i], GC_LINE_F);
+        else
+            fprintf(out, "G0 Z%.1f\nG0 X%.2f Y%.2f\nG1 Z0 F300\n",
+                    GC_SAFE_Z, lx[i], ly[i]);
+    }
+    if (n_line > 0)
+        fprintf(out, "G0 Z%.1f\n", GC_SAFE_Z);
+    fprintf(out, "G0 X0 Y0\nM2\n");
+}
+
+/* write HPGL, each dot a circle, then the lines */
+void pp_write_hpgl(FILE *out, const double *x, const double *y,
+                   const double *dia, const long long *label,
+                   const int *order, int n,
+                   const double *lx, const double *ly, const int *pen,
+                   int n_line)
+{
+    int i, k;
+
+    (void)label;
+    fprintf(out, "IN;SP1;\n");
+    for (i = 0; i < n; i++) {
+        k = order[i];
+        fprintf(out, "PU%ld,%ld;CI%ld;\n",
+                lround(x[k] * HPGL_UNITS), lround(y[k] * HPGL_UNITS),
+                lround(dia[k] * HPGL_UNITS / 2.0));
+    }
+    for (i = 0; i < n_line; i++)
+        fprintf(out, "%s%ld,%ld;\n", pen[i] ? "PD" : "PU",
+                lround(lx[i] * HPGL_UNITS), lround(ly[i] * HPGL_UNITS));
+    fprintf(out, "PU0,0;SP0;\n");
+}
@@ -0,0 +1,49 @@
+/*
+ * Header file for plotter path module
+ *
+ * Orders dots for a pen/marker gantry so that travel between them
+ * is short, and writes the result as G-code or HPGL.
+ */
+
+#ifndef _PLOTPATH_H_
+#define _PLOTPATH_H_
+
+#include <stdio.h>
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * length of closed path from home (hx, hy) through dots
+ * x[order[0]] .. x[order[n - 1]] and back home
+ */
+double pp_length(const double *x, const double *y, const int *order, int n,
+                 double hx, double hy);
+/*
+ * visit order for n dots starting and ending at home (hx, hy):
+ * nearest neighbour tour over a spatial grid, improved with 2-opt
+ * and Or-opt moves on nearest neighbour candidate lists.
+ * returns -1 on error
+ */
+int pp_tour(const double *x, const double *y, int n, double hx, double hy,
+            int *order);
+/*
+ * write plotter program, coordinates and diameters in mm:
+ * each dot is a rapid move, marker down, dwell, marker up.  Then
+ * n_line line points (lx, ly): pen[i] 0 moves to a point with the
+ * marker up, 1 draws to it
+ */
+void pp_write_gcode(FILE *out, const double *x, const double *y,
+                    const double *dia, const long long *label,
+                    const int *order, int n,
+                    const double *lx, const double *ly, const int *pen,
+                    int n_line);
+/* HPGL (40 units per mm), each dot a circle */
+void pp_write_hpgl(FILE *out, const double *x, const double *y,
+                   const double *dia, const long long *label,
+                   const int *order, int n,
+                   const double *lx, const double *ly, const int *pen,
+                   int n_line);
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * quadtree module
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "quadtree.h"
+
+/* point arrays while building */
+struct pts_str {
+    const double *x, *y, *w, *flux, *dist;
+};
+
+/*
+ * private functions
+ */
+
+/* move points with v < c to the front, returns their number */
+static int split(int *p, int n, const double *v, double c)
+{
+    int i, j, t;
+
+    for (i = 0, j = 0; j < n; j++)
+        if (v[p[j]] < c) {
+            t = p[i];
+            p[i++] = p[j];
+            p[j] = t;
+        }
+    return i;
+}
+
+/* sums, centroid and extent of points idx[first .. first + count) */
+static void sum_points(const struct qt_str *t, const struct pts_str *pt,
+                       struct qt_node_str *nd)
+{
+    double x0 = HUGE_VAL, y0 = HUGE_VAL, x1 = -HUGE_VAL, y1 = -HUGE_VAL;
+    int i, k;
+
+    nd->x = nd->y = nd->w = nd->flux = 0.0;
+    nd->near = HUGE_VAL;
+    nd->bright = t->idx[nd->first];
+    for (i = nd->first; i < nd->first + nd->count; i++) {
+        k = t->idx[i];
+        nd->x += pt->w[k] * pt->x[k];
+        nd->y += pt->w[k] * pt->y[k];
+        nd->w += pt->w[k];
+        nd->flux += pt->flux[k];
+        if (pt->dist != NULL && pt->dist[k] < nd->near)
+            nd->near = pt->dist[k];
+        if (pt->flux[k] > pt->flux[nd->bright])
+            nd->bright = k;
+        x0 = fmin(x0, pt->x[k]);
+        x1 = fmax(x1, pt->x[k]);
+        y0 = fmin(y0, pt->y[k]);
+        y1 = fmax(y1, pt->y[k]);
+    }
+    nd->ext = fmax(x1 - x0, y1 - y0);
+}
+
+/* same, from the children */
+static void sum_children(const struct qt_str *t, const struct pts_str *pt,
+                         struct qt_node_str *nd, double x0, double y0,
+                         double x1, double y1)
+{
+    const struct qt_node_str *c;
+    int k;
+
+    nd->x = nd->y = nd->w = nd->flux = 0.0;
+    nd->near = HUGE_VAL;
+    nd->bright = -1;
+    for (k = 0; k < 4; k++) {
+        if (nd->child[k] < 0)
+            continue;
+        c = &t->node[nd->child[k]];
+        nd->x += c->w * c->x;
+        nd->y += c->w * c->y;
+        nd->w += c->w;
+        nd->flux += c->flux;
+        nd->near = fmin(nd->near, c->near);
+        if (nd->bright < 0 || pt->flux[c->bright] > pt->flux[nd->bright])
+            nd->bright = c->bright;
+    }
+    nd->ext = fmax(x1 - x0, y1 - y0);
+}
+
+/*
+ * build subtree over idx[first .. first + count) in the square cell
+ * centered on (cx, cy), returns node index or -1 if empty
+ */
+static int build(struct qt_str *t, const struct pts_str *pt,
+                 int first, int count, double cx, double cy, double half,
+                 int depth)
+{
+    struct qt_node_str *nd;
+    int child[4] = {-1, -1, -1, -1};
+    int n_child = 0;
+    int i, k;
+
+    if (count == 0)
+        return -1;
+
+    if (count > 1 && depth < QT_MAX_DEPTH) {
+        int *p = &t->idx[first];
+        int n_s = split(p, count, pt->y, cy);
+        int start[5];
+        double q = half / 2.0;
+
+        start[0] = 0;
+        start[1] = split(p, n_s, pt->x, cx);
+        start[2] = n_s;
+        start[3] = n_s + split(p + n_s, count - n_s, pt->x, cx);
+        start[4] = count;
+        for (k = 0; k < 4; k++) {
+            child[k] = build(t, pt, first + start[k],
+                             start[k + 1] - start[k],
+                             cx + ((k & 1) ? q : -q),
+                             cy + ((k & 2) ? q : -q), q, depth + 1);
+            if (child[k] >= 0)
+                n_child++;
+        }
+        /* a cell with one occupied quadrant is that quadrant */
+        if (n_child == 1)
+            for (k = 0; k < 4; k++)
+                if (child[k] >= 0)
+                    return child[k];
+    }
+
+    i = t->n_nodes++;
+    nd = &t->node[i];
+    nd->first = first;
+    nd->count = count;
+    for (k = 0; k < 4; k++)
+        nd->child[k] = child[k];
+    if (n_child == 0) {
+        sum_points(t, pt, nd);
+    } else {
+        double x0 = HUGE_VAL, y0 = HUGE_VAL;
+        double x1 = -HUGE_VAL, y1 = -HUGE_VAL;
+
+        for (k = first; k < first + count; k++) {
+            x0 = fmin(x0, pt->x[t->idx[k]]);
+            x1 = fmax(x1, pt->x[t->idx[k]]);
+            y0 = fmin(y0, pt->y[t->idx[k]]);
+            y1 = fmax(y1, pt->y[t->idx[k]]);
+        }
+        sum_children(t, pt, nd, x0, y0, x1, y1);
+    }
+    if (nd->w > 0.0) {
+        nd->x /= nd->w;
+        nd->y /= nd->w;
+    } else {
+        nd->x = pt->x[nd->bright];
+        nd->y = pt->y[nd->bright];
+    }
+    return i;
+}
+
+static void lod(const struct qt_str *t, int i, double res, double res_ang,
+                int *out, int *n)
+{
+    const struct qt_node_str *nd = &t->node[i];
+    int k;
+
+    if (nd->count == 1 || nd->ext <= res
+        || (res_ang > 0.0 && nd->ext <= res_ang * nd->near)
+        || (nd->child[0] < 0 && nd->child[1] < 0
+            && nd->child[2] < 0 && nd->child[3] < 0)) {
+        out[(*n)++] = i;
+        return;
+    }
+    for (k = 0; k < 4; k++)
+        if (nd->child[k] >= 0)
+            lod(t, nd->child[k], res, res_ang, out, n);
+}
+
+/*
+ * public functions
+ */
+
+/* build tree over n points, returns -1 on error */
+int qt_build(struct qt_str *t, const double *x, const double *y,
+             const double *w, const double *flux, const double *dist,
+             int n)
+{
+    struct pts_str pt = {x, y, w, flux, dist};
+    double x0 = HUGE_VAL, y0 = HUGE_VAL, x1 = -HUGE_VAL, y1 = -HUGE_VAL;
+    int i;
+
+    t->n_nodes = 0;
+    t->root = -1;
+    /* every inner node splits at least two ways: under 2n nodes */
+    t->node = malloc((2 * n + 1) * sizeof(*t->node));
+    t->idx = malloc((n + 1) * sizeof(*t->idx));
+    if (t->node == NULL || t->idx == NULL) {
+        qt_free(t);
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        t->idx[i] = i;
+        x0 = fmin(x0, x[i]);
+        x1 = fmax(x1, x[i]);
+        y0 = fmin(y0, y[i]);
+        y1 = fmax(y1, y[i]);
+    }
+    if (n > 0)
+        t->root = build(t, &pt, 0, n, (x0 + x1) / 2.0, (y0 + y1) / 2.0,
+                        fmax(x1 - x0, y1 - y0) / 2.0 * (1.0 + 1e-9) + 1e-9,
+                        0);
+    return 0;
+}
+
+void qt_free(struct qt_str *t)
+{
+    free(t->node);
+    free(t->idx);
+    t->node = NULL;
+    t->idx = NULL;
+    t->n_nodes = 0;
+    t->root = -1;
+}
+
+/* cut through the tree at resolution res or res_ang */
+int qt_lod(const struct qt_str *t, double res, double res_ang, int *out)
+{
+    int n = 0;
+
+    if (t->root >= 0)
+        lod(t, t->root, res, res_ang, out, &n);
+    return n;
+}
@@ -0,0 +1,57 @@
+/*
+ * Header file for quadtree (level of detail) module
+ *
+ * Weighted points (dots on a surface) are held in a compressed
+ * quadtree: a cell with only one occupied quadrant is replaced by
+ * that quadrant, so every inner node has at least two children.
+ * Each node carries the sums and centroid of the points below it,
+ * so a cut through the tree at any resolution is read off in time
+ * proportional to its size.
+ */
+
+#ifndef _QUADTREE_H_
+#define _QUADTREE_H_
+
+#define QT_MAX_DEPTH 40         /* coincident points share a leaf */
+
+struct qt_node_str {
+    double x, y;                /* weighted centroid of points below */
+    double ext;                 /* larger side of their bounding box */
+    double w;                   /* sum of weights */
+    double flux;                /* sum of flux */
+    double near;                /* least observer distance below */
+    int first;                  /* points below: qt_str.idx[first ..] */
+    int count;
+    int bright;                 /* point of greatest flux below */
+    int child[4];               /* sw, se, nw, ne; -1 if none */
+};
+
+struct qt_str {
+    struct qt_node_str *node;
+    int n_nodes;
+    int root;                   /* -1 if no points */
+    int *idx;                   /* points, grouped by subtree */
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * build tree over n points at (x, y) with centroid weight w, flux
+ * and distance from the observer dist (may be NULL).
+ * returns -1 on error
+ */
+int qt_build(struct qt_str *t, const double *x, const double *y,
+             const double *w, const double *flux, const double *dist,
+             int n);
+void qt_free(struct qt_str *t);
+/*
+ * cut through the tree: nodes whose points all lie within res, or
+ * within angle res_ang (radians) as seen by the observer, become
+ * one; other points stay alone.  Node indices go to out (room for
+ * n), returns their number
+ */
+int qt_lod(const struct qt_str *t, double res, double res_ang, int *out);
+
+#endif
@@ -0,0 +1,609 @@
+/*
+ * time series module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "series.h"
+
+#define TS_VERSION 2
+#define VARINT_MAX 10           /* bytes of a 64 bit varint */
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+static const char ts_magic[8] = "APSERIES";
+
+/* quantization steps: what the listing prints */
+static const double dflt_step[TS_N_FIELDS] = {
+    1e-6, 1e-6,                 /* az, alt */
+    0.1, 0.1, 0.1, 0.1,         /* east, north, dn, ds */
+    0.01, 0.1,                  /* vmag, dia */
+    1.0, 1.0                    /* wn, ws */
+};
+/* prediction: parabola for the angles, line for the rest */
+static const int dflt_order[TS_N_FIELDS] = {3, 3, 2, 2, 2, 2, 2, 2, 2, 2};
+
+/*
+ * private functions
+ */
+
+static unsigned long long zigzag(long long v)
+{
+    return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static long long unzigzag(unsigned long long u)
+{
+    return (long long)(u >> 1) ^ -(long long)(u & 1);
+}
+
+static int state_init(struct ts_state_str *st, int n, const int *order)
+{
+    st->n = n;
+    st->order = order;
+    st->n_set = 0;
+    st->q = malloc((TS_HIST * TS_N_FIELDS * (size_t)n + 1) * sizeof(*st->q));
+    st->run = calloc(n + 1, sizeof(*st->run));
+    st->id = calloc(n + 1, sizeof(*st->id));
+    st->set = malloc((n + 1) * sizeof(*st->set));
+    st->tmp = malloc((n + 1) * sizeof(*st->tmp));
+    if (st->q == NULL || st->run == NULL || st->id == NULL
+        || st->set == NULL || st->tmp == NULL)
+        return -1;
+    return 0;
+}
+
+static void state_free(struct ts_state_str *st)
+{
+    free(st->q);
+    free(st->run);
+    free(st->id);
+    free(st->set);
+    free(st->tmp);
+}
+
+/* field f of entry i predicted from the epochs before */
+static long long state_guess(const struct ts_state_str *st, int i, int f)
+{
+    const long long *q = &st->q[TS_HIST * TS_N_FIELDS * (size_t)i] + f;
+    int n = MIN(st->run[i], st->order[f]);
+
+    if (n == 3)
+        return 3 * (q[0] - q[TS_N_FIELDS]) + q[2 * TS_N_FIELDS];
+    if (n == 2)
+        return 2 * q[0] - q[TS_N_FIELDS];
+    return q[0];
+}
+
+/* entry i is qv, held outright (whole) or carried on */
+static void state_put(struct ts_state_str *st, int i, int whole,
+                      long long id, const long long *qv)
+{
+    long long *q = &st->q[TS_HIST * TS_N_FIELDS * (size_t)i];
+
+    if (whole)
+        st->run[i] = 1;
+    else if (st->run[i] < TS_HIST)
+        st->run[i]++;
+    memmove(q + TS_N_FIELDS, q, (TS_HIST - 1) * TS_N_FIELDS * sizeof(*q));
+    memcpy(q, qv, TS_N_FIELDS * sizeof(*q));
+    st->id[i] = id;
+}
+
+/* append varint of u to the block, returns -1 on error */
+static int put_varint(struct ts_writer_str *w, unsigned long long u)
+{
+    if (w->len + VARINT_MAX > w->cap) {
+        size_t cap = 2 * w->cap + 4096;
+        unsigned char *buf = realloc(w->buf, cap);
+
+        if (buf == NULL)
+            return -1;
+        w->buf = buf;
+        w->cap = cap;
+    }
+    while (u >= 0x80) {
+        w->buf[w->len++] = (unsigned char)(u | 0x80);
+        u >>= 7;
+    }
+    w->buf[w->len++] = (unsigned char)u;
+    return 0;
+}
+
+/* varint at *p, before end, to *u.  returns -1 if cut short */
+static int get_varint(const unsigned char **p, const unsigned char *end,
+                      unsigned long long *u)
+{
+    int shift;
+
+    *u = 0;
+    for (shift = 0; *p < end && shift < 7 * VARINT_MAX; shift += 7) {
+        unsigned char c = *(*p)++;
+
+        *u |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+/* id and fields of a dot held outright */
+static int put_whole(struct ts_writer_str *w, long long id,
+                     const long long *qv)
+{
+    int f;
+
+    if (put_varint(w, zigzag(id)) != 0)
+        return -1;
+    for (f = 0; f < TS_N_FIELDS; f++)
+        if (put_varint(w, zigzag(qv[f])) != 0)
+            return -1;
+    return 0;
+}
+
+/* mask and nonzero residuals of entry i, carried on */
+static int put_residual(struct ts_writer_str *w, int i, const long long *qv)
+{
+    long long res[TS_N_FIELDS];
+    unsigned mask = 0;
+    int f;
+
+    for (f = 0; f < TS_N_FIELDS; f++) {
+        res[f] = qv[f] - state_guess(&w->st, i, f);
+        if (res[f] != 0)
+            mask |= 1u << f;
+    }
+    if (put_varint(w, mask) != 0)
+        return -1;
+    for (f = 0; f < TS_N_FIELDS; f++)
+        if (res[f] != 0 && put_varint(w, zigzag(res[f])) != 0)
+            return -1;
+    return 0;
+}
+
+static void quantize(const struct ts_writer_str *w,
+                     const struct ts_rec_str *rec, long long *qv)
+{
+    int f;
+
+    for (f = 0; f < TS_N_FIELDS; f++)
+        qv[f] = llround(rec->v[f] / w->hdr.step[f]);
+}
+
+/*
+ * values that round to zero from below, which the listing prints as
+ * -0: their count, then gaps in k * TS_N_FIELDS + f over the epoch's
+ * dots.  returns -1 on error
+ */
+static int put_neg_zeros(struct ts_writer_str *w,
+                         const struct ts_rec_str *recs, int n_recs)
+{
+    long long c, prev = -1;
+    int n = 0;
+    int k, f;
+
+    for (k = 0; k < n_recs; k++)
+        for (f = 0; f < TS_N_FIELDS; f++)
+            n += (llround(recs[k].v[f] / w->hdr.step[f]) == 0
+                  && signbit(recs[k].v[f]));
+    if (put_varint(w, n) != 0)
+        return -1;
+    for (k = 0; k < n_recs && n > 0; k++)
+        for (f = 0; f < TS_N_FIELDS; f++) {
+            if (llround(recs[k].v[f] / w->hdr.step[f]) != 0
+                || !signbit(recs[k].v[f]))
+                continue;
+            c = (long long)k * TS_N_FIELDS + f;
+            if (put_varint(w, c - prev - 1) != 0)
+                return -1;
+            prev = c;
+        }
+    return 0;
+}
+
+/* catalog index after prev from its gap, -1 if past the catalog */
+static int get_index(const struct ts_reader_str *r, const unsigned char **p,
+                     const unsigned char *end, int prev)
+{
+    unsigned long long u;
+
+    if (get_varint(p, end, &u) != 0
+        || u >= (unsigned long long)(r->st.n - prev - 1))
+        return -1;
+    return prev + 1 + (int)u;
+}
+
+static int get_whole(const unsigned char **p, const unsigned char *end,
+                     long long *id, long long *qv)
+{
+    unsigned long long u;
+    int f;
+
+    if (get_varint(p, end, &u) != 0)
+        return -1;
+    *id = unzigzag(u);
+    for (f = 0; f < TS_N_FIELDS; f++) {
+        if (get_varint(p, end, &u) != 0)
+            return -1;
+        qv[f] = unzigzag(u);
+    }
+    return 0;
+}
+
+static int get_residual(const struct ts_reader_str *r,
+                        const unsigned char **p, const unsigned char *end,
+                        int i, long long *qv)
+{
+    unsigned long long mask, u;
+    int f;
+
+    if (get_varint(p, end, &mask) != 0)
+        return -1;
+    for (f = 0; f < TS_N_FIELDS; f++) {
+        qv[f] = state_guess(&r->st, i, f);
+        if (!(mask & (1u << f)))
+            continue;
+        if (get_varint(p, end, &u) != 0)
+            return -1;
+        qv[f] += unzigzag(u);
+    }
+    return 0;
+}
+
+/* entry i is qv: into the state and rec */
+static void put_rec(struct ts_reader_str *r, struct ts_rec_str *rec, int i,
+                    int whole, long long id, const long long *qv)
+{
+    int f;
+
+    state_put(&r->st, i, whole, id, qv);
+    rec->i = i;
+    rec->id = id;
+    for (f = 0; f < TS_N_FIELDS; f++)
+        rec->v[f] = qv[f] * r->hdr.step[f];
+}
+
+/*
+ * decode block of epoch e into r->recs, the state at the epoch before
+ * (unless e is a keyframe).  returns -1 on error
+ */
+static int read_block(struct ts_reader_str *r, int e)
+{
+    const struct ts_index_str *ix = &r->index[e];
+    struct ts_state_str *st = &r->st;
+    long long next = (e + 1 < r->n_epochs) ? r->index[e + 1].pos
+        : r->index_pos;
+    size_t len = (size_t)(next - ix->pos);
+    const unsigned char *p, *end;
+    unsigned long long u;
+    long long qv[TS_N_FIELDS];
+    long long id, c;
+    int n_gone, n_new, n_cont;
+    int i, j, k, prev;
+
+    if (len > r->cap) {
+        unsigned char *buf = realloc(r->buf, len);
+
+        if (buf == NULL)
+            return -1;
+        r->buf = buf;
+        r->cap = len;
+    }
+    if (fseek(r->in, ix->pos, SEEK_SET) != 0
+        || fread(r->buf, 1, len, r->in) != len)
+        return -1;
+    p = r->buf;
+    end = r->buf + len;
+
+    if (ix->key) {
+        if (get_varint(&p, end, &u) != 0
+            || u != (unsigned long long)ix->n_recs)
+            return -1;
+        for (k = 0, prev = -1; k < ix->n_recs; k++, prev = i) {
+            i = get_index(r, &p, end, prev);
+            if (i < 0 || get_whole(&p, end, &id, qv) != 0)
+                return -1;
+            put_rec(r, &r->recs[k], i, 1, id, qv);
+        }
+    } else {
+        /* what is left of the last set */
+        if (get_varint(&p, end, &u) != 0
+            || u > (unsigned long long)st->n_set)
+            return -1;
+        n_gone = (int)u;
+        for (k = 0, prev = -1; k < n_gone; k++, prev = i) {
+            i = get_index(r, &p, end, prev);
+            if (i < 0)
+                return -1;
+            st->tmp[k] = i;
+        }
+        for (j = 0, k = 0, n_cont = 0; j < st->n_set; j++) {
+            if (k < n_gone && st->tmp[k] == st->set[j])
+                k++;
+            else
+                st->set[n_cont++] = st->set[j];
+        }
+        if (k < n_gone)
+            return -1;
+
+        /* new dots, then the rest merged in */
+        if (get_varint(&p, end, &u) != 0
+            || u != (unsigned long long)(ix->n_recs - n_cont))
+            return -1;
+        n_new = (int)u;
+        for (k = 0, prev = -1; k < n_new; k++, prev = i) {
+            i = get_index(r, &p, end, prev);
+            if (i < 0 || get_whole(&p, end, &id, qv) != 0)
+                return -1;
+            put_rec(r, &r->fresh[k], i, 1, id, qv);
+        }
+        for (j = 0, k = 0; j + k < ix->n_recs; ) {
+            struct ts_rec_str *rec = &r->recs[j + k];
+
+            if (j < n_cont && (k == n_new || st->set[j] < r->fresh[k].i)) {
+                i = st->set[j++];
+                if (get_residual(r, &p, end, i, qv) != 0)
+                    return -1;
+                put_rec(r, rec, i, 0, st->id[i], qv);
+            } else if (j == n_cont || r->fresh[k].i < st->set[j])
+                *rec = r->fresh[k++];
+            else
+                return -1;
+        }
+    }
+    for (k = 0; k < ix->n_recs; k++)
+        st->set[k] = r->recs[k].i;
+    st->n_set = ix->n_recs;
+
+    /* zeros that were negative */
+    if (get_varint(&p, end, &u) != 0
+        || u > (unsigned long long)ix->n_recs * TS_N_FIELDS)
+        return -1;
+    for (n_gone = (int)u, c = -1; n_gone > 0; n_gone--) {
+        if (get_varint(&p, end, &u) != 0
+            || u >= (unsigned long long)ix->n_recs * TS_N_FIELDS - c - 1)
+            return -1;
+        c += 1 + (long long)u;
+        r->recs[c / TS_N_FIELDS].v[c % TS_N_FIELDS] = -0.0;
+    }
+    return (p == end) ? 0 : -1;
+}
+
+/*
+ * public functions
+ */
+
+int ts_create(struct ts_writer_str *w, FILE *out, int n, int key_every)
+{
+    memset(w, 0, sizeof(*w));
+    w->out = out;
+    memcpy(w->hdr.magic, ts_magic, sizeof(w->hdr.magic));
+    w->hdr.version = TS_VERSION;
+    w->hdr.n_fields = TS_N_FIELDS;
+    w->hdr.n = n;
+    w->hdr.key_every = (key_every > 0) ? key_every : TS_KEY_EVERY;
+    memcpy(w->hdr.step, dflt_step, sizeof(w->hdr.step));
+    memcpy(w->hdr.order, dflt_order, sizeof(w->hdr.order));
+    if (state_init(&w->st, n, w->hdr.order) != 0
+        || fwrite(&w->hdr, sizeof(w->hdr), 1, out) != 1) {
+        ts_finish(w);
+        return -1;
+    }
+    w->pos = sizeof(w->hdr);
+    return 0;
+}
+
+int ts_put_epoch(struct ts_writer_str *w, double jd,
+                 const struct ts_rec_str *recs, int n_recs)
+{
+    struct ts_state_str *st = &w->st;
+    struct ts_index_str *ix;
+    long long qv[TS_N_FIELDS];
+    int e = w->n_epochs;
+    int key = (e % w->hdr.key_every == 0);
+    int *cont = st->tmp;        /* carried on from the last set */
+    int n_gone = 0;
+    int i, j, k, prev;
+
+    if (e == w->cap_epochs) {
+        int cap = 2 * w->cap_epochs + 64;
+
+        ix = realloc(w->index, cap * sizeof(*ix));
+        if (ix == NULL)
+            return -1;
+        w->index = ix;
+        w->cap_epochs = cap;
+    }
+    for (k = 0, prev = -1; k < n_recs; prev = recs[k++].i)
+        if (recs[k].i <= prev || recs[k].i >= st->n)
+            return -1;
+
+    /* against the last set: dots gone, carried on and new */
+    for (j = 0, k = 0; j < st->n_set || k < n_recs; ) {
+        if (k == n_recs || (j < st->n_set && st->set[j] < recs[k].i)) {
+            n_gone++;
+            j++;
+        } else if (j == st->n_set || recs[k].i < st->set[j])
+            cont[k++] = 0;
+        else {
+            cont[k++] = !key;
+            j++;
+        }
+    }
+
+    w->len = 0;
+    if (!key) {
+        if (put_varint(w, n_gone) != 0)
+            return -1;
+        for (j = 0, k = 0, prev = -1; j < st->n_set; j++) {
+            while (k < n_recs && recs[k].i < st->set[j])
+                k++;
+            if (k < n_recs && recs[k].i == st->set[j])
+                continue;
+            if (put_varint(w, st->set[j] - prev - 1) != 0)
+                return -1;
+            prev = st->set[j];
+        }
+    }
+    for (k = 0, i = 0; k < n_recs; k++)
+        i += !cont[k];
+    if (put_varint(w, i) != 0)
+        return -1;
+    for (k = 0, prev = -1; k < n_recs; k++) {
+        const struct ts_rec_str *rec = &recs[k];
+
+        if (cont[k])
+            continue;
+        quantize(w, rec, qv);
+        if (put_varint(w, rec->i - prev - 1) != 0
+            || put_whole(w, rec->id, qv) != 0)
+            return -1;
+        state_put(st, rec->i, 1, rec->id, qv);
+        prev = rec->i;
+    }
+    for (k = 0; k < n_recs; k++) {
+        const struct ts_rec_str *rec = &recs[k];
+
+        if (!cont[k])
+            continue;
+        quantize(w, rec, qv);
+        if (put_residual(w, rec->i, qv) != 0)
+            return -1;
+        state_put(st, rec->i, 0, rec->id, qv);
+    }
+    if (put_neg_zeros(w, recs, n_recs) != 0
+        || fwrite(w->buf, 1, w->len, w->out) != w->len)
+        return -1;
+
+    for (k = 0; k < n_recs; k++)
+        st->set[k] = recs[k].i;
+    st->n_set = n_recs;
+    ix = &w->index[e];
+    ix->jd = jd;
+    ix->pos = w->pos;
+    ix->n_recs = n_recs;
+    ix->key = key;
+    w->pos += w->len;
+    w->n_epochs++;
+    w->n_recs += n_recs;
+    return 0;
+}
+
+int ts_finish(struct ts_writer_str *w)
+{
+    struct ts_tail_str tail;
+    int ret = -1;
+
+    if (w->pos == 0)
+        goto done;
+    memset(&tail, 0, sizeof(tail));
+    tail.index_pos = w->pos;
+    tail.n_epochs = w->n_epochs;
+    memcpy(tail.magic, ts_magic, sizeof(tail.magic));
+    if (fwrite(w->index, sizeof(*w->index), w->n_epochs, w->out)
+        != (size_t)w->n_epochs
+        || fwrite(&tail, sizeof(tail), 1, w->out) != 1)
+        goto done;
+    w->pos += w->n_epochs * sizeof(*w->index) + sizeof(tail);
+    ret = 0;
+
+done:
+    state_free(&w->st);
+    free(w->buf);
+    free(w->index);
+    w->buf = NULL;
+    w->index = NULL;
+    return ret;
+}
+
+int ts_open(struct ts_reader_str *r, FILE *in)
+{
+    struct ts_tail_str tail;
+    long long end;
+    int e, f;
+
+    memset(r, 0, sizeof(*r));
+    r->in = in;
+    r->at = -1;
+    if (fread(&r->hdr, sizeof(r->hdr), 1, in) != 1
+        || memcmp(r->hdr.magic, ts_magic, sizeof(r->hdr.magic)) != 0
+        || r->hdr.version != TS_VERSION
+        || r->hdr.n_fields != TS_N_FIELDS || r->hdr.n < 0
+        || r->hdr.key_every < 1
+        || fseek(in, -(long)sizeof(tail), SEEK_END) != 0
+        || (end = ftell(in)) < 0
+        || fread(&tail, sizeof(tail), 1, in) != 1
+        || memcmp(tail.magic, ts_magic, sizeof(tail.magic)) != 0
+        || tail.n_epochs < 0 || tail.index_pos < (long long)sizeof(r->hdr)
+        || tail.index_pos + tail.n_epochs * (long long)sizeof(*r->index)
+        != end)
+        return -1;
+    for (f = 0; f < TS_N_FIELDS; f++)
+        if (r->hdr.order[f] < 1 || r->hdr.order[f] > TS_HIST)
+            return -1;
+
+    r->n_epochs = tail.n_epochs;
+    r->index_pos = tail.index_pos;
+    r->index = malloc((r->n_epochs + 1) * sizeof(*r->index));
+    if (r->index == NULL || fseek(in, r->index_pos, SEEK_SET) != 0
+        || fread(r->index, sizeof(*r->index), r->n_epochs, in)
+        != (size_t)r->n_epochs)
+        goto fail;
+    /* blocks in order, each within the catalog, the first a keyframe */
+    for (e = 0; e < r->n_epochs; e++) {
+        const struct ts_index_str *ix = &r->index[e];
+
+        if (ix->pos < (e > 0 ? ix[-1].pos : (long long)sizeof(r->hdr))
+            || ix->pos > r->index_pos || ix->n_recs < 0
+            || ix->n_recs > r->hdr.n || (e == 0 && !ix->key))
+            goto fail;
+        if (ix->n_recs > r->cap_recs)
+            r->cap_recs = ix->n_recs;
+    }
+    r->recs = malloc((r->cap_recs + 1) * sizeof(*r->recs));
+    r->fresh = malloc((r->cap_recs + 1) * sizeof(*r->fresh));
+    if (r->recs == NULL || r->fresh == NULL
+        || state_init(&r->st, r->hdr.n, r->hdr.order) != 0)
+        goto fail;
+    return 0;
+
+fail:
+    ts_close(r);
+    return -1;
+}
+
+int ts_get_epoch(struct ts_reader_str *r, int e,
+                 const struct ts_rec_str **recs)
+{
+    int k;
+
+    if (e < 0 || e >= r->n_epochs)
+        return -1;
+    for (k = e; !r->index[k].key; k--)
+        ;
+    /* carry on from the epoch decoded last, if on the way */
+    if (r->at < k || r->at > e)
+        r->at = k - 1;
+    for (k = r->at + 1; k <= e; k++) {
+        if (read_block(r, k) != 0) {
+            r->at = -1;
+            return -1;
+        }
+        r->at = k;
+    }
+    *recs = r->recs;
+    return r->index[e].n_recs;
+}
+
+void ts_close(struct ts_reader_str *r)
+{
+    state_free(&r->st);
+    free(r->index);
+    free(r->buf);
+    free(r->recs);
+    free(r->fresh);
+    memset(r, 0, sizeof(*r));
+}
@@ -0,0 +1,148 @@
+/*
+ * Header file for time series module
+ *
+ * Dot listings of many epochs of one site, packed small.  Values are
+ * quantized to the precision the text listing prints them with.
+ * Every key_every epochs is a keyframe holding each dot outright.
+ * Between keyframes an epoch holds the dots gone from the set of the
+ * epoch before and the new ones (outright), and of the rest only
+ * what is left after predicting them from the last few epochs,
+ * mostly zero as dots move smoothly.  Angles follow a parabola,
+ * the rest, whose rounding would swamp that, a line.  Integers are
+ * zigzag varints (7 bits a byte, low first), and a mask per dot says
+ * which fields are not zero.
+ *
+ *   header | epoch block ... | index | trailer
+ *
+ * Dots are in catalog order, each list starting with the gaps in
+ * catalog index.  A block ends with the values that round to zero
+ * from below, so they come back as -0 and print as the listing does.
+ * The index, one entry per epoch, gives each block's offset, so an
+ * epoch is read by decoding forward from the keyframe at or before it.
+ */
+
+#ifndef _SERIES_H_
+#define _SERIES_H_
+
+#include <stdio.h>
+
+#define TS_KEY_EVERY 32         /* default epochs from keyframe to keyframe */
+#define TS_HIST 3               /* epochs predicted from, at most */
+
+/* fields of a dot, those most often changing first */
+enum ts_field {
+    TS_AZ,                      /* degrees */
+    TS_ALT,
+    TS_EAST,                    /* cm */
+    TS_NORTH,
+    TS_DN,                      /* wall measures, cm */
+    TS_DS,
+    TS_VMAG,
+    TS_DIA,                     /* mm */
+    TS_WN,                      /* wall letters, as characters */
+    TS_WS,
+    TS_N_FIELDS
+};
+
+/* one dot of an epoch */
+struct ts_rec_str {
+    int i;                      /* catalog index */
+    long long id;               /* catalog id */
+    double v[TS_N_FIELDS];
+};
+
+struct ts_hdr_str {
+    char magic[8];
+    int version;
+    int n_fields;               /* TS_N_FIELDS */
+    int n;                      /* catalog entries */
+    int key_every;
+    double step[TS_N_FIELDS];   /* quantization step of each field */
+    int order[TS_N_FIELDS];     /* epochs each is predicted from */
+};
+
+/* index entry of an epoch */
+struct ts_index_str {
+    double jd;
+    long long pos;              /* of its block, from start of file */
+    int n_recs;
+    int key;                    /* keyframe */
+};
+
+struct ts_tail_str {
+    long long index_pos;
+    int n_epochs;
+    int pad;
+    char magic[8];
+};
+
+/* prediction state: the last epoch's set, its dots' last epochs */
+struct ts_state_str {
+    int n;
+    const int *order;           /* from the header */
+    long long *q;               /* TS_HIST epochs an entry, last first */
+    unsigned char *run;         /* epochs in q, up to TS_HIST */
+    long long *id;
+    int *set;                   /* entries in the last epoch, in order */
+    int n_set;
+    int *tmp;                   /* scratch, n entries */
+};
+
+/* writer: epochs go out as they come, index at the end */
+struct ts_writer_str {
+    FILE *out;
+    struct ts_hdr_str hdr;
+    struct ts_state_str st;
+    long long pos;              /* bytes written */
+    unsigned char *buf;         /* block being packed */
+    size_t len, cap;
+    struct ts_index_str *index;
+    int n_epochs, cap_epochs;
+    long long n_recs;
+};
+
+/* reader: random access through the index */
+struct ts_reader_str {
+    FILE *in;
+    struct ts_hdr_str hdr;
+    struct ts_state_str st;
+    struct ts_index_str *index;
+    int n_epochs;
+    long long index_pos;
+    int at;                     /* epoch in recs, -1: none */
+    unsigned char *buf;
+    size_t cap;
+    struct ts_rec_str *recs;
+    struct ts_rec_str *fresh;   /* new dots of an epoch */
+    int cap_recs;
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * start a series of dots among n catalog entries on out, a keyframe
+ * every key_every epochs.  returns -1 on error
+ */
+int ts_create(struct ts_writer_str *w, FILE *out, int n, int key_every);
+/*
+ * add the epoch at jd: n_recs dots, in increasing catalog index.
+ * returns -1 on error
+ */
+int ts_put_epoch(struct ts_writer_str *w, double jd,
+                 const struct ts_rec_str *recs, int n_recs);
+/* write the index and free the writer.  returns -1 on error */
+int ts_finish(struct ts_writer_str *w);
+
+/* read header and index of a series in (seekable).  returns -1 on error */
+int ts_open(struct ts_reader_str *r, FILE *in);
+/*
+ * dots of epoch e to *recs, valid until the next call.  returns their
+ * number, -1 on error
+ */
+int ts_get_epoch(struct ts_reader_str *r, int e,
+                 const struct ts_rec_str **recs);
+void ts_close(struct ts_reader_str *r);
+
+#endif
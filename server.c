@@ -0,0 +1,398 @@
+/*
+ * query server module
+ */
+
+#define _GNU_SOURCE             /* accept4 */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#include "server.h"
+
+#define MAX_EVENTS 64
+#define READ_LEN   4096
+/* epoll data of the listening socket and signalfd; clients: slot */
+#define EV_LISTEN  0xffffffffu
+#define EV_SIGNAL  0xfffffffeu
+
+struct srv_client_str {
+    int fd;
+    unsigned gen;
+    char in[SRV_LINE_LEN];      /* partial line */
+    size_t n_in;
+    char *out;                  /* replies not yet written */
+    size_t n_out, off, cap;
+    int eof;                    /* client is done sending */
+    unsigned events;            /* polled for */
+};
+
+/*
+ * private functions
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void drop_client(struct srv_str *srv, int slot)
+{
+    struct srv_client_str *c = srv->client[slot];
+
+    epoll_ctl(srv->ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->out);
+    free(c);
+    srv->client[slot] = NULL;
+}
+
+/*
+ * poll client for reading until it is done sending, and for writing
+ * while it has output queued
+ */
+static void watch(struct srv_str *srv, int slot)
+{
+    struct srv_client_str *c = srv->client[slot];
+    struct epoll_event ev;
+
+    ev.events = (c->eof ? 0 : EPOLLIN) | (c->n_out > c->off ? EPOLLOUT : 0);
+    if (ev.events == c->events)
+        return;
+    ev.data.u64 = (unsigned)slot;
+    epoll_ctl(srv->ep, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = ev.events;
+}
+
+/* write what the socket takes, returns -1 if the client is gone */
+static int flush(struct srv_str *srv, int slot)
+{
+    struct srv_client_str *c = srv->client[slot];
+
+    while (c->off < c->n_out) {
+        ssize_t k = send(c->fd, c->out + c->off, c->n_out - c->off,
+                         MSG_NOSIGNAL);
+
+        if (k < 0 && errno == EINTR)
+            continue;
+        if (k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (k <= 0)
+            return -1;
+        c->off += k;
+    }
+    if (c->off == c->n_out)
+        c->off = c->n_out = 0;
+    watch(srv, slot);
+    return 0;
+}
+
+static void accept_clients(struct srv_str *srv)
+{
+    for (;;) {
+        struct srv_client_str *c;
+        struct epoll_event ev;
+        int fd = accept4(srv->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        int slot;
+
+        if (fd < 0)
+            return;
+        for (slot = 0; slot < srv->n_slots; slot++)
+            if (srv->client[slot] == NULL)
+                break;
+        if (slot == srv->n_slots) {
+            int n = (srv->n_slots > 0) ? 2 * srv->n_slots : 16;
+            struct srv_client_str **p = realloc(srv->client,
+                                                n * sizeof(*p));
+
+            if (p == NULL) {
+                close(fd);
+                return;
+            }
+            memset(p + srv->n_slots, 0, (n - srv->n_slots) * sizeof(*p));
+            srv->client = p;
+            srv->n_slots = n;
+        }
+        c = calloc(1, sizeof(*c));
+        if (c == NULL) {
+            close(fd);
+            return;
+        }
+        c->fd = fd;
+        c->gen = srv->gen++;
+        c->events = ev.events = EPOLLIN;
+        ev.data.u64 = (unsigned)slot;
+        if (epoll_ctl(srv->ep, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            free(c);
+            return;
+        }
+        srv->client[slot] = c;
+    }
+}
+
+/* add a complete line to the batch, returns -1 on error */
+static int add_request(struct srv_str *srv, int slot, const char *line,
+                       size_t len, double t0)
+{
+    struct srv_req_str *r;
+
+    if (srv->n_batch >= srv->batch_cap) {
+        int n = (srv->batch_cap > 0) ? 2 * srv->batch_cap : 64;
+
+        r = realloc(srv->batch, n * sizeof(*r));
+        if (r == NULL)
+            return -1;
+        srv->batch = r;
+        srv->batch_cap = n;
+    }
+    r = &srv->batch[srv->n_batch++];
+    r->client = slot;
+    r->gen = srv->client[slot]->gen;
+    r->t0 = t0;
+    memcpy(r->line, line, len);
+    r->line[len] = '\0';
+    return 0;
+}
+
+/*
+ * read what the client sent, lines into the batch.  returns -1 if
+ * the client is to be dropped (error, line too long)
+ */
+static int read_client(struct srv_str *srv, int slot)
+{
+    struct srv_client_str *c = srv->client[slot];
+    char buf[READ_LEN];
+    double t0 = now();
+
+    for (;;) {
+        ssize_t k = recv(c->fd, buf, sizeof(buf), 0);
+        ssize_t i;
+
+        if (k < 0 && errno == EINTR)
+            continue;
+        if (k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+        if (k < 0)
+            return -1;
+        if (k == 0) {
+            /* a last line without its newline is still a request */
+            if (c->n_in > 0 && c->in[c->n_in - 1] == '\r')
+                c->n_in--;
+            if (c->n_in > 0 && add_request(srv, slot, c->in, c->n_in, t0) != 0)
+                return -1;
+            c->n_in = 0;
+            c->eof = 1;
+            watch(srv, slot);
+            return 0;
+        }
+        for (i = 0; i < k; i++) {
+            if (buf[i] != '\n') {
+                if (c->n_in >= SRV_LINE_LEN - 1)
+                    return -1;
+                c->in[c->n_in++] = buf[i];
+                continue;
+            }
+            if (c->n_in > 0 && c->in[c->n_in - 1] == '\r')
+                c->n_in--;
+            if (add_request(srv, slot, c->in, c->n_in, t0) != 0)
+                return -1;
+            c->n_in = 0;
+        }
+    }
+}
+
+/*
+ * public functions
+ */
+
+/* listen on socket path, returns -1 on error */
+int srv_open(struct srv_str *srv, const char *path)
+{
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    sigset_t mask;
+
+    memset(srv, 0, sizeof(*srv));
+    srv->fd = srv->ep = srv->sig = -1;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(srv->path, path);
+    srv->lat = malloc(SRV_LAT_KEEP * sizeof(*srv->lat));
+    if (srv->lat == NULL)
+        goto fail;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    srv->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (srv->fd < 0
+        || bind(srv->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(srv->fd, SOMAXCONN) != 0)
+        goto fail;
+
+    /* signals are read from the loop like any other event */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) != 0)
+        goto fail;
+    srv->sig = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    srv->ep = epoll_create1(EPOLL_CLOEXEC);
+    if (srv->sig < 0 || srv->ep < 0)
+        goto fail;
+    ev.events = EPOLLIN;
+    ev.data.u64 = EV_LISTEN;
+    if (epoll_ctl(srv->ep, EPOLL_CTL_ADD, srv->fd, &ev) != 0)
+        goto fail;
+    ev.data.u64 = EV_SIGNAL;
+    if (epoll_ctl(srv->ep, EPOLL_CTL_ADD, srv->sig, &ev) != 0)
+        goto fail;
+    return 0;
+
+fail:
+    srv_close(srv);
+    return -1;
+}
+
+/* serve until SIGINT or SIGTERM, returns -1 on error */
+int srv_run(struct srv_str *srv, srv_batch_fn fn, void *ctx)
+{
+    struct epoll_event ev[MAX_EVENTS];
+    int stop = 0;
+    int n, i, slot;
+
+    while (!stop) {
+        n = epoll_wait(srv->ep, ev, MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+
+        for (i = 0; i < n; i++) {
+            unsigned d = (unsigned)ev[i].data.u64;
+
+            if (d == EV_LISTEN) {
+                accept_clients(srv);
+                continue;
+            }
+            if (d == EV_SIGNAL) {
+                stop = 1;
+                continue;
+            }
+            slot = (int)d;
+            if (srv->client[slot] == NULL)
+                continue;
+            if (((ev[i].events & EPOLLOUT) && flush(srv, slot) != 0)
+                || ((ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    && read_client(srv, slot) != 0))
+                drop_client(srv, slot);
+        }
+
+        /* everything that came in this wakeup, in one batch */
+        if (srv->n_batch > 0) {
+            srv->n_batches++;
+            if (srv->n_batch > srv->max_batch)
+                srv->max_batch = srv->n_batch;
+            fn(ctx, srv, srv->batch, srv->n_batch);
+            srv->n_batch = 0;
+        }
+        for (slot = 0; slot < srv->n_slots; slot++) {
+            struct srv_client_str *c = srv->client[slot];
+
+            if (c != NULL && c->eof && c->n_out == 0)
+                drop_client(srv, slot);
+        }
+    }
+    return 0;
+}
+
+/* queue reply to req, returns -1 on error */
+int srv_reply(struct srv_str *srv, const struct srv_req_str *req,
+              const void *buf, size_t len)
+{
+    struct srv_client_str *c = srv->client[req->client];
+
+    srv->lat[srv->n_lat++ % SRV_LAT_KEEP] = 1000.0 * (now() - req->t0);
+    srv->n_req++;
+    /* the client may have gone, and its slot been taken since */
+    if (c == NULL || c->gen != req->gen)
+        return 0;
+    if (c->n_out + len > c->cap) {
+        size_t cap = 2 * (c->n_out + len);
+        char *p = realloc(c->out, cap);
+
+        if (p == NULL)
+            return -1;
+        c->out = p;
+        c->cap = cap;
+    }
+    memcpy(c->out + c->n_out, buf, len);
+    c->n_out += len;
+    if (flush(srv, req->client) != 0)
+        drop_client(srv, req->client);
+    return 0;
+}
+
+/* request count, batching and latency percentiles */
+void srv_stats(const struct srv_str *srv, FILE *out)
+{
+    long n = (srv->n_lat < SRV_LAT_KEEP) ? srv->n_lat : SRV_LAT_KEEP;
+    double *s;
+
+    fprintf(out, "requests: %ld in %ld batches (largest %d)\n",
+            srv->n_req, srv->n_batches, srv->max_batch);
+    if (n == 0)
+        return;
+    s = malloc(n * sizeof(*s));
+    if (s == NULL)
+        return;
+    memcpy(s, srv->lat, n * sizeof(*s));
+    qsort(s, n, sizeof(*s), cmp_double);
+    fprintf(out, "latency (ms, last %ld): p50 %.3f p90 %.3f p99 %.3f"
+            " max %.3f\n", n, s[(n - 1) / 2], s[(n - 1) * 9 / 10],
+            s[(n - 1) * 99 / 100], s[n - 1]);
+    free(s);
+}
+
+/* close clients and socket, remove socket file */
+void srv_close(struct srv_str *srv)
+{
+    int slot;
+
+    for (slot = 0; slot < srv->n_slots; slot++)
+        if (srv->client[slot] != NULL)
+            drop_client(srv, slot);
+    if (srv->fd >= 0) {
+        close(srv->fd);
+        unlink(srv->path);
+    }
+    if (srv->ep >= 0)
+        close(srv->ep);
+    if (srv->sig >= 0)
+        close(srv->sig);
+    free(srv->client);
+    free(srv->batch);
+    free(srv->lat);
+    memset(srv, 0, sizeof(*srv));
+    srv->fd = srv->ep = srv->sig = -1;
+}
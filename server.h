@@ -0,0 +1,76 @@
+/*
+ * Header file for query server module
+ *
+ * A UNIX domain socket server on one epoll loop.  Clients send
+ * requests one per line.  Every line that arrives in one wakeup of
+ * the loop goes to the handler in one batch, so requests sharing
+ * work can be answered together.  Replies are queued per client and
+ * written as the socket takes them, without blocking the loop.  The
+ * time from each request's arrival to its reply is kept for latency
+ * percentiles.  SIGINT and SIGTERM end the loop.
+ */
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define SRV_LINE_LEN 1024
+#define SRV_PATH_LEN 108        /* sun_path */
+#define SRV_LAT_KEEP 65536      /* latencies kept, most recent */
+
+struct srv_client_str;
+
+/* one request line */
+struct srv_req_str {
+    int client;                 /* client slot */
+    unsigned gen;               /* which client had the slot */
+    double t0;                  /* arrival, seconds */
+    char line[SRV_LINE_LEN];    /* without the newline */
+};
+
+struct srv_str {
+    char path[SRV_PATH_LEN];
+    int fd;                     /* listening socket */
+    int ep;                     /* epoll instance */
+    int sig;                    /* signalfd */
+    struct srv_client_str **client;
+    int n_slots;
+    unsigned gen;               /* next client generation */
+    struct srv_req_str *batch;
+    int n_batch, batch_cap;
+    double *lat;                /* latencies, ms, a ring */
+    long n_lat;                 /* ever recorded */
+    long n_req;
+    long n_batches;
+    int max_batch;
+};
+
+/*
+ * handle n requests: each is answered with srv_reply, before
+ * returning or in a later batch
+ */
+typedef void (*srv_batch_fn)(void *ctx, struct srv_str *srv,
+                             const struct srv_req_str *req, int n);
+
+/*
+ * public function prototypes
+ */
+
+/* listen on socket path (replacing any old one), returns -1 on error */
+int srv_open(struct srv_str *srv, const char *path);
+/* serve until SIGINT or SIGTERM, returns -1 on error */
+int srv_run(struct srv_str *srv, srv_batch_fn fn, void *ctx);
+/*
+ * queue reply to req, and count its latency.  A client gone by now
+ * is skipped.  returns -1 on error
+ */
+int srv_reply(struct srv_str *srv, const struct srv_req_str *req,
+              const void *buf, size_t len);
+/* request count, batching and latency percentiles */
+void srv_stats(const struct srv_str *srv, FILE *out);
+/* close clients and socket, remove socket file */
+void srv_close(struct srv_str *srv);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * Header file for SHA-256 module (FIPS 180-4)
+ */
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_LEN 32                   /* digest bytes */
+#define SHA256_HEX (2 * SHA256_LEN + 1) /* hex digest with terminator */
+
+struct sha256_str {
+    uint32_t h[8];
+    uint64_t len;               /* bytes hashed so far */
+    unsigned char buf[64];      /* partial block */
+    size_t n_buf;
+};
+
+/*
+ * public function prototypes
+ */
+
+void sha256_init(struct sha256_str *s);
+void sha256_update(struct sha256_str *s, const void *data, size_t len);
+/* finish, digest to out */
+void sha256_final(struct sha256_str *s, unsigned char out[SHA256_LEN]);
+/* digest as lowercase hex string */
+void sha256_hex(const unsigned char d[SHA256_LEN], char hex[SHA256_HEX]);
+
+#endif
@@ -0,0 +1,188 @@
+/*
+ * sharded execution module
+ */
+
+#define _GNU_SOURCE             /* sched_setaffinity, CPU_SET */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "shard.h"
+
+#define MAX_NODES 256
+#define NODE_PATH "/sys/devices/system/node/node%d/cpulist"
+
+/* shared by the workers of one shard_run */
+struct shard_ctl_str {
+    pthread_mutex_t lock;       /* guards the rest */
+    int next;                   /* next shard to run */
+    int n_ok;                   /* shards run without error */
+};
+
+/*
+ * private functions
+ */
+
+/* parse a cpulist ("0-3,8,10-11") into set, returns -1 on error */
+static int read_cpulist(FILE *in, cpu_set_t *set)
+{
+    int a, b, c;
+
+    CPU_ZERO(set);
+    for (;;) {
+        if (fscanf(in, "%d", &a) != 1)
+            return -1;
+        b = a;
+        c = fgetc(in);
+        if (c == '-') {
+            if (fscanf(in, "%d", &b) != 1)
+                return -1;
+            c = fgetc(in);
+        }
+        for (; a <= b && a < CPU_SETSIZE; a++)
+            CPU_SET(a, set);
+        if (c != ',')
+            return 0;
+    }
+}
+
+/*
+ * CPUs of each NUMA node this process may use, returns the number
+ * of nodes; sets[0] is every allowed CPU when none are known
+ */
+static int node_cpus(cpu_set_t *sets)
+{
+    cpu_set_t allowed;
+    char path[64];
+    int n = 0;
+    int node;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        for (node = 0; node < CPU_SETSIZE; node++)
+            CPU_SET(node, &allowed);
+    }
+    for (node = 0; node < MAX_NODES; node++) {
+        FILE *in;
+
+        snprintf(path, sizeof(path), NODE_PATH, node);
+        in = fopen(path, "r");
+        if (in == NULL)
+            continue;           /* node numbers may have gaps */
+        if (read_cpulist(in, &sets[n]) == 0) {
+            CPU_AND(&sets[n], &sets[n], &allowed);
+            if (CPU_COUNT(&sets[n]) > 0)
+                n++;
+        }
+        fclose(in);
+    }
+    if (n == 0) {
+        sets[0] = allowed;
+        n = 1;
+    }
+    return n;
+}
+
+/* worker: take shards until none are left */
+static void worker(struct shard_ctl_str *ctl, int n_shards, shard_fn fn,
+                   void *ctx)
+{
+    int i;
+
+    for (;;) {
+        pthread_mutex_lock(&ctl->lock);
+        i = ctl->next++;
+        pthread_mutex_unlock(&ctl->lock);
+        if (i >= n_shards)
+            break;
+        if (fn(ctx, i) == 0) {
+            pthread_mutex_lock(&ctl->lock);
+            ctl->n_ok++;
+            pthread_mutex_unlock(&ctl->lock);
+        }
+    }
+}
+
+/*
+ * public functions
+ */
+
+/* NUMA nodes this process may run on */
+int shard_n_nodes(void)
+{
+    static cpu_set_t sets[MAX_NODES];
+
+    return node_cpus(sets);
+}
+
+/* zeroed memory shared with later forked workers, NULL on error */
+void *shard_alloc(size_t len)
+{
+    void *p = mmap(NULL, (len > 0) ? len : 1, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+void shard_free(void *p, size_t len)
+{
+    if (p != NULL)
+        munmap(p, (len > 0) ? len : 1);
+}
+
+/* run n_shards shards on n_procs workers, returns number failed */
+int shard_run(int n_procs, int n_shards, shard_fn fn, void *ctx)
+{
+    static cpu_set_t sets[MAX_NODES];
+    struct shard_ctl_str *ctl;
+    pthread_mutexattr_t attr;
+    pid_t *pid;
+    int n_nodes = node_cpus(sets);
+    int n = 0;
+    int ret = -1;
+    int k;
+
+    if (n_shards <= 0)
+        return 0;
+    n_procs = (n_procs < n_shards) ? n_procs : n_shards;
+    pid = malloc(n_procs * sizeof(*pid));
+    ctl = shard_alloc(sizeof(*ctl));
+    if (pid == NULL || ctl == NULL)
+        goto done;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&ctl->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    /* buffered output would be written once by every child */
+    fflush(NULL);
+    for (k = 0; k < n_procs; k++) {
+        pid_t p = fork();
+
+        if (p == 0) {
+            sched_setaffinity(0, sizeof(sets[0]), &sets[k % n_nodes]);
+            worker(ctl, n_shards, fn, ctx);
+            _exit(0);
+        }
+        if (p > 0)
+            pid[n++] = p;
+    }
+    if (n == 0)
+        goto done;
+    for (k = 0; k < n; k++)
+        while (waitpid(pid[k], NULL, 0) < 0 && errno == EINTR)
+            ;
+    ret = n_shards - ctl->n_ok;
+    pthread_mutex_destroy(&ctl->lock);
+
+done:
+    shard_free(ctl, sizeof(*ctl));
+    free(pid);
+    return ret;
+}
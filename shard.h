@@ -0,0 +1,36 @@
+/*
+ * Header file for sharded execution module
+ *
+ * Work split into numbered shards, run by forked worker processes.
+ * Each worker is pinned to the CPUs of one NUMA node (workers are
+ * dealt out over the nodes in turn) and takes shards off a counter
+ * in shared memory until none are left.  Inputs are shared by the
+ * fork; outputs go to shared memory from shard_alloc, whose pages
+ * land on the node of the worker that first writes them.
+ */
+
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include <stddef.h>
+
+/* run shard i, returns -1 on error */
+typedef int (*shard_fn)(void *ctx, int i);
+
+/*
+ * public function prototypes
+ */
+
+/* NUMA nodes with CPUs this process may run on (1 if none known) */
+int shard_n_nodes(void);
+/* zeroed memory shared with workers forked later, NULL on error */
+void *shard_alloc(size_t len);
+void shard_free(void *p, size_t len);
+/*
+ * run shards 0 .. n_shards - 1 on n_procs worker processes, waiting
+ * for all of them.  returns number of shards failed (a worker that
+ * dies fails all it had left), -1 if no worker could be started
+ */
+int shard_run(int n_procs, int n_shards, shard_fn fn, void *ctx);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * observing site module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "site.h"
+#include "catalog.h"
+
+#define LINE_LEN 512
+
+/*
+ * public functions
+ */
+
+/* read site list, returns number of sites or -1 on error */
+int site_read(FILE *in, const struct room_str *dflt,
+              struct site_str **sites)
+{
+    char line[LINE_LEN];
+    char kw[16];
+    char lat_d[8], lon_d[8];    /* degrees as str ("-00" case) */
+    int lat_m, lon_m;
+    float lat_s, lon_s;
+    struct site_str *s;
+    struct site_str *arr = NULL;
+    int cap = 0;
+    int n = 0;
+    int i;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, "%15s", kw) != 1 || kw[0] == '#')
+            continue;
+
+        if (strcmp(kw, "room") == 0) {
+            struct room_str *r;
+
+            if (n == 0)
+                goto fail;
+            r = &arr[n - 1].room;
+            if (sscanf(line, "%*s %lf %lf %lf %lf",
+                       &r->ceil, &r->wall, &r->ns, &r->ew) != 4
+                || r->ceil <= 0.0 || r->ns <= 0.0 || r->ew <= 0.0)
+                goto fail;
+            continue;
+        }
+        if (strcmp(kw, "site") != 0)
+            goto fail;
+
+        if (n >= cap) {
+            struct site_str *t;
+
+            cap = (cap > 0) ? 2 * cap : 16;
+            t = realloc(arr, cap * sizeof(*t));
+            if (t == NULL)
+                goto fail;
+            arr = t;
+        }
+        s = &arr[n];
+        memset(s, 0, sizeof(*s));
+        if (sscanf(line, "%*s %31s %7s %d %f %7s %d %f %d-%d-%d %d:%d:%lf",
+                   s->name, lat_d, &lat_m, &lat_s, lon_d, &lon_m, &lon_s,
+                   &s->t.year, &s->t.month, &s->t.day,
+                   &s->t.hour, &s->t.minute, &s->t.second) != 13)
+            goto fail;
+        if (strchr(s->name, '/') != NULL)
+            goto fail;
+        /* names become file names, so must be unique */
+        for (i = 0; i < n; i++)
+            if (strcmp(arr[i].name, s->name) == 0)
+                goto fail;
+        s->lat = cat_dms2d(lat_d, lat_m, lat_s);
+        s->lon = cat_dms2d(lon_d, lon_m, lon_s);
+        s->room = *dflt;
+        n++;
+    }
+
+    *sites = arr;
+    return n;
+
+fail:
+    free(arr);
+    return -1;
+}
@@ -0,0 +1,48 @@
+/*
+ * Header file for observing site module
+ *
+ * A site is a named observer location with the room it is painted
+ * in and the moment whose sky is to be reproduced.
+ */
+
+#ifndef _SITE_H_
+#define _SITE_H_
+
+#include <stdio.h>
+
+#include "ephtime.h"
+
+#define SITE_NAME_LEN 32
+
+/* room around the observer (observer frame, cm) */
+struct room_str {
+    double ceil;                /* observer to ceiling */
+    double wall;                /* observer to east wall */
+    double ns;                  /* north-south dimension */
+    double ew;                  /* east-west dimension */
+};
+
+struct site_str {
+    char name[SITE_NAME_LEN];
+    double lat;                 /* degrees, north positive */
+    double lon;                 /* degrees, east positive */
+    struct ymdhms t;            /* time, UTC */
+    struct room_str room;
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * read site list, one record per line ('#' comments):
+ *   site name  latd latm lats  lond lonm lons  yyyy-mm-dd hh:mm:ss
+ *   room ceil wall ns ew   (applies to previous site, cm)
+ * sites without a room line get room dflt.  Names become output file
+ * names, so they must be unique and may not contain '/'.
+ * returns number of sites read or -1 on error
+ */
+int site_read(FILE *in, const struct room_str *dflt,
+              struct site_str **sites);
+
+#endif
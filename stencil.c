@@ -0,0 +1,293 @@
+/*
+ * stencil sheet module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "stencil.h"
+
+#define PT_PER_MM (72.0 / 25.4)
+#define HEADER_MM 8.0           /* room for page title */
+#define LABEL_MM  1.8           /* annotation text height */
+#define TITLE_MM  3.0           /* title text height */
+#define MARK_MM   5.0           /* registration mark arm length */
+#define NOTE_LEN  64
+#define PATH_LEN  256
+
+/* one page (tile) being written */
+struct page_str {
+    FILE *f;
+    int svg;
+    double h;                   /* page height, mm */
+    double tx1, ty0;            /* surface coords of page origin */
+    double margin;
+};
+
+/*
+ * private functions
+ */
+
+/* surface to page coordinates (mm, y up) */
+static double page_x(const struct page_str *pg, double x)
+{
+    return pg->margin + (pg->tx1 - x);
+}
+
+static double page_y(const struct page_str *pg, double y)
+{
+    return pg->margin + (y - pg->ty0);
+}
+
+/* write text, escaped for the output format */
+static void put_text(const struct page_str *pg, double px, double py,
+                     double size, const char *s)
+{
+    if (pg->svg) {
+        fprintf(pg->f, "<text x=\"%.2f\" y=\"%.2f\" font-size=\"%.1f\">",
+                px, pg->h - py, size);
+        for (; *s != '\0'; s++) {
+            if (*s == '<')
+                fputs("&lt;", pg->f);
+            else if (*s == '&')
+                fputs("&amp;", pg->f);
+            else
+                fputc(*s, pg->f);
+        }
+        fputs("</text>\n", pg->f);
+    } else {
+        fprintf(pg->f, "%.1f F (", size);
+        for (; *s != '\0'; s++) {
+            if (*s == '(' || *s == ')' || *s == '\\')
+                fputc('\\', pg->f);
+            fputc(*s, pg->f);
+        }
+        fprintf(pg->f, ") %.2f %.2f T\n", px, py);
+    }
+}
+
+static void put_dot(const struct page_str *pg, double px, double py,
+                    double r)
+{
+    if (pg->svg)
+        fprintf(pg->f, "<circle cx=\"%.2f\" cy=\"%.2f\" r=\"%.2f\"/>\n",
+                px, pg->h - py, r);
+    else
+        fprintf(pg->f, "%.2f %.2f %.2f D\n", px, py, r);
+}
+
+static void put_line(const struct page_str *pg,
+                     double ax, double ay, double bx, double by)
+{
+    if (pg->svg)
+        fprintf(pg->f, "<line x1=\"%.2f\" y1=\"%.2f\" x2=\"%.2f\""
+                " y2=\"%.2f\" stroke=\"black\" stroke-width=\"0.2\"/>\n",
+                ax, pg->h - ay, bx, pg->h - by);
+    else
+        fprintf(pg->f, "%.2f %.2f %.2f %.2f L\n", ax, ay, bx, by);
+}
+
+/* crosshair with circle at surface point (x, y), labeled */
+static void put_mark(const struct page_str *pg, double x, double y)
+{
+    double px = page_x(pg, x);
+    double py = page_y(pg, y);
+    char buf[NOTE_LEN];
+
+    put_line(pg, px - MARK_MM, py, px + MARK_MM, py);
+    put_line(pg, px, py - MARK_MM, px, py + MARK_MM);
+    if (pg->svg)
+        fprintf(pg->f, "<circle cx=\"%.2f\" cy=\"%.2f\" r=\"%.2f\""
+                " fill=\"none\" stroke=\"black\" stroke-width=\"0.2\"/>\n",
+                px, pg->h - py, MARK_MM / 2.0);
+    else
+        fprintf(pg->f, "%.2f %.2f %.2f C\n", px, py, MARK_MM / 2.0);
+    snprintf(buf, sizeof(buf), "%.0f,%.0f", x, y);
+    put_text(pg, px + 1.0, py + 1.0, LABEL_MM, buf);
+}
+
+static void ps_prolog(FILE *f, const struct stn_str *st)
+{
+    fprintf(f, "%%!PS-Adobe-3.0\n");
+    fprintf(f, "%%%%Creator: astroplane\n");
+    fprintf(f, "%%%%Pages: (atend)\n");
+    fprintf(f, "%%%%BoundingBox: 0 0 %.0f %.0f\n",
+            st->page_w * PT_PER_MM, st->page_h * PT_PER_MM);
+    fprintf(f, "%%%%EndComments\n");
+    fprintf(f, "%%%%BeginProlog\n");
+    /* all page coordinates are mm */
+    fprintf(f, "/D { newpath 0 360 arc fill } bind def\n");
+    fprintf(f, "/C { newpath 0 360 arc stroke } bind def\n");
+    fprintf(f, "/L { newpath moveto lineto stroke } bind def\n");
+    fprintf(f, "/F { /Helvetica findfont exch scalefont setfont } bind def\n");
+    fprintf(f, "/T { newpath moveto show } bind def\n");
+    fprintf(f, "%%%%EndProlog\n");
+    fprintf(f, "%%%%BeginSetup\n");
+    fprintf(f, "<< /PageSize [%.2f %.2f] >> setpagedevice\n",
+            st->page_w * PT_PER_MM, st->page_h * PT_PER_MM);
+    fprintf(f, "%%%%EndSetup\n");
+}
+
+/*
+ * public functions
+ */
+
+/* write stencil pages, returns number of pages written, -1 on error */
+int stn_write(const struct stn_str *st,
+              const double *x, const double *y, const double *dia, int n)
+{
+    double cw = st->page_w - 2.0 * st->margin;
+    double ch = st->page_h - 2.0 * st->margin - HEADER_MM;
+    int nx, ny, n_tiles;
+    int *count, *first, *entry;
+    int n_entries = 0;
+    int pages = 0;
+    int pass, i, t;
+
+    if (cw <= 0.0 || ch <= 0.0)
+        return -1;
+    nx = (int)ceil((st->x1 - st->x0) / cw);
+    ny = (int)ceil((st->y1 - st->y0) / ch);
+    nx = (nx < 1) ? 1 : nx;
+    ny = (ny < 1) ? 1 : ny;
+    n_tiles = nx * ny;
+
+    count = calloc(n_tiles, sizeof(*count));
+    first = calloc(n_tiles + 1, sizeof(*first));
+    if (count == NULL || first == NULL) {
+        free(count);
+        free(first);
+        return -1;
+    }
+
+    /*
+     * bucket dots by tile, two passes (count, fill); a dot near an
+     * edge goes on every tile it touches
+     */
+    entry = NULL;
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < n; i++) {
+            double r = dia[i] / 2.0;
+            int c0 = (int)floor((x[i] - r - st->x0) / cw);
+            int c1 = (int)floor((x[i] + r - st->x0) / cw);
+            int r0 = (int)floor((y[i] - r - st->y0) / ch);
+            int r1 = (int)floor((y[i] + r - st->y0) / ch);
+            int c, rw;
+
+            c0 = (c0 < 0) ? 0 : c0;
+            r0 = (r0 < 0) ? 0 : r0;
+            c1 = (c1 >= nx) ? nx - 1 : c1;
+            r1 = (r1 >= ny) ? ny - 1 : r1;
+            for (rw = r0; rw <= r1; rw++)
+                for (c = c0; c <= c1; c++) {
+                    t = rw * nx + c;
+                    if (pass == 0)
+                        first[t + 1]++;
+                    else
+                        entry[first[t] + count[t]++] = i;
+                }
+        }
+        if (pass == 0) {
+            for (t = 0; t < n_tiles; t++)
+                first[t + 1] += first[t];
+            n_entries = first[n_tiles];
+            entry = malloc((n_entries + 1) * sizeof(*entry));
+            if (entry == NULL) {
+                free(count);
+                free(first);
+                return -1;
+            }
+        }
+    }
+
+    if (!st->svg)
+        ps_prolog(st->out, st);
+
+    for (t = 0; t < n_tiles; t++) {
+        struct page_str pg;
+        int col = t % nx;
+        int row = t / nx;
+        double tx0 = st->x0 + col * cw;
+        double ty0 = st->y0 + row * ch;
+        char path[PATH_LEN];
+        char buf[NOTE_LEN + 64];
+
+        if (count[t] == 0)
+            continue;
+        pages++;
+
+        pg.svg = st->svg;
+        pg.h = st->page_h;
+        pg.tx1 = tx0 + cw;
+        pg.ty0 = ty0;
+        pg.margin = st->margin;
+        if (st->svg) {
+            snprintf(path, sizeof(path), "%s-r%02d-c%02d.svg",
+                     st->prefix, row, col);
+            pg.f = fopen(path, "w");
+            if (pg.f == NULL) {
+                pages = -1;
+                break;
+            }
+            fprintf(pg.f, "<?xml version=\"1.0\"?>\n");
+            fprintf(pg.f, "<svg xmlns=\"http://www.w3.org/2000/svg\""
+                    " width=\"%.1fmm\" height=\"%.1fmm\""
+                    " viewBox=\"0 0 %.1f %.1f\""
+                    " font-family=\"Helvetica\">\n",
+                    st->page_w, st->page_h, st->page_w, st->page_h);
+        } else {
+            pg.f = st->out;
+            fprintf(pg.f, "%%%%Page: %d %d\n", pages, pages);
+            fprintf(pg.f, "gsave %.6f dup scale 0.2 setlinewidth\n",
+                    PT_PER_MM);
+        }
+
+        snprintf(buf, sizeof(buf),
+                 "row %d col %d   x %.0f..%.0f  y %.0f..%.0f mm"
+                 "   %d dots   (east is left)",
+                 row, col, tx0, tx0 + cw, ty0, ty0 + ch, count[t]);
+        put_text(&pg, st->margin, st->page_h - st->margin - TITLE_MM,
+                 TITLE_MM, buf);
+
+        /* registration marks at tile corners */
+        put_mark(&pg, tx0, ty0);
+        put_mark(&pg, tx0 + cw, ty0);
+        put_mark(&pg, tx0, ty0 + ch);
+        put_mark(&pg, tx0 + cw, ty0 + ch);
+
+        for (i = first[t]; i < first[t] + count[t]; i++) {
+            int k = entry[i];
+            double px = page_x(&pg, x[k]);
+            double py = page_y(&pg, y[k]);
+
+            put_dot(&pg, px, py, dia[k] / 2.0);
+            if (st->note != NULL) {
+                st->note(st->ctx, k, buf, NOTE_LEN);
+                put_text(&pg, px + dia[k] / 2.0 + 0.5, py - LABEL_MM / 3.0,
+                         LABEL_MM, buf);
+            }
+        }
+
+        if (st->svg) {
+            fprintf(pg.f, "</svg>\n");
+            if (fclose(pg.f) != 0) {
+                pages = -1;
+                break;
+            }
+        } else {
+            fprintf(pg.f, "grestore showpage\n");
+        }
+    }
+
+    if (!st->svg && pages >= 0) {
+        fprintf(st->out, "%%%%Trailer\n%%%%Pages: %d\n%%%%EOF\n", pages);
+        if (ferror(st->out))
+            pages = -1;
+    }
+
+    free(entry);
+    free(count);
+    free(first);
+    return pages;
+}
@@ -0,0 +1,50 @@
+/*
+ * Header file for stencil sheet module
+ *
+ * Tiles dots onto printable pages at 1:1 scale, with registration
+ * marks and per-dot annotations.  Pages are written one at a time
+ * as PostScript (one document) or SVG (one file per page).
+ *
+ * Sheets are meant to be held printed side down against the
+ * ceiling: seen from below, north is up and east is on the left,
+ * so surface x runs right to left across each page.
+ */
+
+#ifndef _STENCIL_H_
+#define _STENCIL_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* paper sizes, mm */
+#define STN_LETTER_W 215.9
+#define STN_LETTER_H 279.4
+#define STN_A4_W     210.0
+#define STN_A4_H     297.0
+
+/* annotation for dot i (e.g. catalog number and wall measurements) */
+typedef void (*stn_note_fn)(void *ctx, int i, char *buf, size_t len);
+
+struct stn_str {
+    double page_w, page_h;      /* paper size, mm */
+    double margin;              /* unprinted border, mm */
+    double x0, y0, x1, y1;      /* surface extent, mm */
+    int svg;                    /* nonzero: SVG pages, else PostScript */
+    FILE *out;                  /* PostScript output */
+    const char *prefix;         /* SVG page file name prefix */
+    stn_note_fn note;           /* optional */
+    void *ctx;
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * write stencil pages for n dots at (x, y) mm with diameter dia mm.
+ * returns number of pages written, -1 on error
+ */
+int stn_write(const struct stn_str *st,
+              const double *x, const double *y, const double *dia, int n);
+
+#endif
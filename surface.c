@@ -0,0 +1,604 @@
+/*
+ * projection surface module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "surface.h"
+
+#define LINE_LEN 512
+#define T_EPS    1e-9           /* ignore hits this close to ray start */
+#define TEX_SCALE 2.0           /* texture area may differ this much, x / */
+
+/* mesh traversal context */
+struct mesh_ctx_str {
+    const struct srf_str *s;
+    int tri;                    /* nearest triangle so far */
+    double bu, bv;              /* its barycentric coords */
+};
+
+/*
+ * private functions
+ */
+
+/* real roots of a t^2 + b t + c = 0 in ascending order, returns count */
+static int solve_quad(double a, double b, double c, double t[2])
+{
+    double disc, q;
+
+    if (fabs(a) < 1e-12) {
+        if (fabs(b) < 1e-12)
+            return 0;
+        t[0] = -c / b;
+        return 1;
+    }
+    disc = b * b - 4.0 * a * c;
+    if (disc < 0.0)
+        return 0;
+    /* numerically stable form */
+    q = -0.5 * (b + ((b >= 0.0) ? sqrt(disc) : -sqrt(disc)));
+    t[0] = q / a;
+    t[1] = (q != 0.0) ? c / q : t[0];
+    if (t[0] > t[1]) {
+        q = t[0];
+        t[0] = t[1];
+        t[1] = q;
+    }
+    return 2;
+}
+
+static int in_box(const struct bvh_box_str *b, const struct v3_str *p)
+{
+    return (p->x >= b->lo.x && p->x <= b->hi.x &&
+            p->y >= b->lo.y && p->y <= b->hi.y &&
+            p->z >= b->lo.z && p->z <= b->hi.z);
+}
+
+/* turn normal toward ray start */
+static void face_normal(struct v3_str *n, const struct v3_str *u)
+{
+    v3_unit(n);
+    if (v3_dot(n, u) > 0.0)
+        v3_rev(n);
+}
+
+/*
+ * fill in hit at distance t, returns -1 if point is clipped or
+ * outside the surface's extent
+ */
+static int accept(const struct srf_str *s, const struct v3_str *p,
+                  const struct v3_str *u, double t, struct srf_hit_str *hit)
+{
+    struct v3_str d, e, w;
+    double aa, ab, bb, da, db, det, sa, sb;
+
+    if (!(t > T_EPS) || isinf(t))
+        return -1;
+    hit->t = t;
+    hit->p = *u;
+    v3_mul(&hit->p, t);
+    v3_add(&hit->p, p);
+    if (s->clipped && !in_box(&s->clip, &hit->p))
+        return -1;
+
+    d = hit->p;
+    v3_sub(&d, &s->c);
+    switch (s->type) {
+    case SRF_PLANE:
+        /* solve d = sa * a + sb * b */
+        aa = v3_dot(&s->a, &s->a);
+        ab = v3_dot(&s->a, &s->b);
+        bb = v3_dot(&s->b, &s->b);
+        da = v3_dot(&d, &s->a);
+        db = v3_dot(&d, &s->b);
+        det = aa * bb - ab * ab;
+        sa = (da * bb - db * ab) / det;
+        sb = (db * aa - da * ab) / det;
+        if (sa < 0.0 || sa > 1.0 || sb < 0.0 || sb > 1.0)
+            return -1;
+        hit->u = sa * sqrt(aa);
+        hit->v = sb * sqrt(bb);
+        hit->n = s->a;
+        v3_cross(&hit->n, &s->b);
+        break;
+    case SRF_SPHERE:
+        /* unrolled about the top: arc length from it, toward azimuth */
+        sa = s->r * acos(fmax(-1.0, fmin(1.0, d.z / s->r)));
+        sb = hypot(d.x, d.y);
+        hit->u = (sb > 0.0) ? sa * d.x / sb : 0.0;
+        hit->v = (sb > 0.0) ? sa * d.y / sb : 0.0;
+        hit->n = d;
+        break;
+    case SRF_CYLINDER:
+        hit->u = v3_dot(&d, &s->a);
+        /* radial component */
+        e = s->a;
+        v3_mul(&e, hit->u);
+        v3_sub(&d, &e);
+        w = s->a;
+        v3_cross(&w, &s->b);
+        hit->v = s->r * atan2(v3_dot(&w, &d), v3_dot(&s->b, &d));
+        hit->n = d;
+        break;
+    case SRF_QUADRIC:
+        e = hit->p;
+        hit->n.x = 2 * s->q[0] * e.x + s->q[3] * e.y + s->q[5] * e.z + s->q[6];
+        hit->n.y = 2 * s->q[1] * e.y + s->q[3] * e.x + s->q[4] * e.z + s->q[7];
+        hit->n.z = 2 * s->q[2] * e.z + s->q[4] * e.y + s->q[5] * e.x + s->q[8];
+        hit->u = e.x;
+        hit->v = e.y;
+        break;
+    case SRF_MESH:
+        /* filled in by caller */
+        return 0;
+    }
+    face_normal(&hit->n, u);
+    return 0;
+}
+
+/* Moller-Trumbore ray/triangle test, BVH callback */
+static int mesh_hit(void *ctx, int prim,
+                    const struct v3_str *p, const struct v3_str *u,
+                    double *t_max)
+{
+    struct mesh_ctx_str *mc = ctx;
+    const struct srf_mesh_str *m = mc->s->mesh;
+    const struct v3_str *v0 = &m->vtx[m->tri[prim][0]];
+    struct v3_str e1 = m->vtx[m->tri[prim][1]];
+    struct v3_str e2 = m->vtx[m->tri[prim][2]];
+    struct v3_str pv, tv, qv, hp;
+    double det, bu, bv, t;
+
+    v3_sub(&e1, v0);
+    v3_sub(&e2, v0);
+    pv = *u;
+    v3_cross(&pv, &e2);
+    det = v3_dot(&e1, &pv);
+    if (fabs(det) < 1e-12)
+        return 0;
+    tv = *p;
+    v3_sub(&tv, v0);
+    bu = v3_dot(&tv, &pv) / det;
+    if (bu < 0.0 || bu > 1.0)
+        return 0;
+    qv = tv;
+    v3_cross(&qv, &e1);
+    bv = v3_dot(u, &qv) / det;
+    if (bv < 0.0 || bu + bv > 1.0)
+        return 0;
+    t = v3_dot(&e2, &qv) / det;
+    if (t <= T_EPS || t >= *t_max)
+        return 0;
+    if (mc->s->clipped) {
+        hp = *u;
+        v3_mul(&hp, t);
+        v3_add(&hp, p);
+        if (!in_box(&mc->s->clip, &hp))
+            return 0;
+    }
+
+    *t_max = t;
+    mc->tri = prim;
+    mc->bu = bu;
+    mc->bv = bv;
+    return 1;
+}
+
+static int mesh_intersect(const struct srf_str *s,
+                          const struct v3_str *p, const struct v3_str *u,
+                          struct srf_hit_str *hit)
+{
+    const struct srf_mesh_str *m = s->mesh;
+    struct mesh_ctx_str mc;
+    double t = HUGE_VAL;
+    double w;
+    const int *ti;
+    struct v3_str e1, e2;
+
+    mc.s = s;
+    mc.tri = -1;
+    if (bvh_trace(&m->bvh, p, u, &t, mesh_hit, &mc) < 0)
+        return -1;
+
+    hit->tri = mc.tri;
+    hit->t = t;
+    hit->p = *u;
+    v3_mul(&hit->p, t);
+    v3_add(&hit->p, p);
+
+    ti = m->tri[mc.tri];
+    e1 = m->vtx[ti[1]];
+    v3_sub(&e1, &m->vtx[ti[0]]);
+    e2 = m->vtx[ti[2]];
+    v3_sub(&e2, &m->vtx[ti[0]]);
+    hit->n = e1;
+    v3_cross(&hit->n, &e2);
+    face_normal(&hit->n, u);
+
+    ti = m->tri_tex[mc.tri];
+    if (ti[0] >= 0 && ti[1] >= 0 && ti[2] >= 0) {
+        w = 1.0 - mc.bu - mc.bv;
+        hit->u = (w * m->tex[ti[0]][0] + mc.bu * m->tex[ti[1]][0]
+                  + mc.bv * m->tex[ti[2]][0]);
+        hit->v = (w * m->tex[ti[0]][1] + mc.bu * m->tex[ti[1]][1]
+                  + mc.bv * m->tex[ti[2]][1]);
+    } else {
+        hit->u = hit->p.x;
+        hit->v = hit->p.y;
+    }
+    return 0;
+}
+
+/*
+ * texture coords in cm: textured triangles cover about as much area
+ * laid out as they do in space.  Otherwise (0..1 coords as modellers
+ * export them) scale them to the real area, or if they cover none
+ * lay the mesh out in plan as without them, with a warning
+ */
+static void tex_metric(struct srf_mesh_str *m, const char *path)
+{
+    double area = 0.0, tex_area = 0.0;
+    double k;
+    struct v3_str e1, e2;
+    const int *vi, *ti;
+    int i;
+
+    for (i = 0; i < m->n_tri; i++) {
+        vi = m->tri[i];
+        ti = m->tri_tex[i];
+        if (ti[0] < 0 || ti[1] < 0 || ti[2] < 0)
+            continue;
+        e1 = m->vtx[vi[1]];
+        v3_sub(&e1, &m->vtx[vi[0]]);
+        e2 = m->vtx[vi[2]];
+        v3_sub(&e2, &m->vtx[vi[0]]);
+        v3_cross(&e1, &e2);
+        area += 0.5 * v3_mag(&e1);
+        tex_area += 0.5 * fabs((m->tex[ti[1]][0] - m->tex[ti[0]][0])
+                               * (m->tex[ti[2]][1] - m->tex[ti[0]][1])
+                               - (m->tex[ti[2]][0] - m->tex[ti[0]][0])
+                               * (m->tex[ti[1]][1] - m->tex[ti[0]][1]));
+    }
+    if (tex_area * TEX_SCALE >= area && tex_area <= area * TEX_SCALE)
+        return;
+    if (tex_area == 0.0) {
+        fprintf(stderr, "%s: texture coordinates cover no area,"
+                " laid out in plan\n", path);
+        for (i = 0; i < m->n_tri; i++)
+            m->tri_tex[i][0] = m->tri_tex[i][1] = m->tri_tex[i][2] = -1;
+        return;
+    }
+    k = sqrt(area / tex_area);
+    fprintf(stderr, "%s: texture coordinates not in cm, scaled by %g\n",
+            path, k);
+    for (i = 0; i < m->n_tex; i++) {
+        m->tex[i][0] *= k;
+        m->tex[i][1] *= k;
+    }
+}
+
+/* grow array to hold at least n + 1 elements of size sz */
+static int grow(void **arr, int *cap, int n, size_t sz)
+{
+    void *t;
+
+    if (n < *cap)
+        return 0;
+    *cap = (*cap > 0) ? 2 * *cap : 64;
+    t = realloc(*arr, *cap * sz);
+    if (t == NULL)
+        return -1;
+    *arr = t;
+    return 0;
+}
+
+/* parse OBJ index "v", "v/vt", "v//vn" or "v/vt/vn" (1-based or negative) */
+static void obj_index(const char *tok, int n_vtx, int n_tex, int *vi, int *ti)
+{
+    const char *slash;
+    int i;
+
+    i = atoi(tok);
+    *vi = (i < 0) ? n_vtx + i : i - 1;
+    *ti = -1;
+    slash = strchr(tok, '/');
+    if (slash != NULL && slash[1] != '/' && slash[1] != '\0') {
+        i = atoi(slash + 1);
+        *ti = (i < 0) ? n_tex + i : i - 1;
+    }
+}
+
+/*
+ * public functions
+ */
+
+/* read Wavefront OBJ (v, vt, f records only), returns -1 on error */
+int srf_mesh_read_obj(const char *path, struct srf_mesh_str *m)
+{
+    FILE *in;
+    char line[LINE_LEN];
+    int cap_vtx = 0, cap_tex = 0, cap_tri = 0, cap_tt = 0;
+    struct bvh_box_str *boxes;
+    int i, j;
+
+    memset(m, 0, sizeof(*m));
+    in = fopen(path, "r");
+    if (in == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (strncmp(line, "v ", 2) == 0) {
+            if (grow((void **)&m->vtx, &cap_vtx, m->n_vtx, sizeof(*m->vtx)))
+                goto fail;
+            if (sscanf(line + 2, "%lf %lf %lf", &m->vtx[m->n_vtx].x,
+                       &m->vtx[m->n_vtx].y, &m->vtx[m->n_vtx].z) == 3)
+                m->n_vtx++;
+        } else if (strncmp(line, "vt ", 3) == 0) {
+            if (grow((void **)&m->tex, &cap_tex, m->n_tex, sizeof(*m->tex)))
+                goto fail;
+            if (sscanf(line + 3, "%lf %lf", &m->tex[m->n_tex][0],
+                       &m->tex[m->n_tex][1]) == 2)
+                m->n_tex++;
+        } else if (strncmp(line, "f ", 2) == 0) {
+            int vi[3], ti[3];
+            int k = 0;
+            char *tok, *save;
+
+            /* fan triangulation of polygon */
+            for (tok = strtok_r(line + 2, " \t\r\n", &save); tok != NULL;
+                 tok = strtok_r(NULL, " \t\r\n", &save)) {
+                j = (k < 2) ? k : 2;
+                obj_index(tok, m->n_vtx, m->n_tex, &vi[j], &ti[j]);
+                if (vi[j] < 0 || vi[j] >= m->n_vtx)
+                    goto fail;
+                if (ti[j] >= m->n_tex)
+                    ti[j] = -1;
+                if (++k < 3)
+                    continue;
+                if (grow((void **)&m->tri, &cap_tri, m->n_tri,
+                         sizeof(*m->tri)) ||
+                    grow((void **)&m->tri_tex, &cap_tt, m->n_tri,
+                         sizeof(*m->tri_tex)))
+                    goto fail;
+                memcpy(m->tri[m->n_tri], vi, sizeof(vi));
+                memcpy(m->tri_tex[m->n_tri], ti, sizeof(ti));
+                m->n_tri++;
+                vi[1] = vi[2];
+                ti[1] = ti[2];
+            }
+        }
+    }
+    fclose(in);
+    in = NULL;
+    tex_metric(m, path);
+
+    boxes = malloc(m->n_tri * sizeof(*boxes) + 1);
+    if (boxes == NULL)
+        goto fail;
+    for (i = 0; i < m->n_tri; i++) {
+        bvh_box_empty(&boxes[i]);
+        for (j = 0; j < 3; j++)
+            bvh_box_add(&boxes[i], &m->vtx[m->tri[i][j]]);
+    }
+    i = bvh_build(&m->bvh, boxes, m->n_tri);
+    free(boxes);
+    if (i != 0)
+        goto fail;
+    return 0;
+
+fail:
+    if (in != NULL)
+        fclose(in);
+    free(m->vtx);
+    free(m->tex);
+    free(m->tri);
+    free(m->tri_tex);
+    memset(m, 0, sizeof(*m));
+    return -1;
+}
+
+/* read surface description, returns number of surfaces or -1 on error */
+int srf_read(FILE *in, struct srf_str **surfs)
+{
+    char line[LINE_LEN];
+    char kw[16];
+    char arg[LINE_LEN];
+    struct srf_str *s;
+    struct srf_str *arr = NULL;
+    int cap = 0;
+    int n = 0;
+    int len;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, "%15s", kw) != 1 || kw[0] == '#')
+            continue;
+
+        if (strcmp(kw, "clip") == 0) {
+            if (n == 0)
+                goto fail;
+            s = &arr[n - 1];
+            if (sscanf(line, "%*s %lf %lf %lf %lf %lf %lf",
+                       &s->clip.lo.x, &s->clip.lo.y, &s->clip.lo.z,
+                       &s->clip.hi.x, &s->clip.hi.y, &s->clip.hi.z) != 6)
+                goto fail;
+            s->clipped = 1;
+            continue;
+        }
+
+        if (grow((void **)&arr, &cap, n, sizeof(*arr)))
+            goto fail;
+        s = &arr[n];
+        memset(s, 0, sizeof(*s));
+        if (sscanf(line, "%*s %15s%n", s->name, &len) != 1)
+            goto fail;
+
+        if (strcmp(kw, "plane") == 0) {
+            s->type = SRF_PLANE;
+            if (sscanf(line + len, "%lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                       &s->c.x, &s->c.y, &s->c.z,
+                       &s->a.x, &s->a.y, &s->a.z,
+                       &s->b.x, &s->b.y, &s->b.z) != 9)
+                goto fail;
+            /* corners to edges */
+            v3_sub(&s->a, &s->c);
+            v3_sub(&s->b, &s->c);
+        } else if (strcmp(kw, "sphere") == 0) {
+            s->type = SRF_SPHERE;
+            if (sscanf(line + len, "%lf %lf %lf %lf",
+                       &s->c.x, &s->c.y, &s->c.z, &s->r) != 4)
+                goto fail;
+        } else if (strcmp(kw, "cylinder") == 0) {
+            struct v3_str e;
+
+            s->type = SRF_CYLINDER;
+            if (sscanf(line + len, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                       &s->c.x, &s->c.y, &s->c.z,
+                       &s->a.x, &s->a.y, &s->a.z,
+                       &s->b.x, &s->b.y, &s->b.z, &s->r) != 10)
+                goto fail;
+            /* unit axis, reference direction perpendicular to it */
+            v3_unit(&s->a);
+            e = s->a;
+            v3_mul(&e, v3_dot(&s->b, &s->a));
+            v3_sub(&s->b, &e);
+            v3_unit(&s->b);
+        } else if (strcmp(kw, "quadric") == 0) {
+            double *q = s->q;
+
+            s->type = SRF_QUADRIC;
+            if (sscanf(line + len, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                       &q[0], &q[1], &q[2], &q[3], &q[4],
+                       &q[5], &q[6], &q[7], &q[8], &q[9]) != 10)
+                goto fail;
+        } else if (strcmp(kw, "mesh") == 0) {
+            s->type = SRF_MESH;
+            if (sscanf(line + len, "%s", arg) != 1)
+                goto fail;
+            s->mesh = malloc(sizeof(*s->mesh));
+            if (s->mesh == NULL)
+                goto fail;
+            if (srf_mesh_read_obj(arg, s->mesh) != 0) {
+                free(s->mesh);
+                s->mesh = NULL;
+                goto fail;
+            }
+        } else {
+            goto fail;
+        }
+        n++;
+    }
+
+    *surfs = arr;
+    return n;
+
+fail:
+    srf_free(arr, n);
+    return -1;
+}
+
+/* release surfaces (and meshes) returned by srf_read */
+void srf_free(struct srf_str *surfs, int n)
+{
+    int i;
+    struct srf_mesh_str *m;
+
+    for (i = 0; i < n; i++) {
+        m = surfs[i].mesh;
+        if (m == NULL)
+            continue;
+        bvh_free(&m->bvh);
+        free(m->vtx);
+        free(m->tex);
+        free(m->tri);
+        free(m->tri_tex);
+        free(m);
+    }
+    free(surfs);
+}
+
+/* nearest intersection with one surface, returns 0 if hit, -1 if not */
+int srf_intersect(const struct srf_str *s,
+                  const struct v3_str *p, const struct v3_str *u,
+                  struct srf_hit_str *hit)
+{
+    struct v3_str o, d, e;
+    double t[2];
+    double a, b, c;
+    const double *q = s->q;
+    int nt = 0;
+    int i;
+
+    hit->tri = -1;
+    o = *p;
+    v3_sub(&o, &s->c);
+
+    switch (s->type) {
+    case SRF_PLANE:
+        d = s->a;
+        v3_cross(&d, &s->b);
+        t[0] = v3_dist_line_plane(p, u, &s->c, &d);
+        nt = 1;
+        break;
+    case SRF_SPHERE:
+        nt = solve_quad(v3_dot(u, u), 2.0 * v3_dot(&o, u),
+                        v3_dot(&o, &o) - s->r * s->r, t);
+        break;
+    case SRF_CYLINDER:
+        /* drop components along the axis */
+        d = *u;
+        e = s->a;
+        v3_mul(&e, v3_dot(u, &s->a));
+        v3_sub(&d, &e);
+        e = s->a;
+        v3_mul(&e, v3_dot(&o, &s->a));
+        v3_sub(&o, &e);
+        nt = solve_quad(v3_dot(&d, &d), 2.0 * v3_dot(&o, &d),
+                        v3_dot(&o, &o) - s->r * s->r, t);
+        break;
+    case SRF_QUADRIC:
+        a = (q[0] * u->x * u->x + q[1] * u->y * u->y + q[2] * u->z * u->z
+             + q[3] * u->x * u->y + q[4] * u->y * u->z + q[5] * u->x * u->z);
+        b = (2.0 * (q[0] * p->x * u->x + q[1] * p->y * u->y
+                    + q[2] * p->z * u->z)
+             + q[3] * (p->x * u->y + p->y * u->x)
+             + q[4] * (p->y * u->z + p->z * u->y)
+             + q[5] * (p->x * u->z + p->z * u->x)
+             + q[6] * u->x + q[7] * u->y + q[8] * u->z);
+        c = (q[0] * p->x * p->x + q[1] * p->y * p->y + q[2] * p->z * p->z
+             + q[3] * p->x * p->y + q[4] * p->y * p->z + q[5] * p->x * p->z
+             + q[6] * p->x + q[7] * p->y + q[8] * p->z + q[9]);
+        nt = solve_quad(a, b, c, t);
+        break;
+    case SRF_MESH:
+        return mesh_intersect(s, p, u, hit);
+    }
+
+    for (i = 0; i < nt; i++)
+        if (accept(s, p, u, t[i], hit) == 0)
+            return 0;
+    return -1;
+}
+
+/* nearest intersection among n surfaces, returns 0 if hit, -1 if not */
+int srf_trace(const struct srf_str *surfs, int n,
+              const struct v3_str *p, const struct v3_str *u,
+              struct srf_hit_str *hit)
+{
+    struct srf_hit_str h;
+    int found = -1;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (srf_intersect(&surfs[i], p, u, &h) != 0)
+            continue;
+        if (found != 0 || h.t < hit->t) {
+            *hit = h;
+            hit->surf = i;
+            found = 0;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,112 @@
+/*
+ * Header file for projection surface module
+ *
+ * Observer is at the origin, x is east, y is north, z is up (cm).
+ */
+
+#ifndef _SURFACE_H_
+#define _SURFACE_H_
+
+#include <stdio.h>
+
+#include "vector3.h"
+#include "bvh.h"
+
+#define SRF_NAME_LEN 16
+
+enum srf_type {
+    SRF_PLANE,                  /* parallelogram */
+    SRF_SPHERE,                 /* dome */
+    SRF_CYLINDER,               /* barrel vault */
+    SRF_QUADRIC,                /* general implicit quadric */
+    SRF_MESH                    /* triangle mesh */
+};
+
+struct srf_mesh_str {
+    struct v3_str *vtx;         /* vertices */
+    double (*tex)[2];           /* texture coords (NULL if none) */
+    int (*tri)[3];              /* vertex indices per triangle */
+    int (*tri_tex)[3];          /* texture indices per triangle */
+    int n_vtx;
+    int n_tex;
+    int n_tri;
+    struct bvh_str bvh;         /* hierarchy over triangles */
+};
+
+struct srf_str {
+    enum srf_type type;
+    char name[SRF_NAME_LEN];
+    /*
+     * plane: corner p0, edges a (u axis), b (v axis)
+     * sphere: center c, radius r
+     * cylinder: point on axis c, axis a, u = 0 direction b, radius r
+     */
+    struct v3_str c;
+    struct v3_str a;
+    struct v3_str b;
+    double r;
+    /* quadric: Ax2 + By2 + Cz2 + Dxy + Eyz + Fxz + Gx + Hy + Iz + J = 0 */
+    double q[10];
+    struct srf_mesh_str *mesh;
+    /* optional clip box, hits outside are ignored */
+    int clipped;
+    struct bvh_box_str clip;
+};
+
+/*
+ * ray/surface intersection
+ *
+ * painting coordinates (u, v), cm on the laid out surface, depend on
+ * surface type:
+ *   plane:    cm along a, cm along b from corner c
+ *   sphere:   east, north of the top of the sphere, the arc length
+ *             from it along the sphere pointing toward the hit's azimuth
+ *   cylinder: cm along axis from c, arc length (cm) from b about axis
+ *   quadric:  x, y of hit point (plan view)
+ *   mesh:     interpolated texture coords (cm), or x, y if mesh has none
+ */
+struct srf_hit_str {
+    int surf;                   /* index of surface hit */
+    int tri;                    /* mesh triangle hit, -1 otherwise */
+    double t;                   /* distance along (unit) ray */
+    struct v3_str p;            /* hit point */
+    struct v3_str n;            /* unit normal at hit point */
+    double u;
+    double v;
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * read surface description, one surface per line ('#' comments):
+ *   plane    name p0x p0y p0z pax pay paz pbx pby pbz
+ *   sphere   name cx cy cz r
+ *   cylinder name cx cy cz ax ay az bx by bz r
+ *   quadric  name A B C D E F G H I J
+ *   mesh     name file.obj
+ *   clip     xmin ymin zmin xmax ymax zmax   (applies to previous surface)
+ * plane corners are absolute, as p0, px, py in astroplane.c
+ * returns number of surfaces read or -1 on error
+ */
+int srf_read(FILE *in, struct srf_str **surfs);
+/*
+ * read Wavefront OBJ (v, vt, f records only).  Texture coords are the
+ * layout in cm; those whose textured area is not within a factor of
+ * two of the mesh's own (0..1 coords, say) are scaled to it, with a
+ * warning on stderr.  returns -1 on error
+ */
+int srf_mesh_read_obj(const char *path, struct srf_mesh_str *m);
+/* release surfaces (and meshes) returned by srf_read */
+void srf_free(struct srf_str *surfs, int n);
+/* nearest intersection with one surface, returns 0 if hit, -1 if not */
+int srf_intersect(const struct srf_str *s,
+                  const struct v3_str *p, const struct v3_str *u,
+                  struct srf_hit_str *hit);
+/* nearest intersection among n surfaces, returns 0 if hit, -1 if not */
+int srf_trace(const struct srf_str *surfs, int n,
+              const struct v3_str *p, const struct v3_str *u,
+              struct srf_hit_str *hit);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * placement tolerance module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "tolerance.h"
+
+#define LINE_LEN 256
+#define TRIALS   10000          /* default number of trials */
+
+/* Philox4x32 multipliers and key increments */
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+static const char *param_names[TOL_N_PARAMS] = {
+    "ceil", "wall", "ns", "ew", "eye_x", "eye_y", "eye_z"
+};
+
+/*
+ * private functions
+ */
+
+/* Philox4x32-10: block ctr under key, in place */
+static void philox(uint32_t *ctr, const uint32_t *key)
+{
+    uint32_t k0 = key[0], k1 = key[1];
+    int r;
+
+    for (r = 0; r < PHILOX_ROUNDS; r++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * ctr[0];
+        uint64_t p1 = (uint64_t)PHILOX_M1 * ctr[2];
+        uint32_t c1 = ctr[1], c3 = ctr[3];
+
+        ctr[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        ctr[1] = (uint32_t)p1;
+        ctr[2] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        ctr[3] = (uint32_t)p0;
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+}
+
+/*
+ * public functions
+ */
+
+/* read tolerances, returns -1 on error */
+int tol_read(FILE *in, struct tol_str *tol)
+{
+    char line[LINE_LEN];
+    char kw[16], dist[16];
+    double w;
+    int i;
+
+    memset(tol, 0, sizeof(*tol));
+    tol->trials = TRIALS;
+    tol->seed = 1;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, "%15s", kw) != 1 || kw[0] == '#')
+            continue;
+        if (strcmp(kw, "trials") == 0) {
+            if (sscanf(line, "%*s %d", &tol->trials) != 1
+                || tol->trials < 2)
+                return -1;
+            continue;
+        }
+        if (strcmp(kw, "seed") == 0) {
+            if (sscanf(line, "%*s %llu", &tol->seed) != 1)
+                return -1;
+            continue;
+        }
+        for (i = 0; i < TOL_N_PARAMS; i++)
+            if (strcmp(kw, param_names[i]) == 0)
+                break;
+        if (i == TOL_N_PARAMS
+            || sscanf(line, "%*s %15s %lf", dist, &w) != 2 || w < 0.0)
+            return -1;
+        if (strcmp(dist, "normal") == 0)
+            tol->dist[i] = TOL_NORMAL;
+        else if (strcmp(dist, "uniform") == 0)
+            tol->dist[i] = TOL_UNIFORM;
+        else
+            return -1;
+        tol->width[i] = w;
+    }
+    return 0;
+}
+
+/* errors of trial t */
+void tol_draw(const struct tol_str *tol, long long t, double *d)
+{
+    uint32_t key[2];
+    uint32_t ctr[2][4];
+    double u[8];
+    int b, i;
+
+    key[0] = (uint32_t)tol->seed;
+    key[1] = (uint32_t)(tol->seed >> 32);
+    /* two blocks: eight uniforms in (0, 1) */
+    for (b = 0; b < 2; b++) {
+        ctr[b][0] = (uint32_t)t;
+        ctr[b][1] = (uint32_t)((unsigned long long)t >> 32);
+        ctr[b][2] = b;
+        ctr[b][3] = 0;
+        philox(ctr[b], key);
+        for (i = 0; i < 4; i++)
+            u[4 * b + i] = (ctr[b][i] + 0.5) / 4294967296.0;
+    }
+
+    for (i = 0; i < TOL_N_PARAMS; i++) {
+        double v;
+
+        switch (tol->dist[i]) {
+        case TOL_NORMAL:
+            /* Box-Muller on the pair holding u[i] */
+            v = sqrt(-2.0 * log(u[i & ~1]));
+            v *= (i & 1) ? sin(2.0 * M_PI * u[i | 1])
+                : cos(2.0 * M_PI * u[i | 1]);
+            d[i] = tol->width[i] * v;
+            break;
+        case TOL_UNIFORM:
+            d[i] = tol->width[i] * (2.0 * u[i] - 1.0);
+            break;
+        default:
+            d[i] = 0.0;
+        }
+    }
+}
+
+void tol_acc_init(struct tol_acc_str *a)
+{
+    memset(a, 0, sizeof(*a));
+}
+
+/* add one error, running (Welford) mean and covariance */
+void tol_acc_add(struct tol_acc_str *a, double ex, double ey)
+{
+    double dx = ex - a->mx;
+    double dy = ey - a->my;
+    double e = hypot(ex, ey);
+
+    a->n++;
+    a->mx += dx / a->n;
+    a->my += dy / a->n;
+    a->sxx += dx * (ex - a->mx);
+    a->syy += dy * (ey - a->my);
+    a->sxy += dx * (ey - a->my);
+    a->max = (e > a->max) ? e : a->max;
+}
+
+/* error ellipse from the covariance */
+void tol_ellipse(const struct tol_acc_str *a, double *major, double *minor,
+                 double *angle)
+{
+    double cxx, cyy, cxy, m, r;
+
+    if (a->n < 2) {
+        *major = *minor = *angle = 0.0;
+        return;
+    }
+    cxx = a->sxx / (a->n - 1);
+    cyy = a->syy / (a->n - 1);
+    cxy = a->sxy / (a->n - 1);
+    /* eigenvalues of the 2 x 2 covariance */
+    m = (cxx + cyy) / 2.0;
+    r = hypot((cxx - cyy) / 2.0, cxy);
+    *major = sqrt(m + r);
+    *minor = sqrt((m - r > 0.0) ? m - r : 0.0);
+    *angle = 0.5 * atan2(2.0 * cxy, cxx - cyy) * 180.0 / M_PI;
+}
@@ -0,0 +1,76 @@
+/*
+ * Header file for placement tolerance module
+ *
+ * Monte Carlo analysis of how measurement errors move painted dots.
+ * Each room measurement and the observer's eye position get an
+ * error distribution; trial t draws its errors from a counter-based
+ * generator (Philox4x32-10) keyed by the seed and counting t, so any
+ * thread can draw any trial, in any order, with the same result.
+ * Per-star errors are accumulated into means and covariances, read
+ * out as error ellipses.
+ */
+
+#ifndef _TOLERANCE_H_
+#define _TOLERANCE_H_
+
+#include <stdio.h>
+
+/* perturbed quantities, room frame, cm */
+enum tol_param {
+    TOL_CEIL,                   /* observer to ceiling */
+    TOL_WALL,                   /* observer to east wall */
+    TOL_NS,                     /* room north-south */
+    TOL_EW,                     /* room east-west */
+    TOL_EYE_X,                  /* eye offset east */
+    TOL_EYE_Y,                  /* eye offset north */
+    TOL_EYE_Z,                  /* eye offset up */
+    TOL_N_PARAMS
+};
+
+enum tol_dist {
+    TOL_FIXED,                  /* no error */
+    TOL_NORMAL,                 /* width is the standard deviation */
+    TOL_UNIFORM                 /* width is the half range */
+};
+
+struct tol_str {
+    int trials;
+    unsigned long long seed;
+    int dist[TOL_N_PARAMS];     /* enum tol_dist */
+    double width[TOL_N_PARAMS];
+};
+
+/* errors of one star over the trials */
+struct tol_acc_str {
+    int n;
+    double mx, my;              /* mean */
+    double sxx, syy, sxy;       /* sums of squared deviations */
+    double max;                 /* largest error */
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * read tolerances, one per line ('#' comments):
+ *   trials n
+ *   seed n
+ *   ceil|wall|ns|ew|eye_x|eye_y|eye_z  normal|uniform  width
+ * returns -1 on error
+ */
+int tol_read(FILE *in, struct tol_str *tol);
+/* errors d[TOL_N_PARAMS] of trial t */
+void tol_draw(const struct tol_str *tol, long long t, double *d);
+
+void tol_acc_init(struct tol_acc_str *a);
+/* add one trial's error (ex, ey) */
+void tol_acc_add(struct tol_acc_str *a, double ex, double ey);
+/*
+ * standard deviations along the major and minor axes of the error
+ * ellipse, and the major axis angle (degrees, counterclockwise from x)
+ */
+void tol_ellipse(const struct tol_acc_str *a, double *major, double *minor,
+                 double *angle);
+
+#endif
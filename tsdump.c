@@ -0,0 +1,103 @@
+/*
+ * tsdump: print epochs of a time series written by astroplane -Z as
+ * the listing astroplane prints
+ *
+ *   tsdump [-i] [-e first[,last]] seriesfile
+ *
+ * Each epoch is "# epoch k jd" then its dots.  -e picks epochs
+ * (from 0, last may be past the end), read through the index
+ * without decoding those before the keyframe of first.  -i prints
+ * the index instead.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "series.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-i] [-e first[,last]] seriesfile\n", prog);
+    exit(1);
+}
+
+static void print_epoch(FILE *out, int e, double jd,
+                        const struct ts_rec_str *recs, int n)
+{
+    int k;
+
+    fprintf(out, "# epoch %d %.6f\n", e, jd);
+    for (k = 0; k < n; k++) {
+        const double *v = recs[k].v;
+
+        fprintf(out,
+                "%6lld %5.2f %010.6f %09.6f %6.1f %6.1f %05.1f %c %05.1f %c %4.1f 0\n",
+                recs[k].id, v[TS_VMAG], v[TS_AZ], v[TS_ALT],
+                v[TS_EAST], v[TS_NORTH], v[TS_DN], (char)v[TS_WN],
+                v[TS_DS], (char)v[TS_WS], v[TS_DIA]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct ts_reader_str r;
+    const struct ts_rec_str *recs;
+    int first = 0;
+    int last = -1;
+    int index = 0;
+    FILE *in;
+    int opt;
+    int e, n;
+
+    while ((opt = getopt(argc, argv, "e:i")) != -1) {
+        switch (opt) {
+        case 'e':
+            n = sscanf(optarg, "%d,%d", &first, &last);
+            if (n < 1 || first < 0 || (n == 2 && last < first))
+                usage(argv[0]);
+            if (n == 1)
+                last = first;
+            break;
+        case 'i':
+            index = 1;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 1)
+        usage(argv[0]);
+
+    in = fopen(argv[optind], "rb");
+    if (in == NULL) {
+        perror(argv[optind]);
+        exit(1);
+    }
+    if (ts_open(&r, in) != 0) {
+        fprintf(stderr, "%s: not a time series\n", argv[optind]);
+        exit(1);
+    }
+    if (last < 0 || last >= r.n_epochs)
+        last = r.n_epochs - 1;
+
+    for (e = first; e <= last; e++) {
+        const struct ts_index_str *ix = &r.index[e];
+
+        if (index) {
+            printf("%6d %.6f %10lld %6d%s\n", e, ix->jd, ix->pos, ix->n_recs,
+                   ix->key ? " key" : "");
+            continue;
+        }
+        n = ts_get_epoch(&r, e, &recs);
+        if (n < 0) {
+            fprintf(stderr, "%s: epoch %d unreadable\n", argv[optind], e);
+            exit(1);
+        }
+        print_epoch(stdout, e, ix->jd, recs, n);
+    }
+
+    ts_close(&r);
+    fclose(in);
+    exit(0);
+}
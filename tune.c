@@ -0,0 +1,55 @@
+/*
+ * tuning profile module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tune.h"
+
+#define LINE_LEN 256
+
+/*
+ * public functions
+ */
+
+/* read profile, returns -1 on error */
+int tune_read(FILE *in, struct tune_str *t)
+{
+    char line[LINE_LEN];
+    char kw[16];
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, "%15s", kw) != 1 || kw[0] == '#')
+            continue;
+        if (strcmp(kw, "cpus") == 0) {
+            if (sscanf(line, "%*s %d", &t->cpus) != 1 || t->cpus < 1)
+                return -1;
+        } else if (strcmp(kw, "cells") == 0) {
+            if (sscanf(line, "%*s %lf %lf", &t->cell_dec, &t->cell_ra) != 2
+                || t->cell_dec <= 0.0 || t->cell_ra <= 0.0)
+                return -1;
+        } else if (strcmp(kw, "threads") == 0) {
+            if (sscanf(line, "%*s %d", &t->threads) != 1 || t->threads < 1)
+                return -1;
+        } else if (strcmp(kw, "shard") == 0) {
+            if (sscanf(line, "%*s %d", &t->shard) != 1 || t->shard < 1)
+                return -1;
+        } else
+            return -1;
+    }
+    return 0;
+}
+
+/* write profile, returns -1 on error */
+int tune_write(FILE *out, const struct tune_str *t, const char *note)
+{
+    if (note != NULL)
+        fprintf(out, "# %s\n", note);
+    fprintf(out, "cpus %d\n", t->cpus);
+    fprintf(out, "cells %g %g\n", t->cell_dec, t->cell_ra);
+    fprintf(out, "threads %d\n", t->threads);
+    fprintf(out, "shard %d\n", t->shard);
+    return ferror(out) ? -1 : 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Header file for tuning profile module
+ *
+ * What astroplane --tune measured fastest on this machine, kept in
+ * astroplane.tune in the working directory, which later runs started
+ * there read at startup, one setting a line ('#' comments):
+ *   cpus n          processors online when tuned
+ *   cells dec ra    sky cell size of the horizon cull, degrees
+ *   threads n       threads splitting one site's frame when -j is
+ *                   not given; -S batches still run a site a processor
+ *   shard n         least catalog entries in a shard (-P)
+ * Settings left out keep what the caller had.
+ */
+
+#ifndef _TUNE_H_
+#define _TUNE_H_
+
+#include <stdio.h>
+
+struct tune_str {
+    int cpus;
+    double cell_dec, cell_ra;
+    int threads;
+    int shard;
+};
+
+/*
+ * public function prototypes
+ */
+
+/* read profile over t, returns -1 on error */
+int tune_read(FILE *in, struct tune_str *t);
+/* write profile, note (may be NULL) as a comment.  returns -1 on error */
+int tune_write(FILE *out, const struct tune_str *t, const char *note);
+
+#endif
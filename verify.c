@@ -0,0 +1,787 @@
+/*
+ * photo verification module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "kdtree.h"
+#include "verify.h"
+
+#define LINE_LEN   256
+#define N_NEAR     5            /* neighbours a point makes triangles with */
+#define RATIO_BIN  0.01         /* side ratio cell */
+#define N_RATIO    101          /* cells per ratio, 0 .. 1 */
+#define MIN_SPREAD 0.03         /* closer sides: vertex order unsure */
+#define MIN_FLAT   0.02         /* flatter (a + b - c over c) is unstable */
+#define N_SEEDS    128          /* photo points triangles are made around */
+/* votes: log scale (scales 1e-3 .. 1e3) and rotation, degrees */
+#define LOG_S_BIN  0.05
+#define LOG_S_MIN  -6.91
+#define N_LOG_S    277
+#define ANG_BIN    2.0
+#define N_ANG      180
+/* offsets are clustered in cells of this share of the dots' extent */
+#define OFF_CELL   0.01
+#define MAX_ITER   20
+#define N_CAND     4            /* dots a blob may be paired with */
+
+/* triangle, vertices ordered by the length of the side opposite */
+struct tri_str {
+    int v[3];
+    float r1, r2;               /* shorter sides over the longest */
+    int ccw;                    /* vertices in order counterclockwise */
+};
+
+/* dot triangles by side ratio cell */
+struct tri_table_str {
+    struct tri_str *tri;
+    int n;
+    int first[N_RATIO * N_RATIO + 1];
+};
+
+/* a photo triangle matching a dot triangle */
+struct match_str {
+    int blob[3], dot[3];
+    int mirror;
+    double re, im;              /* scale, rotation */
+    double tx, ty;              /* offset at the winning scale, rotation */
+};
+
+/* blob and dot that may be paired */
+struct cand_str {
+    int blob, dot;
+    double d2;
+};
+
+/* matches, grown as found */
+struct match_set_str {
+    struct match_str *m;
+    int n, cap;
+};
+
+/*
+ * private functions
+ */
+
+static int ratio_cell(double r)
+{
+    int c = (int)(r / RATIO_BIN);
+
+    return (c < 0) ? 0 : (c >= N_RATIO) ? N_RATIO - 1 : c;
+}
+
+/*
+ * triangle i, j, k of the points xy, returns -1 if too thin or too
+ * near isosceles to tell its vertices apart
+ */
+static int make_tri(const double *xy, int i, int j, int k,
+                    struct tri_str *t)
+{
+    const int v[3] = {i, j, k};
+    double l[3];
+    int o[3] = {0, 1, 2};
+    double cross;
+    int a, b;
+
+    /* side opposite each vertex */
+    for (a = 0; a < 3; a++) {
+        const double *p = &xy[2 * v[(a + 1) % 3]];
+        const double *q = &xy[2 * v[(a + 2) % 3]];
+
+        l[a] = sqrt((p[0] - q[0]) * (p[0] - q[0])
+                    + (p[1] - q[1]) * (p[1] - q[1]));
+    }
+    for (a = 1; a < 3; a++)
+        for (b = a; b > 0 && l[o[b - 1]] > l[o[b]]; b--) {
+            int tmp = o[b];
+
+            o[b] = o[b - 1];
+            o[b - 1] = tmp;
+        }
+    if (l[o[2]] <= 0.0
+        || (l[o[1]] - l[o[0]]) < MIN_SPREAD * l[o[2]]
+        || (l[o[2]] - l[o[1]]) < MIN_SPREAD * l[o[2]]
+        || (l[o[0]] + l[o[1]] - l[o[2]]) < MIN_FLAT * l[o[2]])
+        return -1;
+
+    for (a = 0; a < 3; a++)
+        t->v[a] = v[o[a]];
+    t->r1 = l[o[0]] / l[o[2]];
+    t->r2 = l[o[1]] / l[o[2]];
+    cross = (xy[2 * t->v[1]] - xy[2 * t->v[0]])
+        * (xy[2 * t->v[2] + 1] - xy[2 * t->v[0] + 1])
+        - (xy[2 * t->v[1] + 1] - xy[2 * t->v[0] + 1])
+        * (xy[2 * t->v[2]] - xy[2 * t->v[0]]);
+    t->ccw = (cross > 0.0);
+    return 0;
+}
+
+/* nearest neighbours of point i (not itself) into nb, their number */
+static int near_list(const struct kd_str *kd, const double *xy, int i,
+                     int *nb)
+{
+    int all[N_NEAR + 1];
+    int m, a, j;
+
+    m = kd_knearest(kd, &xy[2 * i], N_NEAR + 1, HUGE_VAL, all, NULL);
+    for (a = 0, j = 0; a < m; a++)
+        if (all[a] != i && j < N_NEAR)
+            nb[j++] = all[a];
+    return j;
+}
+
+static int in_list(const int *nb, int n, int v)
+{
+    int a;
+
+    for (a = 0; a < n; a++)
+        if (nb[a] == v)
+            return 1;
+    return 0;
+}
+
+/*
+ * triangles of point i with pairs of its n neighbours nb into tri
+ * (room for N_NEAR * (N_NEAR - 1) / 2), returns their number.  With
+ * the lists of every point (lists, counts), a triangle another point
+ * of lower index makes too is left to that point.
+ */
+static int point_tris(const double *xy, int i, const int *nb, int n,
+                      const int *lists, const int *counts,
+                      struct tri_str *tri)
+{
+    int n_tri = 0;
+    int a, b;
+
+    for (a = 0; a < n; a++)
+        for (b = a + 1; b < n; b++) {
+            int u = nb[a], v = nb[b];
+
+            if (lists != NULL
+                && ((u < i && in_list(&lists[u * N_NEAR], counts[u], i)
+                     && in_list(&lists[u * N_NEAR], counts[u], v))
+                    || (v < i && in_list(&lists[v * N_NEAR], counts[v], i)
+                        && in_list(&lists[v * N_NEAR], counts[v], u))))
+                continue;
+            if (make_tri(xy, i, u, v, &tri[n_tri]) == 0)
+                n_tri++;
+        }
+    return n_tri;
+}
+
+static int tri_cell(const struct tri_str *t)
+{
+    return ratio_cell(t->r1) * N_RATIO + ratio_cell(t->r2);
+}
+
+/* triangles of every dot, each once, by cell.  returns -1 on error */
+static int table_build(const struct kd_str *kd, const double *xy, int n,
+                       struct tri_table_str *tab)
+{
+    const int per = N_NEAR * (N_NEAR - 1) / 2;
+    struct tri_str *all = NULL, *tri = NULL;
+    int *lists, *counts;
+    int n_all = 0;
+    int ret = -1;
+    int i, c;
+
+    lists = malloc(((size_t)n * N_NEAR + 1) * sizeof(*lists));
+    counts = malloc((n + 1) * sizeof(*counts));
+    all = malloc(((size_t)n * per + 1) * sizeof(*all));
+    if (lists == NULL || counts == NULL || all == NULL)
+        goto done;
+    for (i = 0; i < n; i++)
+        counts[i] = near_list(kd, xy, i, &lists[i * N_NEAR]);
+    for (i = 0; i < n; i++)
+        n_all += point_tris(xy, i, &lists[i * N_NEAR], counts[i], lists,
+                            counts, &all[n_all]);
+
+    /* counting sort by cell */
+    tri = malloc((n_all + 1) * sizeof(*tri));
+    if (tri == NULL)
+        goto done;
+    memset(tab->first, 0, sizeof(tab->first));
+    for (i = 0; i < n_all; i++)
+        tab->first[tri_cell(&all[i]) + 1]++;
+    for (c = 0; c < N_RATIO * N_RATIO; c++)
+        tab->first[c + 1] += tab->first[c];
+    for (i = 0; i < n_all; i++)
+        tri[tab->first[tri_cell(&all[i])]++] = all[i];
+    for (c = N_RATIO * N_RATIO; c > 0; c--)
+        tab->first[c] = tab->first[c - 1];
+    tab->first[0] = 0;
+    tab->tri = tri;
+    tab->n = n_all;
+    ret = 0;
+
+done:
+    free(lists);
+    free(counts);
+    free(all);
+    return ret;
+}
+
+/* photo point, mirrored if asked */
+static void blob_pt(const double *xy, int i, int mirror, double *x,
+                    double *y)
+{
+    *x = xy[2 * i];
+    *y = mirror ? -xy[2 * i + 1] : xy[2 * i + 1];
+}
+
+/*
+ * least squares similarity taking blobs bi[] onto dots di[], for a
+ * given mirroring.  returns -1 if the blobs coincide
+ */
+static int fit(const double *dot_xy, const double *blob_xy, const int *di,
+               const int *bi, int n, int mirror, struct pv_xform_str *xf)
+{
+    double bx = 0.0, by = 0.0, mx = 0.0, my = 0.0;
+    double sre = 0.0, sim = 0.0, sbb = 0.0;
+    int k;
+
+    if (n <= 0)
+        return -1;
+    for (k = 0; k < n; k++) {
+        double x, y;
+
+        blob_pt(blob_xy, bi[k], mirror, &x, &y);
+        bx += x;
+        by += y;
+        mx += dot_xy[2 * di[k]];
+        my += dot_xy[2 * di[k] + 1];
+    }
+    bx /= n;
+    by /= n;
+    mx /= n;
+    my /= n;
+    for (k = 0; k < n; k++) {
+        double x, y, u, v;
+
+        blob_pt(blob_xy, bi[k], mirror, &x, &y);
+        x -= bx;
+        y -= by;
+        u = dot_xy[2 * di[k]] - mx;
+        v = dot_xy[2 * di[k] + 1] - my;
+        /* conj(b) m */
+        sre += x * u + y * v;
+        sim += x * v - y * u;
+        sbb += x * x + y * y;
+    }
+    if (sbb <= 0.0)
+        return -1;
+    xf->re = sre / sbb;
+    xf->im = sim / sbb;
+    xf->mirror = mirror;
+    xf->tx = mx - (xf->re * bx - xf->im * by);
+    xf->ty = my - (xf->im * bx + xf->re * by);
+    return 0;
+}
+
+/* vote cell of a scale, rotation and mirroring, -1 if out of range */
+static int vote_cell(double re, double im, int mirror)
+{
+    double s2 = re * re + im * im;
+    double ang = atan2(im, re) * 180.0 / M_PI;
+    int ls, a;
+
+    if (s2 <= 0.0)
+        return -1;
+    ls = (int)floor((0.5 * log(s2) - LOG_S_MIN) / LOG_S_BIN);
+    if (ls < 0 || ls >= N_LOG_S)
+        return -1;
+    a = (int)floor((ang + 180.0) / ANG_BIN);
+    a = (a % N_ANG + N_ANG) % N_ANG;
+    return (mirror * N_LOG_S + ls) * N_ANG + a;
+}
+
+/* votes in cell c and the cells around it (rotation wraps) */
+static int vote_near(const int *hist, int c, int cell)
+{
+    int mirror = c / (N_LOG_S * N_ANG);
+    int ls = (c / N_ANG) % N_LOG_S;
+    int a = c % N_ANG;
+    int sum = 0;
+    int dl, da;
+
+    for (dl = -1; dl <= 1; dl++)
+        for (da = -1; da <= 1; da++) {
+            int l = ls + dl;
+            int b = (a + da + N_ANG) % N_ANG;
+            int cc = (mirror * N_LOG_S + l) * N_ANG + b;
+
+            if (l < 0 || l >= N_LOG_S)
+                continue;
+            if (cell < 0)
+                sum += hist[cc];
+            else if (cc == cell)
+                return 1;
+        }
+    return sum;
+}
+
+static int add_match(struct match_set_str *ms, const struct match_str *m)
+{
+    if (ms->n >= ms->cap) {
+        int cap = (ms->cap > 0) ? 2 * ms->cap : 1024;
+        struct match_str *p = realloc(ms->m, cap * sizeof(*p));
+
+        if (p == NULL)
+            return -1;
+        ms->m = p;
+        ms->cap = cap;
+    }
+    ms->m[ms->n++] = *m;
+    return 0;
+}
+
+/*
+ * look photo triangles up among the dot triangles: each match votes
+ * into hist, or when best >= 0 is kept in ms if near that cell.
+ * returns -1 on error
+ */
+static int match_tris(const struct tri_table_str *tab, const double *dot_xy,
+                      const struct tri_str *bt, int n_bt,
+                      const double *blob_xy, int *hist, int best,
+                      struct match_set_str *ms)
+{
+    int i, c1, c2, k;
+
+    for (i = 0; i < n_bt; i++) {
+        const struct tri_str *b = &bt[i];
+        int r1 = ratio_cell(b->r1), r2 = ratio_cell(b->r2);
+
+        for (c1 = r1 - 1; c1 <= r1 + 1; c1++)
+            for (c2 = r2 - 1; c2 <= r2 + 1; c2++) {
+                int c = c1 * N_RATIO + c2;
+
+                if (c1 < 0 || c1 >= N_RATIO || c2 < 0 || c2 >= N_RATIO)
+                    continue;
+                for (k = tab->first[c]; k < tab->first[c + 1]; k++) {
+                    const struct tri_str *d = &tab->tri[k];
+                    struct pv_xform_str xf;
+                    struct match_str m;
+                    int cell;
+
+                    if (fabsf(d->r1 - b->r1) > RATIO_BIN
+                        || fabsf(d->r2 - b->r2) > RATIO_BIN)
+                        continue;
+                    m.mirror = (d->ccw != b->ccw);
+                    if (fit(dot_xy, blob_xy, d->v, b->v, 3, m.mirror,
+                            &xf) != 0)
+                        continue;
+                    cell = vote_cell(xf.re, xf.im, m.mirror);
+                    if (cell < 0)
+                        continue;
+                    if (best < 0) {
+                        hist[cell]++;
+                        continue;
+                    }
+                    if (!vote_near(NULL, best, cell))
+                        continue;
+                    memcpy(m.blob, b->v, sizeof(m.blob));
+                    memcpy(m.dot, d->v, sizeof(m.dot));
+                    m.re = xf.re;
+                    m.im = xf.im;
+                    if (add_match(ms, &m) != 0)
+                        return -1;
+                }
+            }
+    }
+    return 0;
+}
+
+/* offset cell of a match, in cells of size cell */
+static long long off_key(double tx, double ty, double cell, int dx, int dy)
+{
+    long long x = (long long)floor(tx / cell) + dx;
+    long long y = (long long)floor(ty / cell) + dy;
+
+    return (x << 32) ^ (y & 0xffffffffLL);
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * matches of the winning vote that agree on the offset (at the mean
+ * scale and rotation), moved to the front.  returns their number
+ */
+static int consensus(struct match_set_str *ms, const double *dot_xy,
+                     const double *blob_xy, double cell)
+{
+    double re = 0.0, im = 0.0;
+    long long *key;
+    long long best_key = 0;
+    int best = 0;
+    int n = 0;
+    int i, j, dx, dy;
+
+    for (i = 0; i < ms->n; i++) {
+        re += ms->m[i].re;
+        im += ms->m[i].im;
+    }
+    re /= ms->n;
+    im /= ms->n;
+    for (i = 0; i < ms->n; i++) {
+        struct match_str *m = &ms->m[i];
+        double bx = 0.0, by = 0.0, mx = 0.0, my = 0.0;
+
+        for (j = 0; j < 3; j++) {
+            double x, y;
+
+            blob_pt(blob_xy, m->blob[j], m->mirror, &x, &y);
+            bx += x / 3.0;
+            by += y / 3.0;
+            mx += dot_xy[2 * m->dot[j]] / 3.0;
+            my += dot_xy[2 * m->dot[j] + 1] / 3.0;
+        }
+        m->tx = mx - (re * bx - im * by);
+        m->ty = my - (im * bx + re * by);
+    }
+
+    /* densest offset cell, counting its neighbours */
+    key = malloc((ms->n + 1) * sizeof(*key));
+    if (key == NULL)
+        return 0;
+    for (i = 0; i < ms->n; i++)
+        key[i] = off_key(ms->m[i].tx, ms->m[i].ty, cell, 0, 0);
+    qsort(key, ms->n, sizeof(*key), cmp_ll);
+    for (i = 0; i < ms->n; i++) {
+        const struct match_str *m = &ms->m[i];
+        int count = 0;
+
+        for (dx = -1; dx <= 1; dx++)
+            for (dy = -1; dy <= 1; dy++) {
+                long long k = off_key(m->tx, m->ty, cell, dx, dy);
+                long long *p = bsearch(&k, key, ms->n, sizeof(*key), cmp_ll);
+
+                /* count the whole run of equal keys */
+                if (p == NULL)
+                    continue;
+                while (p > key && p[-1] == k)
+                    p--;
+                for (; p < key + ms->n && *p == k; p++)
+                    count++;
+            }
+        if (count > best) {
+            best = count;
+            best_key = off_key(m->tx, m->ty, cell, 0, 0);
+        }
+    }
+    free(key);
+
+    for (i = 0; i < ms->n; i++) {
+        int near = 0;
+
+        for (dx = -1; dx <= 1 && !near; dx++)
+            for (dy = -1; dy <= 1 && !near; dy++)
+                near = (off_key(ms->m[i].tx, ms->m[i].ty, cell, dx, dy)
+                        == best_key);
+        if (near) {
+            struct match_str tmp = ms->m[n];
+
+            ms->m[n++] = ms->m[i];
+            ms->m[i] = tmp;
+        }
+    }
+    return n;
+}
+
+static int cmp_cand(const void *pa, const void *pb)
+{
+    const struct cand_str *a = pa, *b = pb;
+
+    return (a->d2 > b->d2) - (a->d2 < b->d2);
+}
+
+/*
+ * pair blobs with dots within r under xf, nearest pairs first, each
+ * blob and dot once.  returns number of pairs, -1 on error
+ */
+static int pair_up(const struct kd_str *kd, const double *blob_xy, int n_blobs,
+                   const struct pv_xform_str *xf, double r, int *blob,
+                   double *d2, int *dot, int n_dots)
+{
+    struct cand_str *cand;
+    int idx[N_CAND];
+    double e2[N_CAND];
+    int n_cand = 0;
+    int n = 0;
+    int i, k, m;
+
+    cand = malloc(((size_t)n_blobs * N_CAND + 1) * sizeof(*cand));
+    if (cand == NULL)
+        return -1;
+    for (i = 0; i < n_blobs; i++) {
+        double q[2];
+
+        pv_apply(xf, blob_xy[2 * i], blob_xy[2 * i + 1], &q[0], &q[1]);
+        m = kd_knearest(kd, q, N_CAND, r * r, idx, e2);
+        for (k = 0; k < m; k++) {
+            cand[n_cand].blob = i;
+            cand[n_cand].dot = idx[k];
+            cand[n_cand++].d2 = e2[k];
+        }
+    }
+    qsort(cand, n_cand, sizeof(*cand), cmp_cand);
+
+    for (i = 0; i < n_dots; i++)
+        blob[i] = -1;
+    for (i = 0; i < n_blobs; i++)
+        dot[i] = -1;
+    for (k = 0; k < n_cand; k++) {
+        const struct cand_str *c = &cand[k];
+
+        if (blob[c->dot] >= 0 || dot[c->blob] >= 0)
+            continue;
+        blob[c->dot] = c->blob;
+        dot[c->blob] = c->dot;
+        d2[c->dot] = c->d2;
+        n++;
+    }
+    free(cand);
+    return n;
+}
+
+/*
+ * public functions
+ */
+
+/* read blob list, returns -1 on error */
+int pv_read_blobs(FILE *in, struct pv_blobs_str *b)
+{
+    char line[LINE_LEN];
+    int cap = 0;
+
+    b->xy = NULL;
+    b->n = 0;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        double x, y;
+        char *p = line + strspn(line, " \t");
+
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+        if (sscanf(p, "%lf %lf", &x, &y) != 2)
+            goto fail;
+        if (b->n >= cap) {
+            double *t;
+
+            cap = (cap > 0) ? 2 * cap : 1024;
+            t = realloc(b->xy, 2 * cap * sizeof(*t));
+            if (t == NULL)
+                goto fail;
+            b->xy = t;
+        }
+        b->xy[2 * b->n] = x;
+        b->xy[2 * b->n + 1] = y;
+        b->n++;
+    }
+    return 0;
+
+fail:
+    pv_blobs_free(b);
+    return -1;
+}
+
+void pv_blobs_free(struct pv_blobs_str *b)
+{
+    free(b->xy);
+    b->xy = NULL;
+    b->n = 0;
+}
+
+/* where photo point (x, y) lands */
+void pv_apply(const struct pv_xform_str *xf, double x, double y,
+              double *u, double *v)
+{
+    if (xf->mirror)
+        y = -y;
+    *u = xf->re * x - xf->im * y + xf->tx;
+    *v = xf->im * x + xf->re * y + xf->ty;
+}
+
+/* register blobs with the dots, returns -1 on error */
+int pv_register(const double *dot_xy, int n_dots,
+                const struct pv_blobs_str *b, double tol, double far,
+                struct pv_str *pv)
+{
+    const int per = N_NEAR * (N_NEAR - 1) / 2;
+    struct kd_str dot_kd, blob_kd;
+    struct tri_table_str tab;
+    struct match_set_str ms = {NULL, 0, 0};
+    struct tri_str *bt = NULL;
+    int *hist = NULL;
+    double *d2 = NULL;
+    int *bi = NULL, *di = NULL;
+    double lo[2], hi[2], cell, r;
+    int n_bt = 0, stride, best = -1;
+    int ret = -1;
+    int i, k, iter, n;
+
+    memset(pv, 0, sizeof(*pv));
+    memset(&tab, 0, sizeof(tab));
+    memset(&blob_kd, 0, sizeof(blob_kd));
+    if (kd_build(&dot_kd, dot_xy, n_dots, 2) != 0)
+        return -1;
+    pv->blob = malloc((n_dots + 1) * sizeof(*pv->blob));
+    pv->off = malloc((2 * n_dots + 1) * sizeof(*pv->off));
+    pv->dot = malloc((b->n + 1) * sizeof(*pv->dot));
+    d2 = malloc((n_dots + 1) * sizeof(*d2));
+    hist = calloc(2 * N_LOG_S * N_ANG, sizeof(*hist));
+    bt = malloc((N_SEEDS * per + 1) * sizeof(*bt));
+    if (pv->blob == NULL || pv->off == NULL || pv->dot == NULL
+        || d2 == NULL || hist == NULL || bt == NULL
+        || kd_build(&blob_kd, b->xy, b->n, 2) != 0
+        || table_build(&dot_kd, dot_xy, n_dots, &tab) != 0)
+        goto done;
+    pv->n_missing = n_dots;
+    pv->n_extra = b->n;
+    if (n_dots < 3 || b->n < 3)
+        goto none;
+
+    /* photo triangles around seeds spread over the list */
+    stride = (b->n + N_SEEDS - 1) / N_SEEDS;
+    for (i = 0; i < b->n; i += stride) {
+        int nb[N_NEAR];
+
+        k = near_list(&blob_kd, b->xy, i, nb);
+        n_bt += point_tris(b->xy, i, nb, k, NULL, NULL, &bt[n_bt]);
+    }
+
+    /* vote for scale, rotation and mirroring, then keep the winners */
+    if (match_tris(&tab, dot_xy, bt, n_bt, b->xy, hist, -1, NULL) != 0)
+        goto done;
+    for (i = 0, k = 0; i < 2 * N_LOG_S * N_ANG; i++) {
+        if (hist[i] == 0)
+            continue;
+        n = vote_near(hist, i, -1);
+        if (n > k) {
+            k = n;
+            best = i;
+        }
+    }
+    if (best < 0
+        || match_tris(&tab, dot_xy, bt, n_bt, b->xy, hist, best, &ms) != 0)
+        goto done;
+    pv->n_votes = ms.n;
+    /* pairs: those of the matches, later one per dot */
+    bi = malloc((3 * (size_t)ms.n + n_dots + 1) * sizeof(*bi));
+    di = malloc((3 * (size_t)ms.n + n_dots + 1) * sizeof(*di));
+    if (bi == NULL || di == NULL)
+        goto done;
+
+    /* offsets scatter with the distance from where they were taken */
+    lo[0] = hi[0] = dot_xy[0];
+    lo[1] = hi[1] = dot_xy[1];
+    for (i = 1; i < n_dots; i++)
+        for (k = 0; k < 2; k++) {
+            lo[k] = fmin(lo[k], dot_xy[2 * i + k]);
+            hi[k] = fmax(hi[k], dot_xy[2 * i + k]);
+        }
+    cell = fmax(far, OFF_CELL * hypot(hi[0] - lo[0], hi[1] - lo[1]));
+    pv->n_consensus = (ms.n > 0) ? consensus(&ms, dot_xy, b->xy, cell) : 0;
+    if (pv->n_consensus == 0)
+        goto none;
+    for (i = 0, n = 0; i < pv->n_consensus; i++)
+        for (k = 0; k < 3; k++) {
+            bi[n] = ms.m[i].blob[k];
+            di[n++] = ms.m[i].dot[k];
+        }
+    if (fit(dot_xy, b->xy, di, bi, n, ms.m[0].mirror, &pv->xf) != 0)
+        goto none;
+
+    /* refine on nearest dots, closing in on far */
+    r = 2.0 * cell;
+    for (iter = 0; iter < MAX_ITER; iter++) {
+        struct pv_xform_str xf = pv->xf;
+
+        n = pair_up(&dot_kd, b->xy, b->n, &xf, r, pv->blob, d2, pv->dot,
+                    n_dots);
+        if (n < 0)
+            goto done;
+        if (n < 3)
+            goto none;
+        for (i = 0, k = 0; i < n_dots; i++)
+            if (pv->blob[i] >= 0) {
+                di[k] = i;
+                bi[k++] = pv->blob[i];
+            }
+        if (fit(dot_xy, b->xy, di, bi, k, xf.mirror, &pv->xf) != 0)
+            goto none;
+        if (r > far) {
+            r = fmax(far, r / 2.0);
+            continue;
+        }
+        if (fabs(pv->xf.re - xf.re) + fabs(pv->xf.im - xf.im)
+            < 1e-12 * hypot(xf.re, xf.im)
+            && fabs(pv->xf.tx - xf.tx) + fabs(pv->xf.ty - xf.ty) < 1e-9)
+            break;
+    }
+
+    /* sort the dots and blobs under the final fit */
+    pv->n_pairs = pair_up(&dot_kd, b->xy, b->n, &pv->xf, far, pv->blob, d2,
+                          pv->dot, n_dots);
+    if (pv->n_pairs < 0)
+        goto done;
+    pv->n_missing = n_dots - pv->n_pairs;
+    pv->n_extra = b->n - pv->n_pairs;
+    for (i = 0; i < n_dots; i++) {
+        double u, v;
+
+        if (pv->blob[i] < 0)
+            continue;
+        pv_apply(&pv->xf, b->xy[2 * pv->blob[i]], b->xy[2 * pv->blob[i] + 1],
+                 &u, &v);
+        pv->off[2 * i] = u - dot_xy[2 * i];
+        pv->off[2 * i + 1] = v - dot_xy[2 * i + 1];
+        pv->rms += d2[i];
+        if (d2[i] <= tol * tol)
+            pv->n_placed++;
+        else
+            pv->n_misplaced++;
+    }
+    pv->rms = (pv->n_pairs > 0) ? sqrt(pv->rms / pv->n_pairs) : 0.0;
+    ret = 0;
+    goto done;
+
+    /* no registration: every dot missing, every blob extra */
+none:
+    memset(&pv->xf, 0, sizeof(pv->xf));
+    for (i = 0; i < n_dots; i++)
+        pv->blob[i] = -1;
+    for (i = 0; i < b->n; i++)
+        pv->dot[i] = -1;
+    pv->n_pairs = 0;
+    ret = 0;
+
+done:
+    kd_free(&dot_kd);
+    kd_free(&blob_kd);
+    free(tab.tri);
+    free(ms.m);
+    free(bt);
+    free(hist);
+    free(d2);
+    free(bi);
+    free(di);
+    if (ret != 0)
+        pv_free(pv);
+    return ret;
+}
+
+void pv_free(struct pv_str *pv)
+{
+    free(pv->blob);
+    free(pv->dot);
+    free(pv->off);
+    pv->blob = pv->dot = NULL;
+    pv->off = NULL;
+}
@@ -0,0 +1,77 @@
+/*
+ * Header file for photo verification module
+ *
+ * Registers blob centroids found in a photograph of the painted
+ * ceiling (pixels, from any blob detector) with the projected dots
+ * (mm), then sorts the dots into placed, misplaced and missing, and
+ * the blobs on no dot into extra.  The registration is a similarity:
+ * scale, rotation, offset, and mirroring, as a photograph taken from
+ * below is.
+ *  - each point and pairs of its nearest neighbours make triangles,
+ *    hashed by the ratios of their sides, which a similarity leaves
+ *    alone.  Photo triangles looked up among the dot triangles each
+ *    vote for a scale, rotation and mirroring
+ *  - the matches of the winning vote are clustered by the offset
+ *    they imply, and the largest cluster fitted by least squares
+ *  - the fit is refined by pairing each blob with its nearest dot
+ *    (k-d tree) and fitting again, closing in on the pairing radius
+ */
+
+#ifndef _VERIFY_H_
+#define _VERIFY_H_
+
+#include <stdio.h>
+
+/* blob centroids of a photograph */
+struct pv_blobs_str {
+    double *xy;                 /* x, y of each, pixels */
+    int n;
+};
+
+/* photo to dots: (u + iv) = a (x + iy') + t, y' = -y if mirrored */
+struct pv_xform_str {
+    double re, im;              /* a: scale, rotation */
+    int mirror;
+    double tx, ty;              /* mm */
+};
+
+struct pv_str {
+    struct pv_xform_str xf;
+    int n_pairs;                /* dots paired with blobs, 0: no fit */
+    double rms;                 /* of their offsets, mm */
+    int *blob;                  /* blob of each dot, -1: missing */
+    int *dot;                   /* dot of each blob, -1: extra */
+    double *off;                /* blob minus dot (x, y) of each dot, mm */
+    int n_placed;
+    int n_misplaced;
+    int n_missing;
+    int n_extra;
+    int n_votes;                /* triangle matches of the winning vote */
+    int n_consensus;            /* of those, agreeing on the offset */
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * read blob list: "x y" first on each line, anything after ignored,
+ * '#' comments.  returns -1 on error
+ */
+int pv_read_blobs(FILE *in, struct pv_blobs_str *b);
+void pv_blobs_free(struct pv_blobs_str *b);
+/*
+ * register blobs with the n_dots dots at dot_xy (x, y, mm).  Dots
+ * within far (mm) of a blob are paired with it, placed when within
+ * tol.  n_pairs is 0 if no registration was found.
+ * returns -1 on error
+ */
+int pv_register(const double *dot_xy, int n_dots,
+                const struct pv_blobs_str *b, double tol, double far,
+                struct pv_str *pv);
+void pv_free(struct pv_str *pv);
+/* where photo point (x, y) lands, mm */
+void pv_apply(const struct pv_xform_str *xf, double x, double y,
+              double *u, double *v);
+
+#endif
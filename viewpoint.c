@@ -0,0 +1,193 @@
+/*
+ * viewpoint module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "viewpoint.h"
+
+#define LINE_LEN  256
+#define MAX_ITER  50
+#define TOL_STEP  1e-5          /* converged when a step is under, cm */
+#define DIFF_STEP 1e-3          /* finite difference step, cm */
+#define LAMBDA_0  1e-3          /* initial damping */
+
+/*
+ * private functions
+ */
+
+/*
+ * residuals of point (x, y, ceil): for each view, the cross product
+ * of the unit direction seen and h (length: sine of the angular
+ * error), scaled by the root of its weight.  returns their sum of
+ * squares
+ */
+static double residuals(const struct vp_set_str *vs, const struct v3_str *h,
+                        double ceil, double x, double y, double *r)
+{
+    double f = 0.0;
+    int k;
+
+    for (k = 0; k < vs->n; k++) {
+        struct v3_str d = {x, y, ceil};
+        double s = sqrt(vs->view[k].w);
+
+        v3_sub(&d, &vs->view[k].eye);
+        v3_unit(&d);
+        v3_cross(&d, h);
+        r[3 * k] = s * d.x;
+        r[3 * k + 1] = s * d.y;
+        r[3 * k + 2] = s * d.z;
+        f += r[3 * k] * r[3 * k] + r[3 * k + 1] * r[3 * k + 1]
+            + r[3 * k + 2] * r[3 * k + 2];
+    }
+    return f;
+}
+
+/*
+ * public functions
+ */
+
+/* read viewpoints, returns -1 on error */
+int vp_read(FILE *in, struct vp_set_str *vs)
+{
+    char line[LINE_LEN];
+    char kw[16];
+    struct vp_view_str *v;
+    double sum = 0.0;
+    int cap = 0;
+    int k;
+
+    memset(vs, 0, sizeof(*vs));
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, "%15s", kw) != 1 || kw[0] == '#')
+            continue;
+        if (strcmp(kw, "view") != 0)
+            goto fail;
+        if (vs->n >= cap) {
+            cap = (cap > 0) ? 2 * cap : 8;
+            v = realloc(vs->view, cap * sizeof(*v));
+            if (v == NULL)
+                goto fail;
+            vs->view = v;
+        }
+        v = &vs->view[vs->n];
+        if (sscanf(line, "%*s %31s %lf %lf %lf %lf", v->name,
+                   &v->eye.x, &v->eye.y, &v->eye.z, &v->w) != 5
+            || v->w <= 0.0)
+            goto fail;
+        sum += v->w;
+        vs->n++;
+    }
+    if (vs->n == 0)
+        goto fail;
+    for (k = 0; k < vs->n; k++)
+        vs->view[k].w /= sum;
+    return 0;
+
+fail:
+    vp_free(vs);
+    return -1;
+}
+
+void vp_free(struct vp_set_str *vs)
+{
+    free(vs->view);
+    vs->view = NULL;
+    vs->n = 0;
+}
+
+/* angle between h and p seen from eye, radians */
+double vp_error(const struct v3_str *eye, const struct v3_str *p,
+                const struct v3_str *h)
+{
+    struct v3_str d = *p;
+    struct v3_str c;
+
+    v3_sub(&d, eye);
+    c = d;
+    v3_cross(&c, h);
+    return atan2(v3_mag(&c), v3_dot(&d, h));
+}
+
+/* least squares point on plane z = ceil, returns iterations */
+int vp_solve(const struct vp_set_str *vs, const struct v3_str *h,
+             double ceil, double *x, double *y)
+{
+    double *r, *rx, *ry;
+    double lambda = LAMBDA_0;
+    double f;
+    int it, i, k;
+
+    /* start: weighted mean of each view's own point */
+    *x = *y = 0.0;
+    for (k = 0; k < vs->n; k++) {
+        const struct v3_str *e = &vs->view[k].eye;
+        double t = (ceil - e->z) / h->z;
+
+        *x += vs->view[k].w * (e->x + t * h->x);
+        *y += vs->view[k].w * (e->y + t * h->y);
+    }
+    if (vs->n == 1)
+        return 0;
+
+    r = malloc(9 * vs->n * sizeof(*r));
+    if (r == NULL)
+        return 0;
+    rx = r + 3 * vs->n;
+    ry = rx + 3 * vs->n;
+    f = residuals(vs, h, ceil, *x, *y, r);
+
+    for (it = 1; it <= MAX_ITER; it++) {
+        double a = 0.0, b = 0.0, c = 0.0, gx = 0.0, gy = 0.0;
+        double det, dx, dy, f1;
+
+        /* forward difference Jacobian, then the normal equations */
+        residuals(vs, h, ceil, *x + DIFF_STEP, *y, rx);
+        residuals(vs, h, ceil, *x, *y + DIFF_STEP, ry);
+        for (i = 0; i < 3 * vs->n; i++) {
+            double jx = (rx[i] - r[i]) / DIFF_STEP;
+            double jy = (ry[i] - r[i]) / DIFF_STEP;
+
+            a += jx * jx;
+            b += jx * jy;
+            c += jy * jy;
+            gx += jx * r[i];
+            gy += jy * r[i];
+        }
+
+        /* damped step; on failure raise damping and try again */
+        for (;;) {
+            double da = a * (1.0 + lambda), dc = c * (1.0 + lambda);
+
+            det = da * dc - b * b;
+            if (det <= 0.0) {
+                dx = dy = 0.0;
+                break;
+            }
+            dx = -(dc * gx - b * gy) / det;
+            dy = -(da * gy - b * gx) / det;
+            f1 = residuals(vs, h, ceil, *x + dx, *y + dy, rx);
+            if (f1 <= f) {
+                *x += dx;
+                *y += dy;
+                f = f1;
+                memcpy(r, rx, 3 * vs->n * sizeof(*r));
+                lambda /= 10.0;
+                break;
+            }
+            lambda *= 10.0;
+            if (lambda > 1e12) {
+                dx = dy = 0.0;
+                break;
+            }
+        }
+        if (hypot(dx, dy) < TOL_STEP)
+            break;
+    }
+    free(r);
+    return (it > MAX_ITER) ? MAX_ITER : it;
+}
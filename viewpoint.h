@@ -0,0 +1,54 @@
+/*
+ * Header file for viewpoint module
+ *
+ * A painted ceiling is exact from one eye point only.  Given several
+ * weighted viewpoints (bed, couch, doorway), a dot is placed where
+ * it minimizes the weighted sum of squared angular errors seen from
+ * all of them: a two parameter nonlinear least squares problem per
+ * star, solved by Levenberg-Marquardt from the weighted mean of the
+ * points each viewpoint alone would choose.
+ */
+
+#ifndef _VIEWPOINT_H_
+#define _VIEWPOINT_H_
+
+#include <stdio.h>
+
+#include "vector3.h"
+
+#define VP_NAME_LEN 32
+
+struct vp_view_str {
+    char name[VP_NAME_LEN];
+    struct v3_str eye;          /* from the nominal observer, cm */
+    double w;                   /* weight, normalized to sum 1 */
+};
+
+struct vp_set_str {
+    struct vp_view_str *view;
+    int n;
+};
+
+/*
+ * public function prototypes
+ */
+
+/*
+ * read viewpoints, one per line ('#' comments):
+ *   view name east north up weight
+ * returns -1 on error
+ */
+int vp_read(FILE *in, struct vp_set_str *vs);
+void vp_free(struct vp_set_str *vs);
+/* angle (radians) between the star direction h and p seen from eye */
+double vp_error(const struct v3_str *eye, const struct v3_str *p,
+                const struct v3_str *h);
+/*
+ * point (*x, *y) on the plane z = ceil minimizing the weighted
+ * squared angular error to unit direction h (h.z > 0) from all
+ * viewpoints.  returns iterations taken
+ */
+int vp_solve(const struct vp_set_str *vs, const struct v3_str *h,
+             double ceil, double *x, double *y);
+
+#endif
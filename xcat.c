@@ -0,0 +1,466 @@
+/*
+ * external catalog module
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "xcat.h"
+
+#define CHUNK_LEN  (4 << 20)    /* input bytes per thread and round */
+#define HEADER_LEN 65536        /* longest CSV header line */
+#define MAX_COLS   1024         /* CSV columns up to the last needed */
+#define FIELD_LEN  40           /* longest numeric field */
+#define MAS_PER_DEG 3600000.0
+#define GAIA_EPOCH 2016.0       /* DR3 reference epoch */
+
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/* one chunk of whole lines and what was parsed from it */
+struct chunk_str {
+    char *buf;
+    size_t len;
+    const struct xcat_fmt_str *fmt;
+    const struct xcat_cols_str *cols;
+    double mag_max;
+    struct cat_star_str *star;
+    int n, cap;
+    long long rows;
+    long long bad;
+    int err;                    /* out of memory */
+};
+
+/* sort key of a kept star */
+struct key_str {
+    float vmag;
+    int i;                      /* in input order */
+};
+
+/*
+ * private functions
+ */
+
+/* number in [p, end), returns 0 if blank or not a number */
+static int number(const char *p, const char *end, double *v)
+{
+    char buf[FIELD_LEN];
+    char *e;
+    size_t len;
+
+    while (p < end && (*p == ' ' || *p == '"'))
+        p++;
+    while (end > p && (end[-1] == ' ' || end[-1] == '"'
+                       || end[-1] == '\r'))
+        end--;
+    len = end - p;
+    if (len == 0 || len >= sizeof(buf))
+        return 0;
+    memcpy(buf, p, len);
+    buf[len] = '\0';
+    *v = strtod(buf, &e);
+    return *e == '\0' && isfinite(*v);
+}
+
+/* fixed width field, columns c0 .. c1 (from 1, inclusive) */
+static int fixed(const char *p, const char *end, int c0, int c1, double *v)
+{
+    if (end - p < c1)
+        return 0;
+    return number(p + c0 - 1, p + c1, v);
+}
+
+/*
+ * Tycho-2 main catalog (catalog.dat), fixed width.  V from the
+ * Tycho magnitudes: V = VT - 0.090 (BT - VT)
+ */
+static int tycho2_parse(const char *p, const char *end,
+                        const struct xcat_cols_str *cols, double mag_max,
+                        struct cat_star_str *s)
+{
+    double bt, vt, v, t1, t2, t3;
+    int have_bt, have_vt;
+
+    (void)cols;
+    if (end - p < 177)
+        return (end - p < 2) ? 0 : -1;
+
+    /* magnitude first, most rows stop here */
+    have_bt = fixed(p, end, 111, 116, &bt);
+    have_vt = fixed(p, end, 124, 129, &vt);
+    if (have_bt && have_vt)
+        v = vt - 0.090 * (bt - vt);
+    else if (have_vt)
+        v = vt;
+    else if (have_bt)
+        v = bt;
+    else
+        return -1;
+    if (v > mag_max)
+        return 0;
+
+    memset(s, 0, sizeof(*s));
+    s->vmag = v;
+    s->src = CAT_SRC_TYCHO;
+    if (have_bt && have_vt) {
+        /* Johnson B - V */
+        s->bv = 0.850 * (bt - vt);
+        s->flags |= CAT_HAVE_BV;
+    }
+    if (!fixed(p, end, 1, 4, &t1) || !fixed(p, end, 6, 10, &t2)
+        || !fixed(p, end, 12, 12, &t3))
+        return -1;
+    s->id = (long long)t1 * 1000000 + (long long)t2 * 10 + (long long)t3;
+    if (fixed(p, end, 143, 148, &t1))
+        s->hip = (int)t1;
+
+    if (p[13] == 'X') {
+        /* no mean position: observed one, no proper motion */
+        if (!fixed(p, end, 153, 164, &s->ra)
+            || !fixed(p, end, 166, 177, &s->dec))
+            return -1;
+        return 1;
+    }
+    if (!fixed(p, end, 16, 27, &s->ra) || !fixed(p, end, 29, 40, &s->dec))
+        return -1;
+    if (fixed(p, end, 42, 48, &t1) && fixed(p, end, 50, 56, &t2)) {
+        s->pmra = t1;
+        s->pmdec = t2;
+        s->flags |= CAT_HAVE_PM;
+    }
+    return 1;
+}
+
+/* column number of name in comma separated header, -1 if absent */
+static int column(const char *line, const char *name)
+{
+    size_t len = strlen(name);
+    const char *p = line;
+    int i = 0;
+
+    for (;;) {
+        while (*p == ' ' || *p == '"')
+            p++;
+        if (strncmp(p, name, len) == 0
+            && strchr(",\" \r\n", p[len]) != NULL)
+            return i;
+        p = strchr(p, ',');
+        if (p == NULL)
+            return -1;
+        p++;
+        i++;
+    }
+}
+
+static int gaia_header(const char *line, struct xcat_cols_str *c)
+{
+    c->id = column(line, "source_id");
+    c->ra = column(line, "ra");
+    c->dec = column(line, "dec");
+    c->mag = column(line, "phot_g_mean_mag");
+    c->pmra = column(line, "pmra");
+    c->pmdec = column(line, "pmdec");
+    c->plx = column(line, "parallax");
+    c->bp_rp = column(line, "bp_rp");
+    c->epoch = column(line, "ref_epoch");
+    if (c->id < 0 || c->ra < 0 || c->dec < 0 || c->mag < 0)
+        return -1;
+    c->last = c->id;
+    c->last = (c->ra > c->last) ? c->ra : c->last;
+    c->last = (c->dec > c->last) ? c->dec : c->last;
+    c->last = (c->mag > c->last) ? c->mag : c->last;
+    c->last = (c->pmra > c->last) ? c->pmra : c->last;
+    c->last = (c->pmdec > c->last) ? c->pmdec : c->last;
+    c->last = (c->plx > c->last) ? c->plx : c->last;
+    c->last = (c->bp_rp > c->last) ? c->bp_rp : c->last;
+    c->last = (c->epoch > c->last) ? c->epoch : c->last;
+    return (c->last + 2 > MAX_COLS) ? -1 : 0;
+}
+
+/* field i of the split record, 0 if absent or blank */
+static int gaia_field(const char **f, int i, double *v)
+{
+    return i >= 0 && f[i] != NULL && number(f[i], f[i + 1] - 1, v);
+}
+
+/*
+ * Gaia CSV extract.  V from G and BP - RP (Evans et al. 2018), and
+ * positions carried back from the reference epoch to J2000
+ */
+static int gaia_parse(const char *p, const char *end,
+                      const struct xcat_cols_str *cols, double mag_max,
+                      struct cat_star_str *s)
+{
+    /* start of each needed column (f[i + 1] - 1 ends it) */
+    const char *f[MAX_COLS];
+    double g, c, v, ep, dt;
+    int i;
+
+    if (p == end || *p == '#')
+        return 0;
+
+    /* split only as far as the last column needed */
+    f[0] = p;
+    for (i = 1; i <= cols->last + 1; i++) {
+        const char *q = memchr(f[i - 1], ',', end - f[i - 1]);
+
+        if (q == NULL) {
+            if (i <= cols->last)
+                return -1;
+            q = end;
+        }
+        f[i] = q + 1;
+    }
+
+    if (!gaia_field(f, cols->mag, &g))
+        return -1;
+    v = g;
+    if (gaia_field(f, cols->bp_rp, &c))
+        v = g + 0.01760 + 0.006860 * c + 0.1732 * c * c;
+    if (v > mag_max)
+        return 0;
+
+    memset(s, 0, sizeof(*s));
+    s->vmag = v;
+    s->src = CAT_SRC_GAIA;
+    if (!gaia_field(f, cols->id, &v))
+        return -1;
+    s->id = strtoll(f[cols->id], NULL, 10);
+    if (!gaia_field(f, cols->ra, &s->ra) || !gaia_field(f, cols->dec, &s->dec))
+        return -1;
+    if (gaia_field(f, cols->pmra, &v) && gaia_field(f, cols->pmdec, &ep)) {
+        s->pmra = v;
+        s->pmdec = ep;
+        s->flags |= CAT_HAVE_PM;
+    }
+    if (gaia_field(f, cols->plx, &v)) {
+        s->plx = v;
+        s->flags |= CAT_HAVE_PLX;
+    }
+    if (!gaia_field(f, cols->epoch, &ep))
+        ep = GAIA_EPOCH;
+
+    /* linear proper motion back to J2000 */
+    dt = 2000.0 - ep;
+    s->dec += s->pmdec * dt / MAS_PER_DEG;
+    if (fabs(s->dec) < 90.0)
+        s->ra += s->pmra * dt / MAS_PER_DEG / cos(s->dec * M_PI / 180.0);
+    s->ra = fmod(s->ra + 360.0, 360.0);
+    return 1;
+}
+
+static const struct xcat_fmt_str formats[] = {
+    {"tycho2", NULL, tycho2_parse},
+    {"gaia", gaia_header, gaia_parse}
+};
+
+/* by magnitude, then input order */
+static int cmp_key(const void *pa, const void *pb)
+{
+    const struct key_str *a = pa;
+    const struct key_str *b = pb;
+
+    if (a->vmag != b->vmag)
+        return (a->vmag < b->vmag) ? -1 : 1;
+    return (a->i > b->i) - (a->i < b->i);
+}
+
+/* parse all lines of one chunk */
+static void *parse_chunk(void *arg)
+{
+    struct chunk_str *ck = arg;
+    const char *p = ck->buf;
+    const char *end = ck->buf + ck->len;
+
+    while (p < end) {
+        const char *e = memchr(p, '\n', end - p);
+        int r;
+
+        if (e == NULL)
+            e = end;
+        if (ck->n >= ck->cap) {
+            struct cat_star_str *t;
+
+            ck->cap = (ck->cap > 0) ? 2 * ck->cap : 1024;
+            t = realloc(ck->star, ck->cap * sizeof(*t));
+            if (t == NULL) {
+                ck->err = 1;
+                return NULL;
+            }
+            ck->star = t;
+        }
+        r = ck->fmt->parse(p, e, ck->cols, ck->mag_max, &ck->star[ck->n]);
+        if (e > p) {
+            ck->rows++;
+            if (r < 0)
+                ck->bad++;
+        }
+        if (r > 0)
+            ck->n++;
+        p = e + 1;
+    }
+    return NULL;
+}
+
+/*
+ * public functions
+ */
+
+/* reader named name, NULL if unknown */
+const struct xcat_fmt_str *xcat_format(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(formats) / sizeof(*formats); i++)
+        if (strcmp(formats[i].name, name) == 0)
+            return &formats[i];
+    return NULL;
+}
+
+/* convert catalog in to binary catalog out, returns -1 on error */
+int xcat_convert(FILE *in, FILE *out, const struct xcat_fmt_str *fmt,
+                 double mag_max, int n_threads, struct xcat_stats_str *st)
+{
+    struct xcat_cols_str cols;
+    struct chunk_str *ck;
+    struct cat_star_str *star = NULL;   /* kept, in input order */
+    struct key_str *key = NULL;
+    size_t cap = 0;
+    pthread_t *tid;
+    int *started;
+    char *line = NULL;
+    char *rest;                 /* partial line held for next chunk */
+    size_t carry = 0;
+    int eof = 0;
+    int ret = -1;
+    int k, n_ck;
+
+    memset(st, 0, sizeof(*st));
+    memset(&cols, 0, sizeof(cols));
+    n_threads = (n_threads < 1) ? 1 : n_threads;
+    ck = calloc(n_threads, sizeof(*ck));
+    tid = malloc(n_threads * sizeof(*tid));
+    started = malloc(n_threads * sizeof(*started));
+    rest = malloc(CHUNK_LEN);
+    if (ck == NULL || tid == NULL || started == NULL || rest == NULL)
+        goto done;
+    for (k = 0; k < n_threads; k++) {
+        ck[k].buf = malloc(CHUNK_LEN);
+        if (ck[k].buf == NULL)
+            goto done;
+        ck[k].fmt = fmt;
+        ck[k].cols = &cols;
+        ck[k].mag_max = mag_max;
+    }
+
+    if (fmt->header != NULL) {
+        line = malloc(HEADER_LEN);
+        if (line == NULL)
+            goto done;
+        do {
+            if (fgets(line, HEADER_LEN, in) == NULL)
+                goto done;
+        } while (line[0] == '#');
+        if (fmt->header(line, &cols) != 0)
+            goto done;
+    }
+
+    while (!eof || carry > 0) {
+        /* fill one chunk per thread with whole lines */
+        for (n_ck = 0; n_ck < n_threads && (!eof || carry > 0); n_ck++) {
+            struct chunk_str *c = &ck[n_ck];
+            size_t cut;
+
+            memcpy(c->buf, rest, carry);
+            c->len = carry;
+            if (!eof) {
+                c->len += fread(c->buf + carry, 1, CHUNK_LEN - carry, in);
+                if (ferror(in))
+                    goto done;
+                eof = (c->len < CHUNK_LEN);
+            }
+            /* last line may lack its newline at end of input */
+            cut = c->len;
+            if (!eof) {
+                while (cut > 0 && c->buf[cut - 1] != '\n')
+                    cut--;
+                /* line longer than a chunk */
+                if (cut == 0)
+                    goto done;
+            }
+            carry = c->len - cut;
+            memcpy(rest, c->buf + cut, carry);
+            c->len = cut;
+            c->n = 0;
+            c->rows = c->bad = 0;
+            c->err = 0;
+        }
+
+        for (k = 1; k < n_ck; k++)
+            started[k] = (pthread_create(&tid[k], NULL, parse_chunk,
+                                         &ck[k]) == 0);
+        parse_chunk(&ck[0]);
+        for (k = 1; k < n_ck; k++) {
+            if (started[k])
+                pthread_join(tid[k], NULL);
+            else
+                parse_chunk(&ck[k]);
+        }
+
+        /* kept in input order */
+        for (k = 0; k < n_ck; k++) {
+            if (ck[k].err)
+                goto done;
+            if (st->kept + ck[k].n >= 0x7fffffff)
+                goto done;
+            if ((size_t)(st->kept + ck[k].n) > cap) {
+                struct cat_star_str *t;
+
+                cap = MAX(2 * cap, (size_t)(st->kept + ck[k].n));
+                t = realloc(star, cap * sizeof(*t));
+                if (t == NULL)
+                    goto done;
+                star = t;
+            }
+            memcpy(star + st->kept, ck[k].star, ck[k].n * sizeof(*star));
+            st->rows += ck[k].rows;
+            st->bad += ck[k].bad;
+            st->kept += ck[k].n;
+        }
+    }
+
+    /* catalogs are in brightness order, stably */
+    key = malloc((st->kept + 1) * sizeof(*key));
+    if (key == NULL)
+        goto done;
+    for (k = 0; k < st->kept; k++) {
+        key[k].vmag = star[k].vmag;
+        key[k].i = k;
+    }
+    qsort(key, st->kept, sizeof(*key), cmp_key);
+    if (cat_write_bin_header(out, st->kept) != 0)
+        goto done;
+    for (k = 0; k < st->kept; k++)
+        if (fwrite(&star[key[k].i], sizeof(*star), 1, out) != 1)
+            goto done;
+    if (fflush(out) != 0)
+        goto done;
+    ret = 0;
+
+done:
+    if (ck != NULL)
+        for (k = 0; k < n_threads; k++) {
+            free(ck[k].buf);
+            free(ck[k].star);
+        }
+    free(ck);
+    free(tid);
+    free(started);
+    free(rest);
+    free(line);
+    free(star);
+    free(key);
+    return ret;
+}
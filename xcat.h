@@ -0,0 +1,60 @@
+/*
+ * Header file for external catalog module
+ *
+ * Readers for large catalogs (Tycho-2, Gaia extracts) that turn
+ * them into the binary catalog of the catalog module.  Only the
+ * columns that are needed are converted, stars fainter than the
+ * magnitude limit are dropped as they are parsed, and the input is
+ * parsed in chunks of whole lines by several threads at once, so
+ * memory stays bounded by the stars kept however long the input is.
+ * Those are written in brightness order, as catalogs are.
+ */
+
+#ifndef _XCAT_H_
+#define _XCAT_H_
+
+#include <stdio.h>
+
+#include "catalog.h"
+
+/* column numbers found in a CSV header, -1 if absent */
+struct xcat_cols_str {
+    int id, ra, dec, mag, pmra, pmdec, plx, bp_rp, epoch;
+    int last;                   /* highest column needed */
+};
+
+/* reader for one catalog format */
+struct xcat_fmt_str {
+    const char *name;
+    /* find columns in the first line; NULL for fixed layouts */
+    int (*header)(const char *line, struct xcat_cols_str *cols);
+    /*
+     * parse record [p, end) into s.  returns 1 if kept, 0 if fainter
+     * than mag_max (or a blank/comment line), -1 if unreadable
+     */
+    int (*parse)(const char *p, const char *end,
+                 const struct xcat_cols_str *cols, double mag_max,
+                 struct cat_star_str *s);
+};
+
+struct xcat_stats_str {
+    long long rows;             /* records read */
+    long long kept;             /* written */
+    long long bad;              /* unreadable */
+};
+
+/*
+ * public function prototypes
+ */
+
+/* reader named "tycho2" or "gaia", NULL if unknown */
+const struct xcat_fmt_str *xcat_format(const char *name);
+/*
+ * convert catalog in to binary catalog out, keeping stars of
+ * magnitude <= mag_max, brightest first, parsing on n_threads.
+ * returns -1 on error
+ */
+int xcat_convert(FILE *in, FILE *out, const struct xcat_fmt_str *fmt,
+                 double mag_max, int n_threads, struct xcat_stats_str *st);
+
+#endif
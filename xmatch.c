@@ -0,0 +1,425 @@
+/*
+ * catalog cross-match module
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "xmatch.h"
+
+#define SKY_DEG2 41253.0        /* whole sky, square degrees */
+#define CELL_STARS 2.0          /* aim for this many aux stars a cell */
+#define RING_CELLS 12           /* fewer cells than this: one per band */
+
+/* one thread's share of xm_match */
+struct part_str {
+    const struct cat_str *base;
+    const struct xm_hash_str *hash;
+    const struct xm_cells_str *cells;
+    int mode;
+    double cos_r;
+    const int *order;           /* base stars by cell, NULL for as is */
+    int first, count;
+    int *match;
+    struct xm_stats_str st;
+};
+
+/*
+ * private functions
+ */
+
+static unsigned hash_hip(int hip)
+{
+    return (unsigned)hip * 2654435761u;
+}
+
+static void unit(double ra, double dec, struct v3_str *u)
+{
+    const double rad = M_PI / 180.0;
+
+    u->x = cos(dec * rad) * cos(ra * rad);
+    u->y = cos(dec * rad) * sin(ra * rad);
+    u->z = sin(dec * rad);
+}
+
+static int dec_band(const struct xm_cells_str *c, double dec)
+{
+    int b = (int)((dec + 90.0) / c->step);
+
+    return (b < 0) ? 0 : ((b >= c->n_bands) ? c->n_bands - 1 : b);
+}
+
+static int ra_cell(const struct xm_cells_str *c, int b, double ra)
+{
+    int r = (int)(ra / 360.0 * c->n_ra[b]);
+
+    return (r < 0) ? 0 : ((r >= c->n_ra[b]) ? c->n_ra[b] - 1 : r);
+}
+
+static int sky_cell(const struct xm_cells_str *c, double ra, double dec)
+{
+    int b = dec_band(c, dec);
+
+    return c->band[b] + ra_cell(c, b, ra);
+}
+
+/*
+ * base stars sorted by cell, so that neighbouring searches share
+ * cells while they are in cache.  NULL on error
+ */
+static int *cell_order(const struct xm_cells_str *c,
+                       const struct cat_str *base)
+{
+    int *order = malloc((base->n + 1) * sizeof(*order));
+    int *cell = malloc((base->n + 1) * sizeof(*cell));
+    int *first = calloc(c->n_cells + 1, sizeof(*first));
+    int i;
+
+    if (order == NULL || cell == NULL || first == NULL) {
+        free(order);
+        order = NULL;
+        goto done;
+    }
+    for (i = 0; i < base->n; i++) {
+        cell[i] = sky_cell(c, base->star[i].ra, base->star[i].dec);
+        first[cell[i] + 1]++;
+    }
+    for (i = 0; i < c->n_cells; i++)
+        first[i + 1] += first[i];
+    for (i = 0; i < base->n; i++)
+        order[first[cell[i]]++] = i;
+
+done:
+    free(cell);
+    free(first);
+    return order;
+}
+
+/* nearest in cells k0 .. k1 to u better than *best, updates *best */
+static int scan_cells(const struct xm_cells_str *c, int k0, int k1,
+                      const struct v3_str *u, double *best, int found)
+{
+    int i;
+
+    for (i = c->first[k0]; i < c->first[k1 + 1]; i++) {
+        const struct v3_str *v = &c->u[i];
+        double d = u->x * v->x + u->y * v->y + u->z * v->z;
+
+        if (d >= *best) {
+            *best = d;
+            found = c->idx[i];
+        }
+    }
+    return found;
+}
+
+static void *match_part(void *arg)
+{
+    struct part_str *p = arg;
+    int j;
+
+    for (j = p->first; j < p->first + p->count; j++) {
+        int i = (p->order != NULL) ? p->order[j] : j;
+        const struct cat_star_str *s = &p->base->star[i];
+        int m = -1;
+
+        if ((p->mode & XM_ID) && s->hip > 0) {
+            m = xm_hash_find(p->hash, s->hip);
+            if (m >= 0)
+                p->st.by_id++;
+        }
+        if (m < 0 && (p->mode & XM_POS)) {
+            m = xm_cells_nearest(p->cells, s->ra, s->dec, p->cos_r);
+            if (m >= 0)
+                p->st.by_pos++;
+        }
+        if (m < 0)
+            p->st.none++;
+        p->match[i] = m;
+    }
+    return NULL;
+}
+
+/*
+ * public functions
+ */
+
+/* hash of aux stars by Hipparcos number, returns -1 on error */
+int xm_hash_build(const struct cat_str *aux, struct xm_hash_str *h)
+{
+    unsigned size = 16;
+    int i, n = 0;
+
+    for (i = 0; i < aux->n; i++)
+        if (aux->star[i].hip > 0)
+            n++;
+    /* at most half full */
+    while (size < 2u * n)
+        size *= 2;
+    h->mask = size - 1;
+    h->key = calloc(size, sizeof(*h->key));
+    h->val = malloc(size * sizeof(*h->val));
+    if (h->key == NULL || h->val == NULL) {
+        xm_hash_free(h);
+        return -1;
+    }
+
+    for (i = 0; i < aux->n; i++) {
+        int hip = aux->star[i].hip;
+        unsigned k;
+
+        if (hip <= 0)
+            continue;
+        k = hash_hip(hip) & h->mask;
+        while (h->key[k] != 0 && h->key[k] != hip)
+            k = (k + 1) & h->mask;
+        /* components sharing a number: keep the brightest */
+        if (h->key[k] == hip
+            && aux->star[h->val[k]].vmag <= aux->star[i].vmag)
+            continue;
+        h->key[k] = hip;
+        h->val[k] = i;
+    }
+    return 0;
+}
+
+/* index of aux star numbered hip, -1 if none */
+int xm_hash_find(const struct xm_hash_str *h, int hip)
+{
+    unsigned k = hash_hip(hip) & h->mask;
+
+    while (h->key[k] != 0) {
+        if (h->key[k] == hip)
+            return h->val[k];
+        k = (k + 1) & h->mask;
+    }
+    return -1;
+}
+
+void xm_hash_free(struct xm_hash_str *h)
+{
+    free(h->key);
+    free(h->val);
+    memset(h, 0, sizeof(*h));
+}
+
+/* sky cells for matches within radius degrees, returns -1 on error */
+int xm_cells_build(const struct cat_str *aux, double radius,
+                   struct xm_cells_str *c)
+{
+    const double rad = M_PI / 180.0;
+    int *cell = NULL;
+    int *fill = NULL;
+    int b, i;
+
+    memset(c, 0, sizeof(*c));
+    /* no narrower than the radius, no emptier than CELL_STARS */
+    c->step = sqrt(SKY_DEG2 * CELL_STARS / (aux->n + 1));
+    c->step = (c->step < radius) ? radius : c->step;
+    c->step = (c->step > 180.0) ? 180.0 : c->step;
+    c->n_bands = (int)ceil(180.0 / c->step);
+    c->n_ra = malloc(c->n_bands * sizeof(*c->n_ra));
+    c->band = malloc(c->n_bands * sizeof(*c->band));
+    if (c->n_ra == NULL || c->band == NULL)
+        goto fail;
+
+    /*
+     * cells of a band are at least a radius wide, in true angle, up
+     * to one band further toward the pole, so a match lies in the
+     * cell of its star or the next one either side in the bands
+     * above and below.  near the poles the band is one cell
+     */
+    for (b = 0; b < c->n_bands; b++) {
+        double lo = fabs(-90.0 + b * c->step);
+        double hi = fabs(-90.0 + (b + 1) * c->step);
+        double far = ((lo > hi) ? lo : hi) + c->step;
+        double n = 0.0;
+
+        if (far < 90.0)
+            n = floor(360.0 * cos(far * rad) / (1.05 * c->step));
+        c->n_ra[b] = (n < RING_CELLS) ? 1 : (int)n;
+        c->band[b] = c->n_cells;
+        c->n_cells += c->n_ra[b];
+    }
+
+    c->first = calloc(c->n_cells + 1, sizeof(*c->first));
+    c->idx = malloc((aux->n + 1) * sizeof(*c->idx));
+    c->u = malloc((aux->n + 1) * sizeof(*c->u));
+    cell = malloc((aux->n + 1) * sizeof(*cell));
+    fill = calloc(c->n_cells, sizeof(*fill));
+    if (c->first == NULL || c->idx == NULL || c->u == NULL
+        || cell == NULL || fill == NULL)
+        goto fail;
+
+    /* counting sort by cell */
+    for (i = 0; i < aux->n; i++) {
+        cell[i] = sky_cell(c, aux->star[i].ra, aux->star[i].dec);
+        c->first[cell[i] + 1]++;
+    }
+    for (i = 0; i < c->n_cells; i++)
+        c->first[i + 1] += c->first[i];
+    for (i = 0; i < aux->n; i++) {
+        int k = c->first[cell[i]] + fill[cell[i]]++;
+
+        c->idx[k] = i;
+        unit(aux->star[i].ra, aux->star[i].dec, &c->u[k]);
+    }
+    free(cell);
+    free(fill);
+    return 0;
+
+fail:
+    free(cell);
+    free(fill);
+    xm_cells_free(c);
+    return -1;
+}
+
+/* nearest aux star to (ra, dec) within acos(cos_r), -1 if none */
+int xm_cells_nearest(const struct xm_cells_str *c, double ra, double dec,
+                     double cos_r)
+{
+    struct v3_str u;
+    double best = cos_r;
+    int found = -1;
+    int b, b0;
+
+    unit(ra, dec, &u);
+    b0 = dec_band(c, dec);
+    for (b = b0 - 1; b <= b0 + 1; b++) {
+        int n, r, k;
+
+        if (b < 0 || b >= c->n_bands)
+            continue;
+        n = c->n_ra[b];
+        k = c->band[b];
+        if (n == 1) {
+            found = scan_cells(c, k, k, &u, &best, found);
+            continue;
+        }
+        /* the three cells are adjacent unless they wrap at RA 0 */
+        r = ra_cell(c, b, ra);
+        if (r == 0) {
+            found = scan_cells(c, k + n - 1, k + n - 1, &u, &best, found);
+            found = scan_cells(c, k, k + 1, &u, &best, found);
+        } else if (r == n - 1) {
+            found = scan_cells(c, k + r - 1, k + r, &u, &best, found);
+            found = scan_cells(c, k, k, &u, &best, found);
+        } else {
+            found = scan_cells(c, k + r - 1, k + r + 1, &u, &best, found);
+        }
+    }
+    return found;
+}
+
+void xm_cells_free(struct xm_cells_str *c)
+{
+    free(c->n_ra);
+    free(c->band);
+    free(c->first);
+    free(c->idx);
+    free(c->u);
+    memset(c, 0, sizeof(*c));
+}
+
+/* match base stars to aux stars, returns -1 on error */
+int xm_match(const struct cat_str *base, const struct cat_str *aux,
+             int mode, double radius, int n_threads, int *match,
+             struct xm_stats_str *st)
+{
+    struct xm_hash_str hash;
+    struct xm_cells_str cells;
+    struct part_str *part = NULL;
+    pthread_t *tid = NULL;
+    int *started = NULL;
+    int *order = NULL;
+    int ret = -1;
+    int k;
+
+    memset(st, 0, sizeof(*st));
+    memset(&hash, 0, sizeof(hash));
+    memset(&cells, 0, sizeof(cells));
+    n_threads = (n_threads < 1) ? 1 : n_threads;
+    if ((mode & XM_ID) && xm_hash_build(aux, &hash) != 0)
+        goto done;
+    if ((mode & XM_POS)
+        && (xm_cells_build(aux, radius, &cells) != 0
+            || (order = cell_order(&cells, base)) == NULL))
+        goto done;
+    part = calloc(n_threads, sizeof(*part));
+    tid = malloc(n_threads * sizeof(*tid));
+    started = calloc(n_threads, sizeof(*started));
+    if (part == NULL || tid == NULL || started == NULL)
+        goto done;
+
+    for (k = 0; k < n_threads; k++) {
+        part[k].base = base;
+        part[k].hash = &hash;
+        part[k].cells = &cells;
+        part[k].order = order;
+        part[k].mode = mode;
+        part[k].cos_r = cos(radius * M_PI / 180.0);
+        part[k].first = (int)((long long)base->n * k / n_threads);
+        part[k].count = (int)((long long)base->n * (k + 1) / n_threads)
+            - part[k].first;
+        part[k].match = match;
+    }
+    for (k = 1; k < n_threads; k++)
+        started[k] = (pthread_create(&tid[k], NULL, match_part,
+                                     &part[k]) == 0);
+    match_part(&part[0]);
+    for (k = 1; k < n_threads; k++) {
+        if (started[k])
+            pthread_join(tid[k], NULL);
+        else
+            match_part(&part[k]);
+    }
+    for (k = 0; k < n_threads; k++) {
+        st->by_id += part[k].st.by_id;
+        st->by_pos += part[k].st.by_pos;
+        st->none += part[k].st.none;
+    }
+    ret = 0;
+
+done:
+    xm_hash_free(&hash);
+    xm_cells_free(&cells);
+    free(part);
+    free(tid);
+    free(started);
+    free(order);
+    return ret;
+}
+
+/* fill in what matched base stars lack from their aux star */
+void xm_enrich(struct cat_str *base, const struct cat_str *aux,
+               const int *match)
+{
+    int i;
+
+    for (i = 0; i < base->n; i++) {
+        struct cat_star_str *s = &base->star[i];
+        const struct cat_star_str *a;
+
+        if (match[i] < 0)
+            continue;
+        a = &aux->star[match[i]];
+        if (!(s->flags & CAT_HAVE_BV) && (a->flags & CAT_HAVE_BV)) {
+            s->bv = a->bv;
+            s->flags |= CAT_HAVE_BV;
+        }
+        if (!(s->flags & CAT_HAVE_PM) && (a->flags & CAT_HAVE_PM)) {
+            s->pmra = a->pmra;
+            s->pmdec = a->pmdec;
+            s->flags |= CAT_HAVE_PM;
+        }
+        if (!(s->flags & CAT_HAVE_PLX) && (a->flags & CAT_HAVE_PLX)) {
+            s->plx = a->plx;
+            s->flags |= CAT_HAVE_PLX;
+        }
+        if (s->hip == 0)
+            s->hip = a->hip;
+    }
+}
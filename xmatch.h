@@ -0,0 +1,80 @@
+/*
+ * Header file for catalog cross-match module
+ *
+ * Joins the stars of a base catalog (normally hip_magle6.dat) with
+ * an auxiliary catalog, first on Hipparcos number through a hash
+ * table, then on position: auxiliary stars are bucketed into sky
+ * cells at least one match radius wide, so the nearest neighbour
+ * of a star is found among the 3 x 3 cells around it.  Matched
+ * stars take the quantities the base lacks (colour, proper motion,
+ * parallax) from their counterpart.
+ */
+
+#ifndef _XMATCH_H_
+#define _XMATCH_H_
+
+#include "catalog.h"
+#include "vector3.h"
+
+/* xm_match modes */
+#define XM_ID  0x01             /* on Hipparcos number */
+#define XM_POS 0x02             /* on position */
+
+/* Hipparcos number to auxiliary index, open addressing */
+struct xm_hash_str {
+    int *key;                   /* 0 for an empty slot */
+    int *val;
+    unsigned mask;              /* slots - 1, a power of two */
+};
+
+/* auxiliary catalog bucketed by sky cell */
+struct xm_cells_str {
+    double step;                /* band height, degrees */
+    int n_bands;
+    int *n_ra;                  /* cells in each band */
+    int *band;                  /* first cell of each band */
+    int n_cells;
+    int *first;                 /* cell c holds idx[first[c] .. first[c+1]) */
+    int *idx;
+    struct v3_str *u;           /* unit vectors, in idx order */
+};
+
+struct xm_stats_str {
+    int by_id;                  /* matched on Hipparcos number */
+    int by_pos;                 /* matched on position */
+    int none;
+};
+
+/*
+ * public function prototypes
+ */
+
+/* hash of the aux stars that have a Hipparcos number, -1 on error */
+int xm_hash_build(const struct cat_str *aux, struct xm_hash_str *h);
+/* index of aux star with Hipparcos number hip, -1 if none */
+int xm_hash_find(const struct xm_hash_str *h, int hip);
+void xm_hash_free(struct xm_hash_str *h);
+
+/* cells for matches within radius (degrees), -1 on error */
+int xm_cells_build(const struct cat_str *aux, double radius,
+                   struct xm_cells_str *c);
+/*
+ * index of the aux star nearest (ra, dec), degrees, within the angle
+ * whose cosine is cos_r (no more than the radius built for), -1 if none
+ */
+int xm_cells_nearest(const struct xm_cells_str *c, double ra, double dec,
+                     double cos_r);
+void xm_cells_free(struct xm_cells_str *c);
+
+/*
+ * match each base star to an aux star (match[i], -1 if none) by the
+ * XM_ modes given, on n_threads.  returns -1 on error
+ */
+int xm_match(const struct cat_str *base, const struct cat_str *aux,
+             int mode, double radius, int n_threads, int *match,
+             struct xm_stats_str *st);
+/* fill in what matched base stars lack from their aux star */
+void xm_enrich(struct cat_str *base, const struct cat_str *aux,
+               const int *match);
+
+#endif